@@ -182,6 +182,8 @@
 #define FLAG_DUMP_DS      0x00080
 #define FLAG_DUMP_BITS    0x000F8
 #define FLAG_SILENT       0x00100
+#define FLAG_RELOAD       0x00200   // control socket has new code for node
+#define FLAG_SCHED        0x00400   // node runs under the cooperative scheduler
 //#define FLAG_RD_BIN_RIGHT 0x00800
 //#define FLAG_RD_BIN_DOWN  0x00400
 //#define FLAG_RD_BIN_LEFT  0x00200
@@ -295,6 +297,14 @@ typedef struct {
     uint8_t io_pin[4];      // upto 4 pins io_type=gpio/analog/serdes ...
     uint18_t trigger[4];    // analog trigger for ...
 } f18_config_t;
+// Execution coverage, one bit per slot (bit 0 = slot 0) for each RAM
+// and ROM word, mirrors share a word. n is the slot counter of f18_emu
+// when a word is left: slots 0..4-n ran (n = 0 after slot 3).
+#define COVER_WORDS 128
+#define COVER_INDEX(a) (((a) & IOREG_START) ? COVER_WORDS :	\
+			(((a) >> 1) & 0x40) | ((a) & 0x3f))
+#define COVER_SLOTS(n) (((1 << (5-(n))) - 1) & 0xf)
+
 //
 // sizeof(node_t) = 656 bytes (update me now and then)
 // total ram usage for threads 93888 bytes.
@@ -322,6 +332,9 @@ typedef struct _node_t {
     uint18_t ds[8];        // data stack
     uint18_t rs[8];        // return stack
 
+    // slots executed per word, RAM 0-63, ROM 64-127, last for port fetch
+    uint8_t cover[COVER_WORDS+1];
+
     // trace buffer
     char buf[32];
 } node_t;
@@ -364,6 +377,7 @@ extern void sys_enter_blocked_port(void);
 extern void sys_leave_blocked_port(void);
 extern void sys_enter_blocked_ext(void);
 extern void sys_leave_blocked_ext(void);
+extern void sys_deadlock(void);
 
 // f8_rom_type_t => f18_rom_t
 extern const f18_rom_t RomMap[];
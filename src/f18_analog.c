@@ -0,0 +1,289 @@
+//
+// ADC/DAC model of the analog nodes
+//
+// The source file is mapped read only and walked by the node on io
+// reads, ring sources are taken in bulk into a buffer per node and a
+// stimulus source samples the pin track at the node's time. DAC
+// levels are buffered per node and written or queued in bulk.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_analog.h"
+#include "f18_wave.h"
+
+#define ANALOG_BULK  1024   // samples buffered per node and direction
+
+typedef struct {
+    node_t* np;
+    unsigned period;         // words per sample
+    // ADC
+    const uint32_t* samples; // mapped source
+    size_t nsamples;
+    size_t map_len;
+    word_queue_t* src_q;     // or ring source
+    int stim;                // or pin stimulus source
+    uint32_t in[ANALOG_BULK];
+    int in_pos;
+    int in_len;
+    int in_closed;           // end of input, hold the sample
+    uint64_t k;              // current sample period
+    uint32_t sample;         // sample of period k
+    uint64_t base;           // count at the start of period k
+    int started;
+    uint18_t (*read_ioreg)(node_t* np, uint18_t reg);   // chained
+    // DAC
+    int fd;
+    word_queue_t* sink_q;    // or ring sink
+    uint32_t out[ANALOG_BULK];
+    int nout;
+    uint64_t k_out;          // next period to emit
+    uint32_t level;
+    void (*write_ioreg)(node_t* np, uint18_t reg, uint18_t val); // chained
+} analog_node_t;
+
+static analog_node_t analog_node[GRID_ROWS][GRID_COLS];
+
+static int analog_errno;     // first sink error
+
+static inline uint64_t node_time(node_t* np)
+{
+    return ((reg_node_t*)np)->debug.act.words;
+}
+
+static inline analog_node_t* get_analog_node(node_t* np)
+{
+    return &analog_node[ID_TO_ROW(np->id)][ID_TO_COLUMN(np->id)];
+}
+
+// Sample k of the source, the previous sample when input has ended
+static uint32_t next_sample(analog_node_t* ap, uint64_t k)
+{
+    if (ap->stim)
+	return f18_stim_sample(ap->np, 0);
+    if (ap->src_q == NULL)
+	return (k < ap->nsamples) ? ap->samples[k] : ap->sample;
+    if (ap->in_pos == ap->in_len) {
+	int n;
+	if (ap->in_closed ||
+	    ((n = word_queue_deq_bulk(ap->src_q, ap->in, ANALOG_BULK)) <= 0)) {
+	    ap->in_closed = 1;
+	    return ap->sample;
+	}
+	ap->in_pos = 0;
+	ap->in_len = n;
+    }
+    return ap->in[ap->in_pos++];
+}
+
+static uint18_t adc_count(node_t* np, analog_node_t* ap)
+{
+    uint64_t now = node_time(np);
+    uint64_t p = now / ap->period;
+
+    if (!ap->started) {
+	ap->sample = 0;
+	ap->sample = next_sample(ap, 0);
+	ap->started = 1;
+    }
+    while (ap->k < p) {
+	ap->base += ap->sample;
+	ap->k++;
+	ap->sample = next_sample(ap, ap->k);
+    }
+    return (ap->base + (uint64_t) ap->sample * (now - p*ap->period) /
+	    ap->period) & MASK18;
+}
+
+static uint18_t adc_read_ioreg(node_t* np, uint18_t ioreg)
+{
+    analog_node_t* ap = get_analog_node(np);
+
+    if (ioreg == IOREG_IO) {
+	(*ap->read_ioreg)(np, ioreg);  // port status is not visible
+	return adc_count(np, ap);
+    }
+    return (*ap->read_ioreg)(np, ioreg);
+}
+
+static int write_all(int fd, const void* buf, size_t len)
+{
+    const uint8_t* ptr = buf;
+
+    while (len > 0) {
+	ssize_t n = write(fd, ptr, len);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	ptr += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static void dac_flush(analog_node_t* ap)
+{
+    if (ap->nout == 0)
+	return;
+    if (ap->sink_q != NULL)
+	word_queue_enq_batch(ap->sink_q, ap->out, ap->nout);
+    else if ((write_all(ap->fd, ap->out, ap->nout*sizeof(uint32_t)) < 0) &&
+	     (__atomic_load_n(&analog_errno, __ATOMIC_SEQ_CST) == 0))
+	__atomic_store_n(&analog_errno, errno, __ATOMIC_SEQ_CST);
+    ap->nout = 0;
+}
+
+// Emit the held level for the periods before p
+static void dac_advance(analog_node_t* ap, uint64_t p)
+{
+    while (ap->k_out < p) {
+	ap->out[ap->nout++] = ap->level;
+	ap->k_out++;
+	if (ap->nout == ANALOG_BULK)
+	    dac_flush(ap);
+    }
+}
+
+static void dac_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    analog_node_t* ap = get_analog_node(np);
+
+    if (ioreg == IOREG_IO) {
+	dac_advance(ap, node_time(np) / ap->period);
+	ap->level = (value ^ F18_DAC_XOR) & F18_DAC_MASK;
+    }
+    (*ap->write_ioreg)(np, ioreg, value);
+}
+
+// Analog node id, with the sample period set or checked
+static analog_node_t* analog_lookup(node_t* nodes[GRID_ROWS][GRID_COLS],
+				    uint18_t id, unsigned period)
+{
+    int i = ID_TO_ROW(id);
+    int j = ID_TO_COLUMN(id);
+    analog_node_t* ap;
+
+    if ((i < 0) || (i >= GRID_ROWS) || (j < 0) || (j >= GRID_COLS) ||
+	(ConfigMap[i][j].io_type != analog_pin) || (nodes[i][j] == NULL)) {
+	errno = ENODEV;
+	return NULL;
+    }
+    ap = &analog_node[i][j];
+    if (period == 0)
+	period = (ap->period != 0) ? ap->period : F18_ANALOG_PERIOD;
+    if ((ap->period != 0) && (ap->period != period)) {
+	errno = EINVAL;
+	return NULL;
+    }
+    ap->np = nodes[i][j];
+    ap->period = period;
+    return ap;
+}
+
+int f18_analog_source(node_t* nodes[GRID_ROWS][GRID_COLS],
+		      uint18_t id, const char* filename,
+		      word_queue_t* q, unsigned period)
+{
+    analog_node_t* ap;
+
+    if ((ap = analog_lookup(nodes, id, period)) == NULL)
+	return -1;
+    if (ap->read_ioreg != NULL) {
+	errno = EBUSY;
+	return -1;
+    }
+    if (filename != NULL) {
+	struct stat st;
+	void* base = NULL;
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0)
+	    return -1;
+	if (fstat(fd, &st) < 0) {
+	    close(fd);
+	    return -1;
+	}
+	if ((st.st_size >= sizeof(uint32_t)) &&
+	    ((base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+			  fd, 0)) == MAP_FAILED)) {
+	    close(fd);
+	    return -1;
+	}
+	close(fd);
+	if (base != NULL)
+	    madvise(base, st.st_size, MADV_SEQUENTIAL);
+	ap->samples = base;
+	ap->nsamples = st.st_size / sizeof(uint32_t);
+	ap->map_len = st.st_size;
+    }
+    else if (q != NULL)
+	ap->src_q = q;
+    else
+	ap->stim = 1;
+    ap->read_ioreg = ap->np->read_ioreg;
+    ap->np->read_ioreg = adc_read_ioreg;
+    return 0;
+}
+
+int f18_analog_sink(node_t* nodes[GRID_ROWS][GRID_COLS],
+		    uint18_t id, int fd, word_queue_t* q,
+		    unsigned period)
+{
+    analog_node_t* ap;
+
+    if ((ap = analog_lookup(nodes, id, period)) == NULL)
+	return -1;
+    if (ap->write_ioreg != NULL) {
+	errno = EBUSY;
+	return -1;
+    }
+    if ((fd < 0) && (q == NULL)) {
+	errno = EINVAL;
+	return -1;
+    }
+    ap->fd = fd;
+    ap->sink_q = (fd < 0) ? q : NULL;
+    ap->write_ioreg = ap->np->write_ioreg;
+    ap->np->write_ioreg = dac_write_ioreg;
+    return 0;
+}
+
+int f18_analog_close(void)
+{
+    int i, j;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    analog_node_t* ap = &analog_node[i][j];
+
+	    if (ap->write_ioreg != NULL) {
+		// include the period the node stopped in
+		dac_advance(ap, (node_time(ap->np) + ap->period - 1) /
+			    ap->period);
+		dac_flush(ap);
+		if (ap->sink_q != NULL)
+		    word_queue_close(ap->sink_q);
+	    }
+	    if (ap->samples != NULL) {
+		munmap((void*) ap->samples, ap->map_len);
+		ap->samples = NULL;
+	    }
+	}
+    }
+    if (analog_errno != 0) {
+	errno = analog_errno;
+	return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __F18_ANALOG_H__
+#define __F18_ANALOG_H__
+
+//
+// ADC and DAC of the analog nodes 117, 617, 709, 713 and 717
+//
+// Samples are 32 bit words in host byte order at a fixed rate, one per
+// period instruction words executed by the node, so the signal keeps
+// its timing however the node threads are scheduled.
+//
+//   ADC  the io register reads as the 18 bit count of a VCO, during
+//        sample period k the count advances by sample k (linearly over
+//        the period), the last sample is held after the end of input
+//   DAC  io writes set the level, bits 8:0 xor 0x155, the sink gets
+//        the level held in each period up to the node's time
+//
+// A source is a mapped file, a word ring fed by the host or the .f18s
+// track of the node's first pin, read at the node's time when a period
+// starts. A sink is a file descriptor or a word ring drained by the
+// host. Rings block the node while empty (source) or full (sink).
+//
+
+#include <stdint.h>
+#include "f18.h"
+#include "f18_word_queue.h"
+
+#define F18_ANALOG_PERIOD  64       // default words per sample
+#define F18_DAC_XOR        0x155
+#define F18_DAC_MASK       0x1ff
+
+// Drive the ADC of analog node id from filename or, when filename is
+// NULL, from the ring q or, when both are NULL, from the pin stimulus.
+// Period 0 keeps the node's period, F18_ANALOG_PERIOD by default.
+extern int f18_analog_source(node_t* nodes[GRID_ROWS][GRID_COLS],
+			     uint18_t id, const char* filename,
+			     word_queue_t* q, unsigned period);
+
+// Send the DAC levels of analog node id to fd or, when fd < 0, to q
+extern int f18_analog_sink(node_t* nodes[GRID_ROWS][GRID_COLS],
+			   uint18_t id, int fd, word_queue_t* q,
+			   unsigned period);
+
+// Flush the sinks up to the node times and unmap the sources, the
+// nodes must be stopped. Sink rings are closed.
+extern int f18_analog_close(void);
+
+#endif
@@ -2,26 +2,40 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "f18_sym.h"
 #include "f18_voc.h"
 #include "f18_asm.h"
 #include "f18_strings.h"
 
+// assembler diagnostics, enabled with -v
+#define ASM_TRACE(fmt...) do {			\
+	if (g_flags & FLAG_VERBOSE)		\
+	    fprintf(logout ? logout : stderr, fmt);	\
+    } while(0)
+
+// Lines are not terminated (the source may be a read only mapping),
+// all scanning is bounded by the line end pointer.
+
 // skip to next character, skip blank and comments
 // (could be more FORTHy)
-static char* next_non_blank(char* ptr)
+static char* next_non_blank(char* ptr, char* end)
 {
-    while(*ptr) {
+    while(ptr < end) {
 	switch(*ptr) {
-	case '\0': return ptr;
+	case '\0': return end;
 	case ' ':  ptr++; break;
 	case '\t': ptr++; break;
+	case '\r': ptr++; break;
 	case '(':
-	    ptr++; while(*ptr && (*ptr != ')')) ptr++;
-	    if (*ptr == ')') ptr++;
+	    ptr++; while((ptr < end) && (*ptr != ')')) ptr++;
+	    if (ptr < end) ptr++;
 	    break;
-	case '\\': ptr++; while(*ptr) ptr++; return ptr;
+	case '\\': return end;
 	default: return ptr;
 	}
     }
@@ -29,13 +43,14 @@ static char* next_non_blank(char* ptr)
 }
 
 // skip non blanks
-static char* next_blank(char* ptr)
+static char* next_blank(char* ptr, char* end)
 {
-    while(*ptr) {
+    while(ptr < end) {
 	switch(*ptr) {
 	case '\0': return ptr;
 	case ' ':  return ptr;
 	case '\t': return ptr;
+	case '\r': return ptr;
 	case '\n': return ptr;
 	default: ptr++; break;
 	}
@@ -117,13 +132,10 @@ uint18_t encode_dest(int enc, uint18_t instr, uint18_t mask,
 
 void print_word(char* msg, char* ptr, char* ptr_end)
 {
-    fwrite(msg, sizeof(char), strlen(msg), stdout);
-    fprintf(stdout, "[");
-    fwrite(ptr, sizeof(char), ptr_end - ptr, stdout);
-    fprintf(stdout, "]\n");
+    ASM_TRACE("%s[%.*s]\n", msg, (int)(ptr_end - ptr), ptr);
 }
 
-int parse_ins(char** pptr,uint18_t* insp,
+int parse_ins(char** pptr, char* end, uint18_t* insp,
 	      int slot, uint18_t addr,
 	      uint18_t* dstp,
 	      f18_voc_t voc)
@@ -135,8 +147,8 @@ int parse_ins(char** pptr,uint18_t* insp,
     int len = 0;
     int ins;
 
-    ptr = next_non_blank(ptr);
-    ptr1 = next_blank(ptr);
+    ptr = next_non_blank(ptr, end);
+    ptr1 = next_blank(ptr, end);
     print_word("INS", ptr, ptr1);
     if ((len = ptr1-ptr) == 0) {
 	*pptr = ptr1;
@@ -186,13 +198,13 @@ int parse_ins(char** pptr,uint18_t* insp,
     
 dest:
     // scan name constant
-    ptr = next_non_blank(ptr);
-    ptr1 = next_blank(ptr);
+    ptr = next_non_blank(ptr, end);
+    ptr1 = next_blank(ptr, end);
     print_word("DST", ptr, ptr1);
     len = ptr1 - ptr;
 dest1:
     if (is_number(ptr,len,0,&value)) {
-	printf("NUMBER %d\n", value);
+	ASM_TRACE("NUMBER %d\n", value);
 	*pptr = ptr1;	
 	*insp = ins;
 	*dstp = value;
@@ -233,13 +245,101 @@ dest1:
 	return TOKEN_ERROR;
     }
     *pptr = ptr1;
-    if ((len == 0) || !(isblank(*ptr) || (*ptr=='\0'))  )
+    if ((len == 0) || ((ptr < end) && !(isblank(*ptr) || (*ptr=='\0'))))
 	return TOKEN_ERROR;
     *insp = value;
     return TOKEN_VALUE;
 }
 
 
+// Open assembler source. Regular files are mapped whole, anything
+// else (stdin, pipes) is read in bulk chunks as lines are consumed.
+int f18_asm_open(f18_asm_src_t* sp, int fd)
+{
+    struct stat st;
+
+    memset(sp, 0, sizeof(*sp));
+    sp->fd = fd;
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+	void* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base != MAP_FAILED) {
+	    madvise(base, st.st_size, MADV_SEQUENTIAL);
+	    sp->buf = base;
+	    sp->len = st.st_size;
+	    sp->size = st.st_size;
+	    sp->mapped = 1;
+	    sp->eof = 1;
+	}
+    }
+    return 0;
+}
+
+void f18_asm_close(f18_asm_src_t* sp)
+{
+    if (sp->mapped)
+	munmap(sp->buf, sp->size);
+    else
+	free(sp->buf);
+    sp->buf = NULL;
+    sp->len = sp->size = sp->pos = 0;
+}
+
+// Set lptr/llen to the next line, return 1 or 0 at end of input and
+// -1 on read error. Streamed input is refilled with bulk reads.
+static int next_line(f18_asm_src_t* sp)
+{
+    char* nl;
+
+    while(1) {
+	size_t avail = sp->len - sp->pos;
+
+	if ((avail > 0) &&
+	    ((nl = memchr(sp->buf + sp->pos, '\n', avail)) != NULL)) {
+	    sp->lptr = sp->buf + sp->pos;
+	    sp->llen = nl - sp->lptr;
+	    sp->pos += sp->llen + 1;
+	    sp->line++;
+	    return 1;
+	}
+	if (sp->eof) {
+	    if (avail == 0)
+		return 0;
+	    sp->lptr = sp->buf + sp->pos;  // last line without newline
+	    sp->llen = avail;
+	    sp->pos = sp->len;
+	    sp->line++;
+	    return 1;
+	}
+	// streamed: move partial line to front and read more
+	if (sp->pos > 0) {
+	    memmove(sp->buf, sp->buf + sp->pos, avail);
+	    sp->len = avail;
+	    sp->pos = 0;
+	}
+	if (sp->len == sp->size) {
+	    size_t size = sp->size ? 2*sp->size : ASM_CHUNK_SIZE;
+	    char* buf;
+	    if ((buf = realloc(sp->buf, size)) == NULL)
+		return -1;
+	    sp->buf = buf;
+	    sp->size = size;
+	}
+	while(1) {
+	    ssize_t r = read(sp->fd, sp->buf + sp->len, sp->size - sp->len);
+	    if (r > 0) {
+		sp->len += r;
+		break;
+	    }
+	    else if (r == 0) {
+		sp->eof = 1;
+		break;
+	    }
+	    else if (errno != EINTR)
+		return -1;
+	}
+    }
+}
+
 // parse an instruction line or number
 // return:
 //   ins LAST instruction (insx)
@@ -248,47 +348,31 @@ dest1:
 //   -3  EOF (closed)
 //
 //
-int f18_asm_line(int fd, int* line_ptr, char* line_buf, size_t line_buf_size,
+int f18_asm_line(f18_asm_src_t* sp,
 		 uint18_t* addr_ptr,uint18_t* node_ptr,
 		 uint18_t* mem_ptr, f18_voc_t voc)
 {
     int i, r;
     char* ptr;
+    char* end;
     uint18_t dest;    
     uint18_t ins = 0;
     uint18_t insx;
     int enc = 1;
     uint18_t addr = *addr_ptr & MASK6;
 again:
-    i = 0;
-    line_buf[0] = '\0';
-    while(i < line_buf_size-1) {
-	r = read(fd, &line_buf[i], 1);
-	// printf("buf[%d]=%c, r = %d\n", i, buf[i], r);
-	if (r == 0) {     // end of file
-	    if (i > 0) { // we have content
-		break;
-	    }
-	    line_buf[i] = '\0';	    
-	    if (fd == 0)  // it was stdin !
-		return -2;
-	    return -3;
-	}
-	else if (r < 0) {
-	    line_buf[i] = '\0';	    
+    if ((r = next_line(sp)) <= 0) {
+	if (r < 0)
 	    return -1;
-	}
-	else if (line_buf[i] == '\n') {
-	    (*line_ptr)++;
-	    break;
-	}
-	i++;
+	if (sp->fd == 0)  // it was stdin !
+	    return -2;
+	return -3;
     }
-    line_buf[i] = '\0';
-    ptr = line_buf;
-    printf("LINE: %d: %s\n", *line_ptr, line_buf);
-    i = parse_ins(&ptr, &insx, 0, addr, &dest, voc);
-    printf("i=%d,s=0,insx=%03x, dest=%05x\n", i, insx, dest);
+    ptr = sp->lptr;
+    end = sp->lptr + sp->llen;
+    ASM_TRACE("LINE: %d: %.*s\n", sp->line, (int)sp->llen, sp->lptr);
+    i = parse_ins(&ptr, end, &insx, 0, addr, &dest, voc);
+    ASM_TRACE("i=%d,s=0,insx=%03x, dest=%05x\n", i, insx, dest);
     switch(i) {
     case TOKEN_EMPTY:
 	goto again;
@@ -300,12 +384,12 @@ again:
 	case META_DEF: {
 	    char* name;
 	    int len = 0;
-	    ptr = next_non_blank(ptr);
+	    ptr = next_non_blank(ptr, end);
 	    name = ptr;
-	    ptr = next_blank(ptr);
+	    ptr = next_blank(ptr, end);
 	    len = ptr - name;
 	    if (voc_add(name, len, addr, mem_ptr, voc) == NOSYM)
-		printf("warning: could not add symbol %-*s to symtab\n",
+		fprintf(stderr, "warning: could not add symbol %.*s to symtab\n",
 		       len, name);
 	    goto again;
 	}
@@ -331,8 +415,8 @@ again:
     default:
 	return -1;
     }
-    i = parse_ins(&ptr,&insx,1,addr,&dest,voc);
-    printf("i=%d,s=1,insx=%03x, dest=%05x\n", i, insx, dest);    
+    i = parse_ins(&ptr,end,&insx,1,addr,&dest,voc);
+    ASM_TRACE("i=%d,s=1,insx=%03x, dest=%05x\n", i, insx, dest);    
     switch(i) {
     case TOKEN_EMPTY: // assume rest of opcode are nops (warn?)
 	ins = (ins | (INS_NOP<<8) | (INS_NOP<<3) | (INS_NOP>>2)) ^ IMASK;
@@ -349,8 +433,8 @@ again:
     default:
 	return -1;
     }
-    i = parse_ins(&ptr,&insx,2,addr,&dest,voc);
-    printf("i=%d,s=2,insx=%03x, dest=%05x\n", i, insx, dest);        
+    i = parse_ins(&ptr,end,&insx,2,addr,&dest,voc);
+    ASM_TRACE("i=%d,s=2,insx=%03x, dest=%05x\n", i, insx, dest);        
     switch(i) {
     case TOKEN_EMPTY:
 	ins = (ins | (INS_NOP<<3) | (INS_NOP>>2)) ^ IMASK;
@@ -367,8 +451,8 @@ again:
     default:
 	return -1;
     }
-    i = parse_ins(&ptr,&insx,3,addr,&dest,voc);
-    printf("i=%d,s=3,insx=%03x, dest=%05x\n", i, insx, dest);        
+    i = parse_ins(&ptr,end,&insx,3,addr,&dest,voc);
+    ASM_TRACE("i=%d,s=3,insx=%03x, dest=%05x\n", i, insx, dest);        
     switch(i) {
     case TOKEN_EMPTY:
 	ins = (ins | (INS_NOP>>2)) ^ IMASK;
@@ -381,7 +465,7 @@ again:
 	    return -1;
 	}
 	ins = (ins | (insx >> 2)) ^ IMASK; // add op and encode
-	printf("mem_ptr=%p,addr=%03x, ins=%05x\n", mem_ptr, addr, ins);
+	ASM_TRACE("mem_ptr=%p,addr=%03x, ins=%05x\n", mem_ptr, addr, ins);
 	mem_ptr[addr] = ins;
 	return insx;
     default:
@@ -10,17 +10,33 @@
 #define TOKEN_VALUE     3
 #define TOKEN_COMMA     4
 
+#define ASM_CHUNK_SIZE  65536  // initial read buffer for streamed input
+#define MAX_SCAN_HEAP_SIZE 256 // symbols table & names
+
+// assembler input, a mapped file or a buffered stream (stdin)
+typedef struct {
+    int    fd;
+    char*  buf;       // mapping or read buffer
+    size_t len;       // valid bytes in buf
+    size_t size;      // size of mapping/buffer
+    size_t pos;       // start of next line
+    int    mapped;    // buf is mmap'ed
+    int    eof;       // nothing more to read from fd
+    int    line;      // current line number
+    char*  lptr;      // current line, not terminated
+    size_t llen;      // current line length
+} f18_asm_src_t;
+
 extern int parse_symbol(char** pptr, uint18_t* valuep,  f18_voc_t voc);
-extern int parse_ins(char** pptr, uint18_t* insp,
+extern int parse_ins(char** pptr, char* end, uint18_t* insp,
 		     int slot, uint18_t addr,
 		     uint18_t* dstp,
 		     f18_voc_t voc);
 
 extern f18_symbol_table_t* copy_symbols(f18_symbol_table_t* symtab);
-extern int f18_asm_line(int fd,
-			int* line_ptr,
-			char* line_buf,
-			size_t line_buf_size,
+extern int f18_asm_open(f18_asm_src_t* sp, int fd);
+extern void f18_asm_close(f18_asm_src_t* sp);
+extern int f18_asm_line(f18_asm_src_t* sp,
 			uint18_t* addr_ptr,
 			uint18_t* node_ptr,
 			uint18_t* data_ptr,
@@ -12,10 +12,13 @@
 #include <memory.h>
 #include <errno.h>
 #include <termios.h>
+#include <poll.h>
 
 #include "f18.h"
 #include "f18_node.h"
 #include "f18_async.h"
+#include "f18_epoll.h"
+#include "f18_boot.h"
 
 // Global async nodes
 async_reader_t r708;
@@ -23,16 +26,50 @@ async_writer_t w708;
 
 #define BITS_PER_WORD     30  // 3 bytes * 10 bits (start + 8 data + stop)
 #define SAMPLES_PER_BIT   10
+#define ASYNC_POLL_MS     100 // poll timeout, to notice terminate
 
 // Initialize async_reader sync buffer
 void async_reader_init(async_reader_t* ap)
 {
-    byte_queue_init(&ap->bq);
+    if (byte_queue_init(&ap->bq, BYTE_QUEUE_SIZE) < 0) {
+	fprintf(stderr, "async_reader: unable to allocate bit queue\n");
+	exit(1);
+    }
+    async_reader_reset(ap);
+}
+
+// Back to idle between words, queued input is kept
+void async_reader_reset(async_reader_t* ap)
+{
+    ap->bit_pos = 0;
+    ap->bit_len = 0;
+    ap->pin17 = 0;
     ap->sample_count = 1;
     ap->bit_count = 0;
     ap->state = ASYNC_STATE_IDLE;
 }
 
+// Next sampled bit, refill the local cache from the queue in bulk
+// so the queue indices are touched once per batch instead of per bit.
+// Blocks when no bits are available, returns -1 on terminate
+static int async_next_bit(async_reader_t* ap)
+{
+    if (ap->bit_pos == ap->bit_len) {
+	int n = byte_queue_deq_bulk(&ap->bq, ap->bits, ASYNC_BIT_CACHE);
+	if (n <= 0)
+	    return -1;
+	ap->bit_pos = 0;
+	ap->bit_len = n;
+    }
+    ap->pin17 = ap->bits[ap->bit_pos++];
+    return ap->pin17;
+}
+
+static int async_bit_available(async_reader_t* ap)
+{
+    return (ap->bit_pos < ap->bit_len) || byte_queue_available(&ap->bq);
+}
+
 // read_ioreg for node 708 - synchronous bit delivery
 // Called when 708 reads from IO register
 //
@@ -65,14 +102,14 @@ uint18_t read_ioreg_708(node_t* np, uint18_t ioreg)
 	return f18_read_ioreg(np, ioreg);
     }
 
-    pin17 = byte_queue_curr(&r708.bq);
+    pin17 = r708.pin17;
 
     if (r708.sample_count <= 0) {  // time for next bit
 	switch (r708.state) {
 	case ASYNC_STATE_ACTIVE:
 	    if (r708.bit_count < BITS_PER_WORD) {
 		// Within word - block until data
-		pin17 = byte_queue_deq(&r708.bq);  // blocks
+		pin17 = async_next_bit(&r708);  // blocks
 		r708.bit_count++;
 		// After certain bits, add half-bit delay for center sampling
 		switch(r708.bit_count) {
@@ -100,10 +137,10 @@ uint18_t read_ioreg_708(node_t* np, uint18_t ioreg)
 
 	case ASYNC_STATE_COMPLETE:
 	    // Word done - check for more data without blocking
-	    if (byte_queue_available(&r708.bq)) {
+	    if (async_bit_available(&r708)) {
 		// More data - start next word
 		r708.state = ASYNC_STATE_ACTIVE;
-		pin17 = byte_queue_deq(&r708.bq);
+		pin17 = async_next_bit(&r708);
 		r708.bit_count = 1;
 		r708.sample_count = SAMPLES_PER_BIT;
 		PRINTF("708/ COMPLETE->ACTIVE: next word, bit=%d, pin=%d\n",
@@ -118,7 +155,7 @@ uint18_t read_ioreg_708(node_t* np, uint18_t ioreg)
 	case ASYNC_STATE_IDLE:
 	    // First read - block until data arrives
 	    PRINTF("708/ IDLE: waiting for data...\n");
-	    pin17 = byte_queue_deq(&r708.bq);  // blocks
+	    pin17 = async_next_bit(&r708);  // blocks
 	    r708.state = ASYNC_STATE_ACTIVE;
 	    r708.bit_count = 1;
 	    r708.sample_count = SAMPLES_PER_BIT;
@@ -130,6 +167,9 @@ uint18_t read_ioreg_708(node_t* np, uint18_t ioreg)
     if (r708.sample_count > 0)
 	r708.sample_count--;
 
+    if (pin17 < 0)  // terminated
+	pin17 = 0;
+
     // Build IOR value with current PIN17 state
     ior_val = __atomic_load_n(&np->ior, __ATOMIC_SEQ_CST);
     if (pin17)
@@ -139,41 +179,59 @@ uint18_t read_ioreg_708(node_t* np, uint18_t ioreg)
     return ior_val;
 }
 
+// Expand the 3 uart bytes of a word into the 30 pin levels seen by 708
+void async_word_bits(const uint8_t* w18, uint8_t* bits)
+{
+    int bi = 0;
+    int i, j;
+
+    for (i = 0; i < 3; i++) {
+	uint8_t b0 = ~w18[i];  // invert all bits
+
+	// Start bit (HIGH after inversion)
+	bits[bi++] = 1;
+
+	// 8 data bits (LSB first)
+	for (j = 0; j < 8; j++) {
+	    bits[bi++] = b0 & 1;
+	    b0 >>= 1;
+	}
+	// Stop bit (LOW after inversion)
+	bits[bi++] = 0;
+    }
+}
+
 // READ from GPIO - fills bit buffer for 708 to consume
+// The pty master is shared with async_writer and is kept non-blocking,
+// wait with poll when no input is ready.
 void async_reader(async_reader_t* ap)
 {
-    printf("async_reader: started baud=%d (sync buffer mode)\n", ap->baud);
+    uint8_t w18[3];
+    int len = 0;
+
+    PRINTF("async_reader: started baud=%d (sync buffer mode)\n", ap->baud);
 
     tcflush(ap->fd, TCIFLUSH);
-    set_blocking(ap->fd, 1);
+
+    if (ap->boot_len > 0) {  // boot stream given on command line
+	f18_boot_stream_inject(ap, ap->boot, ap->boot_len);
+	PRINTF("async_reader: injected %zu boot words\n", ap->boot_len);
+    }
 
     while(!ap->chan.terminate) {
-	uint8_t w18[3];
 	int n;
 
-	if ((n = read(ap->fd, w18, 3)) == 3) {
-	    uint8_t bits[30];  // 3 bytes * 10 bits each
-	    int bi = 0;
-	    int i, j;
+	if ((n = read(ap->fd, w18+len, 3-len)) > 0) {
+	    uint8_t bits[BITS_PER_WORD];
 
-	    // Build all 30 bits first
-	    for (i = 0; i < 3; i++) {
-		uint8_t b0 = ~w18[i];  // invert all bits
+	    if ((len += n) < 3)
+		continue;
+	    len = 0;
 
-		// Start bit (HIGH after inversion)
-		bits[bi++] = 1;
-
-		// 8 data bits (LSB first)
-		for (j = 0; j < 8; j++) {
-		    bits[bi++] = b0 & 1;
-		    b0 >>= 1;
-		}
-		// Stop bit (LOW after inversion)
-		bits[bi++] = 0;
-	    }
+	    async_word_bits(w18, bits);
 
 	    // Push all 30 bits atomically
-	    byte_queue_enq_batch(&ap->bq, bits, 30);
+	    byte_queue_enq_batch(&ap->bq, bits, BITS_PER_WORD);
 
 	    PRINTF("async_reader: delivered bytes 0x%02x%02x%02x\n",
 		   w18[2], w18[1], w18[0]);
@@ -185,6 +243,11 @@ void async_reader(async_reader_t* ap)
 	else if (n < 0) {
 	    if (errno == EINTR)
 		continue;
+	    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+		struct pollfd pfd = { .fd = ap->fd, .events = POLLIN };
+		poll(&pfd, 1, ASYNC_POLL_MS);  // timeout to check terminate
+		continue;
+	    }
 	    ERRORF("async_reader: read error %d (%s)\n",
 		   errno, strerror(errno));
 	    return;
@@ -192,16 +255,81 @@ void async_reader(async_reader_t* ap)
     }
 }
 
+void async_writer_init(async_writer_t* ap)
+{
+    async_writer_reset(ap);
+    if ((ap->fd >= 0) && (f18_epoll_add(ap->fd) < 0))
+	ERRORF("async_writer: epoll add failed %d (%s)\n",
+	       errno, strerror(errno));
+}
+
+// Output not yet written is from the run being reset
+void async_writer_reset(async_writer_t* ap)
+{
+    ap->olen = 0;
+}
+
+// Write out as much of obuf as the fd accepts without blocking.
+// When wait is set, block (via the epoll thread) until all is written.
+// Returns -1 on write error or terminate
+static int async_flush(async_writer_t* ap, int wait)
+{
+    size_t pos = 0;
+
+    while (pos < ap->olen) {
+	ssize_t n = write(ap->fd, ap->obuf+pos, ap->olen-pos);
+	if (n > 0) {
+	    pos += n;
+	    continue;
+	}
+	if ((n < 0) && (errno == EINTR))
+	    continue;
+	if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+	    if (!wait)
+		break;
+	    f18_epoll_select(ap->fd, &ap->chan, F18_CHAN_WRITE);
+	    if (f18_wait_io(&ap->chan) == F18_CHAN_NONE)
+		break;
+	    continue;
+	}
+	ERRORF("async_writer: write error %d (%s)\n", errno, strerror(errno));
+	ap->olen = 0;
+	return -1;
+    }
+    PRINTF("async_writer: flushed %ld of %ld bytes\n", (long) pos,
+	   (long) ap->olen);
+    if (pos > 0) {
+	memmove(ap->obuf, ap->obuf+pos, ap->olen-pos);
+	ap->olen -= pos;
+    }
+    return (ap->olen == 0) ? 0 : -1;
+}
+
+// Final flush at termination, give the consumer a moment to drain
+static void async_flush_final(async_writer_t* ap)
+{
+    int tries = 10;
+
+    while ((ap->olen > 0) && tries--) {
+	struct pollfd pfd = { .fd = ap->fd, .events = POLLOUT };
+	if (async_flush(ap, 0) == 0)
+	    break;
+	poll(&pfd, 1, ASYNC_POLL_MS);
+    }
+}
+
 // WRITE to GPIO (emulated serial port/socket whatever)
 // when 708 write value to ioreg 'io' then it ends up here
 //
+// Decoded bytes are collected in obuf and written with a single write
+// when the buffer is full or when 708 has been quiet for ASYNC_IDLE_US.
+// Only a full buffer on a stalled consumer makes us (and 708) wait.
+//
 void async_writer(async_writer_t* ap)
 {
     int count = 0;
     uint18_t bits = 0;
 
-    set_blocking(ap->fd, 1);
-
     while(!ap->chan.terminate) {
 	uint8_t b;
 	int i;
@@ -218,6 +346,15 @@ void async_writer(async_writer_t* ap)
 		if (f18_chan_read(rp, GPIO, &value)) {
 		    f18_complete_transfer(&ap->chan, F18_CHAN_READ);
 		}
+		else if (ap->olen > 0) {
+		    // output pending, flush it if 708 goes idle
+		    if (!f18_wait_transfer_timeout(&ap->chan, F18_CHAN_READ,
+						   ASYNC_IDLE_US, &value)) {
+			if (!ap->chan.terminate)
+			    async_flush(ap, 0);
+			continue;
+		    }
+		}
 		else {
 		    value = f18_wait_transfer(&ap->chan, F18_CHAN_READ);
 		    if (ap->chan.terminate)
@@ -250,11 +387,14 @@ void async_writer(async_writer_t* ap)
 	    if (ap->fd >= 0) {
 		PRINTF("async_writer: output byte %02x '%c'\n",
 		       b, (b >= 32 && b < 127) ? b : '?');
-		// fix sending
-		write(ap->fd, &b, 1);
+		ap->obuf[ap->olen++] = b;
+		if (ap->olen == sizeof(ap->obuf))
+		    async_flush(ap, 1);
 	    }
 	    bits = 0;
 	    count = 0;
 	}
     }
+    if (ap->fd >= 0)
+	async_flush_final(ap);
 }
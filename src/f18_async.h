@@ -23,6 +23,9 @@ typedef enum {
     ASYNC_STATE_COMPLETE     // Word done - non-blocking idle
 } async_state_t;
 
+// Bits dequeued in bulk by 708 (one word is 30 bits)
+#define ASYNC_BIT_CACHE 32
+
 // Async reader node (receives serial data for 708)
 typedef struct _async_reader_t {
     node_t n;                // dummy node for id
@@ -33,11 +36,22 @@ typedef struct _async_reader_t {
     int fd;
     int baud;
     byte_queue_t bq;
+    uint8_t bits[ASYNC_BIT_CACHE];    // bits taken from bq, not yet sampled
+    int bit_pos;                      // next bit in bits
+    int bit_len;                      // number of valid bits
+    int pin17;                        // current sampled pin level
+    const uint18_t* boot;             // boot stream fed before pty input
+    size_t boot_len;
     volatile int sample_count;        // @b reads since last bit change
     volatile int bit_count;           // bits received in current word (0-29)
     volatile async_state_t state;     // boot state machine
 } async_reader_t;
 
+// Output bytes are collected and written in one go when the buffer
+// fills or when 708 has been idle for ASYNC_IDLE_US
+#define ASYNC_OBUF_SIZE 4096
+#define ASYNC_IDLE_US   2000
+
 // Async writer node (sends serial data from 708)
 typedef struct _async_writer_t {
     node_t n;                // dummy node for id
@@ -47,14 +61,28 @@ typedef struct _async_writer_t {
     pthread_attr_t attr;
     int fd;
     int baud;
+    size_t olen;             // bytes pending in obuf
+    uint8_t obuf[ASYNC_OBUF_SIZE];
 } async_writer_t;
 
 // Initialize async reader
 extern void async_reader_init(async_reader_t* ap);
 
+// Reset the receive state machine (chip reset)
+extern void async_reader_reset(async_reader_t* ap);
+
+// Expand 3 uart bytes into 30 bit levels (start, 8 data, stop)
+extern void async_word_bits(const uint8_t* w18, uint8_t* bits);
+
 // Async reader thread function
 extern void async_reader(async_reader_t* ap);
 
+// Initialize async writer (after fd is set)
+extern void async_writer_init(async_writer_t* ap);
+
+// Drop pending output (chip reset)
+extern void async_writer_reset(async_writer_t* ap);
+
 // Async writer thread function
 extern void async_writer(async_writer_t* ap);
 
@@ -0,0 +1,810 @@
+//
+// f18-bench, emulator benchmark suite
+//
+//   f18-bench [-s scale] [-o json-file] [workload ...]
+//
+// Runs the workloads (all by default) and writes the results as JSON,
+// to stdout unless -o is given. Each workload runs in its own process
+// on a fresh chip with a thread per node, as bin/f18 does, the peak
+// RSS is taken from the child. Node programs are generated here, port
+// registers are derived from the node position so every direction
+// parity is used as on the chip. scale multiplies the work done.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_lib.h"
+#include "f18_boot.h"
+#include "f18_serdes.h"
+
+#ifndef F18_VERSION
+#define F18_VERSION "unknown"
+#endif
+
+#define BENCH_TIMEOUT   120     // seconds per workload
+#define BENCH_PROBES    2000    // latency samples, one word in flight
+#define BENCH_BATCH     1024    // host stream batch
+
+typedef struct {
+    int nodes;               // nodes loaded
+    int hops;                // port hops per word, 0 for none
+    double seconds;          // timed section
+    uint64_t instructions;   // slots executed in the timed loops, 0 n/a
+    uint64_t words;          // words moved end to end
+    double per_hop_ns;       // latency over hops, 0 for n/a
+    int nlat;                // latency samples
+    double lat_p50;          // ns
+    double lat_p90;
+    double lat_p99;
+    double lat_max;
+    char error[80];
+} bench_result_t;
+
+typedef struct {
+    const char* name;
+    const char* desc;
+    int (*run)(bench_result_t* rp, int scale);
+} workload_t;
+
+static inline double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static int bench_fail(bench_result_t* rp, const char* fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(rp->error, sizeof(rp->error), fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+// io register of the ports of node (i,j) in dirs, the mnemonic of a
+// direction depends on the row and column parity of the node
+static uint18_t port_reg(int i, int j, int dirs)
+{
+    uint18_t reg = F18_DIR_BITS | F18_DOWN_BIT | F18_UP_BIT;  // no port
+    int dir;
+
+    for (dir = 0; dir < 4; dir++) {
+	uint18_t r;
+
+	if (!(dirs & DIR_BIT(dir)))
+	    continue;
+	switch (dir) {
+	case UP:   r = north_io(i,j); break;
+	case LEFT: r = west_io(i,j); break;
+	case DOWN: r = south_io(i,j); break;
+	default:   r = east_io(i,j); break;
+	}
+	if (r == IOREG_R___)
+	    reg |= F18_RIGHT_BIT;
+	else if (r == IOREG___L_)
+	    reg |= F18_LEFT_BIT;
+	else if (r == IOREG__D__)
+	    reg &= ~F18_DOWN_BIT;
+	else
+	    reg &= ~F18_UP_BIT;
+    }
+    return reg;
+}
+
+static void prog_node(FILE* f, int i, int j)
+{
+    fprintf(f, "node %d\norg 0\n: main\n", MAKE_ID(i,j));
+}
+
+// Pass words from the ports in in_dirs to port out_dir
+static void prog_relay(FILE* f, int i, int j, int in_dirs, int out_dir)
+{
+    prog_node(f, i, j);
+    fprintf(f, "@p a! @p .\n%d\n%d\nb! . . .\n",
+	    port_reg(i, j, in_dirs), port_reg(i, j, DIR_BIT(out_dir)));
+    fprintf(f, "@ !b . .\njump 4\n");
+}
+
+// Write value to port out_dir forever
+static void prog_source(FILE* f, int i, int j, int out_dir, uint18_t value)
+{
+    prog_node(f, i, j);
+    fprintf(f, "@p b! @p .\n%d\n%d\n", port_reg(i, j, DIR_BIT(out_dir)),
+	    value);
+    fprintf(f, "dup !b . .\njump 3\n");
+}
+
+// Load the generated program text, NULL on error
+static f18_chip_t* bench_chip(FILE* f, bench_result_t* rp)
+{
+    f18_chip_t* chip;
+
+    if ((chip = f18_create(FLAG_SILENT)) == NULL) {
+	bench_fail(rp, "create: %s", strerror(errno));
+	return NULL;
+    }
+    fflush(f);
+    rewind(f);
+    if (f18_load_fd(chip, fileno(f), "bench.f18") < 0) {
+	bench_fail(rp, "load: %s", strerror(errno));
+	return NULL;
+    }
+    fclose(f);
+    return chip;
+}
+
+static int cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Percentiles of n latency samples (ns)
+static void bench_latency(bench_result_t* rp, uint64_t* lat, int n)
+{
+    qsort(lat, n, sizeof(uint64_t), cmp_u64);
+    rp->nlat = n;
+    rp->lat_p50 = lat[n*50/100];
+    if (rp->hops > 0)
+	rp->per_hop_ns = rp->lat_p50 / rp->hops;
+    rp->lat_p90 = lat[n*90/100];
+    rp->lat_p99 = lat[n*99/100];
+    rp->lat_max = lat[n-1];
+}
+
+// Stream n words through the host ports, then time single words
+static int bench_stream(bench_result_t* rp, f18_port_t* in, f18_port_t* out,
+			uint64_t n, int probes)
+{
+    static uint64_t lat[BENCH_PROBES];
+    uint18_t buf[BENCH_BATCH];
+    uint64_t sent = 0, got = 0;
+    double t0;
+    int k;
+
+    t0 = now_sec();
+    while (got < n) {
+	int r;
+
+	if ((sent < n) && (word_queue_space(&in->q) >= BENCH_BATCH)) {
+	    int m = (n - sent < BENCH_BATCH) ? (int)(n - sent) : BENCH_BATCH;
+	    for (k = 0; k < m; k++)
+		buf[k] = (sent + k) & MASK18;
+	    if (f18_port_put(in, buf, m) < 0)
+		return bench_fail(rp, "input port stopped");
+	    sent += m;
+	}
+	else if ((sent < n) && (word_queue_available(&out->q) == 0)) {
+	    sched_yield();
+	    continue;
+	}
+	if ((r = f18_port_get(out, buf, BENCH_BATCH)) < 0)
+	    return bench_fail(rp, "output port stopped");
+	got += r;
+    }
+    rp->seconds = now_sec() - t0;
+    rp->words = got;
+
+    for (k = 0; k < probes; k++) {
+	uint18_t w = k & MASK18;
+	double t1 = now_sec();
+	if ((f18_port_put(in, &w, 1) < 0) || (f18_port_get(out, &w, 1) < 0))
+	    return bench_fail(rp, "port stopped");
+	lat[k] = (now_sec() - t1) * 1e9;
+    }
+    bench_latency(rp, lat, probes);
+    return 0;
+}
+
+// Loop on node 000: outer x inner iterations of body, slots
+// instructions per iteration. The node then waits on the port to 001,
+// which is not loaded, and the chip goes idle.
+static int bench_loop(bench_result_t* rp, const char* body, int slots,
+		      int scale)
+{
+    uint64_t outer = 256*scale;
+    uint64_t inner = 0x40000;
+    f18_chip_t* chip;
+    FILE* f;
+    double t0;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    prog_node(f, 0, 0);
+    fprintf(f, "@p >r . .\n%llu\n@p >r . .\n%llu\n%s\nnext 2\n",
+	    (unsigned long long) outer-1, (unsigned long long) inner-1, body);
+    fprintf(f, "@p a! . .\n%d\n@ . . .\n", port_reg(0, 0, DIR_BIT(RIGHT)));
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    rp->nodes = 1;
+    t0 = now_sec();
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    f18_wait(chip);
+    rp->seconds = now_sec() - t0;
+    rp->instructions = outer*inner*slots;
+    rp->words = ((reg_node_t*) f18_node(chip, 0))->debug.act.words;
+    return 0;
+}
+
+static int bench_unext(bench_result_t* rp, int scale)
+{
+    return bench_loop(rp, ". . . unext", 4, scale);
+}
+
+static int bench_next(bench_result_t* rp, int scale)
+{
+    return bench_loop(rp, ". . next 4", 3, scale);
+}
+
+static int bench_multiply(bench_result_t* rp, int scale)
+{
+    return bench_loop(rp, "+* +* +* unext", 4, scale);
+}
+
+// Host -> 000 -> 001 -> 000 -> host, 000 reads down and writes left
+static int bench_pingpong(bench_result_t* rp, int scale)
+{
+    f18_chip_t* chip;
+    f18_port_t *in, *out;
+    FILE* f;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    prog_node(f, 0, 0);
+    fprintf(f, "@p b! . .\n%d\n", port_reg(0, 0, DIR_BIT(RIGHT)));
+    fprintf(f, "@p a! @ .\n%d\n!b @b @p .\n%d\na! ! . .\njump 2\n",
+	    port_reg(0, 0, DIR_BIT(DOWN)), port_reg(0, 0, DIR_BIT(LEFT)));
+    prog_relay(f, 0, 1, DIR_BIT(LEFT), LEFT);
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    if (((in = f18_attach_stream(chip, 0, DOWN, F18_PORT_IN, -1)) == NULL) ||
+	((out = f18_attach_stream(chip, 0, LEFT, F18_PORT_OUT, -1)) == NULL))
+	return bench_fail(rp, "attach: %s", strerror(errno));
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    rp->nodes = 2;
+    rp->hops = 4;
+    return bench_stream(rp, in, out, 50000ULL*scale, BENCH_PROBES);
+}
+
+// Boustrophedon path over the grid, by rows: row 0 left to right,
+// row 1 right to left and so on, in at 000 down and out at 700 left.
+// By columns: column 0 upwards, column 1 downwards and so on, in at 000
+// left and out at 017 right.
+static int bench_path(bench_result_t* rp, int scale, int by_cols)
+{
+    int n1 = by_cols ? GRID_COLS : GRID_ROWS;   // lines
+    int n2 = by_cols ? GRID_ROWS : GRID_COLS;   // nodes per line
+    int fwd = by_cols ? UP : RIGHT;             // even lines
+    int step = by_cols ? RIGHT : UP;            // to the next line
+    int in_dir = by_cols ? LEFT : DOWN;
+    int out_id, out_dir = LEFT;
+    f18_chip_t* chip;
+    f18_port_t *in, *out;
+    int a, b;
+    FILE* f;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    for (a = 0; a < n1; a++) {
+	for (b = 0; b < n2; b++) {
+	    int k = (a & 1) ? n2-1-b : b;
+	    int i = by_cols ? k : a;
+	    int j = by_cols ? a : k;
+	    out_dir = (b < n2-1) ? ((a & 1) ? fwd^2 : fwd) :
+		((a < n1-1) ? step : (by_cols ? RIGHT : LEFT));
+	    prog_relay(f, i, j, DIR_BIT(in_dir), out_dir);
+	    in_dir = out_dir ^ 2;
+	    out_id = MAKE_ID(i,j);
+	}
+    }
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    if (((in = f18_attach_stream(chip, 0, by_cols ? LEFT : DOWN,
+				 F18_PORT_IN, -1)) == NULL) ||
+	((out = f18_attach_stream(chip, out_id, out_dir,
+				  F18_PORT_OUT, -1)) == NULL))
+	return bench_fail(rp, "attach: %s", strerror(errno));
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    rp->nodes = GRID_ROWS*GRID_COLS;
+    rp->hops = GRID_ROWS*GRID_COLS + 1;
+    return bench_stream(rp, in, out, 2500ULL*scale, BENCH_PROBES/20);
+}
+
+static int bench_snake(bench_result_t* rp, int scale)
+{
+    return bench_path(rp, scale, 0);
+}
+
+static int bench_snake_cols(bench_result_t* rp, int scale)
+{
+    return bench_path(rp, scale, 1);
+}
+
+// Parent of node (i,j) in the reduction tree: rows reduce to column 0,
+// column 0 reduces to 000
+static int reduce_parent(int i, int j)
+{
+    return (j > 0) ? LEFT : DOWN;
+}
+
+// All to one reduction: the host sends a token to 000, it is passed
+// down the tree to every node, each node then adds 1 to the sums of
+// its children and hands the result to its parent. 000 writes the
+// total (the number of nodes) to the host on its left port.
+static int bench_reduce(bench_result_t* rp, int scale)
+{
+    static uint64_t lat[BENCH_PROBES];
+    uint64_t rounds = 2000ULL*scale, r;
+    f18_chip_t* chip;
+    f18_port_t *in, *out;
+    int i, j, dir, depth = 0;
+    double t0;
+    FILE* f;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    int parent = reduce_parent(i, j);
+	    int children = 0;
+
+	    if (j < GRID_COLS-1)
+		children |= DIR_BIT(RIGHT);
+	    if ((j == 0) && (i < GRID_ROWS-1))
+		children |= DIR_BIT(UP);
+	    prog_node(f, i, j);
+	    fprintf(f, "@p b! @p .\n%d\n%d\na! . . .\n@ . . .\n",
+		    port_reg(i, j, DIR_BIT((i|j) ? parent : LEFT)),
+		    port_reg(i, j, DIR_BIT(parent)));
+	    for (dir = 0; dir < 4; dir++)   // token to the children
+		if (children & DIR_BIT(dir))
+		    fprintf(f, "dup @p a! .\n%d\n! . . .\n",
+			    port_reg(i, j, DIR_BIT(dir)));
+	    fprintf(f, "drop @p . .\n1\n");
+	    for (dir = 0; dir < 4; dir++)   // add the child sums
+		if (children & DIR_BIT(dir))
+		    fprintf(f, "@p a! @ .\n%d\n. + . .\n",
+			    port_reg(i, j, DIR_BIT(dir)));
+	    fprintf(f, "!b @p a! .\n%d\njump 4\n",
+		    port_reg(i, j, DIR_BIT(parent)));
+	}
+    }
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    if (((in = f18_attach_stream(chip, 0, DOWN, F18_PORT_IN, -1)) == NULL) ||
+	((out = f18_attach_stream(chip, 0, LEFT, F18_PORT_OUT, -1)) == NULL))
+	return bench_fail(rp, "attach: %s", strerror(errno));
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+
+    t0 = now_sec();
+    for (r = 0; r < rounds; r++) {
+	uint18_t w = 0;
+	double t1 = now_sec();
+	if ((f18_port_put(in, &w, 1) < 0) || (f18_port_get(out, &w, 1) < 0))
+	    return bench_fail(rp, "port stopped");
+	if (w != GRID_ROWS*GRID_COLS)
+	    return bench_fail(rp, "bad sum %d", w);
+	if (r < BENCH_PROBES)
+	    lat[r] = (now_sec() - t1) * 1e9;
+    }
+    rp->seconds = now_sec() - t0;
+    rp->words = rounds*GRID_ROWS*GRID_COLS;   // values reduced
+    rp->nodes = GRID_ROWS*GRID_COLS;
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    if (i + j > depth)
+		depth = i + j;
+    rp->hops = 2*(depth + 1);   // token down and sum up, host links
+    bench_latency(rp, lat, (rounds < BENCH_PROBES) ? rounds : BENCH_PROBES);
+    return 0;
+}
+
+// Nearest neighbour exchange: every node swaps a word with each of its
+// neighbours, in four phases of disjoint pairs (even columns with the
+// column to the right, odd columns with the column to the right, then
+// the same for rows). The lower node of a pair writes first. 000
+// writes a word to the host on its left port when its rounds are done,
+// the pairs run in lockstep so the rest of the grid is within a round.
+static int bench_exchange(bench_result_t* rp, int scale)
+{
+    static const int phase_dir[4] = { RIGHT, RIGHT, UP, UP };
+    uint64_t rounds = 600ULL*scale;
+    f18_chip_t* chip;
+    f18_port_t* out;
+    uint18_t w;
+    int i, j, p, links = 0;
+    double t0;
+    FILE* f;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    int all = 0;
+
+	    prog_node(f, i, j);
+	    fprintf(f, "@p >r . .\n%llu\n", (unsigned long long) rounds-1);
+	    for (p = 0; p < 4; p++) {
+		int dir = phase_dir[p];
+		int k = (dir == RIGHT) ? j : i;     // position on the axis
+		int n = (dir == RIGHT) ? GRID_COLS : GRID_ROWS;
+		int first;
+
+		if ((k & 1) == (p & 1)) {   // lower node of the pair
+		    if (k+1 >= n)
+			continue;
+		    first = 1;
+		}
+		else {
+		    if (k == 0)
+			continue;
+		    dir ^= 2;
+		    first = 0;
+		}
+		all |= DIR_BIT(dir);
+		if (first)
+		    links++;
+		fprintf(f, "@p a! @p .\n%d\n%d\n%s\n",
+			port_reg(i, j, DIR_BIT(dir)), MAKE_ID(i,j),
+			first ? "! @ drop ." : "@ drop ! .");
+	    }
+	    fprintf(f, "next 2\n");
+	    if ((i|j) == 0)
+		fprintf(f, "@p a! . .\n%d\n! . . .\n",
+			port_reg(i, j, DIR_BIT(LEFT)));
+	    // wait on all neighbours, none writes, the chip goes idle
+	    fprintf(f, "@p a! . .\n%d\n@ . . .\n", port_reg(i, j, all));
+	}
+    }
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    if ((out = f18_attach_stream(chip, 0, LEFT, F18_PORT_OUT, -1)) == NULL)
+	return bench_fail(rp, "attach: %s", strerror(errno));
+    t0 = now_sec();
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    if (f18_port_get(out, &w, 1) < 0)
+	return bench_fail(rp, "port stopped");
+    rp->seconds = now_sec() - t0;
+    rp->words = rounds*links*2;
+    rp->nodes = GRID_ROWS*GRID_COLS;
+    rp->hops = 1;
+    // a round is 4 phases of two transfers in sequence
+    rp->per_hop_ns = rp->seconds * 1e9 / (rounds*8);
+    return 0;
+}
+
+// 000, 101 and 002 write to 001 as fast as they can, 001 reads them
+// with one multiport read and passes them to the host
+static int bench_fanin(bench_result_t* rp, int scale)
+{
+    static uint18_t buf[BENCH_BATCH];
+    uint64_t n = 200000ULL*scale, got = 0;
+    f18_chip_t* chip;
+    f18_port_t* out;
+    FILE* f;
+    double t0;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    prog_source(f, 0, 0, RIGHT, 0);
+    prog_source(f, 1, 1, DOWN, 101);
+    prog_source(f, 0, 2, LEFT, 2);
+    prog_relay(f, 0, 1, DIR_BIT(LEFT)|DIR_BIT(UP)|DIR_BIT(RIGHT), DOWN);
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    if ((out = f18_attach_stream(chip, 1, DOWN, F18_PORT_OUT, -1)) == NULL)
+	return bench_fail(rp, "attach: %s", strerror(errno));
+    t0 = now_sec();
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    while (got < n) {
+	int r;
+	if ((r = f18_port_get(out, buf, BENCH_BATCH)) < 0)
+	    return bench_fail(rp, "output port stopped");
+	got += r;
+    }
+    rp->seconds = now_sec() - t0;
+    rp->words = got;
+    rp->nodes = 4;
+    rp->hops = 2;
+    return 0;
+}
+
+// Boot all nodes with a full RAM image through the 708 async boot ROM,
+// the serial input is the boot stream, as bin/f18 -B async
+static int bench_boot(bench_result_t* rp, int scale)
+{
+    static f18_boot_image_t img[GRID_ROWS*GRID_COLS];
+    f18_boot_stream_t bs;
+    f18_chip_t* chip;
+    int rfd[2], wfd;
+    int i, j, k, n = 0;
+    double t0;
+
+    (void) scale;
+    if ((chip = f18_create(FLAG_SILENT)) == NULL)
+	return bench_fail(rp, "create: %s", strerror(errno));
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    img[n].id = MAKE_ID(i,j);
+	    img[n].size = 64;
+	    img[n].entry = BOOT_NO_ENTRY;
+	    for (k = 0; k < 64; k++)
+		img[n].ram[k] = (img[n].id*64 + k*0x1357) & MASK18;
+	    n++;
+	}
+    }
+    f18_boot_stream_init(&bs);
+    if (f18_boot_stream_build(&bs, img, n) < 0)
+	return bench_fail(rp, "boot stream");
+
+    // 708 serial io as bin/f18 sets it up, without a pty
+    if ((pipe(rfd) < 0) || ((wfd = open("/dev/null", O_WRONLY)) < 0))
+	return bench_fail(rp, "pipe: %s", strerror(errno));
+    fcntl(rfd[0], F_SETFL, O_NONBLOCK);
+    if (f18_attach_async(chip, rfd[0], wfd, 9600, bs.words, bs.len) < 0)
+	return bench_fail(rp, "attach: %s", strerror(errno));
+
+    t0 = now_sec();
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    // 708 is loaded last
+    for (;;) {
+	for (k = 0; k < n; k++) {
+	    node_t* xp = f18_node(chip, img[k].id);
+	    if (memcmp(xp->ram, img[k].ram, sizeof(img[k].ram)) != 0)
+		break;
+	}
+	if (k == n)
+	    break;
+	usleep(100);
+    }
+    rp->seconds = now_sec() - t0;
+    rp->words = bs.len;
+    rp->nodes = n;
+    return 0;
+}
+
+// 701 transmits on its SERDES, 001 receives over a socket in this
+// process and passes the words to the host
+static int bench_serdes(bench_result_t* rp, int scale)
+{
+    static uint18_t buf[BENCH_BATCH];
+    uint64_t n = 200000ULL*scale, got = 0;
+    char dir[] = "/tmp/f18-benchXXXXXX";
+    char path[64];
+    f18_chip_t* chip;
+    f18_port_t* out;
+    FILE* f;
+    double t0;
+
+    if ((f = tmpfile()) == NULL)
+	return bench_fail(rp, "tmpfile: %s", strerror(errno));
+    prog_node(f, 7, 1);   // transmit, first word to Data then the up port
+    fprintf(f, "@p b! @p .\n%d\n%d\n!b @p b! .\n%d\n@p !b @p .\n0\n%d\n",
+	    IOREG_IO, SERDES_TX_ENABLE, IOREG_DATA, port_reg(7, 1, DIR_BIT(UP)));
+    fprintf(f, "b! . . .\ndup !b . .\njump 9\n");
+    prog_node(f, 0, 1);   // receive with T = SERDES_RX_MAGIC
+    fprintf(f, "@p a! @p .\n%d\n%d\nb! . . .\n@p @ !b .\n%d\njump 4\n",
+	    port_reg(0, 1, DIR_BIT(UP)), port_reg(0, 1, DIR_BIT(DOWN)),
+	    SERDES_RX_MAGIC);
+    if ((chip = bench_chip(f, rp)) == NULL)
+	return -1;
+    if ((out = f18_attach_stream(chip, 1, DOWN, F18_PORT_OUT, -1)) == NULL)
+	return bench_fail(rp, "attach: %s", strerror(errno));
+
+    if (mkdtemp(dir) == NULL)
+	return bench_fail(rp, "setup: %s", strerror(errno));
+    snprintf(path, sizeof(path), "%s/serdes.sock", dir);
+    if ((f18_attach_serdes(chip, 701, SERDES_MODE_SERVER, path) < 0) ||
+	(f18_attach_serdes(chip, 001, SERDES_MODE_CLIENT, path) < 0)) {
+	unlink(path);
+	rmdir(dir);
+	return bench_fail(rp, "serdes setup");
+    }
+
+    t0 = now_sec();
+    if (f18_start(chip, 0) < 0)
+	return bench_fail(rp, "start: %s", strerror(errno));
+    while (got < n) {
+	int r;
+	if ((r = f18_port_get(out, buf, BENCH_BATCH)) < 0)
+	    break;
+	got += r;
+    }
+    rp->seconds = now_sec() - t0;
+    unlink(path);
+    rmdir(dir);
+    if (got < n)
+	return bench_fail(rp, "output port stopped");
+    rp->words = got;
+    rp->nodes = 2;
+    rp->hops = 2;
+    return 0;
+}
+
+static const workload_t workloads[] = {
+    { "unext",    "unext loop on one node",               bench_unext },
+    { "next",     "next loop on one node",                bench_next },
+    { "multiply", "+* unext loop on one node",            bench_multiply },
+    { "pingpong", "host word echoed between 000 and 001", bench_pingpong },
+    { "snake",    "host stream through all 144 nodes",    bench_snake },
+    { "snake-cols", "stream through all nodes by columns", bench_snake_cols },
+    { "reduce",   "all to one reduction over the grid",   bench_reduce },
+    { "exchange", "nearest neighbour exchange, all nodes", bench_exchange },
+    { "fanin",    "three writers into one multiport read", bench_fanin },
+    { "boot",     "708 async boot of a full image",       bench_boot },
+    { "serdes",   "701 to 001 SERDES loopback",           bench_serdes },
+};
+
+#define NUM_WORKLOADS (int)(sizeof(workloads)/sizeof(workloads[0]))
+
+// Run w in a child process, rss_kb is its peak RSS
+static int bench_run(const workload_t* w, int scale, bench_result_t* rp,
+		     long* rss_kb)
+{
+    struct rusage ru;
+    int fd[2], status;
+    pid_t pid;
+    ssize_t n;
+
+    memset(rp, 0, sizeof(*rp));
+    *rss_kb = 0;
+    if (pipe(fd) < 0)
+	return bench_fail(rp, "pipe: %s", strerror(errno));
+    if ((pid = fork()) < 0)
+	return bench_fail(rp, "fork: %s", strerror(errno));
+    if (pid == 0) {
+	int null = open("/dev/null", O_WRONLY);
+	close(fd[0]);
+	dup2(null, STDOUT_FILENO);  // the io modules print progress
+	alarm(BENCH_TIMEOUT);
+	(*w->run)(rp, scale);
+	n = write(fd[1], rp, sizeof(*rp));
+	_exit((n == sizeof(*rp)) ? 0 : 1);   // node threads left running
+    }
+    close(fd[1]);
+    n = read(fd[0], rp, sizeof(*rp));
+    close(fd[0]);
+    if (wait4(pid, &status, 0, &ru) < 0)
+	return bench_fail(rp, "wait: %s", strerror(errno));
+    *rss_kb = ru.ru_maxrss;
+    if (WIFSIGNALED(status))
+	return bench_fail(rp, "killed by signal %d%s", WTERMSIG(status),
+			  (WTERMSIG(status) == SIGALRM) ? " (timeout)" : "");
+    if (n != sizeof(*rp))
+	return bench_fail(rp, "no result");
+    return (rp->error[0] != '\0') ? -1 : 0;
+}
+
+static void json_result(FILE* f, const workload_t* w,
+			const bench_result_t* rp, long rss_kb, int last)
+{
+    fprintf(f, "    {\"name\": \"%s\", \"description\": \"%s\",\n",
+	    w->name, w->desc);
+    if (rp->error[0] != '\0') {
+	fprintf(f, "     \"error\": \"%s\"}%s\n", rp->error, last ? "" : ",");
+	return;
+    }
+    fprintf(f, "     \"nodes\": %d, \"seconds\": %.6f,\n",
+	    rp->nodes, rp->seconds);
+    if (rp->instructions > 0)
+	fprintf(f, "     \"instructions\": %llu, \"mips\": %.2f,\n",
+		(unsigned long long) rp->instructions,
+		rp->instructions / (rp->seconds * 1e6));
+    else
+	fprintf(f, "     \"instructions\": null, \"mips\": null,\n");
+    fprintf(f, "     \"words\": %llu, \"words_per_sec\": %.0f, \"hops\": %d,\n",
+	    (unsigned long long) rp->words, rp->words / rp->seconds, rp->hops);
+    if (rp->per_hop_ns > 0)
+	fprintf(f, "     \"per_hop_ns\": %.0f,\n", rp->per_hop_ns);
+    else
+	fprintf(f, "     \"per_hop_ns\": null,\n");
+    if (rp->nlat > 0)
+	fprintf(f, "     \"latency_ns\": {\"samples\": %d, \"p50\": %.0f, "
+		"\"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f},\n",
+		rp->nlat, rp->lat_p50, rp->lat_p90, rp->lat_p99, rp->lat_max);
+    else
+	fprintf(f, "     \"latency_ns\": null,\n");
+    fprintf(f, "     \"rss_kb\": %ld}%s\n", rss_kb, last ? "" : ",");
+}
+
+void usage(char* prog, char* fmt, ...)
+{
+    va_list ap;
+    int k;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "usage: %s [-s scale] [-o json-file] [workload ...]\n",
+	    prog);
+    fprintf(stderr, "  workloads:\n");
+    for (k = 0; k < NUM_WORKLOADS; k++)
+	fprintf(stderr, "    %-10s %s\n", workloads[k].name, workloads[k].desc);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    char* prog = basename(argv[0]);
+    const workload_t* run[NUM_WORKLOADS];
+    int nrun = 0, failed = 0, scale = 1;
+    FILE* f = stdout;
+    char* out = NULL;
+    int c, i, k;
+
+    logout = stderr;
+    while ((c = getopt(argc, argv, "s:o:")) != -1) {
+	switch (c) {
+	case 's':
+	    if ((scale = atoi(optarg)) <= 0)
+		usage(prog, "bad scale %s\n", optarg);
+	    break;
+	case 'o': out = optarg; break;
+	default: usage(prog, "");
+	}
+    }
+    for (i = optind; i < argc; i++) {
+	for (k = 0; k < NUM_WORKLOADS; k++)
+	    if (strcmp(argv[i], workloads[k].name) == 0)
+		break;
+	if (k == NUM_WORKLOADS)
+	    usage(prog, "unknown workload %s\n", argv[i]);
+	if (nrun < NUM_WORKLOADS)
+	    run[nrun++] = &workloads[k];
+    }
+    if (nrun == 0)
+	for (k = 0; k < NUM_WORKLOADS; k++)
+	    run[nrun++] = &workloads[k];
+
+    if ((out != NULL) && ((f = fopen(out, "w")) == NULL)) {
+	fprintf(stderr, "unabled to open file %s, error=%s\n",
+		out, strerror(errno));
+	exit(1);
+    }
+    fprintf(f, "{\n  \"version\": \"%s\",\n  \"scale\": %d,\n"
+	    "  \"workloads\": [\n", F18_VERSION, scale);
+    for (i = 0; i < nrun; i++) {
+	bench_result_t r;
+	long rss_kb;
+
+	fprintf(stderr, "%s: ", run[i]->name);
+	if (bench_run(run[i], scale, &r, &rss_kb) < 0) {
+	    fprintf(stderr, "%s\n", r.error);
+	    failed++;
+	}
+	else
+	    fprintf(stderr, "%.3fs\n", r.seconds);
+	json_result(f, run[i], &r, rss_kb, i == nrun-1);
+    }
+    fprintf(f, "  ]\n}\n");
+    if (fclose(f) != 0) {
+	fprintf(stderr, "unable to write results, error=%s\n",
+		strerror(errno));
+	exit(1);
+    }
+    exit(failed ? 2 : 0);
+}
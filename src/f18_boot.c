@@ -0,0 +1,508 @@
+//
+// Boot stream encoder for the 708 async and 705 SPI boot ROMs
+//
+// Replaces the Erlang f18_uart/f18_asm boot path, the stream can be
+// written to a file/uart, fed straight into the 708 bit queue or
+// applied directly to node memory (fast boot). SPI streams are packed
+// into flash images read by the 705 ROM.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <memory.h>
+#include <errno.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_async.h"
+#include "f18_chip.h"
+#include "f18_boot.h"
+
+extern node_t* node[GRID_ROWS][GRID_COLS];
+
+#define BOOT_ROOT_ROW   7      // 708
+#define BOOT_ROOT_COL   8
+#define BOOT_SPI_ROW    7      // 705
+#define BOOT_SPI_COL    5
+#define BOOT_MAX_PACKET 1024   // words in one 708 frame (64 + hops*6)
+
+// instruction words used by the relay/load packets
+#define BOOT_SET_A  (MAKE_INS(INS_FETCH_P,INS_A_STORE,INS_FETCH_P,INS_NOP)^IMASK)
+#define BOOT_PUSH   (MAKE_INS(INS_TO_R,INS_NOP,INS_NOP,INS_NOP)^IMASK)
+#define BOOT_RELAY  (MAKE_INS(INS_FETCH_P,INS_STORE,INS_UNEXT,INS_NOP)^IMASK)
+#define BOOT_LOAD   (MAKE_INS(INS_FETCH_P,INS_STORE_PLUS,INS_UNEXT,INS_NOP)^IMASK)
+#define BOOT_JUMP(dest) \
+    (((MAKE_INS_J1(INS_PJUMP,0)^IMASK) & ~MASK10) | ((dest) & MASK10))
+#define BOOT_IS_JUMP(w) ((((w) ^ IMASK) >> 13) == INS_PJUMP)
+
+// single port ioreg of node (i,j) facing direction dir
+static uint18_t port_ioreg(int i, int j, int dir)
+{
+    static const uint18_t port[4] = {
+	IOREG_R___, IOREG__D__, IOREG___L_, IOREG____U };
+    int k;
+
+    for (k = 0; k < 4; k++) {
+	if (dirbits(i, j, port[k]) == DIR_BIT(dir))
+	    return port[k];
+    }
+    return 0;
+}
+
+// direction of a single port ioreg of node (i,j), -1 if not a port
+static int port_dir(int i, int j, uint18_t ioreg)
+{
+    uint9_t dirs;
+    int dir;
+
+    if ((ioreg & F18_DIR_MASK) != F18_DIR_BITS)
+	return -1;
+    dirs = dirbits(i, j, ioreg);
+    for (dir = 0; dir < 4; dir++) {
+	if (dirs == DIR_BIT(dir))
+	    return dir;
+    }
+    return -1;
+}
+
+void f18_boot_stream_init(f18_boot_stream_t* bs)
+{
+    bs->words = NULL;
+    bs->len = 0;
+    bs->cap = 0;
+}
+
+void f18_boot_stream_free(f18_boot_stream_t* bs)
+{
+    free(bs->words);
+    f18_boot_stream_init(bs);
+}
+
+static int stream_append(f18_boot_stream_t* bs, const uint18_t* w, size_t n)
+{
+    if (bs->len + n > bs->cap) {
+	size_t cap = bs->cap ? bs->cap : 256;
+	uint18_t* words;
+	while (cap < bs->len + n)
+	    cap *= 2;
+	if ((words = realloc(bs->words, cap*sizeof(uint18_t))) == NULL)
+	    return -1;
+	bs->words = words;
+	bs->cap = cap;
+    }
+    memcpy(bs->words + bs->len, w, n*sizeof(uint18_t));
+    bs->len += n;
+    return 0;
+}
+
+static int stream_frame(f18_boot_stream_t* bs, uint18_t completion,
+			uint18_t transfer, const uint18_t* w, size_t n)
+{
+    uint18_t hdr[3] = { completion, transfer, n };
+
+    if (stream_append(bs, hdr, 3) < 0)
+	return -1;
+    return stream_append(bs, w, n);
+}
+
+// breadth first route tree from the root node, parent[i][j] is the
+// direction towards the parent (-1 for the root)
+typedef struct {
+    uint18_t next;            // root frame completion, read next frame
+    int dist[GRID_ROWS][GRID_COLS];
+    int parent[GRID_ROWS][GRID_COLS];
+    int focused[GRID_ROWS][GRID_COLS];
+    int relay[GRID_ROWS][GRID_COLS];
+} boot_route_t;
+
+static void route_init(boot_route_t* rp, int ri, int rj, uint18_t next)
+{
+    int qi[GRID_ROWS*GRID_COLS], qj[GRID_ROWS*GRID_COLS];
+    int head = 0, tail = 0;
+    int i, j;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    rp->dist[i][j] = -1;
+	    rp->parent[i][j] = -1;
+	    rp->focused[i][j] = 0;
+	    rp->relay[i][j] = 0;
+	}
+    }
+    rp->next = next;
+    rp->dist[ri][rj] = 0;
+    qi[tail] = ri; qj[tail] = rj; tail++;
+    while (head < tail) {
+	int dir;
+	i = qi[head]; j = qj[head]; head++;
+	for (dir = 0; dir < 4; dir++) {
+	    int ni = i + f18_drow[dir];
+	    int nj = j + f18_dcol[dir];
+	    if ((ni < 0) || (ni >= GRID_ROWS) || (nj < 0) || (nj >= GRID_COLS))
+		continue;
+	    if (rp->dist[ni][nj] >= 0)
+		continue;
+	    rp->dist[ni][nj] = rp->dist[i][j] + 1;
+	    rp->parent[ni][nj] = dir ^ 2;  // UP<->DOWN, LEFT<->RIGHT
+	    qi[tail] = ni; qj[tail] = nj; tail++;
+	}
+    }
+}
+
+// Wrap the packet for node (i,j) in relay headers up to the root and
+// emit it as one ROM frame. pkt has room for BOOT_MAX_PACKET words.
+static int route_packet(f18_boot_stream_t* bs, boot_route_t* rp,
+			int i, int j, uint18_t* pkt, size_t n)
+{
+    uint18_t tmp[BOOT_MAX_PACKET];
+
+    while (rp->dist[i][j] > 0) {
+	int dir = rp->parent[i][j];
+	int pi = i + f18_drow[dir];
+	int pj = j + f18_dcol[dir];
+	size_t k = 0;
+
+	if (!rp->focused[i][j]) {
+	    // prepend focusing jump, the node still runs from its multiport
+	    if (n + 1 > BOOT_MAX_PACKET)
+		return -1;
+	    memmove(pkt+1, pkt, n*sizeof(uint18_t));
+	    pkt[0] = BOOT_JUMP(port_ioreg(i, j, dir));
+	    rp->focused[i][j] = 1;
+	    n++;
+	}
+	if (rp->dist[pi][pj] == 0)
+	    return stream_frame(bs, rp->next, port_ioreg(pi, pj, dir^2),
+				pkt, n);
+	if (n + 7 > BOOT_MAX_PACKET)
+	    return -1;
+	if (!rp->focused[pi][pj])
+	    tmp[k++] = BOOT_JUMP(port_ioreg(pi, pj, rp->parent[pi][pj]));
+	rp->focused[pi][pj] = 1;
+	rp->relay[pi][pj] = 1;
+	tmp[k++] = BOOT_SET_A;
+	tmp[k++] = port_ioreg(pi, pj, dir^2);
+	tmp[k++] = n-1;
+	tmp[k++] = BOOT_PUSH;
+	tmp[k++] = BOOT_RELAY;
+	memcpy(tmp+k, pkt, n*sizeof(uint18_t));
+	memcpy(pkt, tmp, (n+k)*sizeof(uint18_t));
+	n += k;
+	i = pi;
+	j = pj;
+    }
+    return 0;
+}
+
+// Stream rooted at node (ri,rj), relayed frames complete with next,
+// the root frame with its entry or done
+static int stream_build(f18_boot_stream_t* bs,
+			const f18_boot_image_t* img, int nimages,
+			int ri, int rj, uint18_t next, uint18_t done)
+{
+    const f18_boot_image_t* map[GRID_ROWS][GRID_COLS];
+    boot_route_t route;
+    uint18_t pkt[BOOT_MAX_PACKET];
+    int maxdist = 0;
+    int i, j, k, d;
+
+    memset(map, 0, sizeof(map));
+    for (k = 0; k < nimages; k++) {
+	i = ID_TO_ROW(img[k].id);
+	j = ID_TO_COLUMN(img[k].id);
+	if ((i >= GRID_ROWS) || (j >= GRID_COLS) || (img[k].size > 64) ||
+	    (map[i][j] != NULL))
+	    return -1;
+	map[i][j] = &img[k];
+    }
+    route_init(&route, ri, rj, next);
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    if (route.dist[i][j] > maxdist)
+		maxdist = route.dist[i][j];
+
+    // farthest first, a node is always loaded after the nodes it relays to
+    for (d = maxdist; d > 0; d--) {
+	for (i = 0; i < GRID_ROWS; i++) {
+	    for (j = 0; j < GRID_COLS; j++) {
+		const f18_boot_image_t* ip = map[i][j];
+		size_t n = 0;
+
+		if (route.dist[i][j] != d)
+		    continue;
+		if ((ip != NULL) && (ip->size > 0)) {
+		    pkt[n++] = BOOT_SET_A;
+		    pkt[n++] = 0;
+		    pkt[n++] = ip->size-1;
+		    pkt[n++] = BOOT_PUSH;
+		    pkt[n++] = BOOT_LOAD;
+		    memcpy(pkt+n, ip->ram, ip->size*sizeof(uint18_t));
+		    n += ip->size;
+		}
+		if ((ip != NULL) && (ip->entry != BOOT_NO_ENTRY))
+		    pkt[n++] = BOOT_JUMP(ip->entry);
+		else if ((ip == NULL) && route.relay[i][j])
+		    pkt[n++] = BOOT_JUMP(ConfigMap[i][j].reset);
+		if (n == 0)
+		    continue;
+		if (route_packet(bs, &route, i, j, pkt, n) < 0)
+		    return -1;
+	    }
+	}
+    }
+    // the root itself last, loaded by the ROM frame
+    if ((map[ri][rj]) != NULL) {
+	const f18_boot_image_t* ip = map[ri][rj];
+	uint18_t completion = (ip->entry != BOOT_NO_ENTRY) ?
+	    ip->entry : done;
+	if (stream_frame(bs, completion, 0, ip->ram, ip->size) < 0)
+	    return -1;
+    }
+    return 0;
+}
+
+int f18_boot_stream_build(f18_boot_stream_t* bs,
+			  const f18_boot_image_t* img, int nimages)
+{
+    return stream_build(bs, img, nimages, BOOT_ROOT_ROW, BOOT_ROOT_COL,
+			BOOT_COLD, BOOT_COLD);
+}
+
+// SPI frames carry the completion as address + BOOT_SPI_CHECK, the
+// root frame of a stream with no 705 image is followed by erased flash
+// which the ROM rejects, 705 then ends in warm
+int f18_boot_spi_build(f18_boot_stream_t* bs,
+		       const f18_boot_image_t* img, int nimages)
+{
+    size_t k = 0;
+
+    if (stream_build(bs, img, nimages, BOOT_SPI_ROW, BOOT_SPI_COL,
+		     BOOT_SPI_EXEC, BOOT_SPI_WARM) < 0)
+	return -1;
+    while (k + 3 <= bs->len) {
+	bs->words[k] = (bs->words[k] + BOOT_SPI_CHECK) & MASK18;
+	k += 3 + bs->words[k+2];
+    }
+    return 0;
+}
+
+// Pack the words msb first into a bit stream, the flash byte order,
+// the last byte is padded with ones (erased)
+int f18_boot_spi_write(int fd, const f18_boot_stream_t* bs)
+{
+    uint8_t buf[256+4];
+    uint32_t acc = 0;
+    int nbits = 0;
+    size_t i, n = 0;
+
+    for (i = 0; i <= bs->len; i++) {
+	if (i < bs->len) {
+	    acc = (acc << 18) | (bs->words[i] & MASK18);
+	    nbits += 18;
+	}
+	else if (nbits > 0) {
+	    acc = (acc << (8 - nbits)) | ((1 << (8 - nbits)) - 1);
+	    nbits = 8;
+	}
+	while (nbits >= 8) {
+	    nbits -= 8;
+	    buf[n++] = acc >> nbits;
+	}
+	acc &= (1 << nbits) - 1;
+	if ((n >= 256) || (i == bs->len)) {
+	    size_t pos = 0;
+	    while (pos < n) {
+		ssize_t r = write(fd, buf+pos, n-pos);
+		if (r < 0) {
+		    if (errno == EINTR)
+			continue;
+		    return -1;
+		}
+		pos += r;
+	    }
+	    n = 0;
+	}
+    }
+    return 0;
+}
+
+// uart encoding of f18_uart:encode_word, 0x2d is the autobaud pattern
+void f18_boot_encode_word(uint18_t w, uint8_t* out)
+{
+    uint32_t w1 = (((w & MASK18) << 6) | 0x2d) ^ 0xffffff;
+
+    out[0] = w1;
+    out[1] = w1 >> 8;
+    out[2] = w1 >> 16;
+}
+
+int f18_boot_stream_write(int fd, const f18_boot_stream_t* bs)
+{
+    uint8_t buf[3*256];
+    size_t i = 0;
+
+    while (i < bs->len) {
+	size_t n = 0, pos = 0;
+	while ((i < bs->len) && (n < sizeof(buf))) {
+	    f18_boot_encode_word(bs->words[i++], buf+n);
+	    n += 3;
+	}
+	while (pos < n) {
+	    ssize_t r = write(fd, buf+pos, n-pos);
+	    if (r < 0) {
+		if (errno == EINTR)
+		    continue;
+		return -1;
+	    }
+	    pos += r;
+	}
+    }
+    return 0;
+}
+
+void f18_boot_stream_inject(async_reader_t* ap, const uint18_t* words,
+			    size_t n)
+{
+    size_t i;
+
+    for (i = 0; (i < n) && !ap->chan.terminate; i++) {
+	uint8_t w18[3];
+	uint8_t bits[30];
+
+	f18_boot_encode_word(words[i], w18);
+	async_word_bits(w18, bits);
+	byte_queue_enq_batch(&ap->bq, bits, 30);
+    }
+}
+
+// Run a relay/load packet as node (i,j) would execute it from its port
+static int boot_exec(int i, int j, const uint18_t* w, size_t n)
+{
+    node_t* np = node[i][j];
+    size_t k = 0;
+
+    while (k < n) {
+	uint18_t arg;
+	size_t cnt;
+
+	if (BOOT_IS_JUMP(w[k])) {
+	    np->reg.p = w[k++] & MASK10;
+	    continue;
+	}
+	if ((w[k] != BOOT_SET_A) || (k + 5 > n) || (w[k+3] != BOOT_PUSH))
+	    return -1;
+	arg = w[k+1];
+	cnt = w[k+2] + 1;
+	if (k + 5 + cnt > n)
+	    return -1;
+	if (w[k+4] == BOOT_RELAY) {
+	    int dir = port_dir(i, j, arg);
+	    if ((dir < 0) ||
+		(i+f18_drow[dir] < 0) || (i+f18_drow[dir] >= GRID_ROWS) ||
+		(j+f18_dcol[dir] < 0) || (j+f18_dcol[dir] >= GRID_COLS))
+		return -1;
+	    if (boot_exec(i+f18_drow[dir], j+f18_dcol[dir], w+k+5, cnt) < 0)
+		return -1;
+	}
+	else if (w[k+4] == BOOT_LOAD) {
+	    size_t x;
+	    for (x = 0; x < cnt; x++)
+		np->ram[(arg + x) & 0x3f] = w[k+5+x];
+	}
+	else
+	    return -1;
+	k += 5 + cnt;
+    }
+    return 0;
+}
+
+// Apply one ROM frame at the root node (ri,rj)
+static int frame_load(int ri, int rj, uint18_t transfer,
+		      const uint18_t* w, size_t cnt)
+{
+    if (transfer >= IOREG_START) {
+	int dir = port_dir(ri, rj, transfer);
+	if ((dir < 0) ||
+	    (ri+f18_drow[dir] < 0) || (ri+f18_drow[dir] >= GRID_ROWS) ||
+	    (rj+f18_dcol[dir] < 0) || (rj+f18_dcol[dir] >= GRID_COLS))
+	    return -1;
+	return boot_exec(ri+f18_drow[dir], rj+f18_dcol[dir], w, cnt);
+    }
+    else {
+	node_t* np = node[ri][rj];
+	size_t x;
+	for (x = 0; x < cnt; x++)
+	    np->ram[(transfer + x) & 0x3f] = w[x];
+    }
+    return 0;
+}
+
+int f18_boot_stream_load(const f18_boot_stream_t* bs)
+{
+    node_t* np = node[BOOT_ROOT_ROW][BOOT_ROOT_COL];
+    size_t k = 0;
+
+    while (k + 3 <= bs->len) {
+	uint18_t completion = bs->words[k];
+	uint18_t transfer = bs->words[k+1];
+	size_t cnt = bs->words[k+2];
+	const uint18_t* w = bs->words + k + 3;
+
+	if (k + 3 + cnt > bs->len)
+	    return -1;
+	if ((transfer >= IOREG_START) &&
+	    (port_dir(BOOT_ROOT_ROW, BOOT_ROOT_COL, transfer) == UP))
+	    return -1;
+	if (frame_load(BOOT_ROOT_ROW, BOOT_ROOT_COL, transfer, w, cnt) < 0)
+	    return -1;
+	np->reg.p = completion & MASK10;
+	k += 3 + cnt;
+    }
+    return (k == bs->len) ? 0 : -1;
+}
+
+// 18 bit word at bit offset pos of a flash image, ones past the end
+static uint18_t spi_word(const uint8_t* image, size_t len, uint64_t pos)
+{
+    uint18_t w = 0;
+    int k;
+
+    for (k = 0; k < 18; k++, pos++) {
+	size_t i = pos >> 3;
+	int bit = (i < len) ? (image[i] >> (7 - (pos & 7))) & 1 : 1;
+	w = (w << 1) | bit;
+    }
+    return w;
+}
+
+int f18_boot_spi_load(const uint8_t* image, size_t len)
+{
+    node_t* np = node[BOOT_SPI_ROW][BOOT_SPI_COL];
+    uint18_t w[BOOT_MAX_PACKET];
+    uint64_t pos = 0;
+
+    for (;;) {
+	uint18_t completion = (spi_word(image, len, pos) +
+			       (SIGN_BIT - BOOT_SPI_CHECK)) & MASK18;
+	uint18_t transfer;
+	size_t cnt, x;
+
+	if (!(completion & SIGN_BIT)) {  // rejected, erased flash
+	    np->reg.p = BOOT_SPI_WARM;
+	    return 0;
+	}
+	transfer = spi_word(image, len, pos+18);
+	cnt = spi_word(image, len, pos+36);
+	pos += 54;
+	if (cnt > BOOT_MAX_PACKET)
+	    return -1;
+	for (x = 0; x < cnt; x++, pos += 18)
+	    w[x] = spi_word(image, len, pos);
+	if (frame_load(BOOT_SPI_ROW, BOOT_SPI_COL, transfer, w, cnt) < 0)
+	    return -1;
+	np->reg.p = completion & MASK10;
+	if (np->reg.p != BOOT_SPI_EXEC)
+	    return 0;
+    }
+}
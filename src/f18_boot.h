@@ -0,0 +1,81 @@
+#ifndef __F18_BOOT_H__
+#define __F18_BOOT_H__
+
+//
+// Boot stream encoder for the 708 async and 705 SPI boot ROMs
+//
+// A stream is a sequence of ROM frames [completion, transfer, count | words].
+// Frames for other nodes are sent out through a 708 port and relayed
+// along a breadth first tree rooted at 708. Each node on the way runs
+// the words it receives from its (focused) parent port, a relay copies
+// the rest of the packet to the next port, the target copies it to RAM:
+//
+//   relay:  jump:<in>  @p a! @p .  <out>  <n-1>  push . . .  @p ! unext .
+//   load:   jump:<in>  @p a! @p .  <addr> <n-1>  push . . .  @p !+ unext .
+//           <n words>  [ jump:<entry> ]
+//
+// SPI streams are rooted at 705 and packed into a flash image, frames
+// are read from address 0 and chained through spi-exec.
+//
+// Nodes are loaded farthest first so a relay is never overwritten
+// before it has passed on everything behind it. Relays that are not
+// loaded themselves get a final jump back to their reset address.
+//
+
+#include "f18.h"
+#include "f18_async.h"
+
+#define BOOT_NO_ENTRY  0xfff   // node has no main, keep executing port
+#define BOOT_COLD      0x0aa   // 708 ROM frame completion (read next frame)
+#define BOOT_SPI_EXEC  0x0b6   // 705 ROM frame completion (read next frame)
+#define BOOT_SPI_WARM  0x0a9   // 705 ROM, wait on the ports
+#define BOOT_SPI_CHECK 0x2000  // the 705 ROM adds 0x1e000 to the completion
+                               // and rejects it unless the sign bit is set
+
+typedef struct {
+    uint18_t id;              // node id (000-717)
+    uint18_t entry;           // start address or BOOT_NO_ENTRY
+    size_t   size;            // number of ram words used
+    uint18_t ram[64];
+} f18_boot_image_t;
+
+typedef struct {
+    uint18_t* words;
+    size_t    len;
+    size_t    cap;
+} f18_boot_stream_t;
+
+extern void f18_boot_stream_init(f18_boot_stream_t* bs);
+extern void f18_boot_stream_free(f18_boot_stream_t* bs);
+
+// Build boot stream for nimages images, returns 0 or -1 on error
+extern int f18_boot_stream_build(f18_boot_stream_t* bs,
+				 const f18_boot_image_t* img, int nimages);
+
+// Build boot stream for the 705 SPI ROM
+extern int f18_boot_spi_build(f18_boot_stream_t* bs,
+			      const f18_boot_image_t* img, int nimages);
+
+// Write the SPI stream as a flash image (18 bit words, msb first)
+extern int f18_boot_spi_write(int fd, const f18_boot_stream_t* bs);
+
+// Fast SPI boot: read the frames of a flash image as the 705 ROM does
+// and apply them directly. Returns 0 or -1 on malformed stream
+extern int f18_boot_spi_load(const uint8_t* image, size_t len);
+
+// Encode one word as the three uart bytes expected by the 708 ROM
+extern void f18_boot_encode_word(uint18_t w, uint8_t* out);
+
+// Write the uart encoded stream to fd, returns 0 or -1 on error
+extern int f18_boot_stream_write(int fd, const f18_boot_stream_t* bs);
+
+// Feed the stream to 708 through the reader bit queue (no pty involved)
+// Must run on the producer side of r708.bq
+extern void f18_boot_stream_inject(async_reader_t* ap,
+				   const uint18_t* words, size_t n);
+
+// Fast boot: apply the stream directly to node RAM and P, no emulation
+// Nodes must not be running. Returns 0 or -1 on malformed stream
+extern int f18_boot_stream_load(const f18_boot_stream_t* bs);
+
+#endif
@@ -1,98 +1,198 @@
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "f18_byte_queue.h"
+#include "f18_futex.h"
 
-void byte_queue_init(byte_queue_t* qp)
+// size is rounded up to a power of 2, 0 selects BYTE_QUEUE_SIZE
+int byte_queue_init(byte_queue_t* qp, size_t size)
 {
-    qp->head = 0;
-    qp->tail = 0;
-    qp->curr = 0;
-    pthread_mutex_init(&qp->lock, NULL);
-    pthread_cond_init(&qp->cond, NULL);
+    uint32_t n = 1;
+
+    if (size == 0)
+	size = BYTE_QUEUE_SIZE;
+    while (n < size)
+	n <<= 1;
+    memset(qp, 0, sizeof(*qp));
+    if ((qp->bytes = malloc(n)) == NULL)
+	return -1;
+    qp->size = n;
+    qp->mask = n - 1;
+    return 0;
 }
 
-// Add a byte to the buffer (called by async_reader thread)
-void byte_queue_enq(byte_queue_t* qp, int value)
+void byte_queue_destroy(byte_queue_t* qp)
 {
-    pthread_mutex_lock(&qp->lock);
-
-    // Wait if buffer is full
-    while (((qp->head + 1) & BYTE_QUEUE_MASK) == qp->tail) {
-	pthread_cond_wait(&qp->cond, &qp->lock);
-	if (qp->terminate) {
-	    pthread_mutex_unlock(&qp->lock);
-	    return;
-	}
-    }
+    free(qp->bytes);
+    qp->bytes = NULL;
+}
 
-    qp->bytes[qp->head] = value;
-    qp->head = (qp->head + 1) & BYTE_QUEUE_MASK;
-    pthread_cond_broadcast(&qp->cond);
-    pthread_mutex_unlock(&qp->lock);
+// Wake up both sides, blocked calls return without transfer
+void byte_queue_terminate(byte_queue_t* qp)
+{
+    __atomic_store_n(&qp->terminate, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&qp->prod_seq, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&qp->cons_seq, 1, __ATOMIC_SEQ_CST);
+    f18_futex_wake_all(&qp->prod_seq);
+    f18_futex_wake_all(&qp->cons_seq);
 }
 
-// Add multiple bytes atomically (called by async_reader for a complete 18-bit word)
-void byte_queue_enq_batch(byte_queue_t* qp, uint8_t* values, int count)
+// Consumer: wait until head moves past tail, return the new head
+// (head == tail on return means terminate)
+static uint32_t wait_data(byte_queue_t* qp, uint32_t tail)
 {
-    int i, used, avail;
-    pthread_mutex_lock(&qp->lock);
-
-    // Wait until there's room for all bytes
-    // used = number of elements in queue, avail = free slots (leaving 1 empty)
-    used = (qp->head - qp->tail) & BYTE_QUEUE_MASK;
-    avail = BYTE_QUEUE_SIZE - 1 - used;
-    while (avail < count && !qp->terminate) {
-	pthread_cond_wait(&qp->cond, &qp->lock);
-	used = (qp->head - qp->tail) & BYTE_QUEUE_MASK;
-	avail = BYTE_QUEUE_SIZE - 1 - used;
+    uint32_t head;
+
+    while ((head = __atomic_load_n(&qp->head, __ATOMIC_ACQUIRE)) == tail) {
+	uint32_t seq = __atomic_load_n(&qp->prod_seq, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    return tail;
+	// announce sleep, then re-check before going to the kernel
+	__atomic_store_n(&qp->cons_wait, 1, __ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&qp->head, __ATOMIC_SEQ_CST) == tail) &&
+	    !__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    f18_futex_wait(&qp->prod_seq, seq);
+	__atomic_store_n(&qp->cons_wait, 0, __ATOMIC_RELAXED);
     }
-    if (qp->terminate) {
-	pthread_mutex_unlock(&qp->lock);
-	return;
+    return head;
+}
+
+// Producer: wait until there is room for need bytes, return the new tail
+static uint32_t wait_space(byte_queue_t* qp, uint32_t head, uint32_t need)
+{
+    uint32_t tail;
+
+    while ((head - (tail = __atomic_load_n(&qp->tail, __ATOMIC_ACQUIRE))) >
+	   (qp->size - need)) {
+	uint32_t seq = __atomic_load_n(&qp->cons_seq, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    return tail;
+	__atomic_store_n(&qp->prod_wait, 1, __ATOMIC_SEQ_CST);
+	if (((head - __atomic_load_n(&qp->tail, __ATOMIC_SEQ_CST)) >
+	     (qp->size - need)) &&
+	    !__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    f18_futex_wait(&qp->cons_seq, seq);
+	__atomic_store_n(&qp->prod_wait, 0, __ATOMIC_RELAXED);
     }
+    return tail;
+}
 
-    // Insert all bytes at once
-    for (i = 0; i < count; i++) {
-	qp->bytes[qp->head] = values[i];
-	qp->head = (qp->head + 1) & BYTE_QUEUE_MASK;
+static inline void publish_head(byte_queue_t* qp, uint32_t head)
+{
+    __atomic_store_n(&qp->head, head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&qp->cons_wait, __ATOMIC_SEQ_CST)) {
+	__atomic_fetch_add(&qp->prod_seq, 1, __ATOMIC_SEQ_CST);
+	f18_futex_wake(&qp->prod_seq);
     }
+}
 
-    pthread_cond_broadcast(&qp->cond);
-    pthread_mutex_unlock(&qp->lock);
+static inline void publish_tail(byte_queue_t* qp, uint32_t tail)
+{
+    __atomic_store_n(&qp->tail, tail, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&qp->prod_wait, __ATOMIC_SEQ_CST)) {
+	__atomic_fetch_add(&qp->cons_seq, 1, __ATOMIC_SEQ_CST);
+	f18_futex_wake(&qp->cons_seq);
+    }
+}
+
+// Add a byte to the buffer (called by async_reader thread)
+void byte_queue_enq(byte_queue_t* qp, int value)
+{
+    uint8_t b = value;
+    byte_queue_enq_batch(qp, &b, 1);
+}
+
+// Add multiple bytes (called by async_reader for a complete 18-bit word)
+// A batch that fits in the ring is published in one go.
+void byte_queue_enq_batch(byte_queue_t* qp, uint8_t* values, int count)
+{
+    uint32_t head = qp->head;
+
+    while (count > 0) {
+	uint32_t need = ((uint32_t)count < qp->size) ? count : qp->size;
+	uint32_t n, i, k;
+
+	if ((head - qp->tail_cache) > (qp->size - need)) {
+	    qp->tail_cache = wait_space(qp, head, need);
+	    if (__atomic_load_n(&qp->terminate, __ATOMIC_ACQUIRE))
+		return;
+	}
+	n = qp->size - (head - qp->tail_cache);
+	if (n > (uint32_t)count)
+	    n = count;
+	i = head & qp->mask;
+	k = qp->size - i;        // bytes until wrap
+	if (k >= n)
+	    memcpy(&qp->bytes[i], values, n);
+	else {
+	    memcpy(&qp->bytes[i], values, k);
+	    memcpy(&qp->bytes[0], values+k, n-k);
+	}
+	head += n;
+	publish_head(qp, head);
+	values += n;
+	count -= n;
+    }
 }
 
 // Get next byte from buffer (called by 708 via read_ioreg)
-// Returns -1 if no byte available (should wait)
+// Returns -1 on terminate
 int byte_queue_deq(byte_queue_t* qp)
 {
+    uint32_t tail = qp->tail;
     int curr;
-    pthread_mutex_lock(&qp->lock);
 
-    if (qp->head == qp->tail) {
+    if (tail == qp->head_cache) {
 	// Buffer empty - wait for bytes
-	while ((qp->head == qp->tail) && !qp->terminate) {
-	    pthread_cond_wait(&qp->cond, &qp->lock);
-	}
-	if (qp->terminate) {
-	    pthread_mutex_unlock(&qp->lock);
+	if ((qp->head_cache = wait_data(qp, tail)) == tail)
 	    return -1;
-	}
     }
-
-    curr = qp->bytes[qp->tail];
-    qp->tail = (qp->tail + 1) & BYTE_QUEUE_MASK;
+    curr = qp->bytes[tail & qp->mask];
+    publish_tail(qp, tail + 1);
     qp->curr = curr;
-    pthread_cond_broadcast(&qp->cond);  // signal buffer space available
-    pthread_mutex_unlock(&qp->lock);
     return curr;
 }
 
+// Get up to count bytes, block until at least one is available
+// Returns number of bytes read or -1 on terminate
+int byte_queue_deq_bulk(byte_queue_t* qp, uint8_t* values, int count)
+{
+    uint32_t tail = qp->tail;
+    uint32_t n, i, k;
+
+    if (count <= 0)
+	return 0;
+    if (tail == qp->head_cache) {
+	if ((qp->head_cache = wait_data(qp, tail)) == tail)
+	    return -1;
+    }
+    n = qp->head_cache - tail;
+    if (n > (uint32_t)count)
+	n = count;
+    i = tail & qp->mask;
+    k = qp->size - i;
+    if (k >= n)
+	memcpy(values, &qp->bytes[i], n);
+    else {
+	memcpy(values, &qp->bytes[i], k);
+	memcpy(values+k, &qp->bytes[0], n-k);
+    }
+    publish_tail(qp, tail + n);
+    qp->curr = values[n-1];
+    return n;
+}
+
 int byte_queue_curr(byte_queue_t* qp)
 {
     return qp->curr;
 }
 
-// Check if bytes are available without blocking
+// Check if bytes are available without blocking (consumer side)
 int byte_queue_available(byte_queue_t* qp)
 {
-    return qp->head != qp->tail;
+    if (qp->tail != qp->head_cache)
+	return 1;
+    qp->head_cache = __atomic_load_n(&qp->head, __ATOMIC_ACQUIRE);
+    return qp->tail != qp->head_cache;
 }
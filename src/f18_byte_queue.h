@@ -1,28 +1,51 @@
 #ifndef __BYTE_QUEUE_H__
 #define __BYTE_QUEUE_H__
 
+#include <stddef.h>
 #include <stdint.h>
-#include <pthread.h>
 
-// Buffer size for bits (must be power of 2)
+//
+// Single producer / single consumer byte ring.
+//
+// head is only written by the producer and tail only by the consumer,
+// both are free running and published with release/acquire. Each side
+// lives on its own cache line. A side only enters the kernel (futex)
+// when the ring is empty (consumer) or full (producer).
+//
+
+// Default buffer size for bits (must be power of 2)
 #define BYTE_QUEUE_SIZE 256
-#define BYTE_QUEUE_MASK (BYTE_QUEUE_SIZE - 1)
+#define CACHE_LINE_SIZE 64
 
 typedef struct _byte_queue_t
 {
-    uint8_t bytes[BYTE_QUEUE_SIZE]; // circular byte buffer (0=LOW, 1=HIGH)
-    volatile int head;           // writes here
-    volatile int tail;           // reads here
-    volatile int curr;           // current value bytes[head]
-    int terminate;
-    pthread_mutex_t lock;
-    pthread_cond_t  cond;         // signal when new bits available
+    // consumer side
+    uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE))); // reads here
+    uint32_t head_cache;      // last head seen by consumer
+    uint32_t cons_seq;        // futex word, bumped when space is freed
+    int      cons_wait;       // 1 when consumer sleeps on prod_seq
+    int      curr;            // last dequeued value
+
+    // producer side
+    uint32_t head __attribute__((aligned(CACHE_LINE_SIZE))); // writes here
+    uint32_t tail_cache;      // last tail seen by producer
+    uint32_t prod_seq;        // futex word, bumped when data is published
+    int      prod_wait;       // 1 when producer sleeps on cons_seq
+
+    // constant after init
+    uint8_t* bytes __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t size;            // capacity (power of 2)
+    uint32_t mask;            // size - 1
+    int      terminate;
 } byte_queue_t;
 
-extern void byte_queue_init(byte_queue_t* qp);
+extern int  byte_queue_init(byte_queue_t* qp, size_t size);
+extern void byte_queue_destroy(byte_queue_t* qp);
+extern void byte_queue_terminate(byte_queue_t* qp);
 extern void byte_queue_enq(byte_queue_t* qp, int value);
 extern void byte_queue_enq_batch(byte_queue_t* qp, uint8_t* values, int count);
 extern int byte_queue_deq(byte_queue_t* qp);
+extern int byte_queue_deq_bulk(byte_queue_t* qp, uint8_t* values, int count);
 extern int byte_queue_curr(byte_queue_t* qp);
 extern int byte_queue_available(byte_queue_t* qp);
 
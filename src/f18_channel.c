@@ -24,6 +24,7 @@
 #include "f18_asm.h"
 #include "f18_node.h"
 #include "f18_debug.h"
+#include "f18_sched.h"
 
 extern node_t* node[8][18];
 
@@ -40,7 +41,9 @@ void f18_chan_init(chan_t* chan)
     chan->completed = 0;
     chan->io = 0;    
     chan->wait = 0;
+    chan->blocked = 0;
     chan->terminate = 0;        
+    chan->interrupt = 0;
 }
 
 void f18_chan_wakeup(chan_t* chan, f18_chan_mode_t rw)
@@ -59,6 +62,16 @@ void f18_chan_terminate(chan_t* chan)
     pthread_mutex_unlock(&chan->lock);
 }
 
+// interrupt stays set until the node clears it at an instruction
+// boundary, a transfer started before that returns at once
+void f18_chan_interrupt(chan_t* chan)
+{
+    pthread_mutex_lock(&chan->lock);
+    chan->interrupt = 1;
+    pthread_cond_broadcast(&chan->cond);
+    pthread_mutex_unlock(&chan->lock);
+}
+
 // Decode ioreg into DIR_BIT mask of target directions,
 // filtered by available directions (dmask).
 static uint18_t select_dirs(node_t* np, uint18_t ioreg)
@@ -126,10 +139,62 @@ static void clr_ior(chan_t* chan, uint18_t mask)
 //   2. Announce + re-probe: set own mask, then probe again
 //   3. Wait: sleep on cond until partner completes the transfer
 //
-// Only one lock is held at a time => no deadlock.
+// Phase 2 holds both locks, taken in address order => no deadlock.
+// Otherwise the partner could take the word from our mask after we
+// handed it over and before we withdraw the mask (a duplicate word),
+// or hand us a word after we took one (a lost word).
 // First to claim wins for multiport (clears all mask bits).
 //
 
+// Complete the transfer of a waiting partner, chan->lock held. A
+// blocked waiter is counted active again before it is signalled, so
+// the system does not look idle in the middle of a handoff.
+static void chan_wake(chan_t* chan)
+{
+    chan->completed = 1;
+    if (chan->blocked) {
+	chan->blocked = 0;
+	sys_leave_blocked_port();
+    }
+    pthread_cond_signal(&chan->cond);
+}
+
+// Count the waiter as blocked unless it is already done, chan->lock held
+static void chan_enter_blocked(chan_t* chan)
+{
+    if (!chan->completed && !chan->terminate && !chan->interrupt) {
+	chan->blocked = 1;
+	sys_enter_blocked_port();
+    }
+}
+
+// Woken by terminate, interrupt or a timeout, chan->lock held
+static void chan_leave_blocked(chan_t* chan)
+{
+    if (chan->blocked) {
+	chan->blocked = 0;
+	sys_leave_blocked_port();
+    }
+}
+
+static void lock_pair(chan_t* a, chan_t* b)
+{
+    if (a < b) {
+	pthread_mutex_lock(&a->lock);
+	pthread_mutex_lock(&b->lock);
+    }
+    else {
+	pthread_mutex_lock(&b->lock);
+	pthread_mutex_lock(&a->lock);
+    }
+}
+
+static void unlock_pair(chan_t* a, chan_t* b)
+{
+    pthread_mutex_unlock(&a->lock);
+    pthread_mutex_unlock(&b->lock);
+}
+
 int f18_chan_write(chan_t* chan, uint18_t dir, uint18_t value)
 {
     dir = invert_dir[dir];
@@ -139,8 +204,7 @@ int f18_chan_write(chan_t* chan, uint18_t dir, uint18_t value)
     if (chan->rmask & DIR_BIT(dir)) {
 	chan->data = value;
 	chan->rmask = 0;          // first writer wins, clear all
-	chan->completed = 1;
-	pthread_cond_signal(&chan->cond);
+	chan_wake(chan);
 	pthread_mutex_unlock(&chan->lock);
 	return 1;
     }
@@ -159,8 +223,7 @@ int f18_chan_read(chan_t* chan, uint18_t dir, uint18_t* value_ptr)
 	*value_ptr = chan->data;
 	PRINTF("[%03x] chan_read: got value=%d from chan, dir=%d, wmask was %x\n", chan_to_reg_node(chan)->n.id, chan->data, dir, chan->wmask);
 	chan->wmask = 0;          // first reader wins, clear all
-	chan->completed = 1;
-	pthread_cond_signal(&chan->cond);
+	chan_wake(chan);
 	pthread_mutex_unlock(&chan->lock);
 	return 1;
     }
@@ -168,6 +231,50 @@ int f18_chan_read(chan_t* chan, uint18_t dir, uint18_t* value_ptr)
     return 0;
 }
 
+// Phase 2 write: own transfer is announced, done if a partner already
+// took it or when a reader waits on chan
+int f18_chan_complete_write(chan_t* own, chan_t* chan, uint18_t dir,
+			    uint18_t value)
+{
+    int done;
+
+    dir = invert_dir[dir];
+    lock_pair(own, chan);
+    if (!(done = own->completed) && (chan->rmask & DIR_BIT(dir))) {
+	chan->data = value;
+	chan->rmask = 0;
+	chan_wake(chan);
+	own->wmask = 0;
+	own->completed = 1;
+	done = 1;
+    }
+    unlock_pair(own, chan);
+    return done;
+}
+
+// Phase 2 read: as above, the value comes from the partner that
+// completed us or from the writer waiting on chan
+int f18_chan_complete_read(chan_t* own, chan_t* chan, uint18_t dir,
+			   uint18_t* value_ptr)
+{
+    int done;
+
+    dir = invert_dir[dir];
+    lock_pair(own, chan);
+    if ((done = own->completed))
+	*value_ptr = own->data;
+    else if (chan->wmask & DIR_BIT(dir)) {
+	*value_ptr = chan->data;
+	chan->wmask = 0;
+	chan_wake(chan);
+	own->rmask = 0;
+	own->completed = 1;
+	done = 1;
+    }
+    unlock_pair(own, chan);
+    return done;
+}
+
 // initialize transfer of read/write
 void f18_init_transfer(chan_t* chan, int rw,
 		       uint18_t rdirs, uint18_t wdirs,
@@ -200,12 +307,22 @@ void f18_complete_transfer(chan_t* chan, f18_chan_mode_t rw)
 uint18_t f18_wait_transfer(chan_t* chan, f18_chan_mode_t rw)
 {
     uint18_t value = 0;
-    sys_enter_blocked_port();
+    int sched = (chan_to_reg_node(chan)->n.flags & FLAG_SCHED);
+
     pthread_mutex_lock(&chan->lock);
     chan->wait = 1;
-
-    while (!chan->completed && !chan->terminate)
-	pthread_cond_wait(&chan->cond, &chan->lock);
+    if (!sched)
+	chan_enter_blocked(chan);
+
+    while (!chan->completed && !chan->terminate && !chan->interrupt) {
+	if (sched) {  // let the other nodes run until a partner shows up
+	    pthread_mutex_unlock(&chan->lock);
+	    f18_sched_yield(1);
+	    pthread_mutex_lock(&chan->lock);
+	}
+	else
+	    pthread_cond_wait(&chan->cond, &chan->lock);
+    }
     chan->wait = 0;
     if (rw & F18_CHAN_READ) {
 	chan->rmask = 0;
@@ -214,11 +331,62 @@ uint18_t f18_wait_transfer(chan_t* chan, f18_chan_mode_t rw)
     if (rw & F18_CHAN_WRITE) {
 	chan->wmask = 0;
     }
+    chan_leave_blocked(chan);
     pthread_mutex_unlock(&chan->lock);
-    sys_leave_blocked_port();
     return value;
 }
 
+int f18_wait_transfer_timeout(chan_t* chan, f18_chan_mode_t rw,
+			      long timeout_us, uint18_t* value_ptr)
+{
+    struct timespec ts;
+    int completed;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += timeout_us / 1000000;
+    ts.tv_nsec += (timeout_us % 1000000) * 1000;
+    if (ts.tv_nsec >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&chan->lock);
+    chan->wait = 1;
+    chan_enter_blocked(chan);
+
+    while (!chan->completed && !chan->terminate && !chan->interrupt) {
+	if (pthread_cond_timedwait(&chan->cond, &chan->lock, &ts) == ETIMEDOUT)
+	    break;
+    }
+    chan->wait = 0;
+    // partner can only complete under the lock, clearing the masks
+    // here withdraws the transfer atomically
+    completed = chan->completed;
+    if (rw & F18_CHAN_READ) {
+	chan->rmask = 0;
+	if (completed)
+	    *value_ptr = chan->data;
+    }
+    if (rw & F18_CHAN_WRITE)
+	chan->wmask = 0;
+    chan_leave_blocked(chan);
+    pthread_mutex_unlock(&chan->lock);
+    return completed;
+}
+
+f18_chan_mode_t f18_wait_io(chan_t* chan)
+{
+    f18_chan_mode_t rw;
+
+    pthread_mutex_lock(&chan->lock);
+    while (!chan->io && !chan->terminate)
+	pthread_cond_wait(&chan->cond, &chan->lock);
+    rw = chan->terminate ? F18_CHAN_NONE : chan->io;
+    chan->io = 0;
+    pthread_mutex_unlock(&chan->lock);
+    return rw;
+}
+
 void f18_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
 {
     reg_node_t* dp = (reg_node_t*) np;
@@ -267,8 +435,10 @@ void f18_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
 	    continue;
 	if ((rp = dp->neighbour[dir]) == NULL)
 	    continue;
-	if (f18_chan_write(rp, dir, value))
+	if (f18_chan_write(rp, dir, value)) {
+	    DBG_COUNT(dp->debug.act.wr[dir]);
 	    return;
+	}
     }
 
     // setup for transfer to dirs
@@ -279,17 +449,16 @@ void f18_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
 	    continue;
 	if ((rp = dp->neighbour[dir]) == NULL)
 	    continue;
-	if (f18_chan_write(rp, dir, value)) {
-	    f18_complete_transfer(&dp->chan, F18_CHAN_WRITE);
+	if (f18_chan_complete_write(&dp->chan, rp, dir, value)) {
+	    DBG_COUNT(dp->debug.act.wr[dir]);
 	    return;
 	}
     }
 
     // Phase 3: wait for a reader to find us and complete the transfer
-    dp->debug.blocked_addr = ioreg;
-    dp->debug.blocked_dir = 1;  // write
+    debug_publish_blocked(dp, ioreg, 1);  // write
     f18_wait_transfer(&dp->chan, F18_CHAN_WRITE);
-    dp->debug.blocked_addr = 0;
+    debug_publish_blocked(dp, 0, 1);
 }
 
 // check neighbours and pins and update io read mask
@@ -384,8 +553,10 @@ uint18_t f18_read_ioreg(node_t* np, uint18_t ioreg)
 	    continue;
 	if ((rp = dp->neighbour[dir]) == NULL)
 	    continue;
-	if (f18_chan_read(rp, dir, &value))
+	if (f18_chan_read(rp, dir, &value)) {
+	    DBG_COUNT(dp->debug.act.rd[dir]);
 	    return value;
+	}
     }
 
     f18_init_transfer(&dp->chan, F18_CHAN_READ, dirs, 0, 0);
@@ -395,18 +566,17 @@ uint18_t f18_read_ioreg(node_t* np, uint18_t ioreg)
 	    continue;
 	if ((rp = dp->neighbour[dir]) == NULL)
 	    continue;
-	if (f18_chan_read(rp, dir, &value)) {
-	    f18_complete_transfer(&dp->chan, F18_CHAN_READ);
+	if (f18_chan_complete_read(&dp->chan, rp, dir, &value)) {
+	    DBG_COUNT(dp->debug.act.rd[dir]);
 	    return value;
 	}
     }
 
-    dp->debug.blocked_addr = ioreg;
-    dp->debug.blocked_dir = 0;  // read
+    debug_publish_blocked(dp, ioreg, 0);  // read
     value = f18_wait_transfer(&dp->chan, F18_CHAN_READ);
-    dp->debug.blocked_addr = 0;
+    debug_publish_blocked(dp, 0, 0);
 
-    if (np->flags & FLAG_TERMINATE)
+    if (np->flags & (FLAG_TERMINATE|FLAG_RELOAD))
 	return 0;
     return value;
 }
@@ -27,7 +27,9 @@ typedef struct {
     int      completed; // transfer completed flag
     int      io;        // =0 when no "gpio" CHAN_READ/CHAN_WRITE 
     int      wait;      // 1 when in cond_wait
+    int      blocked;   // counted as blocked, the completer clears it
     int      terminate; // 1 when time to terminate user thread
+    int      interrupt; // 1 when a blocked node must give up its transfer
 } chan_t;
 
 // Initialize channel
@@ -36,6 +38,9 @@ extern void f18_chan_init(chan_t* chan);
 // Signal channel to terminate
 extern void f18_chan_terminate(chan_t* chan);
 
+// Make a node blocked in a transfer withdraw it (node reload)
+extern void f18_chan_interrupt(chan_t* chan);
+
 // Signal "gpio" on edge node 
 extern void f18_chan_wakeup(chan_t* chan, f18_chan_mode_t rw);
 
@@ -47,6 +52,15 @@ extern int f18_chan_write(chan_t* chan, uint18_t dir, uint18_t value);
 // Returns 1 if successful, 0 if no writer waiting
 extern int f18_chan_read(chan_t* chan, uint18_t dir, uint18_t* value_ptr);
 
+// Phase 2, after f18_init_transfer on own: complete the transfer with
+// a partner waiting on chan, both channels locked so the partner can
+// not complete own at the same time. Returns 1 when own is done (also
+// when the partner already completed it), 0 to go on waiting.
+extern int f18_chan_complete_write(chan_t* own, chan_t* chan, uint18_t dir,
+				   uint18_t value);
+extern int f18_chan_complete_read(chan_t* own, chan_t* chan, uint18_t dir,
+				  uint18_t* value_ptr);
+
 // Initialize transfer state
 extern void f18_init_transfer(chan_t* chan, int rw,
 			      uint18_t rdirs, uint18_t wdirs,
@@ -58,4 +72,14 @@ extern void f18_complete_transfer(chan_t* chan, f18_chan_mode_t rw);
 // Wait for transfer to complete (blocking)
 extern uint18_t f18_wait_transfer(chan_t* chan, f18_chan_mode_t rw);
 
+// Wait for transfer to complete, or give up after timeout_us
+// Returns 1 if completed (read value in *value_ptr), 0 on timeout
+// (the transfer is withdrawn) or terminate
+extern int f18_wait_transfer_timeout(chan_t* chan, f18_chan_mode_t rw,
+				     long timeout_us, uint18_t* value_ptr);
+
+// Wait for the epoll thread to signal io (after f18_epoll_select)
+// Returns the signalled mode or F18_CHAN_NONE on terminate
+extern f18_chan_mode_t f18_wait_io(chan_t* chan);
+
 #endif
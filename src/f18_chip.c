@@ -0,0 +1,423 @@
+//
+// Chip setup, node arena, neighbour links and program loading
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <memory.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "f18.h"
+#include "f18_asm.h"
+#include "f18_node.h"
+#include "f18_image.h"
+#include "f18_async.h"
+#include "f18_serdes.h"
+#include "f18_chip.h"
+
+#define PAGE(x)     ((((x)+g_page_size-1)/g_page_size)*g_page_size)
+#define NODE_SIZE   sizeof(reg_node_t)
+
+node_t* node[GRID_ROWS][GRID_COLS];
+uint18_t g_flags = 0;
+FILE* logout = NULL;
+char g_pty_name[256] = "";  // PTY name for TUI display
+
+const int f18_drow[4] = { [UP]=1, [LEFT]=0, [DOWN]=-1, [RIGHT]=0 };
+const int f18_dcol[4] = { [UP]=0, [LEFT]=-1, [DOWN]=0, [RIGHT]=1 };
+
+static size_t g_page_size = 0;
+static uint8_t* chip_mem = NULL;       // node arena, a page per node
+static uint8_t* chip_template = NULL;  // arena copy made by f18_chip_save
+static size_t chip_size = 0;
+
+// System thread state tracking (atomics for counters, mutex/cond for wait)
+static _Atomic int num_active = 0;
+static _Atomic int num_blocked_port = 0;
+static _Atomic int num_blocked_ext = 0;
+static _Atomic int num_terminated = 0;
+static _Atomic int deadlock = 0;
+static _Atomic int stopped = 0;
+static pthread_mutex_t sys_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sys_cond = PTHREAD_COND_INITIALIZER;
+
+static void check_done(void)
+{
+    if (num_active == 0 && num_blocked_ext == 0) {
+	pthread_mutex_lock(&sys_lock);
+	pthread_cond_signal(&sys_cond);
+	pthread_mutex_unlock(&sys_lock);
+    }
+}
+
+// Set num_active before creating threads to avoid race where main
+// thread checks the termination condition before threads have started
+void sys_add_active(int n)
+{
+    num_active += n;
+}
+
+void sys_thread_started(void)
+{
+    // num_active is pre-set in main() before thread creation
+}
+
+void sys_thread_terminated(void)
+{
+    num_active--;
+    num_terminated++;
+    check_done();
+}
+
+void sys_enter_blocked_port(void)
+{
+    num_blocked_port++;
+    num_active--;
+    check_done();
+}
+
+void sys_leave_blocked_port(void)
+{
+    num_active++;
+    num_blocked_port--;
+}
+
+void sys_enter_blocked_ext(void)
+{
+    num_blocked_ext++;
+    num_active--;
+}
+
+void sys_leave_blocked_ext(void)
+{
+    num_active++;
+    num_blocked_ext--;
+    check_done();
+}
+
+// Called by the watchdog, stops the emulator with F18_EXIT_DEADLOCK
+void sys_deadlock(void)
+{
+    pthread_mutex_lock(&sys_lock);
+    deadlock = 1;
+    pthread_cond_signal(&sys_cond);
+    pthread_mutex_unlock(&sys_lock);
+}
+
+// Stop waiting as if the run was done (SIGINT/SIGTERM)
+void sys_stop(void)
+{
+    pthread_mutex_lock(&sys_lock);
+    stopped = 1;
+    pthread_cond_signal(&sys_cond);
+    pthread_mutex_unlock(&sys_lock);
+}
+
+int sys_wait_done(void)
+{
+    pthread_mutex_lock(&sys_lock);
+    while ((num_active > 0 || num_blocked_ext > 0) && !deadlock && !stopped)
+	pthread_cond_wait(&sys_cond, &sys_lock);
+    pthread_mutex_unlock(&sys_lock);
+    return deadlock;
+}
+
+int f18_chip_alloc(void)
+{
+    void* node_mem;
+    uint8_t* np_mem;
+    size_t alloc_size;
+    int i, j;
+
+    g_page_size = sysconf(_SC_PAGESIZE);
+    alloc_size = GRID_ROWS*GRID_COLS*(PAGE(NODE_SIZE));
+    if (g_flags & FLAG_VERBOSE) {
+	fprintf(stderr, "page size %ld\n", g_page_size);
+	fprintf(stderr, "alloc size: %ld\n", alloc_size);
+	fprintf(stderr, "node size: %ld bytes\n", PAGE(NODE_SIZE));
+	fprintf(stderr, "sizeof(node_t): %lu\n", sizeof(node_t));
+	fprintf(stderr, "sizeof(reg_node_t): %lu\n", sizeof(reg_node_t));
+    }
+
+    if (posix_memalign(&node_mem, g_page_size, alloc_size))
+	return -1;
+    chip_mem = node_mem;
+    chip_size = alloc_size;
+
+    voc_index_init();
+
+    // reset global node connection 8x18 array pointers!
+    memset(node, 0, sizeof(node));
+
+    // start moving memory into the node data
+    np_mem = (uint8_t*) node_mem;
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* np;
+	    f18_rom_type_t rt;
+	    int node_id = MAKE_ID(i,j);
+
+	    // each thread structure is allocated in one page
+	    memset(np_mem, 0, PAGE(NODE_SIZE));
+
+	    np = (reg_node_t*) np_mem;
+	    np_mem += (PAGE(NODE_SIZE));
+	    node[i][j] = (node_t*) np;
+	    rt = RomTypeMap[i][j];
+	    np->n.rom_type = rt;
+	    np->n.rom = RomMap[rt].addr;
+	    np->n.id = node_id;
+
+	    np->dmask = 0;
+	    np->imask = 0;
+
+	    f18_chan_init(&np->chan);
+
+	    np->neighbour[0] = NULL;
+	    np->neighbour[1] = NULL;
+	    np->neighbour[2] = NULL;
+	    np->neighbour[3] = NULL;
+	    np->ioc = NULL;
+
+	    np->n.ior    = IMASK;  // default read value
+	    np->n.iow    = 0;      // write cache
+	    np->n.wins   = INS_NOP;  // not in a port access
+
+	    np->n.reg.p = ConfigMap[i][j].reset;
+	    np->n.io_addr = ConfigMap[i][j].io_addr;
+	    np->dmask = dirbits(i,j,ConfigMap[i][j].comm);
+	    np->imask = (ConfigMap[i][j].io_addr ?
+			 dirbits(i,j,ConfigMap[i][j].io_addr) : 0);
+
+	    np->n.reg.b = IOREG_IO;
+	    np->n.read_ioreg  = f18_read_ioreg;
+	    np->n.write_ioreg = f18_write_ioreg;
+	}
+    }
+    return 0;
+}
+
+void f18_chip_link(void)
+{
+    int i, j;
+
+    for (i=0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* np = (reg_node_t*) node[i][j];
+
+	    if (i < GRID_ROWS-1)
+		np->neighbour[UP] = &((reg_node_t*)node[i+1][j])->chan;
+	    if (i > 0)
+		np->neighbour[DOWN] = &((reg_node_t*)node[i-1][j])->chan;
+	    if (j > 0)
+		np->neighbour[LEFT] = &((reg_node_t*)node[i][j-1])->chan;
+	    if (j < GRID_COLS-1)
+		np->neighbour[RIGHT] = &((reg_node_t*)node[i][j+1])->chan;
+	}
+    }
+}
+
+int f18_chip_attach(uint18_t id, int dir, chan_t* cp)
+{
+    int i = ID_TO_ROW(id);
+    int j = ID_TO_COLUMN(id);
+    int fi, fj;
+    reg_node_t* np;
+
+    if ((i >= GRID_ROWS) || (j >= GRID_COLS) || (dir < 0) || (dir > 3))
+	return -1;
+    np = (reg_node_t*) node[i][j];
+    fi = i + f18_drow[dir];
+    fj = j + f18_dcol[dir];
+    // the far node would otherwise still see (and take) our port words
+    if ((fi >= 0) && (fi < GRID_ROWS) && (fj >= 0) && (fj < GRID_COLS)) {
+	reg_node_t* fp = (reg_node_t*) node[fi][fj];
+	if (fp->neighbour[dir ^ 2] == &np->chan)  // inverse direction
+	    fp->neighbour[dir ^ 2] = NULL;
+    }
+    np->neighbour[dir] = cp;
+    np->dmask |= DIR_BIT(dir);
+    return 0;
+}
+
+static void* f18_emu_start(void *arg)
+{
+    node_t* np = (node_t*) arg;
+
+    sys_thread_started();
+    VERBOSE(np, "node started%s\n", "");
+    f18_emu(np);
+    VERBOSE(np, "node stopped%s\n", "");
+    // FIXME: cleanup neighbours etc ... possible? needed?
+    sys_thread_terminated();
+    return NULL;
+}
+
+int f18_chip_start(size_t stack_size)
+{
+    int i, j;
+
+    // Count threads in before creating them to avoid race where main
+    // thread checks the termination condition before threads have started
+    sys_add_active(GRID_ROWS * GRID_COLS);
+
+    for (i=0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* np = (reg_node_t*) node[i][j];
+
+	    pthread_attr_init(&np->attr);
+	    pthread_attr_setstacksize(&np->attr, stack_size);
+	    VERBOSE(np, "about to start node%s\n", "");
+	    if (pthread_create(&np->thread,&np->attr,f18_emu_start,(void*) np) <0)
+		return -1;
+	}
+    }
+    return 0;
+}
+
+void f18_chip_stop(void)
+{
+    int i, j;
+
+    // Signal all nodes to terminate and wake blocked threads
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* np = (reg_node_t*) node[i][j];
+
+	    np->n.flags |= FLAG_TERMINATE;  // emulator loop
+	    f18_chan_terminate(&np->chan);  // signal termination
+	}
+    }
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    pthread_join(((reg_node_t*)node[i][j])->thread, NULL);
+}
+
+void f18_chip_free(void)
+{
+    int i, j;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* np = (reg_node_t*) node[i][j];
+	    pthread_mutex_destroy(&np->chan.lock);
+	    pthread_cond_destroy(&np->chan.cond);
+	}
+    }
+    free(chip_template);
+    free(chip_mem);
+    chip_template = chip_mem = NULL;
+    chip_size = 0;
+    memset(node, 0, sizeof(node));
+}
+
+int f18_chip_save(void)
+{
+    if ((chip_template == NULL) &&
+	posix_memalign((void**)&chip_template, g_page_size, chip_size))
+	return -1;
+    memcpy(chip_template, chip_mem, chip_size);
+    return 0;
+}
+
+// Copy node_t and the channel state of each node back from the
+// template, the neighbour wiring has not changed since the save
+void f18_chip_reset(void)
+{
+    size_t page = PAGE(NODE_SIZE);
+    size_t chan_state = offsetof(chan_t, wmask);
+    size_t off;
+
+    for (off = 0; off < chip_size; off += page) {
+	reg_node_t* np = (reg_node_t*) (chip_mem + off);
+	reg_node_t* tp = (reg_node_t*) (chip_template + off);
+	f18_symbol_table_t* symtab = np->n.symtab;
+
+	memcpy(&np->n, &tp->n, sizeof(node_t));
+	np->n.symtab = symtab;
+	memcpy((uint8_t*)&np->chan + chan_state,
+	       (uint8_t*)&tp->chan + chan_state, sizeof(chan_t) - chan_state);
+	if (np->n.rom_type == serdes_boot)
+	    ((serdes_node_t*)np)->transmitting = 0;
+    }
+    async_reader_reset(&r708);
+    async_writer_reset(&w708);
+}
+
+int f18_chip_load(int fd, const char* filename,
+		  int loaded[GRID_ROWS][GRID_COLS])
+{
+    uint18_t nid = 0xfff;
+    uint18_t addr = 0;
+    node_t* np = NULL;
+    f18_symbol_table_t symtab;
+    uint8_t heap[MAX_SCAN_HEAP_SIZE];
+    f18_asm_src_t src;
+    symindex_t si;
+    f18_voc_t voc;
+    int r;
+
+    memset(loaded, 0, sizeof(int)*GRID_ROWS*GRID_COLS);
+    if (f18_image_check(fd))
+	return f18_image_load(fd, node, loaded);
+
+    // temporary symbol table memory used while loading node
+    INIT_SYMTAB(&symtab, heap, MAX_SCAN_HEAP_SIZE);
+    voc_setup(voc, &symtab, &no_symbols);
+
+    f18_asm_open(&src, fd);
+    while((r = f18_asm_line(&src, &addr, &nid, np->ram, voc)) >= 0) {
+	switch(r) {
+	case META_NODE:
+	    // fixme: multiple switch to same node !
+	    if (np != NULL) { // find main in symtab
+		if ((si = sym_find_by_name("main", &symtab)) != NOSYM)
+		    np->reg.p = symtab.symbol[si].value;
+		// printf("set p = %03x\n", np->reg.p);
+		np->symtab = sym_copy_table(&symtab);
+	    }
+	    // reinitialize
+	    INIT_SYMTAB(&symtab, heap, MAX_SCAN_HEAP_SIZE);
+	    np = node[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)];
+	    if (!loaded[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)])
+		loaded[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)] = 1; // size+1
+	    voc_setup(voc, &symtab,
+		      SymTabMap[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)]);
+	    addr = 0;
+	    break;
+	case META_ORG:
+	    // printf("load: set org=%03x\n", addr);
+	    break;
+	default:
+	    // printf("load: %03d ram[%03x]=%06x\n", nid, addr, data);
+	    addr++;
+	    if ((np != NULL) && (addr <= 64) &&
+		(loaded[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)] < addr+1))
+		loaded[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)] = addr+1;
+	}
+    }
+    if (r < 0) {
+	switch(r) {
+	case -1:
+	    fprintf(stderr, "%s:%d: syntax error: %.*s\n",
+		    filename, src.line, (int)src.llen, src.lptr);
+	    break;
+	case -2:
+	case -3:
+	    break;
+	}
+    }
+    if (np != NULL) { // find main in symtab
+	if ((si = sym_find_by_name("main", &symtab)) != NOSYM) {
+	    np->reg.p = symtab.symbol[si].value;
+	    // printf("set p = %03x\n", np->reg.p);
+	}
+	np->symtab = sym_copy_table(&symtab);
+    }
+    f18_asm_close(&src);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef __F18_CHIP_H__
+#define __F18_CHIP_H__
+
+//
+// Chip setup shared by the emulator and the tools linking its core
+//
+// The nodes live in one arena, a page per node, in row order. The
+// arena is configured from ConfigMap and the node channels linked to
+// their grid neighbours. Special io (708 async, SERDES) is left to the
+// caller. The public interface on top of this is f18_lib.h.
+//
+
+#include <stddef.h>
+#include "f18.h"
+#include "f18_channel.h"
+
+extern node_t* node[GRID_ROWS][GRID_COLS];
+extern char g_pty_name[256];  // 708 async pty, see f18_attach_async
+
+// Row and column step of each port direction (UP, LEFT, DOWN, RIGHT)
+extern const int f18_drow[4];
+extern const int f18_dcol[4];
+
+// Allocate and initialise the node arena, returns -1 on failure
+extern int f18_chip_alloc(void);
+
+// Link neighbour channels inside the grid (708 up port is not linked)
+extern void f18_chip_link(void);
+
+// Connect cp (NULL for none) to edge port dir of node id in place of
+// the grid neighbour, the grid neighbour is unlinked from the node and
+// dir is added to the node's port directions. Returns -1 for a bad id.
+extern int f18_chip_attach(uint18_t id, int dir, chan_t* cp);
+
+// Load a .f18 source or .f18b image from fd into the nodes, sets
+// loaded[i][j] to size+1 for loaded nodes. Returns -1 on a bad image.
+extern int f18_chip_load(int fd, const char* filename,
+			 int loaded[GRID_ROWS][GRID_COLS]);
+
+// Start a thread per node running f18_emu, returns -1 on failure
+extern int f18_chip_start(size_t stack_size);
+
+// Terminate the node threads and join them
+extern void f18_chip_stop(void);
+
+// Release the node arena and the template (symbol tables are kept)
+extern void f18_chip_free(void);
+
+// Save the node arena as the template for f18_chip_reset (after load)
+extern int f18_chip_save(void);
+
+// Restore registers, ram, stacks, ior/iow, channel state, the 708
+// reader and writer state and SERDES transmit state from the template. Threads, sockets, symbol
+// tables and debugger state are left alone, call it with nodes stopped.
+extern void f18_chip_reset(void);
+
+// System thread state, count threads in before they are started
+extern void sys_add_active(int n);
+// Wait until no thread is active or waiting on external io, 1 on deadlock
+extern int sys_wait_done(void);
+// End sys_wait_done with the threads still running
+extern void sys_stop(void);
+
+#endif
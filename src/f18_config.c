@@ -159,13 +159,13 @@
 const f18_config_t ConfigMap[8][18] =
 {
     
-    /* 000 */ { N000, N001, N002, N003, N004, N005, N006, N006, N008, N009, N010, N011, N012, N013, N014, N015, N016, N017 },
-    /* 100 */ { N100, N101, N102, N103, N104, N105, N106, N106, N108, N109, N110, N111, N112, N113, N114, N115, N116, N117 },    
-    /* 200 */ { N200, N201, N202, N203, N204, N205, N206, N206, N208, N209, N210, N211, N212, N213, N214, N215, N216, N217 },
-    /* 300 */ { N300, N301, N302, N303, N304, N305, N306, N306, N308, N309, N310, N311, N312, N313, N314, N315, N316, N317 },
-    /* 400 */ { N400, N401, N402, N403, N404, N405, N406, N406, N408, N409, N410, N411, N412, N413, N414, N415, N416, N417 },
-    /* 500 */ { N500, N501, N502, N503, N504, N505, N506, N506, N508, N509, N510, N511, N512, N513, N514, N515, N516, N517 },
-    /* 600 */ { N600, N601, N602, N603, N604, N605, N606, N606, N608, N609, N610, N611, N612, N613, N614, N615, N616, N617 },
-    /* 700 */ { N700, N701, N702, N703, N704, N705, N706, N706, N708, N709, N710, N711, N712, N713, N714, N715, N716, N717 },
+    /* 000 */ { N000, N001, N002, N003, N004, N005, N006, N007, N008, N009, N010, N011, N012, N013, N014, N015, N016, N017 },
+    /* 100 */ { N100, N101, N102, N103, N104, N105, N106, N107, N108, N109, N110, N111, N112, N113, N114, N115, N116, N117 },    
+    /* 200 */ { N200, N201, N202, N203, N204, N205, N206, N207, N208, N209, N210, N211, N212, N213, N214, N215, N216, N217 },
+    /* 300 */ { N300, N301, N302, N303, N304, N305, N306, N307, N308, N309, N310, N311, N312, N313, N314, N315, N316, N317 },
+    /* 400 */ { N400, N401, N402, N403, N404, N405, N406, N407, N408, N409, N410, N411, N412, N413, N414, N415, N416, N417 },
+    /* 500 */ { N500, N501, N502, N503, N504, N505, N506, N507, N508, N509, N510, N511, N512, N513, N514, N515, N516, N517 },
+    /* 600 */ { N600, N601, N602, N603, N604, N605, N606, N607, N608, N609, N610, N611, N612, N613, N614, N615, N616, N617 },
+    /* 700 */ { N700, N701, N702, N703, N704, N705, N706, N707, N708, N709, N710, N711, N712, N713, N714, N715, N716, N717 },
 };
 
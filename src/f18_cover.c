@@ -0,0 +1,273 @@
+//
+// Execution coverage write, merge and report
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <memory.h>
+#include <errno.h>
+
+#include "f18.h"
+#include "f18_sym.h"
+#include "f18_voc.h"
+#include "f18_dis.h"
+#include "f18_cover.h"
+
+static int write_all(int fd, const void* buf, size_t len)
+{
+    const uint8_t* ptr = buf;
+
+    while (len > 0) {
+	ssize_t n = write(fd, ptr, len);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	ptr += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static int write_file(const char* filename,
+		      const uint18_t ram[GRID_ROWS][GRID_COLS][64],
+		      const uint8_t cover[GRID_ROWS][GRID_COLS][COVER_WORDS])
+{
+    f18_cover_header_t hdr;
+    f18_cover_node_t rec;
+    int i, j, k, fd;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, F18_COVER_MAGIC, sizeof(hdr.magic));
+    hdr.version = F18_COVER_VERSION;
+    hdr.nnodes = GRID_ROWS*GRID_COLS;
+
+    if ((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+	return -1;
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0)
+	goto error;
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    memset(&rec, 0, sizeof(rec));
+	    rec.id = MAKE_ID(i,j);
+	    for (k = 0; k < 64; k++)
+		rec.ram[k] = ram[i][j][k];
+	    memcpy(rec.cover, cover[i][j], COVER_WORDS);
+	    if (write_all(fd, &rec, sizeof(rec)) < 0)
+		goto error;
+	}
+    }
+    return close(fd);
+error:
+    close(fd);
+    return -1;
+}
+
+int f18_cover_write(const char* filename, node_t* nodes[GRID_ROWS][GRID_COLS])
+{
+    static uint18_t ram[GRID_ROWS][GRID_COLS][64];
+    static uint8_t cover[GRID_ROWS][GRID_COLS][COVER_WORDS];
+    int i, j;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    memcpy(ram[i][j], nodes[i][j]->ram, sizeof(ram[i][j]));
+	    memcpy(cover[i][j], nodes[i][j]->cover, COVER_WORDS);
+	}
+    }
+    return write_file(filename, ram, cover);
+}
+
+int f18_cover_write_merged(const char* filename, const f18_cover_t* cp)
+{
+    return write_file(filename, cp->ram, cp->cover);
+}
+
+int f18_cover_read(const char* filename, f18_cover_t* cp)
+{
+    f18_cover_header_t hdr;
+    f18_cover_node_t rec;
+    uint32_t n;
+    int fd, k, s;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+	return -1;
+    if ((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+	(memcmp(hdr.magic, F18_COVER_MAGIC, sizeof(hdr.magic)) != 0) ||
+	(hdr.version != F18_COVER_VERSION) ||
+	(hdr.nnodes > GRID_ROWS*GRID_COLS))
+	goto bad;
+    for (n = 0; n < hdr.nnodes; n++) {
+	int i, j;
+
+	if (read(fd, &rec, sizeof(rec)) != sizeof(rec))
+	    goto bad;
+	i = ID_TO_ROW(rec.id);
+	j = ID_TO_COLUMN(rec.id);
+	if ((i >= GRID_ROWS) || (j >= GRID_COLS))
+	    goto bad;
+	if (cp->nfiles == 0) {  // listing shows the ram of the first file
+	    for (k = 0; k < 64; k++)
+		cp->ram[i][j][k] = rec.ram[k] & MASK18;
+	}
+	for (k = 0; k < COVER_WORDS; k++) {
+	    cp->cover[i][j][k] |= rec.cover[k];
+	    for (s = 0; s < 4; s++)
+		if (rec.cover[k] & (1 << s))
+		    cp->hits[i][j][k][s]++;
+	}
+    }
+    cp->nfiles++;
+    close(fd);
+    return 0;
+bad:
+    close(fd);
+    errno = EINVAL;
+    return -1;
+}
+
+// number of slots in the (decoded) instruction word I
+static int num_slots(uint18_t I)
+{
+    int slot;
+
+    for (slot = 0; slot < 3; slot++) {
+	uint5_t ins = (((I << 2) << slot*5) >> 15) & 0x1f;
+	if (is_last_uinst(ins))
+	    break;
+    }
+    return slot+1;
+}
+
+// @p literals following I, counted as f18_disasm_instruction does
+static int num_literals(uint18_t I)
+{
+    int slot, np = 0;
+
+    for (slot = 0; slot < 4; slot++) {
+	uint5_t ins = (((I << 2) << slot*5) >> 15) & 0x1f;
+	if (ins == INS_FETCH_P)
+	    np++;
+	if (is_last_uinst(ins))
+	    return 0;
+    }
+    return np;
+}
+
+// f18_disasm listing with the hit count of each slot in front
+static void report_words(FILE* fout, const uint18_t* insp,
+			 const uint8_t* cover, const uint16_t (*hits)[4],
+			 f18_voc_t voc, uint18_t addr, size_t n)
+{
+    int np = 0;
+
+    while(n--) {
+	char ins_buf[32];
+	char hit_buf[16];
+	uint32_t val0 = *insp++;
+	uint32_t val = val0 ^ IMASK;
+	symindex_t si;
+	int s, ns;
+
+	if (np > 0) {
+	    fprintf(fout, "%12s %03x: %05x: %05x\n", "", addr, val, val0);
+	    np--;
+	}
+	else {
+	    np = f18_disasm_instruction(addr+1, val, voc,
+					ins_buf, sizeof(ins_buf));
+	    ns = num_slots(val);
+	    for (s = 0; s < 4; s++) {
+		if (s >= ns)
+		    strcpy(hit_buf+3*s, "   ");
+		else if (cover[0] & (1 << s))
+		    sprintf(hit_buf+3*s, "%3d", (*hits)[s]);
+		else
+		    strcpy(hit_buf+3*s, "  -");
+	    }
+	    if ((si = voc_find_by_addr(addr, voc)) != NOSYM)
+		fprintf(fout, "%s:\n", VOC_SYMNAM(voc,si));
+	    fprintf(fout, "%s %03x: %05x: %s\n", hit_buf, addr, val, ins_buf);
+	}
+	cover++;
+	hits++;
+	addr++;
+    }
+}
+
+// words and slots hit, of instruction words (literals skipped)
+static void count_hits(const uint18_t* insp, const uint8_t* cover, size_t n,
+		       int* words, int* slots)
+{
+    int np = 0;
+
+    *words = *slots = 0;
+    while(n--) {
+	uint32_t val = *insp++ ^ IMASK;
+	int s;
+
+	if (np > 0)
+	    np--;
+	else {
+	    np = num_literals(val);
+	    for (s = 0; s < num_slots(val); s++)
+		if (*cover & (1 << s))
+		    (*slots)++;
+	    if (*cover)
+		(*words)++;
+	}
+	cover++;
+    }
+}
+
+static void report_node(FILE* fout, const f18_cover_t* cp,
+			node_t* nodes[GRID_ROWS][GRID_COLS],
+			int i, int j, int rom)
+{
+    node_t* np = nodes[i][j];
+    size_t rom_size = RomMap[np->rom_type].size;
+    f18_voc_t voc;
+    int words, slots;
+    int k, n = 0;
+
+    for (k = 0; k < 64; k++)
+	if (cp->ram[i][j][k] || cp->cover[i][j][k])
+	    n = k+1;
+    voc_setup(voc, np->symtab, SymTabMap[i][j]);
+
+    count_hits(cp->ram[i][j], cp->cover[i][j], n, &words, &slots);
+    fprintf(fout, "node %03d ram: %d words, %d slots hit (%d file%s)\n",
+	    np->id, words, slots, cp->nfiles, (cp->nfiles == 1) ? "" : "s");
+    report_words(fout, cp->ram[i][j], cp->cover[i][j], cp->hits[i][j],
+		 voc, RAM_START, n);
+    if (rom && (np->rom != NULL)) {
+	count_hits(np->rom, cp->cover[i][j]+64, rom_size, &words, &slots);
+	fprintf(fout, "node %03d rom %s: %d words, %d slots hit\n",
+		np->id, RomMap[np->rom_type].name, words, slots);
+	report_words(fout, np->rom, cp->cover[i][j]+64, cp->hits[i][j]+64,
+		     voc, ROM_START, rom_size);
+    }
+}
+
+void f18_cover_report(FILE* fout, const f18_cover_t* cp,
+		      node_t* nodes[GRID_ROWS][GRID_COLS],
+		      uint18_t id, int rom)
+{
+    int i, j, k;
+
+    if (id != 999) {
+	report_node(fout, cp, nodes, ID_TO_ROW(id), ID_TO_COLUMN(id), rom);
+	return;
+    }
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    for (k = 0; (k < 64) && (cp->cover[i][j][k] == 0); k++)
+		;
+	    if (k < 64)
+		report_node(fout, cp, nodes, i, j, rom);
+	}
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef __F18_COVER_H__
+#define __F18_COVER_H__
+
+//
+// Execution coverage file (.f18c)
+//
+// Host byte order:
+//
+//   header:  "F18C" version nnodes 0               (32 bit)
+//   node:    id ram[64] (32 bit) cover[128] (8 bit) (nnodes times)
+//
+// cover[k] holds the slots executed in RAM word k (0-63) and ROM word
+// k-64, ram is the node RAM at exit. Files are merged by or'ing cover
+// per node, a report counts the files that hit each slot.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include "f18.h"
+
+#define F18_COVER_MAGIC   "F18C"
+#define F18_COVER_VERSION 1
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t nnodes;
+    uint32_t reserved;
+} f18_cover_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t ram[64];
+    uint8_t  cover[COVER_WORDS];
+} f18_cover_node_t;
+
+// Coverage of a set of runs
+typedef struct {
+    int      nfiles;
+    uint18_t ram[GRID_ROWS][GRID_COLS][64];
+    uint8_t  cover[GRID_ROWS][GRID_COLS][COVER_WORDS];    // or of all
+    uint16_t hits[GRID_ROWS][GRID_COLS][COVER_WORDS][4];  // files per slot
+} f18_cover_t;
+
+// Write the coverage of all nodes to filename
+extern int f18_cover_write(const char* filename,
+			   node_t* nodes[GRID_ROWS][GRID_COLS]);
+
+// Write merged coverage to filename
+extern int f18_cover_write_merged(const char* filename,
+				  const f18_cover_t* cp);
+
+// Read filename and merge it into cp (zeroed before the first file)
+extern int f18_cover_read(const char* filename, f18_cover_t* cp);
+
+// Disassembly listing annotated with hits per slot for node id (or
+// all nodes with ram hits for 999), rom adds the ROM listing
+extern void f18_cover_report(FILE* fout, const f18_cover_t* cp,
+			     node_t* nodes[GRID_ROWS][GRID_COLS],
+			     uint18_t id, int rom);
+
+#endif
@@ -0,0 +1,831 @@
+//
+// Control socket, hot code reload of single nodes
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <memory.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "f18.h"
+#include "f18_asm.h"
+#include "f18_node.h"
+#include "f18_image.h"
+#include "f18_ctl.h"
+
+#define CTL_LINE_SIZE 1024
+
+extern node_t* node[GRID_ROWS][GRID_COLS];
+
+typedef struct {
+    uint18_t ram[64];
+    f18_symbol_table_t* symtab;
+    uint18_t p;
+    int done;
+} ctl_reload_t;
+
+// reload handed to a node, protected by ctl_lock
+static ctl_reload_t* ctl_pending[GRID_ROWS][GRID_COLS];
+static pthread_mutex_t ctl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  ctl_cond = PTHREAD_COND_INITIALIZER;
+static char ctl_path[sizeof(((struct sockaddr_un*)0)->sun_path)];
+static int ctl_stop_fd[2] = { -1, -1 };  // f18_ctl_stop wakes the thread
+
+int f18_ctl_open(const char* path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+	errno = ENAMETOOLONG;
+	return -1;
+    }
+    // only remove a stale socket, never a regular file
+    if ((stat(path, &st) == 0) && S_ISSOCK(st.st_mode))
+	unlink(path);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) ||
+	(listen(fd, 1) < 0)) {
+	int err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+    }
+    // a socket pair, the stop may come after the thread left on quit
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, ctl_stop_fd) < 0) {
+	int err = errno;
+	close(fd);
+	unlink(path);
+	errno = err;
+	return -1;
+    }
+    strcpy(ctl_path, path);
+    return fd;
+}
+
+void f18_ctl_stop(void)
+{
+    char c = 0;
+
+    if (ctl_stop_fd[1] >= 0)
+	(void) send(ctl_stop_fd[1], &c, 1, MSG_NOSIGNAL);
+}
+
+// Wait until fd is readable, returns 0 when the thread is stopped
+static int ctl_poll(int fd)
+{
+    struct pollfd fds[2];
+
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = ctl_stop_fd[0];
+    fds[1].events = POLLIN;
+    while (1) {
+	if (poll(fds, 2, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return 0;
+	}
+	if (fds[1].revents)
+	    return 0;
+	if (fds[0].revents)
+	    return 1;
+    }
+}
+
+// Node thread side, registers are swapped out
+void f18_ctl_reload(node_t* np)
+{
+    reg_node_t* dp = (reg_node_t*) np;
+    ctl_reload_t* rp;
+    int i = ID_TO_ROW(np->id);
+    int j = ID_TO_COLUMN(np->id);
+
+    pthread_mutex_lock(&ctl_lock);
+    if ((rp = ctl_pending[i][j]) != NULL) {
+	memcpy(np->ram, rp->ram, sizeof(np->ram));
+	memset(np->cover, 0, 64);  // ram coverage was for the old code
+	// old table is not freed, the debugger may still look at it
+	np->symtab = rp->symtab;
+	np->reg.p = rp->p;
+	ctl_pending[i][j] = NULL;
+	rp->done = 1;
+	pthread_cond_broadcast(&ctl_cond);
+    }
+    __atomic_and_fetch(&np->flags, ~FLAG_RELOAD, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&dp->chan.lock);
+    dp->chan.interrupt = 0;
+    pthread_mutex_unlock(&dp->chan.lock);
+    pthread_mutex_unlock(&ctl_lock);
+}
+
+// Hand rp to node id and wait until the node has picked it up
+static int reload_node(uint18_t id, ctl_reload_t* rp)
+{
+    int i = ID_TO_ROW(id);
+    int j = ID_TO_COLUMN(id);
+    reg_node_t* dp = (reg_node_t*) node[i][j];
+    struct timespec ts;
+    int r = 0;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += CTL_RELOAD_TIMEOUT_MS / 1000;
+    ts.tv_nsec += (CTL_RELOAD_TIMEOUT_MS % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&ctl_lock);
+    rp->done = 0;
+    ctl_pending[i][j] = rp;
+    __atomic_or_fetch(&dp->n.flags, FLAG_RELOAD, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&ctl_lock);
+
+    // wake the node if it sits in a port transfer
+    f18_chan_interrupt(&dp->chan);
+
+    pthread_mutex_lock(&ctl_lock);
+    while (!rp->done) {
+	if (pthread_cond_timedwait(&ctl_cond, &ctl_lock, &ts) == ETIMEDOUT)
+	    break;
+    }
+    if (!rp->done) {  // stopped or held by the debugger, withdraw
+	ctl_pending[i][j] = NULL;
+	__atomic_and_fetch(&dp->n.flags, ~FLAG_RELOAD, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&dp->chan.lock);
+	dp->chan.interrupt = 0;
+	pthread_mutex_unlock(&dp->chan.lock);
+	r = -1;
+    }
+    pthread_mutex_unlock(&ctl_lock);
+    return r;
+}
+
+// Assemble source from fd, keep only the code for node id
+static int load_source(int fd, uint18_t id, ctl_reload_t* rp)
+{
+    uint18_t nid = 0xfff;
+    uint18_t cur = 0xfff;
+    uint18_t addr = 0;
+    uint18_t scratch[64];
+    f18_symbol_table_t symtab;
+    uint8_t heap[MAX_SCAN_HEAP_SIZE];
+    f18_asm_src_t src;
+    symindex_t si;
+    f18_voc_t voc;
+    int done = 0;
+    int r;
+
+    INIT_SYMTAB(&symtab, heap, MAX_SCAN_HEAP_SIZE);
+    voc_setup(voc, &symtab, &no_symbols);
+
+    f18_asm_open(&src, fd);
+    while(!done && ((r = f18_asm_line(&src, &addr, &nid,
+				       (cur == id) ? rp->ram : scratch,
+				       voc)) >= 0)) {
+	switch(r) {
+	case META_NODE:
+	    if (cur == id) {  // next node after the one we want
+		done = 1;
+		break;
+	    }
+	    INIT_SYMTAB(&symtab, heap, MAX_SCAN_HEAP_SIZE);
+	    voc_setup(voc, &symtab,
+		      SymTabMap[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)]);
+	    cur = nid;
+	    addr = 0;
+	    break;
+	case META_ORG:
+	    break;
+	default:
+	    addr++;
+	    break;
+	}
+    }
+    f18_asm_close(&src);
+    if ((r == -1) || (cur != id))
+	return -1;
+    rp->p = ConfigMap[ID_TO_ROW(id)][ID_TO_COLUMN(id)].reset;
+    if ((si = sym_find_by_name("main", &symtab)) != NOSYM)
+	rp->p = symtab.symbol[si].value;
+    rp->symtab = sym_copy_table(&symtab);
+    return 0;
+}
+
+// Load a .f18b image into scratch nodes and pick node id
+static int load_image(int fd, uint18_t id, ctl_reload_t* rp)
+{
+    node_t* nodes[GRID_ROWS][GRID_COLS];
+    int loaded[GRID_ROWS][GRID_COLS];
+    node_t* mem;
+    int i, j, k, r = -1;
+
+    if ((mem = calloc(GRID_ROWS*GRID_COLS, sizeof(node_t))) == NULL)
+	return -1;
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    nodes[i][j] = &mem[i*GRID_COLS+j];
+    memset(loaded, 0, sizeof(loaded));
+    i = ID_TO_ROW(id);
+    j = ID_TO_COLUMN(id);
+    if ((f18_image_load(fd, nodes, loaded) == 0) && loaded[i][j]) {
+	memcpy(rp->ram, nodes[i][j]->ram, sizeof(rp->ram));
+	rp->symtab = nodes[i][j]->symtab;
+	rp->p = nodes[i][j]->reg.p;
+	nodes[i][j]->symtab = NULL;
+	r = 0;
+    }
+    for (k = 0; k < GRID_ROWS*GRID_COLS; k++)  // tables of the other nodes
+	sym_free_table(mem[k].symtab);
+    free(mem);
+    return r;
+}
+
+static int reply(int fd, const char* fmt, ...)
+{
+    char buf[2*CTL_LINE_SIZE];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n >= (int) sizeof(buf))
+	n = sizeof(buf)-1;
+    return (write(fd, buf, n) == n) ? 0 : -1;
+}
+
+static int command_load(int fd, char* arg)
+{
+    ctl_reload_t* rp;
+    struct timespec t0, t1;
+    char* file;
+    char* end;
+    unsigned long id;
+    int ffd, r;
+
+    id = strtoul(arg, &end, 10);
+    if ((end == arg) || (*end != ' ') ||
+	(ID_TO_ROW(id) >= GRID_ROWS) || (ID_TO_COLUMN(id) >= GRID_COLS))
+	return reply(fd, "error bad node\n");
+    file = end + 1;
+    if ((ffd = open(file, O_RDONLY)) < 0)
+	return reply(fd, "error %s: %s\n", file, strerror(errno));
+    if ((rp = calloc(1, sizeof(ctl_reload_t))) == NULL) {
+	close(ffd);
+	return reply(fd, "error %s\n", strerror(errno));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (f18_image_check(ffd))
+	r = load_image(ffd, id, rp);
+    else
+	r = load_source(ffd, id, rp);
+    close(ffd);
+    if (r < 0) {
+	free(rp);
+	return reply(fd, "error no code for node %03lu in %s\n", id, file);
+    }
+    if (reload_node(id, rp) < 0) {
+	sym_free_table(rp->symtab);
+	free(rp);
+	return reply(fd, "error node %03lu did not stop\n", id);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    r = reply(fd, "ok %03lu p=%03x %ldus\n", id, rp->p,
+	      (t1.tv_sec - t0.tv_sec)*1000000 +
+	      (t1.tv_nsec - t0.tv_nsec)/1000);
+    free(rp);
+    return r;
+}
+
+//
+// Debug commands, node ids are decimal, addresses and values hex
+//
+
+// Parse a node id, NULL if not a node
+static reg_node_t* parse_node(char** argp)
+{
+    char* end;
+    unsigned long id = strtoul(*argp, &end, 10);
+
+    if ((end == *argp) || (ID_TO_ROW(id) >= GRID_ROWS) ||
+	(ID_TO_COLUMN(id) >= GRID_COLS))
+	return NULL;
+    *argp = end;
+    return (reg_node_t*) node[ID_TO_ROW(id)][ID_TO_COLUMN(id)];
+}
+
+static int parse_hex(char** argp, uint18_t* value)
+{
+    char* end;
+    unsigned long v = strtoul(*argp, &end, 16);
+
+    if (end == *argp)
+	return -1;
+    *argp = end;
+    *value = v & MASK18;
+    return 0;
+}
+
+static char* skip_space(char* arg)
+{
+    while (*arg == ' ')
+	arg++;
+    return arg;
+}
+
+// In a port access, also covers nodes with their own io handlers
+static int node_blocked(reg_node_t* rp, const dbg_view_t* vp)
+{
+    return (vp->blocked_addr != 0) ||
+	(__atomic_load_n(&rp->n.wins, __ATOMIC_RELAXED) != INS_NOP);
+}
+
+static const char* node_state(reg_node_t* rp, const dbg_view_t* vp)
+{
+    if (!debug_is_step_node(rp->n.id))
+	return node_blocked(rp, vp) ? "blocked" : "free";
+    if (vp->at_barrier)
+	return "paused";
+    return node_blocked(rp, vp) ? "blocked" : "running";
+}
+
+// Node is parked at a barrier, its state may be changed
+static int node_parked(reg_node_t* rp)
+{
+    return debug_is_step_node(rp->n.id) &&
+	__atomic_load_n(&rp->debug.at_barrier, __ATOMIC_ACQUIRE);
+}
+
+static int format_regs(char* buf, size_t len, reg_node_t* rp,
+		       const dbg_view_t* vp)
+{
+    return snprintf(buf, len,
+		    "%03d %s p=%03x a=%05x b=%03x i=%05x t=%05x s=%05x "
+		    "r=%05x sp=%d rp=%d c=%d",
+		    rp->n.id, node_state(rp, vp), vp->reg.p, vp->reg.a,
+		    vp->reg.b, vp->reg.i, vp->reg.t, vp->reg.s, vp->reg.r,
+		    vp->reg.sp, vp->reg.rp, vp->reg.c);
+}
+
+// Running hooked nodes publish their view at the next instruction,
+// parked and blocked nodes already have
+static void request_views(void)
+{
+    __atomic_add_fetch(&g_debugger.view_gen, 1, __ATOMIC_RELAXED);
+}
+
+static int command_attach(int fd, char* arg)
+{
+    arg = skip_space(arg);
+    debug_attach((*arg == '\0') ? CTL_ALL_NODES : arg);
+    request_views();
+    return reply(fd, "ok %d held\n", g_debugger.num_step_nodes);
+}
+
+static int command_detach(int fd)
+{
+    if (g_flags & FLAG_DEBUG_ENABLE)
+	return reply(fd, "error debugger owned by -G\n");
+    if (g_debugger.enabled)
+	debug_detach();
+    return reply(fd, "ok\n");
+}
+
+// pause [id], resume [id]
+static int command_pause(int fd, char* arg, int pause)
+{
+    reg_node_t* rp = NULL;
+
+    if (!g_debugger.enabled)
+	return reply(fd, "error not attached\n");
+    arg = skip_space(arg);
+    if ((*arg != '\0') && ((rp = parse_node(&arg)) == NULL))
+	return reply(fd, "error bad node\n");
+    if (pause) {
+	if (rp != NULL)
+	    debug_hold(rp->n.id, 1);
+	debug_pause();
+    }
+    else if (rp != NULL)
+	debug_hold(rp->n.id, 0);
+    else
+	debug_continue();
+    return reply(fd, "ok\n");
+}
+
+// step [n] (instruction words), stepi [n] (slots)
+static int command_step(int fd, char* arg, int slots)
+{
+    char* end;
+    long n = strtol(arg, &end, 10);
+
+    if (!g_debugger.enabled)
+	return reply(fd, "error not attached\n");
+    if (end == arg)
+	n = 1;
+    if (n <= 0)
+	return reply(fd, "error bad count\n");
+    if (slots)
+	debug_step_slot(n);
+    else
+	debug_step_inst(n);
+    return reply(fd, "ok\n");
+}
+
+// Wait until every held node is parked or blocked
+static int command_wait(int fd, char* arg)
+{
+    char* end;
+    long ms = strtol(arg, &end, 10);
+    int i, j;
+
+    if (!g_debugger.enabled)
+	return reply(fd, "error not attached\n");
+    if (end == arg)
+	ms = CTL_WAIT_MS;
+    request_views();
+    while (1) {
+	int busy = 0;
+	for (i = 0; i < GRID_ROWS; i++) {
+	    for (j = 0; j < GRID_COLS; j++) {
+		reg_node_t* rp = (reg_node_t*) node[i][j];
+		if (debug_is_step_node(rp->n.id) &&
+		    !__atomic_load_n(&rp->debug.at_barrier, __ATOMIC_ACQUIRE) &&
+		    !node_blocked(rp, &rp->debug.view))
+		    busy++;
+	    }
+	}
+	if (busy == 0)
+	    return reply(fd, "ok\n");
+	if (ms-- <= 0)
+	    return reply(fd, "error timeout %d running\n", busy);
+	usleep(1000);
+    }
+}
+
+static int command_regs(int fd, char* arg)
+{
+    char buf[CTL_LINE_SIZE];
+    reg_node_t* rp;
+    dbg_view_t v;
+
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    if (!debug_read_view(rp, &v))
+	return reply(fd, "error %03d no state\n", rp->n.id);
+    format_regs(buf, sizeof(buf), rp, &v);
+    return reply(fd, "ok %s\n", buf);
+}
+
+// Both stacks, top first
+static int command_stack(int fd, char* arg)
+{
+    char buf[CTL_LINE_SIZE];
+    reg_node_t* rp;
+    dbg_view_t v;
+    int k, n;
+
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    if (!debug_read_view(rp, &v))
+	return reply(fd, "error %03d no state\n", rp->n.id);
+    n = snprintf(buf, sizeof(buf), "ds=%05x,%05x", v.reg.t, v.reg.s);
+    for (k = 0; k < 8; k++)
+	n += snprintf(buf+n, sizeof(buf)-n, ",%05x",
+		      v.ds[(v.reg.sp - 1 - k) & 7]);
+    n += snprintf(buf+n, sizeof(buf)-n, " rs=%05x", v.reg.r);
+    for (k = 0; k < 8; k++)
+	n += snprintf(buf+n, sizeof(buf)-n, ",%05x",
+		      v.rs[(v.reg.rp - 1 - k) & 7]);
+    return reply(fd, "ok %03d %s\n", rp->n.id, buf);
+}
+
+// ram <id> [addr [count]]
+static int command_ram(int fd, char* arg)
+{
+    char buf[CTL_LINE_SIZE];
+    reg_node_t* rp;
+    uint18_t addr = 0, count = 64;
+    dbg_view_t v;
+    int k, n = 0;
+
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    arg = skip_space(arg);
+    if ((*arg != '\0') && (parse_hex(&arg, &addr) < 0))
+	return reply(fd, "error bad address\n");
+    arg = skip_space(arg);
+    if ((*arg != '\0') && (parse_hex(&arg, &count) < 0))
+	return reply(fd, "error bad count\n");
+    if ((addr > RAM_END2) || (count > 64))
+	return reply(fd, "error not in ram\n");
+    if (!debug_read_view(rp, &v))
+	return reply(fd, "error %03d no state\n", rp->n.id);
+    buf[0] = '\0';
+    for (k = 0; k < (int) count; k++)
+	n += snprintf(buf+n, sizeof(buf)-n, " %05x", v.ram[(addr+k) & MASK6]);
+    return reply(fd, "ok %03d %02x%s\n", rp->n.id, addr & MASK6, buf);
+}
+
+// set <id> <reg> <value>, node must be parked
+static int command_set(int fd, char* arg)
+{
+    reg_node_t* rp;
+    f18_regs_t* r;
+    char name[8];
+    uint18_t value;
+    int len = 0;
+
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    arg = skip_space(arg);
+    while ((len < (int)sizeof(name)-1) && (arg[len] != ' ') &&
+	   (arg[len] != '\0')) {
+	name[len] = arg[len];
+	len++;
+    }
+    name[len] = '\0';
+    arg = skip_space(arg+len);
+    if (parse_hex(&arg, &value) < 0)
+	return reply(fd, "error bad value\n");
+    if (!node_parked(rp))
+	return reply(fd, "error node %03d not paused\n", rp->n.id);
+
+    r = &rp->n.reg;
+    if (strcmp(name, "p") == 0)       r->p = value & MASK10;
+    else if (strcmp(name, "a") == 0)  r->a = value;
+    else if (strcmp(name, "b") == 0)  r->b = value & MASK9;
+    else if (strcmp(name, "t") == 0)  r->t = value;
+    else if (strcmp(name, "s") == 0)  r->s = value;
+    else if (strcmp(name, "r") == 0)  r->r = value;
+    else if (strcmp(name, "c") == 0)  r->c = value & 1;
+    else if ((len == 3) && (strncmp(name, "ds", 2) == 0) &&
+	     (name[2] >= '0') && (name[2] <= '7'))
+	rp->n.ds[(r->sp - 1 - (name[2]-'0')) & 7] = value;
+    else if ((len == 3) && (strncmp(name, "rs", 2) == 0) &&
+	     (name[2] >= '0') && (name[2] <= '7'))
+	rp->n.rs[(r->rp - 1 - (name[2]-'0')) & 7] = value;
+    else
+	return reply(fd, "error bad register %s\n", name);
+    debug_publish(rp);  // node is parked, we are the only writer
+    return reply(fd, "ok\n");
+}
+
+// poke <id> <addr> <value>..., node must be parked
+static int command_poke(int fd, char* arg)
+{
+    reg_node_t* rp;
+    uint18_t addr, value;
+    int n = 0;
+
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    arg = skip_space(arg);
+    if ((parse_hex(&arg, &addr) < 0) || (addr > RAM_END2))
+	return reply(fd, "error bad address\n");
+    if (!node_parked(rp))
+	return reply(fd, "error node %03d not paused\n", rp->n.id);
+    while (*(arg = skip_space(arg)) != '\0') {
+	if (parse_hex(&arg, &value) < 0)
+	    return reply(fd, "error bad value\n");
+	rp->n.ram[(addr + n++) & MASK6] = value;
+    }
+    debug_publish(rp);
+    return reply(fd, "ok %d\n", n);
+}
+
+// break <id> <addr> [t|s|r|a <value>]
+static int command_break(int fd, char* arg)
+{
+    dbg_cond_t cond = DBG_COND_NONE;
+    uint18_t addr, value = 0;
+    reg_node_t* rp;
+    int idx;
+
+    if (!g_debugger.enabled)
+	return reply(fd, "error not attached\n");
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    arg = skip_space(arg);
+    if (parse_hex(&arg, &addr) < 0)
+	return reply(fd, "error bad address\n");
+    arg = skip_space(arg);
+    if (*arg != '\0') {
+	switch (*arg++) {
+	case 't': cond = DBG_COND_T; break;
+	case 's': cond = DBG_COND_S; break;
+	case 'r': cond = DBG_COND_R; break;
+	case 'a': cond = DBG_COND_A; break;
+	default: return reply(fd, "error bad condition\n");
+	}
+	arg = skip_space(arg);
+	if (parse_hex(&arg, &value) < 0)
+	    return reply(fd, "error bad value\n");
+    }
+    if ((idx = debug_add_breakpoint_if(rp->n.id, addr, cond, value)) < 0)
+	return reply(fd, "error too many breakpoints\n");
+    return reply(fd, "ok %d\n", idx);
+}
+
+// watch <id> <addr> r|w|rw
+static int command_watch(int fd, char* arg)
+{
+    uint18_t addr;
+    reg_node_t* rp;
+    int idx;
+
+    if (!g_debugger.enabled)
+	return reply(fd, "error not attached\n");
+    arg = skip_space(arg);
+    if ((rp = parse_node(&arg)) == NULL)
+	return reply(fd, "error bad node\n");
+    arg = skip_space(arg);
+    if (parse_hex(&arg, &addr) < 0)
+	return reply(fd, "error bad address\n");
+    arg = skip_space(arg);
+    if ((*arg == '\0') || (strspn(arg, "rw") != strlen(arg)))
+	return reply(fd, "error bad mode\n");
+    idx = debug_add_watchpoint(rp->n.id, addr,
+			       strchr(arg, 'w') != NULL,
+			       strchr(arg, 'r') != NULL);
+    if (idx < 0)
+	return reply(fd, "error too many watchpoints\n");
+    return reply(fd, "ok %d\n", idx);
+}
+
+// delete <index>, unwatch <index>
+static int command_delete(int fd, char* arg, int watch)
+{
+    char* end;
+    long idx = strtol(arg, &end, 10);
+
+    if (!g_debugger.enabled)
+	return reply(fd, "error not attached\n");
+    if ((end == arg) ||
+	((watch ? debug_del_watchpoint(idx) : debug_del_breakpoint(idx)) < 0))
+	return reply(fd, "error bad index\n");
+    return reply(fd, "ok\n");
+}
+
+// dump [ram], one line per node then "ok <count>"
+static int command_dump(int fd, char* arg)
+{
+    char buf[CTL_LINE_SIZE];
+    int with_ram = (strcmp(skip_space(arg), "ram") == 0);
+    int i, j, k, n, count = 0;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* rp = (reg_node_t*) node[i][j];
+	    dbg_view_t v;
+
+	    if (!debug_read_view(rp, &v))
+		snprintf(buf, sizeof(buf), "%03d no state", rp->n.id);
+	    else {
+		n = format_regs(buf, sizeof(buf), rp, &v);
+		for (k = 0; with_ram && (k < 64); k++)
+		    n += snprintf(buf+n, sizeof(buf)-n, " %05x", v.ram[k]);
+	    }
+	    if (reply(fd, "%s\n", buf) < 0)
+		return -1;
+	    count++;
+	}
+    }
+    return reply(fd, "ok %d\n", count);
+}
+
+static int command_status(int fd)
+{
+    if (!g_debugger.enabled)
+	return reply(fd, "ok detached\n");
+    return reply(fd, "ok %s held=%d breakpoints=%d watchpoints=%d\n",
+		 debug_mode_name(g_debugger.mode), g_debugger.num_step_nodes,
+		 g_debugger.num_breakpoints, g_debugger.num_watchpoints);
+}
+
+// Returns 1 on quit, -1 when the client is gone
+static int command(int fd, char* line)
+{
+    char* arg;
+
+    if (strncmp(line, "load node ", 10) == 0)
+	return command_load(fd, line+10);
+    else if (strcmp(line, "quit") == 0) {
+	reply(fd, "ok\n");
+	return 1;
+    }
+    else if (line[0] == '\0')
+	return 0;
+
+    // debug commands: word [args]
+    if ((arg = strchr(line, ' ')) != NULL)
+	*arg++ = '\0';
+    else
+	arg = line + strlen(line);
+    if (strcmp(line, "attach") == 0)       return command_attach(fd, arg);
+    else if (strcmp(line, "detach") == 0)  return command_detach(fd);
+    else if (strcmp(line, "pause") == 0)   return command_pause(fd, arg, 1);
+    else if (strcmp(line, "resume") == 0)  return command_pause(fd, arg, 0);
+    else if (strcmp(line, "step") == 0)    return command_step(fd, arg, 0);
+    else if (strcmp(line, "stepi") == 0)   return command_step(fd, arg, 1);
+    else if (strcmp(line, "wait") == 0)    return command_wait(fd, arg);
+    else if (strcmp(line, "regs") == 0)    return command_regs(fd, arg);
+    else if (strcmp(line, "stack") == 0)   return command_stack(fd, arg);
+    else if (strcmp(line, "ram") == 0)     return command_ram(fd, arg);
+    else if (strcmp(line, "set") == 0)     return command_set(fd, arg);
+    else if (strcmp(line, "poke") == 0)    return command_poke(fd, arg);
+    else if (strcmp(line, "break") == 0)   return command_break(fd, arg);
+    else if (strcmp(line, "delete") == 0)  return command_delete(fd, arg, 0);
+    else if (strcmp(line, "watch") == 0)   return command_watch(fd, arg);
+    else if (strcmp(line, "unwatch") == 0) return command_delete(fd, arg, 1);
+    else if (strcmp(line, "dump") == 0)    return command_dump(fd, arg);
+    else if (strcmp(line, "status") == 0)  return command_status(fd);
+    return reply(fd, "error unknown command\n");
+}
+
+// Serve one client, returns 1 on quit or stop
+static int serve(int fd)
+{
+    char buf[CTL_LINE_SIZE];
+    size_t len = 0;
+
+    while (1) {
+	char* nl;
+	ssize_t n;
+
+	if (!ctl_poll(fd))
+	    return 1;
+	n = read(fd, buf+len, sizeof(buf)-1-len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 0;
+	len += n;
+	buf[len] = '\0';
+	while ((nl = memchr(buf, '\n', len)) != NULL) {
+	    size_t llen = nl - buf;
+	    int r;
+	    *nl = '\0';
+	    if ((llen > 0) && (buf[llen-1] == '\r'))
+		buf[llen-1] = '\0';
+	    if ((r = command(fd, buf)) != 0)
+		return (r > 0);
+	    len -= llen+1;
+	    memmove(buf, nl+1, len);
+	}
+	if (len == sizeof(buf)-1) {  // line too long, drop it
+	    reply(fd, "error line too long\n");
+	    len = 0;
+	}
+    }
+}
+
+void* f18_ctl_main(void* arg)
+{
+    int listen_fd = (int)(intptr_t) arg;
+    int quit = 0;
+
+    while (!quit) {
+	int fd;
+
+	if (!ctl_poll(listen_fd))
+	    break;
+	fd = accept(listen_fd, NULL, NULL);
+	if (fd < 0) {
+	    if (errno == EINTR)
+		continue;
+	    ERRORF("control socket accept error=%s\n", strerror(errno));
+	    break;
+	}
+	quit = serve(fd);
+	close(fd);
+    }
+    close(listen_fd);
+    close(ctl_stop_fd[0]);
+    unlink(ctl_path);
+    return NULL;
+}
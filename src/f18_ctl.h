@@ -0,0 +1,65 @@
+#ifndef __F18_CTL_H__
+#define __F18_CTL_H__
+
+//
+// Control socket (AF_UNIX) for hot code reload
+//
+// One command per line, each answered with "ok ..." or "error ...":
+//
+//   load node <id> <file>   replace ram, symbols and p of node <id> with
+//                           the node from <file> (.f18 source or .f18b)
+//   quit                    stop the control thread
+//
+// The control thread does not keep the chip running, the emulator
+// exits as usual when the nodes are done and f18_ctl_stop ends it.
+//
+// The node is quiesced at its next instruction boundary, a port
+// transfer it is blocked in is withdrawn. All other nodes keep running.
+//
+// Debugger, node ids decimal, addresses and values hex. Nodes run
+// without debug hooks until attached and again after detach.
+//
+//   attach [nodes]          hold nodes ("705,706", "700-717", default
+//                           all) at their next instruction boundary
+//   detach                  release all nodes, hooks off
+//   pause [id]              pause held nodes, id is held first
+//   resume [id]             continue held nodes, or release node id
+//   step [n] / stepi [n]    step held nodes n words / n slots
+//   wait [ms]               until all held nodes are parked or blocked
+//   regs <id>               ok <id> <state> p= a= b= i= t= s= r= sp= rp= c=
+//   stack <id>              ok <id> ds=t,s,.. rs=r,..   (top first)
+//   ram <id> [addr [n]]     ok <id> <addr> <word>...
+//   set <id> <reg> <value>  p a b t s r c ds0-ds7 rs0-rs7 (paused node)
+//   poke <id> <addr> <v>..  write ram words (paused node)
+//   break <id> <addr> [t|s|r|a <value>]       ok <index>
+//   delete <index>
+//   watch <id> <addr> r|w|rw                   ok <index>
+//   unwatch <index>
+//   dump [ram]              regs line (+ ram) for all nodes, ok <count>
+//   status                  ok <mode> held= breakpoints= watchpoints=
+//
+// Register reads come from the node display snapshot, exact for
+// paused nodes, the last published state for others (nodes publish
+// when they block, attach and wait ask held nodes to publish). A node
+// that never published answers "error <id> no state".
+//
+
+#include "f18.h"
+
+#define CTL_RELOAD_TIMEOUT_MS 1000  // node must reach a boundary in time
+#define CTL_WAIT_MS           1000  // default wait for held nodes
+#define CTL_ALL_NODES         "0-717"
+
+// Create the listening socket, returns fd or -1
+extern int f18_ctl_open(const char* path);
+
+// Control thread main, arg is the listening fd
+extern void* f18_ctl_main(void* arg);
+
+// Make the control thread return, a command in progress is finished
+extern void f18_ctl_stop(void);
+
+// Called by the node thread at an instruction boundary (FLAG_RELOAD)
+extern void f18_ctl_reload(node_t* np);
+
+#endif
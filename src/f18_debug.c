@@ -5,15 +5,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sched.h>
+#include <time.h>
 #include "f18_debug.h"
 #include "f18_node.h"
+#include "f18_futex.h"
+
+extern node_t* node[8][18];
+extern uint18_t normalize_addr(uint18_t addr);
 
 // Global debugger state
 debugger_state_t g_debugger;
 
 // Mode names for display
 static const char* mode_names[] = {
-    "RUN", "SLOT", "INST", "OVER", "PAUSE", "QUIT"
+    "RUN", "SLOT", "INST", "OVER", "BACK", "RCONT", "PAUSE", "QUIT"
 };
 
 // Node state names
@@ -45,7 +51,6 @@ void debug_init(void)
     g_debugger.focus_node = 0;  // Default to node 000
 
     pthread_mutex_init(&g_debugger.barrier_lock, NULL);
-    pthread_cond_init(&g_debugger.barrier_cond, NULL);
 
     gettimeofday(&g_debugger.start_time, NULL);
 }
@@ -54,7 +59,15 @@ void debug_init(void)
 void debug_cleanup(void)
 {
     pthread_mutex_destroy(&g_debugger.barrier_lock);
-    pthread_cond_destroy(&g_debugger.barrier_cond);
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 18; j++) {
+            reg_node_t* rp = (reg_node_t*) node[i][j];
+            if (rp != NULL) {
+                free(rp->debug.hist);
+                rp->debug.hist = NULL;
+            }
+        }
+    }
 }
 
 // Parse step nodes specification: "708", "708,709,710", "700-709"
@@ -156,86 +169,342 @@ void debug_set_focus(uint18_t id)
     }
 }
 
+// Publish a new mode to all step nodes. Nodes read mode and step_count
+// when they see gen change, so both are written before the bump.
+static void debug_release(dbg_mode_t mode, uint32_t count)
+{
+    pthread_mutex_lock(&g_debugger.barrier_lock);
+    g_debugger.mode = mode;
+    g_debugger.step_count = count;
+    __atomic_add_fetch(&g_debugger.gen, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    f18_futex_wake_all(&g_debugger.gen);
+}
+
+// Attach an external debugger to a running chip. Nodes in spec join
+// the step nodes and are held at their next instruction boundary.
+void debug_attach(const char* spec)
+{
+    uint32_t old[STEP_MASK_WORDS];
+    uint18_t focus = g_debugger.focus_node;
+    int was_enabled = g_debugger.enabled;
+    int i, j, k;
+
+    if (!was_enabled)
+        debug_init();  // starts in pause mode
+    else
+        debug_pause();
+
+    memcpy(old, g_debugger.step_mask, sizeof(old));
+    debug_parse_step_nodes(spec);
+    g_debugger.num_step_nodes = 0;
+    for (k = 0; k < STEP_MASK_WORDS; k++) {
+        g_debugger.step_mask[k] |= old[k];
+        g_debugger.num_step_nodes += __builtin_popcount(g_debugger.step_mask[k]);
+    }
+    if (was_enabled)
+        g_debugger.focus_node = focus;
+
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 18; j++) {
+            node_t* np = node[i][j];
+            if ((np != NULL) && debug_is_step_node(np->id))
+                __atomic_or_fetch(&np->flags, FLAG_DEBUG_ENABLE,
+                                  __ATOMIC_SEQ_CST);
+        }
+    }
+}
+
+// Release every node and turn the hooks off, breakpoints are kept
+void debug_detach(void)
+{
+    int i, j;
+
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 18; j++) {
+            node_t* np = node[i][j];
+            if (np != NULL)
+                __atomic_and_fetch(&np->flags, ~FLAG_DEBUG_ENABLE,
+                                   __ATOMIC_SEQ_CST);
+        }
+    }
+    memset(g_debugger.step_mask, 0, sizeof(g_debugger.step_mask));
+    g_debugger.num_step_nodes = 0;
+    debug_release(DBG_MODE_RUN, 0);
+}
+
+// Hold (add to the step nodes) or release a single node. A released
+// node leaves the barrier and runs freely.
+void debug_hold(uint18_t id, int hold)
+{
+    node_t* np = node[ID_TO_ROW(id)][ID_TO_COLUMN(id)];
+
+    debug_set_step_node(id, hold);
+    if (hold)
+        __atomic_or_fetch(&np->flags, FLAG_DEBUG_ENABLE, __ATOMIC_SEQ_CST);
+    else  // wake it, held nodes park again (left over steps are lost)
+        debug_release(g_debugger.mode, 0);
+}
+
+static void snapshot_take(reg_node_t* rp, dbg_history_t* h)
+{
+    dbg_snapshot_t* sp = &h->snap[h->nsnap % DBG_SNAPSHOTS];
+
+    sp->slot = rp->debug.slots;
+    sp->log = h->nlog;
+    sp->reg = rp->n.reg;
+    memcpy(sp->ds, rp->n.ds, sizeof(sp->ds));
+    memcpy(sp->rs, rp->n.rs, sizeof(sp->rs));
+    memcpy(sp->ram, rp->n.ram, sizeof(sp->ram));
+    sp->call_depth = rp->debug.call_depth;
+    h->nsnap++;
+    h->next_snap = rp->debug.slots + DBG_SNAP_INTERVAL;
+}
+
+static void snapshot_restore(reg_node_t* rp, dbg_history_t* h, uint64_t k)
+{
+    dbg_snapshot_t* sp = &h->snap[k % DBG_SNAPSHOTS];
+
+    rp->n.reg = sp->reg;
+    memcpy(rp->n.ds, sp->ds, sizeof(sp->ds));
+    memcpy(rp->n.rs, sp->rs, sizeof(sp->rs));
+    memcpy(rp->n.ram, sp->ram, sizeof(sp->ram));
+    rp->debug.call_depth = sp->call_depth;
+    rp->debug.slots = sp->slot;
+    h->replay_log = sp->log;
+    h->replaying = 1;
+}
+
+// Snapshot k is still in the ring and its port values are still logged
+static int snapshot_usable(dbg_history_t* h, uint64_t k)
+{
+    return (k < h->nsnap) && (h->nsnap - k <= DBG_SNAPSHOTS) &&
+        (h->nlog - h->snap[k % DBG_SNAPSHOTS].log <= DBG_PORT_LOG);
+}
+
+// Latest usable snapshot at or before slot, the oldest usable one if
+// all are later, -1 if there is none
+static int64_t snapshot_find(dbg_history_t* h, uint64_t slot)
+{
+    int64_t found = -1;
+    uint64_t k = h->nsnap;
+
+    while ((k > 0) && snapshot_usable(h, k-1)) {
+        found = k-1;
+        if (h->snap[found % DBG_SNAPSHOTS].slot <= slot)
+            break;
+        k--;
+    }
+    return found;
+}
+
+// Restore the nearest snapshot (at the next instruction boundary)
+// and replay forward to target
+static void rewind_start(dbg_history_t* h, uint64_t target)
+{
+    int64_t k = snapshot_find(h, target);
+
+    if (k < 0)
+        return;
+    if (h->snap[k % DBG_SNAPSHOTS].slot > target)
+        target = h->snap[k % DBG_SNAPSHOTS].slot;  // history is gone
+    h->restore_snap = k;
+    h->target = target;
+    h->rewind = 2;
+}
+
+// Reverse continue: replay interval [snap, end) and remember the last
+// breakpoint, moving one snapshot back at a time until one is found
+static void search_start(reg_node_t* rp, dbg_history_t* h)
+{
+    uint64_t now = rp->debug.slots;
+    int64_t k;
+
+    if ((now == 0) || ((k = snapshot_find(h, now-1)) < 0))
+        return;
+    h->search = 1;
+    h->search_end = now;
+    h->search_hit = DBG_NO_SLOT;
+    h->search_snap = k;
+    h->restore_snap = k;
+    h->target = now;
+    h->rewind = 2;
+}
+
+// End of a search pass, returns 0 when done searching
+static int search_next(dbg_history_t* h)
+{
+    uint64_t k = h->search_snap;
+
+    if (h->search_hit != DBG_NO_SLOT) {
+        h->search = 0;
+        rewind_start(h, h->search_hit);
+        return 1;
+    }
+    if ((k == 0) || !snapshot_usable(h, k-1)) {
+        h->search = 0;  // stop at the oldest point we can reach
+        rewind_start(h, h->snap[k % DBG_SNAPSHOTS].slot);
+        return 1;
+    }
+    h->search_end = h->snap[k % DBG_SNAPSHOTS].slot;
+    h->search_snap = k-1;
+    h->restore_snap = k-1;
+    h->target = h->search_end;
+    h->rewind = 2;
+    return 1;
+}
+
+// Per-node barrier, no shared lock is taken on the way through.
+// Each release gives every step node its own budget of step_count
+// steps (slots at slot level, instruction words otherwise).
+// Returns DBG_EXIT if the emulator should exit, DBG_RESTART when a
+// snapshot must be restored at the instruction boundary
+static int debug_gate(reg_node_t* rp, int slot_level)
+{
+    dbg_history_t* h = rp->debug.hist;
+
+    while (1) {
+        uint32_t gen = __atomic_load_n(&g_debugger.gen, __ATOMIC_ACQUIRE);
+        dbg_mode_t mode = g_debugger.mode;
+
+        if (gen != rp->debug.gen) {
+            rp->debug.gen = gen;
+            rp->debug.steps = g_debugger.step_count;
+            rp->debug.over_depth = rp->debug.call_depth;
+            if ((mode == DBG_MODE_STEP_BACK) || (mode == DBG_MODE_REVERSE)) {
+                h->rewind = 0;
+                h->search = 0;
+                if (mode == DBG_MODE_REVERSE)
+                    search_start(rp, h);
+                else if (rp->debug.steps < rp->debug.slots)
+                    rewind_start(h, rp->debug.slots - rp->debug.steps);
+                else
+                    rewind_start(h, 0);
+            }
+        }
+
+        // running to a point in the past, no barriers on the way
+        if (h->rewind == 2)
+            return DBG_RESTART;
+        if (h->rewind) {
+            if (rp->debug.slots < h->target)
+                return 0;
+            if (!slot_level)
+                return 0;  // stop at the slot barrier
+            if (h->search && search_next(h))
+                continue;
+            h->rewind = 0;
+        }
+
+        switch (mode) {
+        case DBG_MODE_RUN:
+            return 0;
+        case DBG_MODE_QUIT:
+            return DBG_EXIT;
+        case DBG_MODE_STEP_SLOT:
+            if (!slot_level)
+                return 0;  // slot barrier does the counting
+            if (rp->debug.steps > 0) {
+                rp->debug.steps--;
+                return 0;
+            }
+            break;
+        case DBG_MODE_STEP_INST:
+        case DBG_MODE_STEP_OVER:
+            if (slot_level)
+                return 0;  // execute whole word
+            if (rp->debug.steps > 0) {
+                rp->debug.steps--;
+                return 0;
+            }
+            // step-over keeps going until the call has returned
+            if ((mode == DBG_MODE_STEP_OVER) &&
+                (rp->debug.call_depth > rp->debug.over_depth))
+                return 0;
+            break;
+        default:
+            break;
+        }
+
+        if (!debug_is_step_node(rp->n.id))
+            return 0;  // released from the hold
+
+        // wait for the next release (or any other mode change)
+        rp->debug.at_barrier = 1;
+        rp->debug.state = DBG_NODE_PAUSED;
+        debug_publish(rp);
+        f18_futex_wait(&g_debugger.gen, gen);
+        rp->debug.at_barrier = 0;
+        rp->debug.state = DBG_NODE_STEP;
+    }
+}
+
 // Pre-instruction hook - called before each instruction fetch
 // Returns 1 if the emulator should exit
 int debug_pre_instruction(void* vp)
 {
     reg_node_t* rp = (reg_node_t*)vp;
     node_t* np = &rp->n;
+    dbg_history_t* h;
     uint18_t pc;
-    int should_quit;
+    int r;
 
     if (!g_debugger.enabled)
         return 0;
 
-    if (!debug_is_step_node(np->id))
+    if (!debug_is_step_node(np->id)) {
+        if (rp->debug.hist != NULL) {  // history ends when released
+            free(rp->debug.hist);
+            rp->debug.hist = NULL;
+        }
         return 0;  // Not a step node, run freely
-
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-
-    // At instruction boundary, update PC and fetch instruction word for display
-    pc = np->reg.p & MASK9;
-    g_debugger.current_slot = 0;
-    g_debugger.current_pc = pc;
-
-    // Read instruction word for display (same logic as f18_emu read_mem)
-    if (pc <= RAM_END2) {
-        g_debugger.current_iword = np->ram[pc & MASK6];
-    } else if (pc <= ROM_END2 && np->rom) {
-        g_debugger.current_iword = np->rom[(pc - ROM_START) & MASK6];
-    } else {
-        g_debugger.current_iword = 0;
-    }
-
-    // Check for breakpoints
-    if (debug_check_breakpoint(np->id, np->reg.p)) {
-        g_debugger.mode = DBG_MODE_PAUSE;
     }
 
-    // In STEP_INST mode with step_count exhausted, switch to PAUSE
-    if (g_debugger.mode == DBG_MODE_STEP_INST && g_debugger.step_count == 0) {
-        g_debugger.mode = DBG_MODE_PAUSE;
+    if ((h = rp->debug.hist) == NULL) {
+        if ((h = calloc(1, sizeof(dbg_history_t))) == NULL)
+            return DBG_EXIT;
+        rp->debug.hist = h;
     }
 
-    // In PAUSE mode, wait at barrier
-    // STEP_SLOT passes through here to stop at slot barriers instead
-    // STEP_INST/STEP_OVER: decrement count and let instruction execute
-    if (g_debugger.mode == DBG_MODE_PAUSE ||
-        g_debugger.mode == DBG_MODE_STEP_INST ||
-        g_debugger.mode == DBG_MODE_STEP_OVER) {
-
-        rp->debug.at_barrier = 1;
-        rp->debug.state = DBG_NODE_PAUSED;
-        g_debugger.barrier_count++;
-
-        // Wait for release signal
-        while (!g_debugger.barrier_release &&
-               g_debugger.mode != DBG_MODE_RUN &&
-               g_debugger.mode != DBG_MODE_QUIT) {
-            pthread_cond_wait(&g_debugger.barrier_cond,
-                              &g_debugger.barrier_lock);
+    do {
+        if (h->rewind == 2) {
+            snapshot_restore(rp, h, h->restore_snap);
+            h->rewind = 1;
         }
 
-        g_debugger.barrier_count--;
-        rp->debug.at_barrier = 0;
-        rp->debug.state = DBG_NODE_STEP;
-
-        // Decrement step count - but DON'T change mode yet!
-        // The instruction must execute first (slot barriers check mode)
-        if (g_debugger.mode == DBG_MODE_STEP_INST) {
-            if (g_debugger.step_count > 0) {
-                g_debugger.step_count--;
+        // At instruction boundary, update PC and fetch instruction word
+        // for display, only the focused node owns the display fields
+        pc = np->reg.p & MASK9;
+        if (np->id == g_debugger.focus_node) {
+            g_debugger.current_slot = 0;
+            g_debugger.current_pc = pc;
+
+            // Read instruction word (same logic as f18_emu read_mem)
+            if (pc <= RAM_END2) {
+                g_debugger.current_iword = np->ram[pc & MASK6];
+            } else if (pc <= ROM_END2 && np->rom) {
+                g_debugger.current_iword = np->rom[(pc - ROM_START) & MASK6];
+            } else {
+                g_debugger.current_iword = 0;
             }
-            // Mode stays STEP_INST so slot barriers pass through
-            // At NEXT instruction boundary, step_count==0 will trigger PAUSE
         }
-        // For STEP_SLOT, don't touch anything here - slot barrier handles it
-    }
 
-    should_quit = (g_debugger.mode == DBG_MODE_QUIT);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+        // Check for breakpoints, pause all step nodes. While rewinding
+        // they are only recorded by a reverse continue search
+        if (DBG_MAP_TEST(rp->debug.bp_map, pc) &&
+            debug_check_breakpoint(np, np->reg.p)) {
+            if (!h->rewind)
+                debug_pause();
+            else if (h->search && (rp->debug.slots < h->search_end))
+                h->search_hit = rp->debug.slots;
+        }
+
+        if (!h->replaying && (rp->debug.slots >= h->next_snap))
+            snapshot_take(rp, h);
 
-    return should_quit;
+        r = debug_gate(rp, 0);
+    } while (r == DBG_RESTART);
+    return r;
 }
 
 // Post-instruction hook - called after each instruction
@@ -248,7 +517,6 @@ void debug_post_instruction(void* vp, uint18_t pc, uint8_t opcode)
         return;
 
     rp->debug.instruction_count++;
-    g_debugger.total_instructions++;
 
     // Track call depth for step-over
     if (opcode == INS_PCALL) {
@@ -259,28 +527,231 @@ void debug_post_instruction(void* vp, uint18_t pc, uint8_t opcode)
     }
 
     rp->debug.last_pc = pc;
+
+    // the TUI wants a new frame
+    if (rp->debug.view_gen !=
+        __atomic_load_n(&g_debugger.view_gen, __ATOMIC_RELAXED)) {
+        rp->debug.view_gen = g_debugger.view_gen;
+        debug_publish(rp);
+    }
 }
 
-// Add a breakpoint
-int debug_add_breakpoint(uint18_t node_id, uint18_t addr)
+// Summed from the per-node counters, nodes never share a counter
+uint64_t debug_total_instructions(void)
+{
+    uint64_t total = 0;
+    int i, j;
+
+    for (i = 0; i < 8; i++) {
+        for (j = 0; j < 18; j++) {
+            reg_node_t* rp = (reg_node_t*) node[i][j];
+            if (rp != NULL)
+                total += __atomic_load_n(&rp->debug.instruction_count,
+                                         __ATOMIC_RELAXED);
+        }
+    }
+    return total;
+}
+
+// Seqlock write side, only the owning node thread writes its view
+static inline void view_begin(dbg_view_t* vp)
+{
+    __atomic_store_n(&vp->seq, vp->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void view_end(dbg_view_t* vp)
+{
+    __atomic_store_n(&vp->seq, vp->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Publish the (swapped out) node state for display
+void debug_publish(void* vp)
+{
+    reg_node_t* rp = (reg_node_t*)vp;
+    dbg_view_t* v = &rp->debug.view;
+
+    view_begin(v);
+    v->reg = rp->n.reg;
+    memcpy(v->ds, rp->n.ds, sizeof(v->ds));
+    memcpy(v->rs, rp->n.rs, sizeof(v->rs));
+    memcpy(v->ram, rp->n.ram, sizeof(v->ram));
+    if ((rp->n.flags & FLAG_DEBUG_ENABLE) &&
+        (rp->n.id == g_debugger.focus_node)) {
+        v->pc = g_debugger.current_pc;
+        v->iword = g_debugger.current_iword;
+        v->slot = g_debugger.current_slot;
+    }
+    else {
+        v->pc = rp->n.reg.p & MASK9;
+        v->iword = 0;
+        v->slot = 0;
+    }
+    v->blocked_addr = rp->debug.blocked_addr;
+    v->blocked_dir = rp->debug.blocked_dir;
+    v->wins = rp->n.wins;
+    v->at_barrier = rp->debug.at_barrier;
+    v->slots = rp->debug.slots;
+    view_end(v);
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Enter (ioreg != 0) or leave a blocking port transfer
+void debug_publish_blocked(void* vp, uint18_t ioreg, int dir)
+{
+    reg_node_t* rp = (reg_node_t*)vp;
+    dbg_view_t* v = &rp->debug.view;
+    dbg_activity_t* ap = &rp->debug.act;
+    uint64_t t = now_ns();
+
+    // clear block_start first, a sampler may miss but never double count
+    if (ioreg != 0)
+        __atomic_store_n(&ap->block_start, t, __ATOMIC_RELAXED);
+    else if (ap->block_start != 0) {
+        uint64_t t0 = ap->block_start;
+        __atomic_store_n(&ap->block_start, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&ap->blocked_ns, ap->blocked_ns + (t - t0),
+                         __ATOMIC_RELAXED);
+    }
+
+    rp->debug.blocked_addr = ioreg;
+    rp->debug.blocked_dir = dir;
+    if (ioreg != 0) {  // registers are swapped out for the io access
+        debug_publish(rp);
+        return;
+    }
+    view_begin(v);
+    v->blocked_addr = ioreg;
+    v->blocked_dir = dir;
+    v->wins = rp->n.wins;
+    v->at_barrier = rp->debug.at_barrier;
+    view_end(v);
+}
+
+// Consistent copy of a node view, retried while a write is in progress.
+// A node that never published (running free, never blocked) is read
+// live, returns 0 then.
+int debug_read_view(void* vp, dbg_view_t* dst)
+{
+    reg_node_t* rp = (reg_node_t*)vp;
+    dbg_view_t* v = &rp->debug.view;
+    uint32_t seq;
+
+    if (__atomic_load_n(&v->seq, __ATOMIC_ACQUIRE) == 0) {
+        memset(dst, 0, sizeof(dbg_view_t));
+        dst->reg = rp->n.reg;
+        memcpy(dst->ds, rp->n.ds, sizeof(dst->ds));
+        memcpy(dst->rs, rp->n.rs, sizeof(dst->rs));
+        memcpy(dst->ram, rp->n.ram, sizeof(dst->ram));
+        dst->pc = rp->n.reg.p & MASK9;
+        dst->wins = rp->n.wins;
+        return 0;
+    }
+    do {
+        while ((seq = __atomic_load_n(&v->seq, __ATOMIC_ACQUIRE)) & 1)
+            sched_yield();
+        memcpy(dst, v, sizeof(dbg_view_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&v->seq, __ATOMIC_RELAXED) != seq);
+    return 1;
+}
+
+// Set addr and its RAM/ROM mirror in map
+static void map_set(uint64_t* map, uint18_t addr)
+{
+    addr &= MASK9;
+    map[addr >> 6] |= (1ULL << (addr & 63));
+    if (addr <= ROM_END2) {
+        addr ^= 0x40;
+        map[addr >> 6] |= (1ULL << (addr & 63));
+    }
+}
+
+static int node_match(uint18_t node_id, uint18_t id)
+{
+    return (node_id == 0xFFF) || (node_id == id);
+}
+
+// Rebuild the per-node address maps from the breakpoint and watchpoint
+// lists. Called with barrier_lock held, nodes read the maps unlocked
+static void debug_update_maps(void)
+{
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 18; j++) {
+            reg_node_t* rp = (reg_node_t*) node[i][j];
+            uint64_t bp[DBG_MAP_WORDS] = { 0 };
+            uint64_t rd[DBG_MAP_WORDS] = { 0 };
+            uint64_t wr[DBG_MAP_WORDS] = { 0 };
+
+            if (rp == NULL)
+                continue;
+            for (int k = 0; k < g_debugger.num_breakpoints; k++) {
+                breakpoint_t* bpp = &g_debugger.breakpoints[k];
+                if (bpp->enabled && node_match(bpp->node_id, rp->n.id))
+                    map_set(bp, bpp->addr);
+            }
+            for (int k = 0; k < g_debugger.num_watchpoints; k++) {
+                watchpoint_t* wp = &g_debugger.watchpoints[k];
+                if (!wp->enabled || !node_match(wp->node_id, rp->n.id))
+                    continue;
+                if (wp->on_read)
+                    map_set(rd, wp->addr);
+                if (wp->on_write)
+                    map_set(wr, wp->addr);
+            }
+            for (int k = 0; k < DBG_MAP_WORDS; k++) {
+                __atomic_store_n(&rp->debug.bp_map[k], bp[k], __ATOMIC_RELAXED);
+                __atomic_store_n(&rp->debug.rd_map[k], rd[k], __ATOMIC_RELAXED);
+                __atomic_store_n(&rp->debug.wr_map[k], wr[k], __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+// Add a breakpoint, only taken when register cond equals value
+int debug_add_breakpoint_if(uint18_t node_id, uint18_t addr,
+                            dbg_cond_t cond, uint18_t value)
 {
-    if (g_debugger.num_breakpoints >= MAX_BREAKPOINTS)
+    pthread_mutex_lock(&g_debugger.barrier_lock);
+    if (g_debugger.num_breakpoints >= MAX_BREAKPOINTS) {
+        pthread_mutex_unlock(&g_debugger.barrier_lock);
         return -1;
+    }
 
     int idx = g_debugger.num_breakpoints++;
     g_debugger.breakpoints[idx].node_id = node_id;
     g_debugger.breakpoints[idx].addr = addr;
     g_debugger.breakpoints[idx].enabled = 1;
     g_debugger.breakpoints[idx].hit_count = 0;
+    g_debugger.breakpoints[idx].cond = cond;
+    g_debugger.breakpoints[idx].cond_value = value & MASK18;
 
+    debug_update_maps();
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
     return idx;
 }
 
+// Add a breakpoint
+int debug_add_breakpoint(uint18_t node_id, uint18_t addr)
+{
+    return debug_add_breakpoint_if(node_id, addr, DBG_COND_NONE, 0);
+}
+
 // Delete a breakpoint
 int debug_del_breakpoint(int index)
 {
-    if (index < 0 || index >= g_debugger.num_breakpoints)
+    pthread_mutex_lock(&g_debugger.barrier_lock);
+    if (index < 0 || index >= g_debugger.num_breakpoints) {
+        pthread_mutex_unlock(&g_debugger.barrier_lock);
         return -1;
+    }
 
     // Shift remaining breakpoints down
     for (int i = index; i < g_debugger.num_breakpoints - 1; i++) {
@@ -288,32 +759,58 @@ int debug_del_breakpoint(int index)
     }
     g_debugger.num_breakpoints--;
 
+    debug_update_maps();
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
     return 0;
 }
 
-// Check if we hit a breakpoint
-int debug_check_breakpoint(uint18_t node_id, uint18_t addr)
+static int cond_match(const breakpoint_t* bp, const node_t* np)
+{
+    switch (bp->cond) {
+    case DBG_COND_T: return np->reg.t == bp->cond_value;
+    case DBG_COND_S: return np->reg.s == bp->cond_value;
+    case DBG_COND_R: return np->reg.r == bp->cond_value;
+    case DBG_COND_A: return np->reg.a == bp->cond_value;
+    default: return 1;
+    }
+}
+
+// Check if we hit a breakpoint, the caller has already found addr
+// in the node bp_map so this only runs for candidate addresses
+int debug_check_breakpoint(void* vp, uint18_t addr)
 {
+    node_t* np = (node_t*)vp;
+    uint18_t a = normalize_addr(addr & MASK9);
+    int hit = 0;
+
+    pthread_mutex_lock(&g_debugger.barrier_lock);
     for (int i = 0; i < g_debugger.num_breakpoints; i++) {
         breakpoint_t* bp = &g_debugger.breakpoints[i];
         if (!bp->enabled)
             continue;
-        if (bp->addr != addr)
+        if (normalize_addr(bp->addr & MASK9) != a)
+            continue;
+        if (!node_match(bp->node_id, np->id))
             continue;
-        if (bp->node_id != 0xFFF && bp->node_id != node_id)
+        if (!cond_match(bp, np))
             continue;
 
         bp->hit_count++;
-        return 1;
+        hit = 1;
+        break;
     }
-    return 0;
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    return hit;
 }
 
 // Add a watchpoint
 int debug_add_watchpoint(uint18_t node_id, uint18_t addr, int on_write, int on_read)
 {
-    if (g_debugger.num_watchpoints >= MAX_WATCHPOINTS)
+    pthread_mutex_lock(&g_debugger.barrier_lock);
+    if (g_debugger.num_watchpoints >= MAX_WATCHPOINTS) {
+        pthread_mutex_unlock(&g_debugger.barrier_lock);
         return -1;
+    }
 
     int idx = g_debugger.num_watchpoints++;
     g_debugger.watchpoints[idx].node_id = node_id;
@@ -323,189 +820,203 @@ int debug_add_watchpoint(uint18_t node_id, uint18_t addr, int on_write, int on_r
     g_debugger.watchpoints[idx].on_read = on_read;
     g_debugger.watchpoints[idx].last_value = 0;
 
+    debug_update_maps();
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
     return idx;
 }
 
 // Delete a watchpoint
 int debug_del_watchpoint(int index)
 {
-    if (index < 0 || index >= g_debugger.num_watchpoints)
+    pthread_mutex_lock(&g_debugger.barrier_lock);
+    if (index < 0 || index >= g_debugger.num_watchpoints) {
+        pthread_mutex_unlock(&g_debugger.barrier_lock);
         return -1;
+    }
 
     for (int i = index; i < g_debugger.num_watchpoints - 1; i++) {
         g_debugger.watchpoints[i] = g_debugger.watchpoints[i + 1];
     }
     g_debugger.num_watchpoints--;
 
+    debug_update_maps();
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
     return 0;
 }
 
-// Check watchpoint on write
-void debug_check_watchpoint_write(uint18_t node_id, uint18_t addr, uint18_t value)
+// Check watchpoint on write (after wr_map hit)
+void debug_check_watchpoint_write(void* vp, uint18_t addr, uint18_t value)
 {
+    reg_node_t* rp = (reg_node_t*)vp;
+    uint18_t node_id = rp->n.id;
+    uint18_t a = normalize_addr(addr & MASK9);
+    int hit = 0;
+
+    if ((rp->debug.hist != NULL) && rp->debug.hist->rewind)
+        return;
+
+    pthread_mutex_lock(&g_debugger.barrier_lock);
     for (int i = 0; i < g_debugger.num_watchpoints; i++) {
         watchpoint_t* wp = &g_debugger.watchpoints[i];
         if (!wp->enabled || !wp->on_write)
             continue;
-        if (wp->addr != addr)
+        if (normalize_addr(wp->addr & MASK9) != a)
             continue;
-        if (wp->node_id != 0xFFF && wp->node_id != node_id)
+        if (!node_match(wp->node_id, node_id))
             continue;
 
         // Value changed - trigger pause
         if (wp->last_value != value) {
             wp->last_value = value;
-            pthread_mutex_lock(&g_debugger.barrier_lock);
-            g_debugger.mode = DBG_MODE_PAUSE;
-            pthread_mutex_unlock(&g_debugger.barrier_lock);
+            hit = 1;
         }
     }
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    if (hit)
+        debug_pause();
 }
 
-// Check watchpoint on read
-void debug_check_watchpoint_read(uint18_t node_id, uint18_t addr)
+// Check watchpoint on read (after rd_map hit)
+void debug_check_watchpoint_read(void* vp, uint18_t addr)
 {
+    reg_node_t* rp = (reg_node_t*)vp;
+    uint18_t node_id = rp->n.id;
+    uint18_t a = normalize_addr(addr & MASK9);
+    int hit = 0;
+
+    if ((rp->debug.hist != NULL) && rp->debug.hist->rewind)
+        return;
+
+    pthread_mutex_lock(&g_debugger.barrier_lock);
     for (int i = 0; i < g_debugger.num_watchpoints; i++) {
         watchpoint_t* wp = &g_debugger.watchpoints[i];
         if (!wp->enabled || !wp->on_read)
             continue;
-        if (wp->addr != addr)
-            continue;
-        if (wp->node_id != 0xFFF && wp->node_id != node_id)
+        if (normalize_addr(wp->addr & MASK9) != a)
             continue;
-
-        pthread_mutex_lock(&g_debugger.barrier_lock);
-        g_debugger.mode = DBG_MODE_PAUSE;
-        pthread_mutex_unlock(&g_debugger.barrier_lock);
+        if (node_match(wp->node_id, node_id))
+            hit = 1;
     }
+    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    if (hit)
+        debug_pause();
 }
 
-// Step N slots (micro-step)
+// Step N slots (micro-step) on every step node
 void debug_step_slot(int count)
 {
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-    g_debugger.mode = DBG_MODE_STEP_SLOT;
-    g_debugger.step_count = count;
-    g_debugger.barrier_release = 1;
-    pthread_cond_broadcast(&g_debugger.barrier_cond);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    debug_release(DBG_MODE_STEP_SLOT, count);
 }
 
-// Step N instruction words (each word = up to 4 slots)
+// Step N instruction words (each word = up to 4 slots) on every step node
 void debug_step_inst(int count)
 {
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-    g_debugger.mode = DBG_MODE_STEP_INST;
-    g_debugger.step_count = count;
-    g_debugger.barrier_release = 1;
-    pthread_cond_broadcast(&g_debugger.barrier_cond);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    debug_release(DBG_MODE_STEP_INST, count);
 }
 
 // Slot-level barrier - called before each slot execution
-// Returns 1 if should exit
+// Returns DBG_EXIT if should exit, DBG_RESTART after a rewind
 int debug_slot_barrier(void* vp, int slot)
 {
     reg_node_t* rp = (reg_node_t*)vp;
     node_t* np = &rp->n;
+    dbg_history_t* h = rp->debug.hist;
+    int r;
 
-    if (!g_debugger.enabled)
+    if (!g_debugger.enabled || (h == NULL))
         return 0;
 
     if (!debug_is_step_node(np->id))
         return 0;
 
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-
-    // Track current slot for display (under lock for consistency)
-    g_debugger.current_slot = slot;
-
-    // In STEP_INST mode, don't stop at slots (execute whole word)
-    if (g_debugger.mode == DBG_MODE_STEP_INST ||
-        g_debugger.mode == DBG_MODE_STEP_OVER ||
-        g_debugger.mode == DBG_MODE_RUN) {
-        pthread_mutex_unlock(&g_debugger.barrier_lock);
-        return 0;
-    }
+    // Track current slot for display
+    if (np->id == g_debugger.focus_node)
+        g_debugger.current_slot = slot;
 
-    // PAUSE or STEP_SLOT: wait at barrier
-    rp->debug.at_barrier = 1;
-    rp->debug.state = DBG_NODE_PAUSED;
-    g_debugger.barrier_count++;
+    if ((r = debug_gate(rp, 1)) != 0)
+        return r;
 
-    // Wait for release
-    while (!g_debugger.barrier_release &&
-           g_debugger.mode != DBG_MODE_RUN &&
-           g_debugger.mode != DBG_MODE_QUIT) {
-        pthread_cond_wait(&g_debugger.barrier_cond,
-                          &g_debugger.barrier_lock);
+    // advance debugger time, past live the replay is over
+    if (++rp->debug.slots > h->live) {
+        h->live = rp->debug.slots;
+        h->replaying = 0;
     }
+    return 0;
+}
 
-    g_debugger.barrier_count--;
-    rp->debug.at_barrier = 0;
-    rp->debug.state = DBG_NODE_STEP;
-
-    // In STEP_SLOT mode, decrement step count and pause when done
-    if (g_debugger.mode == DBG_MODE_STEP_SLOT) {
-        // Consume the release signal for this slot step
-        g_debugger.barrier_release = 0;
-        if (g_debugger.step_count > 0) {
-            g_debugger.step_count--;
-            if (g_debugger.step_count == 0) {
-                g_debugger.mode = DBG_MODE_PAUSE;
-            }
-        }
-    }
+// Port read, values already seen live are taken from the log
+uint18_t debug_port_read(void* vp, uint18_t ioreg)
+{
+    reg_node_t* rp = (reg_node_t*)vp;
+    dbg_history_t* h = rp->debug.hist;
+    uint18_t value;
+
+    if (h == NULL)
+        return (*rp->n.read_ioreg)(&rp->n, ioreg);
+    if (h->replaying && (h->replay_log < h->nlog))
+        return h->log[h->replay_log++ % DBG_PORT_LOG];
+    value = (*rp->n.read_ioreg)(&rp->n, ioreg);
+    h->log[h->nlog++ % DBG_PORT_LOG] = value;
+    h->replay_log = h->nlog;
+    return value;
+}
 
-    int should_quit = (g_debugger.mode == DBG_MODE_QUIT);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+// Port write, dropped while replaying (the partner already has it)
+void debug_port_write(void* vp, uint18_t ioreg, uint18_t value)
+{
+    reg_node_t* rp = (reg_node_t*)vp;
+    dbg_history_t* h = rp->debug.hist;
 
-    return should_quit;
+    if ((h != NULL) && h->replaying)
+        return;
+    (*rp->n.write_ioreg)(&rp->n, ioreg, value);
 }
 
 // Step over (run until call returns)
 void debug_step_over(void)
 {
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-    g_debugger.mode = DBG_MODE_STEP_OVER;
     g_debugger.step_into = 0;
-    g_debugger.barrier_release = 1;
-    pthread_cond_broadcast(&g_debugger.barrier_cond);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    debug_release(DBG_MODE_STEP_OVER, 1);
+}
+
+// Step back N slots on every step node
+void debug_step_back(int count)
+{
+    debug_release(DBG_MODE_STEP_BACK, count);
+}
+
+// Run backwards to the previous breakpoint on every step node
+void debug_reverse_continue(void)
+{
+    debug_release(DBG_MODE_REVERSE, 0);
 }
 
 // Continue execution
 void debug_continue(void)
 {
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-    g_debugger.mode = DBG_MODE_RUN;
-    g_debugger.barrier_release = 1;
-    pthread_cond_broadcast(&g_debugger.barrier_cond);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    debug_release(DBG_MODE_RUN, 0);
 }
 
-// Pause all step nodes
+// Pause all step nodes, just a generation bump: running nodes stop
+// at their next barrier
 void debug_pause(void)
 {
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-    g_debugger.mode = DBG_MODE_PAUSE;
-    g_debugger.barrier_release = 0;
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    debug_release(DBG_MODE_PAUSE, 0);
 }
 
 // Request exit
 void debug_quit(void)
 {
-    pthread_mutex_lock(&g_debugger.barrier_lock);
-    g_debugger.mode = DBG_MODE_QUIT;
-    g_debugger.barrier_release = 1;
-    pthread_cond_broadcast(&g_debugger.barrier_cond);
-    pthread_mutex_unlock(&g_debugger.barrier_lock);
+    debug_release(DBG_MODE_QUIT, 0);
 }
 
 // Set current instruction info (called after fetch)
-void debug_set_current_instruction(uint18_t pc, uint18_t iword)
+void debug_set_current_instruction(void* vp, uint18_t pc, uint18_t iword)
 {
+    node_t* np = (node_t*)vp;
+
+    if (np->id != g_debugger.focus_node)
+        return;
     g_debugger.current_pc = pc;
     g_debugger.current_iword = iword;
 }
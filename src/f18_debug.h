@@ -12,6 +12,8 @@ typedef enum {
     DBG_MODE_STEP_SLOT,  // Step one slot (micro-step)
     DBG_MODE_STEP_INST,  // Step one instruction word (4 slots)
     DBG_MODE_STEP_OVER,  // Step over call/loop
+    DBG_MODE_STEP_BACK,  // Step back N slots (restore + replay)
+    DBG_MODE_REVERSE,    // Reverse continue to previous breakpoint
     DBG_MODE_PAUSE,      // Paused, waiting for user input
     DBG_MODE_QUIT        // Exit debugger
 } dbg_mode_t;
@@ -25,12 +27,23 @@ typedef enum {
     DBG_NODE_TERMINATED  // Node has exited
 } dbg_node_state_t;
 
+// Breakpoint condition, register compared against cond_value
+typedef enum {
+    DBG_COND_NONE,       // Always break
+    DBG_COND_T,
+    DBG_COND_S,
+    DBG_COND_R,
+    DBG_COND_A
+} dbg_cond_t;
+
 // Breakpoint structure
 typedef struct {
     uint18_t addr;       // Breakpoint address (P)
     uint18_t node_id;    // Which node (0xFFF = all nodes)
     int      enabled;
     int      hit_count;
+    dbg_cond_t cond;     // Only break when register == cond_value
+    uint18_t cond_value;
 } breakpoint_t;
 
 // Watchpoint structure
@@ -53,6 +66,91 @@ typedef struct {
 #define STEP_NODE_CLR(mask, id)   ((mask)[(id)/32] &= ~(1U << ((id) % 32)))
 #define STEP_NODE_TEST(mask, id)  ((mask)[(id)/32] &   (1U << ((id) % 32)))
 
+// Hook return values
+#define DBG_EXIT        1   // Leave the emulator loop
+#define DBG_RESTART     2   // State restored, restart at instruction boundary
+
+// Reverse execution history (per step node). Snapshots are taken at
+// instruction boundaries every DBG_SNAP_INTERVAL slots, port reads are
+// logged so a replay from a snapshot sees the same values. Stepping
+// back costs at most one interval of replay.
+#define DBG_SNAPSHOTS     256
+#define DBG_SNAP_INTERVAL 1024   // slots
+#define DBG_PORT_LOG      16384  // port reads kept for replay
+#define DBG_NO_SLOT       UINT64_MAX
+
+typedef struct {
+    uint64_t   slot;         // Slot count at the instruction boundary
+    uint64_t   log;          // Port log position
+    f18_regs_t reg;
+    uint18_t   ds[8];
+    uint18_t   rs[8];
+    uint18_t   ram[64];
+    int        call_depth;
+} dbg_snapshot_t;
+
+typedef struct {
+    dbg_snapshot_t snap[DBG_SNAPSHOTS];
+    uint64_t nsnap;          // Snapshots taken (ring index nsnap % DBG_SNAPSHOTS)
+    uint64_t next_snap;      // Slot count of next snapshot
+    uint18_t log[DBG_PORT_LOG];
+    uint64_t nlog;           // Port reads logged
+    uint64_t live;           // Slots reached by live execution
+    int      replaying;      // Re-executing slots up to live
+    uint64_t replay_log;     // Next port value to replay
+
+    int      rewind;         // 1 = running to target, 2 = restore pending
+    uint64_t restore_snap;
+    uint64_t target;         // Slot count to stop at
+
+    int      search;         // Reverse continue in progress
+    uint64_t search_snap;    // Snapshot the current pass started from
+    uint64_t search_end;     // End of the replayed interval
+    uint64_t search_hit;     // Last breakpoint seen in the pass
+} dbg_history_t;
+
+// Display snapshot of a node, written by the node thread only, under
+// a seqlock (seq odd while a write is in progress). Published when the
+// TUI asks for a new frame (view_gen), when the node parks and when it
+// blocks in a port transfer. Readers only touch the live node state of
+// a node that never published.
+typedef struct {
+    uint32_t   seq;
+    f18_regs_t reg;
+    uint18_t   ds[8];
+    uint18_t   rs[8];
+    uint18_t   ram[64];
+    uint18_t   pc;           // Current instruction word (focus node)
+    uint18_t   iword;
+    int        slot;
+    uint18_t   blocked_addr; // IO address blocked on, 0 if not blocked
+    int        blocked_dir;  // 0=read, 1=write
+    uint5_t    wins;         // Instruction blocked in
+    int        at_barrier;
+    uint64_t   slots;
+} dbg_view_t;
+
+// Activity counters for the TUI heatmap. Written by the node thread
+// only (a port transfer is counted once, by the side completing it),
+// sampled by the TUI without locking.
+typedef struct {
+    uint64_t words;          // Instruction words executed (incl. unext)
+    uint64_t blocked_ns;     // Time spent blocked in port transfers
+    uint64_t block_start;    // Start of current block (ns), 0 if running
+    uint64_t rd[4];          // Port words read per neighbour (UP..RIGHT)
+    uint64_t wr[4];          // Port words written per neighbour
+    uint18_t pc;             // Address of the word fetched last
+} dbg_activity_t;
+
+// Owner-only increment, readers use relaxed loads
+#define DBG_COUNT(c) __atomic_store_n(&(c), (c) + 1, __ATOMIC_RELAXED)
+
+// 512 bit address maps (9 bit addresses: RAM, ROM and IOREG), RAM and
+// ROM mirrors are both set so a raw P or A is tested with a single bit
+#define DBG_MAP_WORDS 8
+#define DBG_MAP_TEST(map, addr) \
+    ((map)[((addr) >> 6) & 7] & (1ULL << ((addr) & 63)))
+
 // Node ID to linear index (for bitmask)
 #define NODE_ID_TO_INDEX(id)   (ID_TO_ROW(id) * 18 + ID_TO_COLUMN(id))
 #define INDEX_TO_NODE_ID(idx)  MAKE_ID((idx) / 18, (idx) % 18)
@@ -81,11 +179,11 @@ typedef struct {
     watchpoint_t    watchpoints[MAX_WATCHPOINTS];
     int             num_watchpoints;
 
-    // Step barrier synchronization
+    // Step barrier synchronization, barrier_lock serialises the
+    // controller side only, nodes wait on gen (futex word)
     pthread_mutex_t barrier_lock;
-    pthread_cond_t  barrier_cond;
-    int             barrier_count;     // Nodes waiting at barrier
-    int             barrier_release;   // Signal to release waiting nodes
+    uint32_t        gen;               // Bumped on every mode change
+    uint32_t        view_gen;          // Bumped by the TUI for each frame
 
     // UI scroll positions
     int             grid_scroll_x;
@@ -97,7 +195,6 @@ typedef struct {
 
     // Timing and stats
     struct timeval  start_time;
-    uint64_t        total_instructions;
 
 } debugger_state_t;
 
@@ -108,8 +205,19 @@ typedef struct {
     uint64_t         instruction_count;
     uint18_t         last_pc;          // Previous PC (for step-over)
     int              call_depth;       // Track call nesting for step-over
+    uint32_t         gen;              // Last release generation seen
+    uint32_t         steps;            // Steps left of that release
+    int              over_depth;       // Call depth to return to (step-over)
     uint18_t         blocked_addr;     // IO address we're blocked on (if blocked)
     int              blocked_dir;      // 0=read, 1=write
+    uint64_t         slots;            // Slots executed (debugger time)
+    dbg_history_t*   hist;             // Reverse execution history
+    uint64_t         bp_map[DBG_MAP_WORDS];  // Breakpoint addresses
+    uint64_t         rd_map[DBG_MAP_WORDS];  // Read watchpoint addresses
+    uint64_t         wr_map[DBG_MAP_WORDS];  // Write watchpoint addresses
+    uint32_t         view_gen;         // Last view_gen published
+    dbg_view_t       view __attribute__((aligned(64)));  // Display snapshot
+    dbg_activity_t   act __attribute__((aligned(64)));   // Heatmap counters
 } node_debug_t;
 
 // Global debugger instance
@@ -128,34 +236,57 @@ int  debug_is_step_node(uint18_t id);
 void debug_set_step_node(uint18_t id, int enable);
 void debug_set_focus(uint18_t id);
 
+// External debugger (control socket), attach works without -G
+void debug_attach(const char* spec);
+void debug_detach(void);
+void debug_hold(uint18_t id, int hold);
+
 // Barrier functions (called from f18_exec.c)
 int  debug_pre_instruction(void* rp);  // Returns 1 if should exit
 void debug_post_instruction(void* rp, uint18_t pc, uint8_t opcode);
 
 // Breakpoint management
 int  debug_add_breakpoint(uint18_t node_id, uint18_t addr);
+int  debug_add_breakpoint_if(uint18_t node_id, uint18_t addr,
+                             dbg_cond_t cond, uint18_t value);
 int  debug_del_breakpoint(int index);
-int  debug_check_breakpoint(uint18_t node_id, uint18_t addr);
+int  debug_check_breakpoint(void* np, uint18_t addr);  // after bp_map hit
 
 // Watchpoint management
 int  debug_add_watchpoint(uint18_t node_id, uint18_t addr, int on_write, int on_read);
 int  debug_del_watchpoint(int index);
-void debug_check_watchpoint_write(uint18_t node_id, uint18_t addr, uint18_t value);
-void debug_check_watchpoint_read(uint18_t node_id, uint18_t addr);
+// Called from f18_emu.c read_mem/write_mem after a rd_map/wr_map hit
+void debug_check_watchpoint_write(void* np, uint18_t addr, uint18_t value);
+void debug_check_watchpoint_read(void* np, uint18_t addr);
 
 // Step control (called from UI)
 void debug_step_slot(int count);   // Step N slots (micro-step)
 void debug_step_inst(int count);   // Step N instruction words
 void debug_step_over(void);        // Step over call/loop
+void debug_step_back(int count);   // Step back N slots
+void debug_reverse_continue(void); // Run backwards to previous breakpoint
 void debug_continue(void);         // Continue execution
 void debug_pause(void);            // Pause all step nodes
 void debug_quit(void);             // Request exit
 
 // Slot-level barrier (called from f18_emu.c slot loop)
-int  debug_slot_barrier(void* np, int slot); // Returns 1 if should exit
+int  debug_slot_barrier(void* np, int slot); // Returns DBG_EXIT/DBG_RESTART
+
+// Port access of step nodes, logged live and served from the log on replay
+uint18_t debug_port_read(void* np, uint18_t ioreg);
+void debug_port_write(void* np, uint18_t ioreg, uint18_t value);
 
 // Set current instruction info (called after fetch in f18_emu.c)
-void debug_set_current_instruction(uint18_t pc, uint18_t iword);
+void debug_set_current_instruction(void* np, uint18_t pc, uint18_t iword);
+
+// Display snapshots, publish from the node thread (registers swapped
+// out), read from any thread
+void debug_publish(void* np);
+void debug_publish_blocked(void* np, uint18_t ioreg, int dir); // + blocked time
+int  debug_read_view(void* np, dbg_view_t* vp);  // 0 = never published
+
+// Sum of instructions executed by all step nodes
+uint64_t debug_total_instructions(void);
 
 // Utility
 const char* debug_mode_name(dbg_mode_t mode);
@@ -6,6 +6,8 @@
 #include "f18_node.h"
 #include "f18_strings.h"
 #include "f18_dis.h"
+#include "f18_ctl.h"
+#include "f18_sched.h"
 
 const f18_symbol_t f18_ins[32+3+5] = {
     { 0x00,   SYMSTR(SEMI)},     // slot 3
@@ -153,9 +155,11 @@ const f18_symbol_table_t io_symbols  = SYMTAB_INITALIZER(iosym);
 	np->reg.c = C;				\
     } while(0)
 
-// Light version - sync only T for IOREG handlers (e.g., SERDES checks T)
-#define SWAP_OUT_LIGHT(np) do {			\
-	np->reg.t = T;				\
+// Before an io access, the node may block and publish its view and
+// IOREG handlers look at the registers (e.g., SERDES checks T)
+#define SWAP_OUT_IO(np, addr) do {		\
+	if ((addr) > ROM_END2)			\
+	    SWAP_OUT(np);			\
     } while(0)
 
 // wrap addresses into regular ROM/RAM/IO addresses
@@ -249,15 +253,31 @@ static uint18_t read_mem(node_t* np, uint18_t addr, uint5_t ins)
     }
     else {
 	np->wins = ins;
-	value = (*np->read_ioreg)(np, addr & MASK9);
+	if (np->flags & FLAG_DEBUG_ENABLE)
+	    value = debug_port_read(np, addr & MASK9);
+	else
+	    value = (*np->read_ioreg)(np, addr & MASK9);
 	np->wins = INS_NOP;
 	VERBOSE(np,"read ioreg[%x] = %x\n", addr & MASK9, value);
     }
     return value;
 }
 
+// Data read (@p literal, @+, @b, @), the instruction fetch does not
+// trigger read watchpoints
+static inline uint18_t read_data(node_t* np, uint18_t addr, uint5_t ins)
+{
+    if ((np->flags & FLAG_DEBUG_ENABLE) &&
+	DBG_MAP_TEST(((reg_node_t*)np)->debug.rd_map, addr))
+	debug_check_watchpoint_read(np, addr);
+    return read_mem(np, addr, ins);
+}
+
 static void write_mem(node_t* np, uint18_t addr, uint18_t val, uint5_t ins)
 {
+    if ((np->flags & FLAG_DEBUG_ENABLE) &&
+	DBG_MAP_TEST(((reg_node_t*)np)->debug.wr_map, addr))
+	debug_check_watchpoint_write(np, addr, val);
     if (addr <= RAM_END2) {
 	np->ram[addr & MASK6] = val;
 	PRINTF("[%03d] write ram[%04x] = %02x %02x %02x %02x = %x\n",	
@@ -275,7 +295,10 @@ static void write_mem(node_t* np, uint18_t addr, uint18_t val, uint5_t ins)
     else {
 	VERBOSE(np,"write ioreg[%04x] = %x\n", addr & MASK9, val);
 	np->wins = ins;	 
-	(*np->write_ioreg)(np, addr & MASK9, val);
+	if (np->flags & FLAG_DEBUG_ENABLE)
+	    debug_port_write(np, addr & MASK9, val);
+	else
+	    (*np->write_ioreg)(np, addr & MASK9, val);
 	np->wins = INS_NOP;	 
     }
 }
@@ -311,7 +334,9 @@ void f18_emu(node_t* np)
     uint10_t  P0;           // p_inc
     uint10_t  A0;           // a_inc
     uint32_t II;
-    int n;
+    int n = 4;
+    int cw = COVER_WORDS;  // cover index of the word executing
+    int dr;
     // trace buffer
     char tbuf[32];
 
@@ -319,24 +344,38 @@ void f18_emu(node_t* np)
 
     DUMP(np);
 next:
+    np->cover[cw] |= COVER_SLOTS(n);
+    if (np->flags & FLAG_SCHED) {
+	SWAP_OUT(np);      // visible to f18_node while others run
+	f18_sched_next();  // locals stay on the coroutine stack
+    }
     // Debug barrier: pause at instruction boundary if stepping
-    if (np->flags & FLAG_DEBUG_ENABLE) {
+    if (np->flags & (FLAG_DEBUG_ENABLE|FLAG_RELOAD)) {
 	SWAP_OUT(np);  // Save registers before barrier
-	if (debug_pre_instruction(np)) {
+	if (np->flags & FLAG_RELOAD)
+	    f18_ctl_reload(np);  // new ram and p from control socket
+	if ((np->flags & FLAG_DEBUG_ENABLE) && debug_pre_instruction(np)) {
 	    return;    // Debugger requested exit
 	}
 	SWAP_IN(np);   // Restore registers after barrier
     }
 
     P0 = P & MASK9;
+    __atomic_store_n(&((reg_node_t*)np)->debug.act.pc, P0, __ATOMIC_RELAXED);
     p_inc();
+    cw = COVER_INDEX(P0);
+    SWAP_OUT_IO(np, P0);
     I = read_mem(np, P0, INS_FETCH_P);
-    if (np->flags & FLAG_TERMINATE)
-	return;
+    if (np->flags & (FLAG_TERMINATE|FLAG_RELOAD)) {
+	if (np->flags & FLAG_TERMINATE)
+	    return;
+	goto next;     // port fetch interrupted by reload
+    }
     // Track instruction address and word for debugger display
     if (np->flags & FLAG_DEBUG_ENABLE)
-	debug_set_current_instruction(P0, I);
+	debug_set_current_instruction(np, P0, I);
 restart:
+    DBG_COUNT(((reg_node_t*)np)->debug.act.words);
     II = I ^ IMASK;  // decode
     II = II << 2;
     n = 4;
@@ -344,7 +383,9 @@ unext:
     // Slot-level debug barrier (micro-step)
     if (np->flags & FLAG_DEBUG_ENABLE) {
 	SWAP_OUT(np);
-	if (debug_slot_barrier(np, 4 - n)) {  // slot 0-3
+	if ((dr = debug_slot_barrier(np, 4 - n)) != 0) {  // slot 0-3
+	    if (dr == DBG_RESTART)
+		goto next;  // rewound, restore at instruction boundary
 	    return;
 	}
 	SWAP_IN(np);
@@ -380,6 +421,10 @@ unext:
 	    POP_r(np);
 	else {
 	    R--;
+	    if (np->flags & FLAG_SCHED) {  // a word like any other
+		SWAP_OUT(np);
+		f18_sched_next();
+	    }
 	    goto restart;
 	}
 	break;
@@ -406,30 +451,31 @@ unext:
     case INS_FETCH_P:  //  @p ( -- x ) fetch via P auto-increament
 	P0 = P & MASK9;
 	p_inc();
-	SWAP_OUT_LIGHT(np);
-	PUSH_s(np, read_mem(np, P0, INS_FETCH_P));
+	SWAP_OUT_IO(np, P0);
+	PUSH_s(np, read_data(np, P0, INS_FETCH_P));
 	break;
 
     case INS_FETCH_PLUS:  // @+ ( -- x ) fetch via A auto-increament
 	A0 = A & MASK9;
 	a_inc();
-	SWAP_OUT_LIGHT(np);
-	PUSH_s(np, read_mem(np, A0, INS_FETCH_PLUS));
+	SWAP_OUT_IO(np, A0);
+	PUSH_s(np, read_data(np, A0, INS_FETCH_PLUS));
 	break;
 
     case INS_FETCH_B:  // @b ( -- x ) fetch via B
-	SWAP_OUT_LIGHT(np);
-	PUSH_s(np, read_mem(np, B, INS_FETCH_B));
+	SWAP_OUT_IO(np, B);
+	PUSH_s(np, read_data(np, B, INS_FETCH_B));
 	break;
 
     case INS_FETCH:    // @ ( -- x ) fetch via A
-	SWAP_OUT_LIGHT(np);
-	PUSH_s(np, read_mem(np, A, INS_FETCH));
+	SWAP_OUT_IO(np, A);
+	PUSH_s(np, read_data(np, A, INS_FETCH));
 	break;
 
     case INS_STORE_P:  // !p ( x -- ) store via P auto increment
 	P0 = P & MASK9;
 	p_inc();
+	SWAP_OUT_IO(np, P0);
 	write_mem(np, P0, T, INS_STORE_P);
 	POP_s(np);
 	break;
@@ -437,16 +483,19 @@ unext:
     case INS_STORE_PLUS: // !+ ( x -- ) \ write T in [A] pop data stack, inc A
 	A0 = A & MASK9;	
 	a_inc();
+	SWAP_OUT_IO(np, A0);
 	write_mem(np, A0, T, INS_STORE_PLUS);
 	POP_s(np);
 	break;
 
     case INS_STORE_B:  // !b ( x -- ) \ store T into [B], pop data stack
+	SWAP_OUT_IO(np, B);
 	write_mem(np, B, T, INS_STORE_B);
 	POP_s(np);
 	break;
 
     case INS_STORE:    // ! ( x -- ) \ store T info [A], pop data stack
+	SWAP_OUT_IO(np, A);
 	write_mem(np, A, T, INS_STORE);
 	POP_s(np);
 	break;
@@ -538,7 +587,13 @@ unext:
     }
 
     // Debug post-instruction hook for tracking
-    if (np->flags & FLAG_DEBUG_ENABLE) {
+    if (np->flags & (FLAG_DEBUG_ENABLE|FLAG_RELOAD|FLAG_TERMINATE)) {
+	if (np->flags & FLAG_TERMINATE) {  // slot did not complete
+	    np->cover[cw] |= COVER_SLOTS(n+1);
+	    return;
+	}
+	if (np->flags & FLAG_RELOAD)
+	    goto next; // drop rest of word, port transfer may be interrupted
 	SWAP_OUT(np);
 	debug_post_instruction(np, P0, (II >> 15) & MASK5);
 	SWAP_IN(np);
@@ -30,9 +30,17 @@
 #include "f18_debug.h"
 #include "f18_tui.h"
 #include "f18_epoll.h"
-
-#define MAX_SCAN_HEAP_SIZE 256 // symbols table & names
-#define MAX_LINE_LEN 80
+#include "f18_boot.h"
+#include "f18_image.h"
+#include "f18_ctl.h"
+#include "f18_watchdog.h"
+#include "f18_cover.h"
+#include "f18_chip.h"
+#include "f18_lib.h"
+#include "f18_wave.h"
+#include "f18_sdram.h"
+#include "f18_flash.h"
+#include "f18_analog.h"
 
 extern int open_pty(char* name, size_t max_namelen);
 
@@ -52,82 +60,51 @@ extern void init_node(int i, int j);
 #define STACK_SIZE  (2*PAGE_SIZE+PTHREAD_STACK_MIN)
 
 static int tty_fd = -1;
-FILE* logout = NULL;
 static struct termios tty_smode;
 static struct termios tty_rmode;
 static size_t  g_page_size = 0;
-uint18_t g_flags = 0;
-char g_pty_name[256] = "";  // PTY name for TUI display
 static char* g_step_spec = NULL;  // -I step node specification
 
-static pthread_t g_epoll_thread;
-static pthread_attr_t g_epoll_attr;
+static pthread_t g_ctl_thread;
+static pthread_attr_t g_ctl_attr;
+static pthread_t g_wd_thread;
+static pthread_attr_t g_wd_attr;
+static pthread_t g_sig_thread;
+static pthread_attr_t g_sig_attr;
 
-// SERDES configuration: mode for each SERDES node (0=none, 1=server, 2=client)
-/// static int g_serdes_701_mode = 0;
-// static int g_serdes_001_mode = 0;
+// -p host streams on edge ports
+#define MAX_PORT_OPTS 16
 
-// System thread state tracking (atomics for counters, mutex/cond for wait)
-static _Atomic int num_active = 0;
-static _Atomic int num_blocked_port = 0;
-static _Atomic int num_blocked_ext = 0;
-static _Atomic int num_terminated = 0;
-static pthread_mutex_t sys_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t  sys_cond = PTHREAD_COND_INITIALIZER;
+typedef struct {
+    uint18_t id;
+    int dir;
+    f18_port_mode_t mode;
+    char* path;      // - for stdin / stdout
+} port_opt_t;
 
-static void check_done(void)
-{
-    if (num_active == 0 && num_blocked_ext == 0) {
-	pthread_mutex_lock(&sys_lock);
-	pthread_cond_signal(&sys_cond);
-	pthread_mutex_unlock(&sys_lock);
-    }
-}
+static const char* dir_name[4] = { "up", "left", "down", "right" };
 
-void sys_thread_started(void)
-{
-    // num_active is pre-set in main() before thread creation
-}
+// -R default capture size limit
+#define WAVE_LIMIT  (256ULL << 20)
 
-void sys_thread_terminated(void)
-{
-    num_active--;
-    num_terminated++;
-    check_done();
-}
+// -a analog sample streams
+#define MAX_ANALOG_OPTS 10
 
-void sys_enter_blocked_port(void)
-{
-    num_blocked_port++;
-    num_active--;
-    check_done();
-}
+typedef struct {
+    uint18_t id;
+    f18_port_mode_t mode;   // in: adc source, out: dac sink
+    unsigned period;        // 0 for the default
+    char* path;             // - for stdout
+} analog_opt_t;
 
-void sys_leave_blocked_port(void)
-{
-    num_active++;
-    num_blocked_port--;
-}
-
-void sys_enter_blocked_ext(void)
-{
-    num_blocked_ext++;
-    num_active--;
-}
-
-void sys_leave_blocked_ext(void)
-{
-    num_active++;
-    num_blocked_ext--;
-    check_done();
-}
+// SERDES configuration: mode for each SERDES node (0=none, 1=server, 2=client)
+/// static int g_serdes_701_mode = 0;
+// static int g_serdes_001_mode = 0;
 
 static SIGRETTYPE ctl_c(int);
 static SIGRETTYPE suspend(int);
 static SIGRETTYPE (*orig_ctl_c)(int);
 
-node_t* node[GRID_ROWS][GRID_COLS];
-
 SIGRETTYPE (*sys_sigset(int sig, SIGRETTYPE (*func)(int)))(int)
 {
     struct sigaction act, oact;
@@ -199,6 +176,25 @@ static SIGRETTYPE ctl_c(int sig)
 }
 
 
+// SIGINT/SIGTERM end the run normally, so capture and coverage files
+// are written (the 708 pty reader keeps the emulator running). A
+// second signal gets the default action, in case shutdown hangs.
+static void* sig_main(void* arg)
+{
+    sigset_t* set = arg;
+    int sig;
+
+    while (sigwait(set, &sig) != 0)
+	;
+    sys_stop();
+    while (sigwait(set, &sig) != 0)
+	;
+    signal(sig, SIG_DFL);
+    pthread_sigmask(SIG_UNBLOCK, set, NULL);
+    raise(sig);
+    return NULL;
+}
+
 // Setup termial file descriptor "io port"
 
 int tty_init(int fd)
@@ -257,11 +253,50 @@ void usage(char* prog, char* fmt, ...)
             "       rs            return stack\n"
 	    "       ds            data stack\n"
 	    "    -d <delay>       Set delay between instructions (in usecs)\n"
-	    "    -f load-file     Load node RAM from file (testing)\n"
+	    "    -f load-file     Load node RAM from file, - for stdin\n"
+	    "                     (source or .f18b image)\n"
+	    "    -o image-file    Write loaded nodes as .f18b image\n"
+	    "    -B <mode>        Boot -f nodes through a boot stream\n"
+	    "       async         fed to the 708 async boot ROM\n"
+	    "       fast          applied directly to node memory\n"
+	    "    -w stream-file   Write -f nodes as 708 uart boot stream\n"
+	    "    -x flash-file    Write -f nodes as 705 SPI flash image\n"
+	    "    -F <file>[:fast] Boot from SPI flash image on 705 pins,\n"
+	    "                     fast applies the frames directly\n"
+	    "    -C socket-path   Accept node reload commands on this socket\n"
+	    "    -W <ms>          Exit with status 3 and dump the wait-for graph\n"
+	    "                     when nodes deadlock in port transfers,\n"
+	    "                     checked every ms (not with -G)\n"
+	    "    -c cover-file    Write execution coverage at exit\n"
+	    "    -r <comma-list>  Report merged coverage files and exit,\n"
+	    "                     nodes with ram hits or -I node, -D rom\n"
+	    "                     adds ROM, -c writes the merged file\n"
+	    "    -s stim-file     Drive gpio and analog pins from a .f18s\n"
+	    "                     stimulus (see f18-wave)\n"
+	    "    -R <file>[:<mb>] Record io register writes to a .f18w\n"
+	    "                     capture, f18-wave vcd exports it, at\n"
+	    "                     most mb (default 256, 0 no limit) MiB\n"
+	    "    -a <node>:<in|out>[:<period>]:<file>\n"
+	    "                     ADC samples from file (in) or DAC levels\n"
+	    "                     to file (out, - for stdout) on analog\n"
+	    "                     node 117, 617, 709, 713 or 717, 4 byte\n"
+	    "                     samples in host byte order, one per\n"
+	    "                     period words (default 64)\n"
+	    "    -m <file|->[:fast]\n"
+	    "                     SDRAM on nodes 007/008/009, file backed\n"
+	    "                     (kept across runs) or - for memory,\n"
+	    "                     fast adds the transaction port on 007\n"
 	    "    -l log-file      Direct all log output to this file\n"
 	    "    -b <baud>        Set async boot baud rate\n"
 	    "    -P               GPIO poll mode (no wakeup wait)\n"
 	    "    -A               Enable CPU affinity (pin threads to cores)\n"
+	    "    -p <node>:<dir>:<in|out>[:<file>]\n"
+	    "                     Stream words between file and an edge\n"
+	    "                     port, 4 byte words in host byte order,\n"
+	    "                     in: the node reads them, out: the node\n"
+	    "                     writes them. dir is up, left, down or\n"
+	    "                     right in the grid (up is towards row 7),\n"
+	    "                     file - (default) is stdin or stdout\n"
 	    "    -S <node>:<mode>[:<path>]\n"
 	    "                     SERDES mode for node 701 or 001\n"
 	    "                     mode: server or client, path is the\n"
@@ -271,150 +306,107 @@ void usage(char* prog, char* fmt, ...)
     exit(1);
 }
 
-// Global emulator speed in instructions per microsecond
-double g_emu_speed = 0.0;
-
-// Helper: get current time in nanoseconds (monotonic)
-static inline long long get_time_ns(void)
+// Parse <node>:<dir>:<in|out>[:<file>], returns -1 when malformed
+static int port_option(char* arg, port_opt_t* op)
 {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
-}
+    char* ptr;
+    int dir;
 
-// Benchmark: measure emulator speed using unext loop on node[0][0]
-// Must be called after nodes are initialized
-// Returns instructions per microsecond
-double f18_benchmark(node_t* np, int iterations)
-{
-    long long nt0, nt1;
-    // struct timeval t0, t1;
-    double loop1;
-    double loop2;
-    uint18_t saved_ram[3];
-    f18_regs_t saved_reg;
-    uint18_t ins;
-
-    // Save current state
-    saved_ram[0] = np->ram[0];
-    saved_ram[1] = np->ram[1];
-    saved_ram[2] = np->ram[2];    
-    saved_reg = np->reg;
-
-    // Code at RAM[0]: unext ; . .  (loop R times, then return)
-    // unext ; . . 
-    // Word = (0x04<<13)|(0x00<<8)|(0x1C<<3)|0x04 = 0x080E4
-    // XOR with IMASK: 0x080E4 ^ 0x15555 = 0x1D5B1
-    //
-    ins = MAKE_INS(INS_UNEXT,INS_RETURN,INS_NOP,INS_NOP);
-    np->ram[0] = ins ^ IMASK; // 0x1D5B1;
-
-    // Initialize registers for benchmark
-    // unext does POP_r when R=0, then ; does another POP_r
-    // So we need RP=2: unext pops rs[1], ; pops rs[0]=termination
-    np->reg.p = 0;              // Start at RAM[0]
-    np->reg.r = iterations;     // Loop count for unext
-    np->reg.rp = 2;             // unext POP→RP=1, ; POP→RP=0
-    np->rs[0] = 0x3FFFF;        // Magic termination value (popped by ;)
-    np->rs[1] = 0;              // Dummy (popped by unext)
-    np->reg.sp = 0;
-    np->reg.t = 0;
-    np->reg.s = 0;
-    np->reg.b = IOREG_IO;
-
-    printf("Benchmark: loop1 running %d unext iterations...\n", iterations);
-
-    // gettimeofday(&t0, NULL);
-    nt0 = get_time_ns();
-    f18_emu(np);
-    // gettimeofday(&t1, NULL);
-    nt1 = get_time_ns();
-
-    // loop1 = (t1.tv_sec - t0.tv_sec) * 1000000.0 + (t1.tv_usec - t0.tv_usec);
-    loop1 = (nt1 - nt0) / 1000;
-
-    printf("Benchmark1: %d iterations in %.0f us (%.2f MIPS)\n",
-           iterations, loop1,
-           loop1 > 0 ? (double)iterations / loop1 : 0);
-
-    // No sync
-    // loop:
-    //   @ drop . .
-    //   . drop next:loop
-    // done:
-    //   ;
-    ins = MAKE_INS(INS_FETCH,INS_NOP,INS_NOP,INS_NOP);
-    np->ram[0] = ins ^ (IMASK & 0x3FFFF);
-    ins = MAKE_INS_J3(INS_NOP,INS_DROP,INS_NEXT,0);
-    np->ram[1] = ins ^ (IMASK & 0x3FFF8);
-    ins = MAKE_INS_J3(INS_RETURN,INS_NOP,INS_NOP,INS_NOP);
-    np->ram[2] = ins ^ (IMASK & 0x1FFFF);
-
-    np->reg.p = 0;              // Start at RAM[0]
-    np->reg.r = iterations;     // Loop count for unext
-    np->reg.rp = 2;             // unext POP→RP=1, ; POP→RP=0
-    np->rs[0] = 0x3FFFF;        // Magic termination value (popped by ;)
-    np->rs[1] = 0;              // Dummy (popped by unext)
-    np->reg.sp = 0;
-    np->reg.t = 0;
-    np->reg.s = 0;
-    np->reg.a = 0;
-    np->reg.b = IOREG_IO;
-
-    printf("Benchmark2: loop2 running %d next iterations...\n", iterations);
-    
-    // gettimeofday(&t0, NULL);
-    nt0 = get_time_ns();    
-    f18_emu(np);
-    // gettimeofday(&t1, NULL);
-    nt1 = get_time_ns();
-    
-    // loop2 = (t1.tv_sec - t0.tv_sec) * 1000000.0 + (t1.tv_usec - t0.tv_usec);
-    loop2 = (nt1 - nt0) / 1000;
-    
-    printf("Benchmark2: %d iterations in %.0f us (%.2f MIPS)\n",
-           iterations, loop2,
-	   loop2 > 0 ? (double)iterations / loop2 : 0);
-    
-    // Restore state
-    np->ram[0] = saved_ram[0];
-    np->ram[1] = saved_ram[1];
-    np->ram[2] = saved_ram[2];
-    np->reg = saved_reg;
-
-    if (loop2 > 0) {
-        return (double)iterations / loop2;
+    op->id = strtol(arg, &ptr, 10);
+    if ((ptr == arg) || (*ptr++ != ':'))
+	return -1;
+    for (dir = 0; dir < 4; dir++) {
+	size_t len = strlen(dir_name[dir]);
+	if ((strncmp(ptr, dir_name[dir], len) == 0) && (ptr[len] == ':')) {
+	    ptr += len+1;
+	    break;
+	}
+    }
+    if ((op->dir = dir) == 4)
+	return -1;
+    if (strncmp(ptr, "in", 2) == 0) {
+	op->mode = F18_PORT_IN;
+	ptr += 2;
     }
-    return 100.0;  // Default if measurement fails
+    else if (strncmp(ptr, "out", 3) == 0) {
+	op->mode = F18_PORT_OUT;
+	ptr += 3;
+    }
+    else
+	return -1;
+    if (*ptr == '\0')
+	op->path = "-";
+    else if ((*ptr == ':') && (ptr[1] != '\0'))
+	op->path = ptr+1;
+    else
+	return -1;
+    return 0;
 }
 
-void* f18_emu_start(void *arg)
+static int analog_option(char* arg, analog_opt_t* op)
 {
-    node_t* np = (node_t*) arg;
-
-    sys_thread_started();
-    VERBOSE(np, "node started%s\n", "");
-    f18_emu(np);
-    VERBOSE(np, "node stopped%s\n", "");
-    // FIXME: cleanup neighbours etc ... possible? needed?
-    sys_thread_terminated();
-    return NULL;
-}
+    char* ptr;
 
-void* async_reader_start(void *arg)
-{
-    sys_thread_started();
-    async_reader(arg);
-    sys_thread_terminated();
-    return NULL;
+    op->id = strtol(arg, &ptr, 10);
+    if ((ptr == arg) || (*ptr++ != ':'))
+	return -1;
+    if (strncmp(ptr, "in:", 3) == 0) {
+	op->mode = F18_PORT_IN;
+	ptr += 3;
+    }
+    else if (strncmp(ptr, "out:", 4) == 0) {
+	op->mode = F18_PORT_OUT;
+	ptr += 4;
+    }
+    else
+	return -1;
+    op->period = 0;
+    if ((*ptr >= '0') && (*ptr <= '9') && (strchr(ptr, ':') != NULL)) {
+	char* endptr;
+	op->period = strtoul(ptr, &endptr, 10);
+	if ((*endptr != ':') || (op->period == 0))
+	    return -1;
+	ptr = endptr+1;
+    }
+    if ((*ptr == '\0') ||
+	((op->mode == F18_PORT_IN) && (strcmp(ptr, "-") == 0)))
+	return -1;
+    op->path = ptr;
+    return 0;
 }
 
-void* async_writer_start(void *arg)
+// Collect the -f loaded nodes as boot images, when clear is set the
+// nodes are put back in reset state so the stream must load them,
+// spi builds the 705 stream
+static int boot_stream_setup(f18_boot_stream_t* bs,
+			     int loaded[GRID_ROWS][GRID_COLS], int clear,
+			     int spi)
 {
-    sys_thread_started();
-    async_writer(arg);
-    sys_thread_terminated();
-    return NULL;
+    f18_boot_image_t img[GRID_ROWS*GRID_COLS];
+    int i, j, n = 0;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    node_t* np = node[i][j];
+	    if (!loaded[i][j])
+		continue;
+	    img[n].id = np->id;
+	    img[n].size = loaded[i][j]-1;
+	    img[n].entry = (np->reg.p == ConfigMap[i][j].reset) ?
+		BOOT_NO_ENTRY : np->reg.p;
+	    memcpy(img[n].ram, np->ram, sizeof(img[n].ram));
+	    n++;
+	    if (clear) {
+		memset(np->ram, 0, sizeof(np->ram));
+		np->reg.p = ConfigMap[i][j].reset;
+	    }
+	}
+    }
+    if ((spi ? f18_boot_spi_build(bs, img, n) :
+	 f18_boot_stream_build(bs, img, n)) < 0)
+	return -1;
+    PRINTF("boot stream: %d nodes, %zu words\n", n, bs->len);
+    return 0;
 }
 
 char node_map[3*8][5*18] = { {' '}, };
@@ -538,11 +530,30 @@ int main(int argc, char** argv)
     int i,j;
     useconds_t delay = 0;
     // uint32_t h=18, v=8;
-    void* node_mem;
-    uint8_t* np_mem;
-    size_t alloc_size;
     int interactive = 0;
     char* filename = NULL;
+    char* boot_mode = NULL;
+    char* stream_filename = NULL;
+    char* image_filename = NULL;
+    char* ctl_path = NULL;
+    int ctl_fd = -1;
+    int watchdog_ms = 0;
+    int deadlock = 0;
+    f18_chip_t* chip;
+    char* cover_filename = NULL;
+    char* stim_filename = NULL;
+    char* wave_filename = NULL;
+    uint64_t wave_limit = WAVE_LIMIT;
+    char* sdram_filename = NULL;
+    int sdram_fast = 0;
+    char* flash_filename = NULL;
+    char* spi_filename = NULL;
+    int flash_fast = 0;
+    char* report_files = NULL;
+    f18_boot_stream_t boot_stream;
+    const uint18_t* boot_words = NULL;  // -B async, fed to 708
+    size_t boot_len = 0;
+    int loaded[GRID_ROWS][GRID_COLS];
     char* log_filename = NULL;
     int file_fd = -1;
     uint18_t id = 999;
@@ -552,6 +563,10 @@ int main(int argc, char** argv)
     char n001_path[MAX_SOCKET_NAMELEN];
     int n701_mode;
     char n701_path[MAX_SOCKET_NAMELEN];  
+    port_opt_t port_opts[MAX_PORT_OPTS];
+    int num_port_opts = 0;
+    analog_opt_t analog_opts[MAX_ANALOG_OPTS];
+    int num_analog_opts = 0;
     
     g_page_size = sysconf(_SC_PAGESIZE);  // must be first!
     g_flags = 0;
@@ -562,11 +577,75 @@ int main(int argc, char** argv)
 
     // check_clock();
     
-    while((c = getopt(argc, argv, "ivqtnPAl:b:d:I:L:D:f:GS:")) != -1) {
+    while((c = getopt(argc, argv, "ivqtnPAl:b:d:I:L:D:f:GS:B:w:o:C:W:c:r:p:s:R:m:F:x:a:")) != -1) {
 	switch(c) {
 	case 'i': interactive = 1; break;
 	case 'n': noexec = 1; break;
 	case 'f': filename = optarg; break;
+	case 'B':
+	    if ((strcmp(optarg, "async") != 0) && (strcmp(optarg, "fast") != 0))
+		usage(basename(argv[0]), "bad boot mode %s\n", optarg);
+	    boot_mode = optarg;
+	    break;
+	case 'w': stream_filename = optarg; break;
+	case 'o': image_filename = optarg; break;
+	case 'C': ctl_path = optarg; break;
+	case 'c': cover_filename = optarg; break;
+	case 's': stim_filename = optarg; break;
+	case 'R': {
+	    char* ptr;
+	    wave_filename = optarg;
+	    if ((ptr = strrchr(optarg, ':')) != NULL) {
+		char* endptr;
+		wave_limit = strtoull(ptr+1, &endptr, 10) << 20;
+		if ((endptr == ptr+1) || (*endptr != '\0'))
+		    usage(basename(argv[0]), "bad capture option %s\n", optarg);
+		*ptr = '\0';
+	    }
+	    break;
+	}
+	case 'm': {
+	    char* ptr;
+	    sdram_filename = optarg;
+	    if ((ptr = strchr(optarg, ':')) != NULL) {
+		if (strcmp(ptr+1, "fast") != 0)
+		    usage(basename(argv[0]), "bad sdram option %s\n", optarg);
+		*ptr = '\0';
+		sdram_fast = 1;
+	    }
+	    break;
+	}
+	case 'F': {
+	    char* ptr;
+	    flash_filename = optarg;
+	    if ((ptr = strchr(optarg, ':')) != NULL) {
+		if (strcmp(ptr+1, "fast") != 0)
+		    usage(basename(argv[0]), "bad flash option %s\n", optarg);
+		*ptr = '\0';
+		flash_fast = 1;
+	    }
+	    break;
+	}
+	case 'x': spi_filename = optarg; break;
+	case 'r': report_files = optarg; break;
+	case 'W':
+	    if ((watchdog_ms = atoi(optarg)) <= 0)
+		usage(basename(argv[0]), "bad watchdog period %s\n", optarg);
+	    break;
+	case 'p':
+	    if (num_port_opts == MAX_PORT_OPTS)
+		usage(basename(argv[0]), "too many ports\n");
+	    if (port_option(optarg, &port_opts[num_port_opts]) < 0)
+		usage(basename(argv[0]), "bad port %s\n", optarg);
+	    num_port_opts++;
+	    break;
+	case 'a':
+	    if (num_analog_opts == MAX_ANALOG_OPTS)
+		usage(basename(argv[0]), "too many analog streams\n");
+	    if (analog_option(optarg, &analog_opts[num_analog_opts]) < 0)
+		usage(basename(argv[0]), "bad analog stream %s\n", optarg);
+	    num_analog_opts++;
+	    break;
 	case 'l': log_filename = optarg; break;	    
 	case 'v': g_flags |= FLAG_VERBOSE; break;
 	case 'q': g_flags |= FLAG_SILENT; break;
@@ -724,7 +803,9 @@ int main(int argc, char** argv)
 	    exit(1);
 	}
     }
-    if (filename != NULL) {
+    if ((filename != NULL) && (strcmp(filename, "-") == 0))
+	file_fd = STDIN_FILENO;
+    else if (filename != NULL) {
 	if ((file_fd = open(filename, O_RDONLY)) < 0) {
 	    fprintf(stderr, "unabled to open file %s, error=%s\n",
 		    filename, strerror(errno));
@@ -741,225 +822,146 @@ int main(int argc, char** argv)
 	}
     }
 
-    alloc_size = GRID_ROWS*GRID_COLS*(PAGE(NODE_SIZE));
     if (g_flags & FLAG_VERBOSE) {
-	fprintf(stderr, "page size %ld\n", g_page_size);
-	fprintf(stderr, "alloc size: %ld\n", alloc_size);
 	fprintf(stderr, "stack size: %ld bytes\n", PAGE(STACK_SIZE));
-	fprintf(stderr, "node size: %ld bytes\n", PAGE(NODE_SIZE));
-	fprintf(stderr, "sizeof(node_t): %lu\n", sizeof(node_t));
-	fprintf(stderr, "sizeof(reg_node_t): %lu\n", sizeof(reg_node_t));
-	fprintf(stderr, "sizeof(serdes_node_t): %lu\n", sizeof(serdes_node_t));	
+	fprintf(stderr, "sizeof(serdes_node_t): %lu\n", sizeof(serdes_node_t));
     }
-
-    if (posix_memalign(&node_mem, g_page_size, alloc_size)) {
+    if ((chip = f18_create(g_flags)) == NULL) {
 	perror("posix_memalign (node_mem) failed");
 	exit(1);
     }
 
-    // reset global node connection 8x18 array pointers!
-    memset(node, 0, sizeof(node));
-
-    // start moving memory into the node data
-    np_mem = (uint8_t*) node_mem;
     for (i = 0; i < GRID_ROWS; i++) {
 	for (j = 0; j < GRID_COLS; j++) {
-	    reg_node_t* np;
-	    f18_rom_type_t rt;
-	    int node_id = MAKE_ID(i,j);
-
-	    // each thread structure is allocated in one page
-	    memset(np_mem, 0, PAGE(NODE_SIZE));
-
-	    np = (reg_node_t*) np_mem;
-	    np_mem += (PAGE(NODE_SIZE));
-	    node[i][j] = (node_t*) np;
-	    rt = RomTypeMap[i][j];
-	    np->n.rom_type = rt;
-	    np->n.rom = RomMap[rt].addr;
-	    np->n.id = node_id;
+	    // fixme: better config per process
+	    if ((id != 999) && (node[i][j]->id != id))
+		node[i][j]->flags  = 0;
+	    node[i][j]->delay  = delay;
+	}
+    }
 
-	    np->dmask = 0;
-	    np->imask = 0;
+    if ((f18_attach_serdes(chip, 001, n001_mode, n001_path) < 0) ||
+	(f18_attach_serdes(chip, 701, n701_mode, n701_path) < 0)) {
+	fprintf(stderr, "Failed to setup SERDES node, error=%s\n",
+		strerror(errno));
+	exit(1);
+    }
 
-	    f18_chan_init(&np->chan);
+    // load nodes if -f was given
+    if ((file_fd >= 0) && (f18_load_fd(chip, file_fd, filename) < 0)) {
+	fprintf(stderr, "unable to load image %s, error=%s\n",
+		filename, strerror(errno));
+	exit(1);
+    }
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    loaded[i][j] = f18_loaded(chip, MAKE_ID(i,j));
 
-	    np->neighbour[0] = NULL;
-	    np->neighbour[1] = NULL;
-	    np->neighbour[2] = NULL;
-	    np->neighbour[3] = NULL;
-	    np->neighbour[4] = NULL;
+    if (image_filename != NULL) {
+	if (f18_image_write(image_filename, node, loaded) < 0) {
+	    fprintf(stderr, "unable to write image %s, error=%s\n",
+		    image_filename, strerror(errno));
+	    exit(1);
+	}
+    }
 
-	    np->n.ior    = IMASK;  // default read value
-	    np->n.iow    = 0;      // write cache
+    if (spi_filename != NULL) {
+	int fd;
 
-	    np->n.reg.p = ConfigMap[i][j].reset;
-	    np->n.io_addr = ConfigMap[i][j].io_addr;
-	    np->dmask = dirbits(i,j,ConfigMap[i][j].comm);
-	    np->imask = (ConfigMap[i][j].io_addr ?
-			 dirbits(i,j,ConfigMap[i][j].io_addr) : 0);
+	f18_boot_stream_init(&boot_stream);
+	if (boot_stream_setup(&boot_stream, loaded, 0, 1) < 0) {
+	    fprintf(stderr, "unable to build spi boot stream\n");
+	    exit(1);
+	}
+	if (((fd = open(spi_filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) ||
+	    (f18_boot_spi_write(fd, &boot_stream) < 0)) {
+	    fprintf(stderr, "unable to write file %s, error=%s\n",
+		    spi_filename, strerror(errno));
+	    exit(1);
+	}
+	close(fd);
+	f18_boot_stream_free(&boot_stream);
+    }
 
-	    // fixme: better config per process
-	    if (id == 999)
-		np->n.flags  = g_flags;
-	    else if (np->n.id == id)
-		np->n.flags  = g_flags;
-	    np->n.delay  = delay;
-	    np->n.reg.b = IOREG_IO;
-	    np->n.read_ioreg  = f18_read_ioreg;
-	    np->n.write_ioreg = f18_write_ioreg;
-
-	    // Special node initialization based on node_id
-	    switch (rt) {
-	    case async_boot: {
-		int master, slave;
-		
-		assert(node_id == 708);
-		
-		memset(&r708, 0, sizeof(r708));
-		memset(&w708, 0, sizeof(w708));
-
-		f18_chan_init(&r708.chan);
-		f18_chan_init(&w708.chan);
-		async_reader_init(&r708);
-
-		if ((master = open_pty(g_pty_name, sizeof(g_pty_name))) < 0) {
-		    fprintf(stderr, "unable to open a pty error=%s (%d)\n",
-			    strerror(errno), errno);
-		    exit(1);
-		}
-		PRINTF("PTY_NAME=%s\n", g_pty_name);
-		slave = open(g_pty_name, O_RDWR | O_NOCTTY);
-		(void) slave;
-
-		r708.fd = master;
-		r708.baud = baud;
-		w708.fd = master; // STDOUT_FILENO;
-		w708.baud = baud;
-		np->n.read_ioreg = read_ioreg_708; // sync buffer read
-		break;		
-	    }
-	    case serdes_boot: {
-		serdes_node_t* sp = (serdes_node_t*) np;
-		
-		assert(node_id == 001 || node_id == 701);
-		// fixme: pass as argument to init?
-		if (node_id == 001) {
-		    serdes_node_init(sp,n001_mode,n001_path);
-		    if (serdes_setup(sp) < 0) {
-			fprintf(stderr, "Failed to setup SERDES node %03d\n",
-				node_id);
-			exit(1);
-		    }
-		}
-		else if (node_id == 701) {
-		    serdes_node_init(sp,n701_mode,n701_path);    
-		    if (serdes_setup(sp) < 0) {
-			fprintf(stderr, "Failed to setup SERDES node %03d\n",
-				node_id);
-			exit(1);
-		    }
-		}
-		break;
+    // reload -f nodes through a boot stream
+    if ((boot_mode != NULL) || (stream_filename != NULL)) {
+	f18_boot_stream_init(&boot_stream);
+	if (boot_stream_setup(&boot_stream, loaded, boot_mode != NULL, 0) < 0) {
+	    fprintf(stderr, "unable to build boot stream\n");
+	    exit(1);
+	}
+	if (stream_filename != NULL) {
+	    int fd;
+	    if (((fd = open(stream_filename, O_WRONLY|O_CREAT|O_TRUNC,
+			    0644)) < 0) ||
+		(f18_boot_stream_write(fd, &boot_stream) < 0)) {
+		fprintf(stderr, "unable to write file %s, error=%s\n",
+			stream_filename, strerror(errno));
+		exit(1);
 	    }
-	    default:
-		break;
+	    close(fd);
+	}
+	if ((boot_mode != NULL) && (strcmp(boot_mode, "fast") == 0)) {
+	    if (f18_boot_stream_load(&boot_stream) < 0) {
+		fprintf(stderr, "malformed boot stream\n");
+		exit(1);
 	    }
 	}
+	else if (boot_mode != NULL) {
+	    boot_words = boot_stream.words;
+	    boot_len = boot_stream.len;
+	}
     }
 
-    // load nodes if -f was given
-    if (file_fd >= 0) {
-	uint18_t nid = 0xfff;
-	uint18_t addr = 0;
-	node_t* np = NULL;
-	f18_symbol_table_t symtab;
-	uint8_t heap[MAX_SCAN_HEAP_SIZE];
-	int line = 0;
-	char linebuf[MAX_LINE_LEN+1];
-	symindex_t si;
-	f18_voc_t voc;
-	int r;
+    // host streams on edge ports, started with the nodes
+    for (i = 0; i < num_port_opts; i++) {
+	port_opt_t* op = &port_opts[i];
+	int pfd;
 
-	// temporary symbol table memory used while loading node
-	INIT_SYMTAB(&symtab, heap, MAX_SCAN_HEAP_SIZE);
-	voc_setup(voc, &symtab, &no_symbols);
-	
-	while((r = f18_asm_line(file_fd,&line,linebuf,sizeof(linebuf),
-				&addr, &nid, np->ram, voc)) >= 0) {
-	    switch(r) {
-	    case META_NODE:
-		// fixme: multiple switch to same node !
-		if (np != NULL) { // find main in symtab
-		    if ((si = sym_find_by_name("main", &symtab)) != NOSYM)
-			np->reg.p = symtab.symbol[si].value;
-		    // printf("set p = %03x\n", np->reg.p);
-		    np->symtab = sym_copy_table(&symtab);
-		}
-		// reinitialize
-		INIT_SYMTAB(&symtab, heap, MAX_SCAN_HEAP_SIZE);
-		np = node[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)];
-		voc_setup(voc, &symtab,
-			  SymTabMap[ID_TO_ROW(nid)][ID_TO_COLUMN(nid)]);
-		addr = 0;
-		break;
-	    case META_ORG:
-		// printf("load: set org=%03x\n", addr);
-		break;
-	    default:
-		// printf("load: %03d ram[%03x]=%06x\n", nid, addr, data);
-		addr++;
-	    }
+	if (strcmp(op->path, "-") == 0)
+	    pfd = (op->mode == F18_PORT_IN) ? STDIN_FILENO : STDOUT_FILENO;
+	else if ((pfd = open(op->path, (op->mode == F18_PORT_IN) ? O_RDONLY :
+			     (O_WRONLY|O_CREAT|O_TRUNC), 0644)) < 0) {
+	    fprintf(stderr, "unabled to open file %s, error=%s\n",
+		    op->path, strerror(errno));
+	    exit(1);
 	}
-	if (r < 0) {
-	    switch(r) {
-	    case -1:
-		fprintf(stderr, "%s:%d: syntax error: %s\n",
-			filename, line, linebuf);
-		break;
-	    case -2:
-	    case -3:
-		break;
-	    }
+	if (f18_attach_stream(chip, op->id, op->dir, op->mode, pfd) == NULL) {
+	    fprintf(stderr, "port %03d %s is not an edge port of a loaded node\n",
+		    op->id, dir_name[op->dir]);
+	    exit(1);
 	}
-	if (np != NULL) { // find main in symtab
-	    if ((si = sym_find_by_name("main", &symtab)) != NOSYM) {
-		np->reg.p = symtab.symbol[si].value;
-		// printf("set p = %03x\n", np->reg.p);
-	    }
-	    np->symtab = sym_copy_table(&symtab);
+    }
+
+    // external SDRAM, the fast path needs a program in 007
+    if (sdram_filename != NULL) {
+	char* path = (strcmp(sdram_filename, "-") == 0) ? NULL : sdram_filename;
+
+	if ((f18_sdram_open(path, 0) < 0) || (f18_sdram_attach(node) < 0)) {
+	    fprintf(stderr, "unable to setup sdram %s, error=%s\n",
+		    sdram_filename, strerror(errno));
+	    exit(1);
+	}
+	if (sdram_fast &&
+	    (f18_attach_device(chip, F18_SDRAM_NODE, DOWN,
+			       f18_sdram_serve, NULL) == NULL)) {
+	    fprintf(stderr, "port %03d down is not an edge port of a loaded node\n",
+		    F18_SDRAM_NODE);
+	    exit(1);
 	}
     }
 
-    // init neighbours channels
-    for (i=0; i < GRID_ROWS; i++) {
-	for (j = 0; j < GRID_COLS; j++) {
-	    reg_node_t* np = (reg_node_t*) node[i][j];
-
-	    if (i < GRID_ROWS-1)
-		np->neighbour[UP] = &((reg_node_t*)node[i+1][j])->chan;
-	    else if (i == GRID_ROWS-1) {
-		if (np->n.id == 708) {
-		    np->neighbour[UP] = &r708.chan;    // read async
-		    r708.out = &np->chan;              //
-		    r708.n.id = 808;
-		    np->ioc = &w708.chan;              // io control channel
-		    w708.n.id = 908;
-		    w708.in = &np->chan;              // write from 708
-		}
-	    }
-	    if (i > 0)
-		np->neighbour[DOWN] = &((reg_node_t*)node[i-1][j])->chan;
-	    if (j > 0)
-		np->neighbour[LEFT] = &((reg_node_t*)node[i][j-1])->chan;
-	    if (j < GRID_COLS-1)
-		np->neighbour[RIGHT] = &((reg_node_t*)node[i][j+1])->chan;
-
-	    // FIXME add io channels !
+    // SPI flash, read by the 705 boot ROM or applied directly
+    if (flash_filename != NULL) {
+	if ((f18_flash_open(flash_filename) < 0) ||
+	    ((flash_fast ? f18_flash_boot() : f18_flash_attach(node)) < 0)) {
+	    fprintf(stderr, "unable to boot flash %s, error=%s\n",
+		    flash_filename, strerror(errno));
+	    exit(1);
 	}
     }
 
-    if (id != 999) {
+    if ((id != 999) && (report_files == NULL)) {
 	int i = ID_TO_ROW(id);
 	int j = ID_TO_COLUMN(id);
 	f18_voc_t voc;
@@ -987,16 +989,97 @@ int main(int argc, char** argv)
 	    f18_disasm(logout,np->n.ram, voc, RAM_START, (RAM_END-RAM_START)+1);
 	}
     }
+    if (report_files != NULL) {
+	f18_cover_t* cp = calloc(1, sizeof(f18_cover_t));
+	char* fname;
+
+	if (cp == NULL) {
+	    perror("calloc");
+	    exit(1);
+	}
+	while ((fname = strsep(&report_files, ",")) != NULL) {
+	    if (f18_cover_read(fname, cp) < 0) {
+		fprintf(stderr, "unable to read coverage %s, error=%s\n",
+			fname, strerror(errno));
+		exit(1);
+	    }
+	}
+	f18_cover_report(logout, cp, node, id, (g_flags & FLAG_DUMP_ROM) != 0);
+	if ((cover_filename != NULL) &&
+	    (f18_cover_write_merged(cover_filename, cp) < 0)) {
+	    fprintf(stderr, "unable to write file %s, error=%s\n",
+		    cover_filename, strerror(errno));
+	    exit(1);
+	}
+	exit(0);
+    }
     if (noexec)
 	exit(0);
 
-    pthread_attr_init(&g_epoll_attr);
-    pthread_attr_setstacksize(&g_epoll_attr, PAGE(STACK_SIZE));
-    if (pthread_create(&g_epoll_thread,&g_epoll_attr,
-		       f18_epoll_main, (void*) NULL) < 0) {
-	perror("pthread_create");
+    // 708 async io on a pty, fed the boot stream first with -B async.
+    // Not opened for -r reports or -n, they exit above
+    if (f18_attach_async(chip, -1, -1, baud, boot_words, boot_len) < 0) {
+	fprintf(stderr, "unable to open a pty error=%s (%d)\n",
+		strerror(errno), errno);
 	exit(1);
     }
+    PRINTF("PTY_NAME=%s\n", g_pty_name);
+
+    if ((ctl_path != NULL) && ((ctl_fd = f18_ctl_open(ctl_path)) < 0)) {
+	fprintf(stderr, "unable to open control socket %s, error=%s\n",
+		ctl_path, strerror(errno));
+	exit(1);
+    }
+
+    for (i = 0; i < num_analog_opts; i++) {
+	analog_opt_t* op = &analog_opts[i];
+	int r;
+
+	if (op->mode == F18_PORT_IN)
+	    r = f18_analog_source(node, op->id, op->path, NULL, op->period);
+	else {
+	    int afd = STDOUT_FILENO;
+	    if ((strcmp(op->path, "-") != 0) &&
+		((afd = open(op->path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0))
+		r = -1;
+	    else
+		r = f18_analog_sink(node, op->id, afd, NULL, op->period);
+	}
+	if (r < 0) {
+	    fprintf(stderr, "unable to setup analog %03d %s, error=%s\n",
+		    op->id, op->path, strerror(errno));
+	    exit(1);
+	}
+    }
+
+    // pin stimulus and capture hook the io registers set up above
+    if ((stim_filename != NULL) && (f18_stim_open(stim_filename, node) < 0)) {
+	fprintf(stderr, "unable to load stimulus %s, error=%s\n",
+		stim_filename, strerror(errno));
+	exit(1);
+    }
+    if ((wave_filename != NULL) && (f18_wave_open(wave_filename, node, wave_limit) < 0)) {
+	fprintf(stderr, "unable to open file %s, error=%s\n",
+		wave_filename, strerror(errno));
+	exit(1);
+    }
+
+    // blocked before the first thread is created, all threads inherit it
+    if (!interactive) {
+	static sigset_t stop_set;
+
+	sigemptyset(&stop_set);
+	sigaddset(&stop_set, SIGINT);
+	sigaddset(&stop_set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop_set, NULL);
+	pthread_attr_init(&g_sig_attr);
+	pthread_attr_setstacksize(&g_sig_attr, PAGE(STACK_SIZE));
+	if (pthread_create(&g_sig_thread, &g_sig_attr, sig_main,
+			   (void*) &stop_set) < 0) {
+	    perror("pthread_create");
+	    exit(1);
+	}
+    }
 
     // Initialize debugger if -G flag set
     if (g_flags & FLAG_DEBUG_ENABLE) {
@@ -1013,53 +1096,22 @@ int main(int argc, char** argv)
 	}
     }
 
-    // Benchmark emulator speed using node[0][0]
-//    g_emu_speed = f18_benchmark(node[0][0], 262143);  // 0x3FFFF iterations
-//    printf("Emulator speed: %.2f MIPS\n", g_emu_speed);
-
-    // Set num_active before creating threads to avoid race where main
-    // thread checks the termination condition before threads have started
-    // Check if node 708 exists (row 7, col 8) before including async threads
-    num_active = GRID_ROWS * GRID_COLS;
-
-    for (i=0; i < GRID_ROWS; i++) {
-	for (j = 0; j < GRID_COLS; j++) {
-	    reg_node_t* np = (reg_node_t*) node[i][j];
-
-	    if (np->n.id == 708) {
-		pthread_attr_init(&r708.attr);
-		pthread_attr_setstacksize(&r708.attr, PAGE(STACK_SIZE));
-		if (pthread_create(&r708.thread,&r708.attr,async_reader_start,
-				   (void*) &r708) <0) {
-		    perror("pthread_create");
-		    exit(1);
-		}
-
-		pthread_attr_init(&w708.attr);
-		pthread_attr_setstacksize(&w708.attr, PAGE(STACK_SIZE));
-		if (pthread_create(&w708.thread,&w708.attr,async_writer_start,
-				   (void*)&w708) <0) {
-		    perror("pthread_create");
-		    exit(1);
-		}
-		num_active += 2;
-	    }
-
-	    pthread_attr_init(&np->attr);
-	    pthread_attr_setstacksize(&np->attr, PAGE(STACK_SIZE));
-	    if (g_flags & FLAG_VERBOSE) {
-		size_t size;
-		pthread_attr_getstacksize(&np->attr, &size);
-		// fprintf(stderr, "thread stack size: %ld\n", size);
-	    }
-	    VERBOSE(np, "about to start node%s\n", "");
-	    if (pthread_create(&np->thread,&np->attr,f18_emu_start,(void*) np) <0) {
-		perror("pthread_create");
-		exit(1);
-	    }
+    // control thread, not counted as active, the chip may go idle
+    if (ctl_fd >= 0) {
+	pthread_attr_init(&g_ctl_attr);
+	pthread_attr_setstacksize(&g_ctl_attr, PAGE(STACK_SIZE));
+	if (pthread_create(&g_ctl_thread, &g_ctl_attr, f18_ctl_main,
+			   (void*)(intptr_t) ctl_fd) < 0) {
+	    perror("pthread_create");
+	    exit(1);
 	}
     }
 
+    if (f18_start(chip, PAGE(STACK_SIZE)) < 0) {
+	perror("pthread_create");
+	exit(1);
+    }
+
     // Set CPU affinity for threads if requested
     if (g_flags & FLAG_AFFINITY) {
 	int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
@@ -1087,7 +1139,7 @@ int main(int argc, char** argv)
 
 	// Pin async I/O threads to first CPUs
 	    
-	if ((node[7][8] != NULL) && (num_cpus >= 2)) {
+	if (num_cpus >= 2) {
 	    CPU_ZERO(&cpuset);
 	    CPU_SET(cpu % num_cpus, &cpuset);
 	    pthread_setaffinity_np(r708.thread, sizeof(cpuset), &cpuset);
@@ -1116,42 +1168,58 @@ int main(int argc, char** argv)
 	}
     }
 
+    // paused and stepped nodes would look wedged, no watchdog with -G
+    if ((watchdog_ms > 0) && !(g_flags & FLAG_DEBUG_ENABLE)) {
+	pthread_attr_init(&g_wd_attr);
+	pthread_attr_setstacksize(&g_wd_attr, PAGE(STACK_SIZE));
+	if (pthread_create(&g_wd_thread, &g_wd_attr, f18_watchdog_main,
+			   (void*)(intptr_t) watchdog_ms) < 0) {
+	    perror("pthread_create");
+	    exit(1);
+	}
+    }
+
     // Wait until no threads are active and none are waiting on external I/O
     if (g_flags & FLAG_DEBUG_ENABLE) {
 	// Run debugger TUI main loop
 	// extern void debug_tui_main(void);
 	debug_tui_main();
-    } else {
-	pthread_mutex_lock(&sys_lock);
-	while (num_active > 0 || num_blocked_ext > 0)
-	    pthread_cond_wait(&sys_cond, &sys_lock);
-	pthread_mutex_unlock(&sys_lock);
+    } else
+	deadlock = f18_wait(chip);
+
+    if (ctl_fd >= 0) {
+	f18_ctl_stop();
+	if (!deadlock)  // a wedged chip exits without waiting on commands
+	    pthread_join(g_ctl_thread, NULL);
+	// nodes held from the control socket leave their barriers
+	if (g_debugger.enabled && !(g_flags & FLAG_DEBUG_ENABLE))
+	    debug_detach();
     }
+    f18_stop(chip);  // terminate and join the io and node threads
 
-    // Signal all nodes to terminate and wake blocked threads
-    for (i = 0; i < GRID_ROWS; i++) {
-	for (j = 0; j < GRID_COLS; j++) {
-	    reg_node_t* np = (reg_node_t*) node[i][j];
-
-	    np->n.flags |= FLAG_TERMINATE;  // emulator loop
-	    f18_chan_terminate(&np->chan);  // signal termination
-	}
-    }
-    // Terminate and join async threads only if node 708 exists
-    if (node[7][8] != NULL) {
-	f18_chan_terminate(&r708.chan);
-	f18_chan_terminate(&w708.chan);
+    if ((watchdog_ms > 0) && !(g_flags & FLAG_DEBUG_ENABLE)) {
+	f18_watchdog_stop();
+	pthread_join(g_wd_thread, NULL);
     }
 
-    // Join all threads
-    for (i = 0; i < GRID_ROWS; i++)
-	for (j = 0; j < GRID_COLS; j++)
-	    pthread_join(((reg_node_t*)node[i][j])->thread, NULL);
+    if (flash_filename != NULL)
+	f18_flash_close();
+    if ((sdram_filename != NULL) && (f18_sdram_close() < 0))
+	fprintf(stderr, "unable to write file %s, error=%s\n",
+		sdram_filename, strerror(errno));
 
-    if (node[7][8] != NULL) {
-	pthread_join(r708.thread, NULL);
-	pthread_join(w708.thread, NULL);
-    }
+    if ((num_analog_opts > 0) && (f18_analog_close() < 0))
+	fprintf(stderr, "unable to write analog samples, error=%s\n",
+		strerror(errno));
+
+    if ((wave_filename != NULL) && (f18_wave_close() < 0))
+	fprintf(stderr, "unable to write file %s, error=%s\n",
+		wave_filename, strerror(errno));
+
+    if ((cover_filename != NULL) &&
+	(f18_cover_write(cover_filename, node) < 0))
+	fprintf(stderr, "unable to write file %s, error=%s\n",
+		cover_filename, strerror(errno));
 
     if (g_flags & FLAG_DEBUG_ENABLE)
 	debug_cleanup();
@@ -1160,5 +1228,5 @@ int main(int argc, char** argv)
 	tty_reset(tty_fd);
     if ((logout != NULL) && (logout != stderr))
 	fclose(logout);
-    exit(0);
+    exit(deadlock ? F18_EXIT_DEADLOCK : 0);
 }
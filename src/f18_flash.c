@@ -0,0 +1,200 @@
+//
+// SPI flash model for the 705 boot node
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_boot.h"
+#include "f18_flash.h"
+
+#define PIN_SCK   0     // shift of the 2 bit pin fields
+#define PIN_CS    2
+#define PIN_MOSI  4
+
+enum {
+    FLASH_IDLE,      // ~CS high
+    FLASH_CMD,       // 8 command bits
+    FLASH_ADDR,      // 24 address bits
+    FLASH_DUMMY,     // 8 dummy bits (FAST_READ)
+    FLASH_DATA,      // shift out from addr
+    FLASH_IGNORE     // unsupported command, until ~CS high
+};
+
+typedef struct {
+    const uint8_t* image;
+    size_t len;
+    int state;
+    int nbits;       // bits shifted in the current phase
+    uint32_t shift;
+    uint32_t cmd;
+    uint64_t pos;    // bit position of the data phase
+    int sck;         // last SCK level
+    void (*write_ioreg)(node_t* np, uint18_t reg, uint18_t val);
+} flash_t;
+
+static flash_t flash;
+
+int f18_flash_open(const char* filename)
+{
+    struct stat st;
+    void* image;
+    int fd;
+
+    if (flash.image != NULL) {
+	errno = EBUSY;
+	return -1;
+    }
+    if ((fd = open(filename, O_RDONLY)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0)
+	goto error;
+    if (st.st_size == 0) {
+	errno = EINVAL;
+	goto error;
+    }
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (image == MAP_FAILED)
+	goto error;
+    close(fd);
+    madvise(image, st.st_size, MADV_SEQUENTIAL);
+    flash.image = image;
+    flash.len = st.st_size;
+    flash.state = FLASH_IDLE;
+    return 0;
+error:
+    close(fd);
+    return -1;
+}
+
+int f18_flash_close(void)
+{
+    if (flash.image == NULL)
+	return 0;
+    munmap((void*) flash.image, flash.len);
+    flash.image = NULL;
+    return 0;
+}
+
+int f18_flash_boot(void)
+{
+    if (flash.image == NULL) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (f18_boot_spi_load(flash.image, flash.len) < 0) {
+	errno = EINVAL;
+	return -1;
+    }
+    return 0;
+}
+
+// 1 when the 2 bit pin field is driven high
+static inline int pin_high(uint18_t value, int shift)
+{
+    return ((value >> shift) & 3) == 3;
+}
+
+static void set_miso(node_t* np, int bit)
+{
+    uint32_t old_val, new_val;
+
+    do {
+	old_val = __atomic_load_n(&np->ior, __ATOMIC_SEQ_CST);
+	new_val = bit ? (old_val | F18_IO_PIN17) : (old_val & ~F18_IO_PIN17);
+    } while (!__atomic_compare_exchange_n(&np->ior, &old_val, new_val,
+					  0, __ATOMIC_SEQ_CST,
+					  __ATOMIC_SEQ_CST));
+}
+
+// next data bit, erased past the end of the image
+static int data_bit(void)
+{
+    size_t i = flash.pos >> 3;
+    int bit = (i < flash.len) ?
+	(flash.image[i] >> (7 - (flash.pos & 7))) & 1 : 1;
+    flash.pos++;
+    return bit;
+}
+
+// rising SCK edge, shift in MOSI
+static void flash_clock_in(int mosi)
+{
+    flash.shift = (flash.shift << 1) | mosi;
+    flash.nbits++;
+    switch (flash.state) {
+    case FLASH_CMD:
+	if (flash.nbits < 8)
+	    break;
+	flash.cmd = flash.shift & 0xff;
+	flash.state = ((flash.cmd == F18_FLASH_READ) ||
+		       (flash.cmd == F18_FLASH_FAST_READ)) ?
+	    FLASH_ADDR : FLASH_IGNORE;
+	flash.nbits = 0;
+	flash.shift = 0;
+	break;
+    case FLASH_ADDR:
+	if (flash.nbits < 24)
+	    break;
+	flash.pos = (uint64_t)(flash.shift & 0xffffff) * 8;
+	flash.state = (flash.cmd == F18_FLASH_FAST_READ) ?
+	    FLASH_DUMMY : FLASH_DATA;
+	flash.nbits = 0;
+	break;
+    case FLASH_DUMMY:
+	if (flash.nbits == 8)
+	    flash.state = FLASH_DATA;
+	break;
+    default:
+	break;
+    }
+}
+
+static void flash_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    if (ioreg == IOREG_IO) {
+	int sck = pin_high(value, PIN_SCK);
+
+	if (pin_high(value, PIN_CS)) {
+	    if (flash.state != FLASH_IDLE)
+		set_miso(np, 0);
+	    flash.state = FLASH_IDLE;
+	}
+	else {
+	    if (flash.state == FLASH_IDLE) {
+		flash.state = FLASH_CMD;
+		flash.nbits = 0;
+		flash.shift = 0;
+	    }
+	    if (sck && !flash.sck)
+		flash_clock_in(pin_high(value, PIN_MOSI));
+	    else if (!sck && flash.sck && (flash.state == FLASH_DATA))
+		set_miso(np, data_bit());
+	}
+	flash.sck = sck;
+    }
+    (*flash.write_ioreg)(np, ioreg, value);
+}
+
+int f18_flash_attach(node_t* nodes[GRID_ROWS][GRID_COLS])
+{
+    node_t* np;
+
+    if ((flash.image == NULL) || (flash.write_ioreg != NULL)) {
+	errno = EINVAL;
+	return -1;
+    }
+    np = nodes[ID_TO_ROW(F18_FLASH_NODE)][ID_TO_COLUMN(F18_FLASH_NODE)];
+    flash.write_ioreg = np->write_ioreg;
+    np->write_ioreg = flash_write_ioreg;
+    flash.sck = 1;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __F18_FLASH_H__
+#define __F18_FLASH_H__
+
+//
+// SPI flash on the 705 boot pins
+//
+// Pin model, driven by 705 io register writes (10 low, 11 high):
+//
+//   pin 1  (bits 1:0)   SCK
+//   pin 3  (bits 3:2)   ~CS
+//   pin 5  (bits 5:4)   MOSI, sampled on the rising SCK edge
+//   pin 17 (io bit 17)  MISO, next bit driven on the falling SCK edge
+//
+// Commands READ (03) and FAST_READ (0B) with a 24 bit address are
+// served from the image, reads past the end return erased bits (1s).
+// ~CS high ends the command.
+//
+// Accelerated mode skips the pins, f18_flash_boot reads the frames
+// from the image and applies them as the 705 ROM would.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include "f18.h"
+
+#define F18_FLASH_NODE       705
+#define F18_FLASH_READ       0x03
+#define F18_FLASH_FAST_READ  0x0b
+
+// Map the flash image read only
+extern int f18_flash_open(const char* filename);
+
+// Hook the io register of 705
+extern int f18_flash_attach(node_t* nodes[GRID_ROWS][GRID_COLS]);
+
+// Accelerated boot, 705 is left at its next ROM address
+extern int f18_flash_boot(void);
+
+// Unmap the image
+extern int f18_flash_close(void);
+
+#endif
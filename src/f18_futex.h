@@ -0,0 +1,33 @@
+#ifndef __F18_FUTEX_H__
+#define __F18_FUTEX_H__
+
+//
+// Minimal futex wrappers (Linux) used for wait/wake on 32-bit words
+// where a pthread mutex/cond pair would cost syscalls on every access.
+//
+
+#include <stdint.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+// Sleep while *addr == val (returns immediately if it differs)
+static inline void f18_futex_wait(uint32_t* addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+// Wake one waiter sleeping on addr
+static inline void f18_futex_wake(uint32_t* addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Wake all waiters sleeping on addr
+static inline void f18_futex_wake_all(uint32_t* addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+#endif
@@ -0,0 +1,498 @@
+//
+// Coverage guided fuzzer for node programs
+//
+// The chip is created and the program loaded once through libf18, the
+// loaded nodes then run with f18_run in a single thread. Each execution
+// resets the chip to the state after load (f18_reset) and feeds one
+// input to the environment, endpoints on all edge ports of loaded nodes
+// (ports that face the chip edge or a node that is not loaded).
+//
+// An input is a sequence of 3 byte (big endian) records:
+//
+//   11.. .... .... nnnn nnnn pppp    pin record, pins 17,5,3,1 (bit 0-3)
+//                                    of loaded node n (8 bits, modulo the
+//                                    number of loaded nodes), applied
+//                                    between run slices or when all
+//                                    nodes wait
+//   ..ss ssvv vvvv vvvv vvvv vvvv    port word v, for environment port
+//                                    s (modulo the number of them) when
+//                                    all nodes wait, dropped when that
+//                                    port is not being read
+//
+// Words written to the environment are taken as they show up. An
+// execution ends when all nodes wait and the input is used up, or
+// after a maximum number of words. Inputs that hit new RAM/ROM
+// slots are kept in the corpus and mutated further.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_chip.h"
+#include "f18_sched.h"
+#include "f18_lib.h"
+#include "f18_cover.h"
+
+#define FUZZ_MAX_INPUT (3*256)   // bytes
+#define MAX_CORPUS    4096
+#define NUM_NODES     (GRID_ROWS*GRID_COLS)
+
+#define REC_IS_PIN(r)  (((r) >> 22) == 3)
+
+typedef struct {
+    size_t  len;
+    uint8_t data[FUZZ_MAX_INPUT];
+} input_t;
+
+static f18_chip_t*  s_chip = NULL;
+static int          s_nloaded = 0;
+static uint18_t     s_loaded[NUM_NODES];  // ids of the loaded nodes
+static int          s_nenv = 0;           // environment ports
+static uint8_t      s_cover[NUM_NODES][COVER_WORDS+1];
+static int          s_ncover = 0;         // slots hit in all executions
+
+static input_t*     s_corpus[MAX_CORPUS];
+static int          s_ncorpus = 0;
+static char*        s_corpus_dir = NULL;
+
+static uint64_t     s_rand = 1;
+static uint64_t     s_max_words = 10000;
+static uint64_t     s_outputs = 0;        // words taken from the environment
+
+static const input_t* s_in;               // input of the execution
+static size_t       s_pos;                // next record in s_in
+
+static const uint18_t pin_bit[4] = {
+    F18_IO_PIN17, F18_IO_PIN5, F18_IO_PIN3, F18_IO_PIN1
+};
+
+void usage(char* prog, char* fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "usage: %s [options] [seed-file|seed-dir ...]\n", prog);
+    fprintf(stderr, " options:\n"
+	    "    -f load-file     Program to fuzz (source or .f18b image)\n"
+	    "    -n <count>       Number of executions (default 100000)\n"
+	    "    -s <seed>        Random seed (default 1)\n"
+	    "    -i <words>       Max words per execution (default 10000)\n"
+	    "    -c cover-file    Write coverage of all executions at exit\n"
+	    "    -o corpus-dir    Write inputs with new coverage to this dir\n"
+	    "    -v               Show node io errors\n"
+	);
+    exit(1);
+}
+
+// xorshift64*
+static uint32_t rnd(uint32_t n)
+{
+    s_rand ^= s_rand >> 12;
+    s_rand ^= s_rand << 25;
+    s_rand ^= s_rand >> 27;
+    return (uint32_t)((s_rand * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static uint32_t record(const input_t* in, size_t pos)
+{
+    return (in->data[pos] << 16) | (in->data[pos+1] << 8) | in->data[pos+2];
+}
+
+// environment port arg (its index) is read: hand it the next record
+// when that is a port word for it
+static int env_read(void* arg, uint18_t id, int dir, uint18_t* value)
+{
+    uint32_t r;
+
+    (void) id;
+    (void) dir;
+    if (s_pos + 3 > s_in->len)
+	return 0;
+    r = record(s_in, s_pos);
+    if (REC_IS_PIN(r) || (((r >> 18) & 0xf) % s_nenv != (intptr_t) arg))
+	return 0;
+    s_pos += 3;
+    *value = r & MASK18;
+    return 1;
+}
+
+static void env_write(void* arg, uint18_t id, int dir, uint18_t value)
+{
+    (void) arg;
+    (void) id;
+    (void) dir;
+    (void) value;
+    s_outputs++;
+}
+
+static void apply_pins(uint32_t r)
+{
+    uint18_t id = s_loaded[((r >> 4) & 0xff) % s_nloaded];
+    uint18_t pins = 0;
+    int b;
+
+    for (b = 0; b < 4; b++)
+	if (r & (1 << b))
+	    pins |= pin_bit[b];
+    f18_set_pins(s_chip, id, pins);
+}
+
+// apply the next record if it is a pin record
+static int pin_step(void)
+{
+    uint32_t r;
+
+    if (s_pos + 3 > s_in->len)
+	return 0;
+    if (!REC_IS_PIN(r = record(s_in, s_pos)))
+	return 0;
+    s_pos += 3;
+    apply_pins(r);
+    return 1;
+}
+
+// run one input, returns number of new slots hit
+static int execute(const input_t* in)
+{
+    uint64_t slice = (uint64_t) F18_SCHED_SLICE * s_nloaded;
+    int k, w, nnew = 0;
+
+    f18_reset(s_chip);
+    s_in = in;
+    s_pos = 0;
+    for (;;) {
+	uint64_t words = f18_words(s_chip);
+
+	if (words >= s_max_words)
+	    break;
+	if (words + slice > s_max_words)
+	    slice = s_max_words - words;
+	if (f18_run(s_chip, slice) == F18_RUN_LIMIT) {
+	    pin_step();
+	    continue;
+	}
+	// all nodes wait and no endpoint took the next record
+	if (s_pos + 3 > in->len)
+	    break;
+	if (!pin_step())
+	    s_pos += 3;  // nobody reads that port, word is lost
+    }
+
+    for (k = 0; k < s_nloaded; k++) {
+	const uint8_t* cover = f18_node(s_chip, s_loaded[k])->cover;
+	for (w = 0; w <= COVER_WORDS; w++) {
+	    uint8_t bits = cover[w] & ~s_cover[k][w];
+	    if (bits) {
+		s_cover[k][w] |= bits;
+		nnew += __builtin_popcount(bits);
+	    }
+	}
+    }
+    s_ncover += nnew;
+    return nnew;
+}
+
+static void write_input(const input_t* in)
+{
+    char path[PATH_MAX];
+    uint64_t h = 0xcbf29ce484222325ULL;  // fnv-1a
+    size_t i;
+    int fd;
+
+    for (i = 0; i < in->len; i++)
+	h = (h ^ in->data[i]) * 0x100000001b3ULL;
+    snprintf(path, sizeof(path), "%s/%016llx", s_corpus_dir,
+	     (unsigned long long) h);
+    if ((fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0) {
+	fprintf(stderr, "unable to write %s, error=%s\n", path,
+		strerror(errno));
+	return;
+    }
+    if (write(fd, in->data, in->len) != (ssize_t) in->len)
+	fprintf(stderr, "unable to write %s, error=%s\n", path,
+		strerror(errno));
+    close(fd);
+}
+
+static void add_corpus(const input_t* in)
+{
+    input_t* cp;
+
+    if (s_ncorpus >= MAX_CORPUS)
+	return;
+    if ((cp = malloc(sizeof(input_t))) == NULL)
+	return;
+    *cp = *in;
+    s_corpus[s_ncorpus++] = cp;
+    if (s_corpus_dir != NULL)
+	write_input(in);
+}
+
+static void random_record(uint8_t* rec)
+{
+    uint32_t r;
+
+    switch(rnd(4)) {
+    case 0:  // pin record
+	r = (3 << 22) | rnd(1 << 22);
+	break;
+    case 1:  // small value
+	r = rnd(1 << 22) & ~MASK18;
+	r |= rnd(256);
+	break;
+    case 2:  // value near the top
+	r = (rnd(1 << 22) & ~MASK18) | (MASK18 - rnd(16));
+	break;
+    default:
+	r = rnd(3 << 22);
+	break;
+    }
+    rec[0] = r >> 16;
+    rec[1] = r >> 8;
+    rec[2] = r;
+}
+
+static void mutate(input_t* in)
+{
+    int m, nmut = 1 + rnd(4);
+    size_t nrec, at;
+
+    for (m = 0; m < nmut; m++) {
+	nrec = in->len / 3;
+	switch((nrec == 0) ? 2 : rnd(7)) {
+	case 0:  // flip a bit
+	    in->data[rnd(in->len)] ^= (1 << rnd(8));
+	    break;
+	case 1:  // random byte
+	    in->data[rnd(in->len)] = rnd(256);
+	    break;
+	case 2:  // insert a record
+	    if (in->len + 3 > FUZZ_MAX_INPUT)
+		break;
+	    at = 3*rnd(nrec+1);
+	    memmove(in->data+at+3, in->data+at, in->len-at);
+	    random_record(in->data+at);
+	    in->len += 3;
+	    break;
+	case 3:  // delete a record
+	    at = 3*rnd(nrec);
+	    memmove(in->data+at, in->data+at+3, in->len-at-3);
+	    in->len -= 3;
+	    break;
+	case 4:  // duplicate a record
+	    if (in->len + 3 > FUZZ_MAX_INPUT)
+		break;
+	    at = 3*rnd(nrec);
+	    memmove(in->data+at+3, in->data+at, in->len-at);
+	    in->len += 3;
+	    break;
+	case 5: {  // splice records of an other corpus input
+	    const input_t* sp = s_corpus[rnd(s_ncorpus)];
+	    size_t from, n;
+	    if (sp->len < 3)
+		break;
+	    from = 3*rnd(sp->len/3);
+	    n = 3*(1 + rnd((sp->len - from)/3));
+	    if (in->len + n > FUZZ_MAX_INPUT)
+		n = ((FUZZ_MAX_INPUT - in->len)/3)*3;
+	    at = 3*rnd(nrec+1);
+	    memmove(in->data+at+n, in->data+at, in->len-at);
+	    memcpy(in->data+at, sp->data+from, n);
+	    in->len += n;
+	    break;
+	}
+	case 6: {  // add or subtract a little from a port word
+	    uint32_t r, delta = 1 + rnd(16);
+	    at = 3*rnd(nrec);
+	    r = record(in, at);
+	    if (REC_IS_PIN(r))
+		break;
+	    r = (r & ~MASK18) | ((rnd(2) ? r + delta : r - delta) & MASK18);
+	    in->data[at] = r >> 16;
+	    in->data[at+1] = r >> 8;
+	    in->data[at+2] = r;
+	    break;
+	}
+	}
+    }
+}
+
+static int read_input(const char* path, input_t* in)
+{
+    ssize_t n;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return -1;
+    n = read(fd, in->data, FUZZ_MAX_INPUT);
+    close(fd);
+    if (n < 0)
+	return -1;
+    in->len = n;
+    return 0;
+}
+
+static void run_seed(const char* path)
+{
+    static input_t in;
+
+    if (read_input(path, &in) < 0) {
+	fprintf(stderr, "unable to read seed %s, error=%s\n", path,
+		strerror(errno));
+	exit(1);
+    }
+    if (execute(&in) > 0)
+	add_corpus(&in);
+}
+
+static void run_seeds(const char* path)
+{
+    char fpath[PATH_MAX];
+    struct dirent* de;
+    struct stat st;
+    DIR* dir;
+
+    if ((stat(path, &st) < 0) || !S_ISDIR(st.st_mode)) {
+	run_seed(path);
+	return;
+    }
+    if ((dir = opendir(path)) == NULL)
+	return;
+    while ((de = readdir(dir)) != NULL) {
+	snprintf(fpath, sizeof(fpath), "%s/%s", path, de->d_name);
+	if ((stat(fpath, &st) == 0) && S_ISREG(st.st_mode))
+	    run_seed(fpath);
+    }
+    closedir(dir);
+}
+
+static void status(const char* what, uint64_t n, uint64_t t0)
+{
+    uint64_t us = (now_ns() - t0) / 1000;
+
+    fprintf(stderr, "#%lu\t%s cov: %d corp: %d words: %lu out: %lu "
+	    "exec/s: %lu\n",
+	    n, what, s_ncover, s_ncorpus, f18_words(s_chip), s_outputs,
+	    us ? (n*1000000)/us : 0);
+}
+
+int main(int argc, char** argv)
+{
+    int c, i, j, k, dir;
+    char* filename = NULL;
+    char* cover_filename = NULL;
+    uint18_t flags = FLAG_SILENT;
+    uint64_t iterations = 100000;
+    uint64_t n, t0;
+    static input_t in;
+
+    while((c = getopt(argc, argv, "vf:n:s:i:c:o:")) != -1) {
+	switch(c) {
+	case 'v': flags &= ~FLAG_SILENT; break;
+	case 'f': filename = optarg; break;
+	case 'n': iterations = strtoull(optarg, NULL, 0); break;
+	case 's': s_rand = strtoull(optarg, NULL, 0); break;
+	case 'i':
+	    if ((s_max_words = strtoull(optarg, NULL, 0)) == 0)
+		usage(basename(argv[0]), "bad word limit %s\n", optarg);
+	    break;
+	case 'c': cover_filename = optarg; break;
+	case 'o': s_corpus_dir = optarg; break;
+	default:
+	    usage(basename(argv[0]), "");
+	}
+    }
+    if (filename == NULL)
+	usage(basename(argv[0]), "missing -f load-file\n");
+    if (s_rand == 0)  // xorshift is stuck at zero
+	s_rand = 1;
+    logout = stderr;
+
+    if ((s_chip = f18_create(flags)) == NULL) {
+	perror("posix_memalign (node_mem) failed");
+	exit(1);
+    }
+    if (f18_load(s_chip, filename) < 0) {
+	fprintf(stderr, "unable to load image %s, error=%s\n",
+		filename, strerror(errno));
+	exit(1);
+    }
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    if (f18_loaded(s_chip, MAKE_ID(i,j)))
+		s_loaded[s_nloaded++] = MAKE_ID(i,j);
+    if (s_nloaded == 0) {
+	fprintf(stderr, "no nodes loaded from %s\n", filename);
+	exit(1);
+    }
+    for (k = 0; k < s_nloaded; k++)
+	for (dir = 0; dir < 4; dir++)
+	    if (f18_attach_port(s_chip, s_loaded[k], dir, env_read, env_write,
+				(void*)(intptr_t) s_nenv) == 0)
+		s_nenv++;
+    if (f18_run(s_chip, 0) < 0) {  // setup the scheduler, nothing run
+	perror("f18_run");
+	exit(1);
+    }
+
+    if ((s_corpus_dir != NULL) && (mkdir(s_corpus_dir, 0755) < 0) &&
+	(errno != EEXIST)) {
+	fprintf(stderr, "unable to create %s, error=%s\n", s_corpus_dir,
+		strerror(errno));
+	exit(1);
+    }
+
+    t0 = now_ns();
+    in.len = 0;
+    execute(&in);
+    add_corpus(&in);  // the empty input is always there to mutate
+    for (k = optind; k < argc; k++)
+	run_seeds(argv[k]);
+    status("INITED", s_ncorpus, t0);
+
+    for (n = 1; n <= iterations; n++) {
+	in = *s_corpus[rnd(s_ncorpus)];
+	mutate(&in);
+	if (execute(&in) > 0) {
+	    add_corpus(&in);
+	    status("NEW", n, t0);
+	}
+	else if ((n & (n-1)) == 0)
+	    status("pulse", n, t0);
+    }
+    status("DONE", iterations, t0);
+
+    if (cover_filename != NULL) {
+	f18_reset(s_chip);  // ram as loaded
+	for (k = 0; k < s_nloaded; k++)
+	    memcpy(f18_node(s_chip, s_loaded[k])->cover, s_cover[k],
+		   sizeof(s_cover[k]));
+	if (f18_cover_write(cover_filename, node) < 0) {
+	    fprintf(stderr, "unable to write coverage %s, error=%s\n",
+		    cover_filename, strerror(errno));
+	    exit(1);
+	}
+    }
+    exit(0);
+}
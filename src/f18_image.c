@@ -0,0 +1,260 @@
+//
+// Binary chip image (.f18b) write and mmap load
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <memory.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "f18.h"
+#include "f18_sym.h"
+#include "f18_image.h"
+
+#define ALIGN4(n) (((n)+3) & ~3)
+
+int f18_image_check(int fd)
+{
+    char magic[4];
+
+    if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic))
+	return 0;
+    return memcmp(magic, F18_IMAGE_MAGIC, sizeof(magic)) == 0;
+}
+
+static int write_all(int fd, const void* buf, size_t len)
+{
+    const uint8_t* ptr = buf;
+
+    while (len > 0) {
+	ssize_t n = write(fd, ptr, len);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	ptr += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static size_t symbol_block_size(const f18_symbol_table_t* symtab)
+{
+    const f18_symbol_t* sp;
+    size_t len = 0;
+
+    if (symtab == NULL)
+	return 0;
+    for (sp = symtab->symbol; sp < symtab->next; sp++)
+	len += sizeof(uint32_t) + SYMLEN(sp) + 3;
+    return ALIGN4(len);
+}
+
+int f18_image_write(const char* filename,
+		    node_t* nodes[GRID_ROWS][GRID_COLS],
+		    int loaded[GRID_ROWS][GRID_COLS])
+{
+    f18_image_header_t hdr;
+    f18_image_node_t rec;
+    uint32_t symoff;
+    int i, j, k, fd;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, F18_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = F18_IMAGE_VERSION;
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    if (loaded[i][j])
+		hdr.nnodes++;
+
+    if ((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+	return -1;
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0)
+	goto error;
+
+    // node records, symbol blocks follow in the same order
+    symoff = sizeof(hdr) + hdr.nnodes*sizeof(rec);
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    node_t* np = nodes[i][j];
+	    if (!loaded[i][j])
+		continue;
+	    memset(&rec, 0, sizeof(rec));
+	    rec.id = np->id;
+	    rec.size = loaded[i][j]-1;
+	    rec.p = np->reg.p;
+	    rec.a = np->reg.a;
+	    rec.b = np->reg.b;
+	    rec.nsyms = np->symtab ? (np->symtab->next - np->symtab->symbol) : 0;
+	    rec.symoff = symoff;
+	    rec.symlen = symbol_block_size(np->symtab);
+	    for (k = 0; k < 64; k++)
+		rec.ram[k] = np->ram[k];
+	    if (write_all(fd, &rec, sizeof(rec)) < 0)
+		goto error;
+	    symoff += rec.symlen;
+	}
+    }
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    const f18_symbol_table_t* symtab = nodes[i][j]->symtab;
+	    const f18_symbol_t* sp;
+	    size_t len, pos = 0;
+	    uint8_t* buf;
+
+	    if (!loaded[i][j] || ((len = symbol_block_size(symtab)) == 0))
+		continue;
+	    if ((buf = calloc(1, len)) == NULL)
+		goto error;
+	    for (sp = symtab->symbol; sp < symtab->next; sp++) {
+		uint32_t value = sp->value;
+		memcpy(buf+pos, &value, sizeof(value));
+		pos += sizeof(value);
+	    }
+	    for (sp = symtab->symbol; sp < symtab->next; sp++) {
+		memcpy(buf+pos, sp->name-2, SYMLEN(sp)+3);
+		pos += SYMLEN(sp)+3;
+	    }
+	    if (write_all(fd, buf, len) < 0) {
+		free(buf);
+		goto error;
+	    }
+	    free(buf);
+	}
+    }
+    return close(fd);
+error:
+    close(fd);
+    return -1;
+}
+
+// Check that rec is a node record the load can use as is
+static int check_record(const uint8_t* base, size_t size,
+			const f18_image_node_t* rec)
+{
+    const uint8_t* ptr = base + rec->symoff;
+    const uint8_t* end;
+    const uint8_t* names;
+    uint32_t k;
+
+    if ((ID_TO_ROW(rec->id) >= GRID_ROWS) ||
+	(ID_TO_COLUMN(rec->id) >= GRID_COLS) || (rec->size > 64))
+	return -1;
+    if ((rec->symoff > size) || (rec->symlen > size - rec->symoff) ||
+	(rec->nsyms > rec->symlen / sizeof(uint32_t)))
+	return -1;
+    end = ptr + rec->symlen;
+    names = ptr + rec->nsyms*sizeof(uint32_t);
+    for (k = 0; k < rec->nsyms; k++) {
+	if ((names + 3 > end) || (names + names[1] + 3 > end) ||
+	    (names[names[1]+2] != '\0'))
+	    return -1;
+	names += names[1] + 3;
+    }
+    return 0;
+}
+
+// Symbol table with names pointing into the mapped symbol block,
+// rec is checked
+static f18_symbol_table_t* map_symbols(const uint8_t* base,
+				       const f18_image_node_t* rec)
+{
+    const uint8_t* ptr = base + rec->symoff;
+    const uint8_t* names = ptr + rec->nsyms*sizeof(uint32_t);
+    f18_symbol_table_t* symtab;
+    uint32_t k;
+
+    symtab = malloc(sizeof(f18_symbol_table_t) +
+		    rec->nsyms*sizeof(f18_symbol_t));
+    if (symtab == NULL)
+	return NULL;
+    symtab->heap = ((uint8_t*)symtab) + sizeof(f18_symbol_table_t);
+    symtab->heap_size = rec->nsyms*sizeof(f18_symbol_t);
+    symtab->symbol = (f18_symbol_t*) symtab->heap;
+    symtab->next = symtab->symbol + rec->nsyms;
+    symtab->dp = (char*) symtab->heap + symtab->heap_size;
+
+    for (k = 0; k < rec->nsyms; k++) {
+	f18_symbol_t* sp = &symtab->symbol[k];
+	uint32_t value;
+	memcpy(&value, ptr + k*sizeof(uint32_t), sizeof(value));
+	sp->value = value;
+	sp->name = (char*) names + 2;
+	names += names[1] + 3;
+    }
+    symtab->index = NULL;
+    sym_build_index(symtab);
+    return symtab;
+}
+
+int f18_image_load(int fd, node_t* nodes[GRID_ROWS][GRID_COLS],
+		   int loaded[GRID_ROWS][GRID_COLS])
+{
+    f18_symbol_table_t* symtab[GRID_ROWS*GRID_COLS];
+    int seen[GRID_ROWS][GRID_COLS];
+    const f18_image_header_t* hdr;
+    const f18_image_node_t* rec;
+    struct stat st;
+    uint8_t* base;
+    uint32_t n;
+    int k;
+
+    if (fstat(fd, &st) < 0)
+	return -1;
+    if (st.st_size < sizeof(f18_image_header_t)) {
+	errno = EINVAL;
+	return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+	return -1;
+    hdr = (const f18_image_header_t*) base;
+    if ((memcmp(hdr->magic, F18_IMAGE_MAGIC, sizeof(hdr->magic)) != 0) ||
+	(hdr->version != F18_IMAGE_VERSION) ||
+	(hdr->nnodes > GRID_ROWS*GRID_COLS) ||
+	(sizeof(*hdr) + hdr->nnodes*sizeof(*rec) > st.st_size))
+	goto bad;
+
+    // all records are checked before a node is touched
+    memset(seen, 0, sizeof(seen));
+    rec = (const f18_image_node_t*) (base + sizeof(*hdr));
+    for (n = 0; n < hdr->nnodes; n++) {
+	if ((check_record(base, st.st_size, &rec[n]) < 0) ||
+	    seen[ID_TO_ROW(rec[n].id)][ID_TO_COLUMN(rec[n].id)]++)
+	    goto bad;
+    }
+    for (n = 0; n < hdr->nnodes; n++) {
+	if ((symtab[n] = map_symbols(base, &rec[n])) == NULL) {
+	    while (n > 0)
+		sym_free_table(symtab[--n]);
+	    munmap(base, st.st_size);
+	    errno = ENOMEM;
+	    return -1;
+	}
+    }
+
+    for (n = 0; n < hdr->nnodes; n++, rec++) {
+	int i = ID_TO_ROW(rec->id);
+	int j = ID_TO_COLUMN(rec->id);
+	node_t* np = nodes[i][j];
+
+	for (k = 0; k < 64; k++)
+	    np->ram[k] = rec->ram[k] & MASK18;
+	np->reg.p = rec->p & MASK10;
+	np->reg.a = rec->a & MASK18;
+	np->reg.b = rec->b & MASK9;
+	np->symtab = symtab[n];
+	loaded[i][j] = rec->size+1;
+    }
+    return 0;
+bad:
+    munmap(base, st.st_size);
+    errno = EINVAL;
+    return -1;
+}
@@ -0,0 +1,59 @@
+#ifndef __F18_IMAGE_H__
+#define __F18_IMAGE_H__
+
+//
+// Binary chip image (.f18b)
+//
+// Host byte order, all fields 32 bit:
+//
+//   header:  "F18B" version nnodes 0
+//   node:    id size p a b nsyms symoff symlen ram[64]   (nnodes times)
+//   symbols: value[nsyms] names                          (per node)
+//
+// names are stored as [typ][len]name\0 so a loaded symbol table points
+// straight into the mapped file.
+//
+// An image holds what the assembler sets up, not a running chip: ram
+// and the p, a and b registers. The other registers and the stacks are
+// left at their reset values by a load, so they are not stored.
+//
+
+#include <stdint.h>
+#include "f18.h"
+
+#define F18_IMAGE_MAGIC   "F18B"
+#define F18_IMAGE_VERSION 1
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t nnodes;
+    uint32_t reserved;
+} f18_image_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t size;      // ram words used
+    uint32_t p;         // entry point
+    uint32_t a;
+    uint32_t b;
+    uint32_t nsyms;
+    uint32_t symoff;    // file offset of symbol block
+    uint32_t symlen;    // size of symbol block
+    uint32_t ram[64];
+} f18_image_node_t;
+
+// Check if fd starts with an image header (fd must be seekable)
+extern int f18_image_check(int fd);
+
+// Write nodes with loaded[i][j] != 0 (size+1) to filename
+extern int f18_image_write(const char* filename,
+			   node_t* nodes[GRID_ROWS][GRID_COLS],
+			   int loaded[GRID_ROWS][GRID_COLS]);
+
+// Map image from fd and load it into nodes, sets loaded[i][j]
+// The mapping is kept, node symbol tables point into it.
+extern int f18_image_load(int fd, node_t* nodes[GRID_ROWS][GRID_COLS],
+			  int loaded[GRID_ROWS][GRID_COLS]);
+
+#endif
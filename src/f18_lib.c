@@ -0,0 +1,566 @@
+//
+// libf18, chip life cycle on top of f18_chip.c and f18_sched.c
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_chip.h"
+#include "f18_sched.h"
+#include "f18_async.h"
+#include "f18_serdes.h"
+#include "f18_epoll.h"
+#include "f18_lib.h"
+
+#define NUM_NODES  (GRID_ROWS*GRID_COLS)
+#define PIN_BITS   (F18_IO_PIN17|F18_IO_PIN5|F18_IO_PIN3|F18_IO_PIN1)
+
+typedef enum {
+    CHIP_LOADING,   // create, load and attach
+    CHIP_SCHED,     // run by f18_run
+    CHIP_THREADS,   // node threads started
+    CHIP_STOPPED    // node threads joined
+} chip_mode_t;
+
+typedef struct {
+    f18_port_read_t  rd;
+    f18_port_write_t wr;
+    void* arg;
+} port_ep_t;
+
+typedef struct {
+    f18_pin_write_t wr;
+    void* arg;
+    void (*write_ioreg)(node_t* np, uint18_t reg, uint18_t val); // chained
+} pin_ep_t;
+
+struct _f18_chip_t {
+    chip_mode_t mode;
+    int loaded[GRID_ROWS][GRID_COLS];
+    int nsched;
+    node_t* sched[NUM_NODES];     // loaded nodes in run order
+    port_ep_t port[GRID_ROWS][GRID_COLS][4];
+    pin_ep_t  pin[GRID_ROWS][GRID_COLS];
+    f18_port_t* streams;          // f18_attach_stream ports
+    int async;                    // 708 async io attached
+    int epoll;                    // io served by the epoll thread
+};
+
+static f18_chip_t* the_chip = NULL;
+static int epoll_ready = 0;       // epoll set created, once per process
+static int epoll_running = 0;     // epoll thread started, never stops
+static pthread_t epoll_thread;
+
+// port direction seen from the other side, f18_chan_read/write invert it
+static const int far_dir[4] = { DOWN, RIGHT, UP, LEFT };
+
+static reg_node_t* get_node(uint18_t id)
+{
+    int i = ID_TO_ROW(id);
+    int j = ID_TO_COLUMN(id);
+
+    if ((i >= GRID_ROWS) || (j >= GRID_COLS))
+	return NULL;
+    return (reg_node_t*) node[i][j];
+}
+
+static int is_loaded(f18_chip_t* chip, uint18_t id)
+{
+    int i = ID_TO_ROW(id);
+    int j = ID_TO_COLUMN(id);
+
+    if ((i >= GRID_ROWS) || (j >= GRID_COLS))
+	return 0;
+    return chip->loaded[i][j] != 0;
+}
+
+static int epoll_setup(void)
+{
+    if (!epoll_ready) {
+	if (f18_epoll_init() < 0)
+	    return -1;
+	epoll_ready = 1;
+    }
+    return 0;
+}
+
+static void* async_reader_start(void* arg)
+{
+    sys_thread_started();
+    async_reader(arg);
+    sys_thread_terminated();
+    return NULL;
+}
+
+static void* async_writer_start(void* arg)
+{
+    sys_thread_started();
+    async_writer(arg);
+    sys_thread_terminated();
+    return NULL;
+}
+
+static void pin_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    pin_ep_t* pp = &the_chip->pin[ID_TO_ROW(np->id)][ID_TO_COLUMN(np->id)];
+
+    (*pp->write_ioreg)(np, ioreg, value);
+    if (ioreg == IOREG_IO)
+	(*pp->wr)(pp->arg, np->id, value);
+}
+
+f18_chip_t* f18_create(uint18_t flags)
+{
+    f18_chip_t* chip;
+    int i, j;
+
+    if (the_chip != NULL) {
+	errno = EBUSY;
+	return NULL;
+    }
+    if ((chip = calloc(1, sizeof(f18_chip_t))) == NULL)
+	return NULL;
+    g_flags = flags;
+    if (logout == NULL)
+	logout = stderr;
+    if (f18_chip_alloc() < 0) {
+	free(chip);
+	return NULL;
+    }
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    node[i][j]->flags = flags;
+    f18_chip_link();
+    chip->mode = CHIP_LOADING;
+    the_chip = chip;
+    return chip;
+}
+
+int f18_load_fd(f18_chip_t* chip, int fd, const char* filename)
+{
+    int loaded[GRID_ROWS][GRID_COLS];
+    int i, j;
+
+    if (chip->mode != CHIP_LOADING) {
+	errno = EBUSY;
+	return -1;
+    }
+    if (f18_chip_load(fd, filename, loaded) < 0)
+	return -1;
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    if (loaded[i][j] > chip->loaded[i][j])
+		chip->loaded[i][j] = loaded[i][j];
+    return 0;
+}
+
+int f18_load(f18_chip_t* chip, const char* filename)
+{
+    int fd, r;
+
+    if (strcmp(filename, "-") == 0)
+	return f18_load_fd(chip, STDIN_FILENO, filename);
+    if ((fd = open(filename, O_RDONLY)) < 0)
+	return -1;
+    r = f18_load_fd(chip, fd, filename);
+    close(fd);
+    return r;
+}
+
+int f18_loaded(f18_chip_t* chip, uint18_t id)
+{
+    if (!is_loaded(chip, id))
+	return 0;
+    return chip->loaded[ID_TO_ROW(id)][ID_TO_COLUMN(id)];
+}
+
+// a port facing the chip edge or a node that is not loaded
+static int is_edge_port(f18_chip_t* chip, uint18_t id, int dir)
+{
+    reg_node_t* np;
+    chan_t* cp;
+    int i, j;
+
+    if ((chip->mode != CHIP_LOADING) || (dir < 0) || (dir > 3) ||
+	!is_loaded(chip, id) || ((np = get_node(id)) == NULL))
+	return 0;
+    if ((cp = np->neighbour[dir]) == NULL)
+	return 1;
+    i = ID_TO_ROW(id) + f18_drow[dir];
+    j = ID_TO_COLUMN(id) + f18_dcol[dir];
+    if ((i >= 0) && (i < GRID_ROWS) && (j >= 0) && (j < GRID_COLS) &&
+	(cp == &((reg_node_t*)node[i][j])->chan))
+	return !chip->loaded[i][j];
+    return 0;  // async, serdes or a stream
+}
+
+int f18_attach_port(f18_chip_t* chip, uint18_t id, int dir,
+		    f18_port_read_t rd, f18_port_write_t wr, void* arg)
+{
+    port_ep_t* ep;
+
+    if (!is_edge_port(chip, id, dir)) {
+	errno = EINVAL;
+	return -1;
+    }
+    f18_chip_attach(id, dir, NULL);
+    ep = &chip->port[ID_TO_ROW(id)][ID_TO_COLUMN(id)][dir];
+    ep->rd = rd;
+    ep->wr = wr;
+    ep->arg = arg;
+    return 0;
+}
+
+f18_port_t* f18_attach_stream(f18_chip_t* chip, uint18_t id, int dir,
+			      f18_port_mode_t mode, int fd)
+{
+    f18_port_t* pp;
+
+    if (!is_edge_port(chip, id, dir)) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if ((pp = f18_port_attach(id, dir, mode, fd, 0)) == NULL)
+	return NULL;
+    pp->next = chip->streams;
+    chip->streams = pp;
+    return pp;
+}
+
+f18_port_t* f18_attach_device(f18_chip_t* chip, uint18_t id, int dir,
+			      void (*serve)(f18_port_t* pp, void* arg),
+			      void* arg)
+{
+    f18_port_t* pp;
+
+    if ((serve == NULL) || !is_edge_port(chip, id, dir)) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if ((pp = f18_port_device(id, dir, serve, arg)) == NULL)
+	return NULL;
+    pp->next = chip->streams;
+    chip->streams = pp;
+    return pp;
+}
+
+int f18_attach_async(f18_chip_t* chip, int fd_in, int fd_out, int baud,
+		     const uint18_t* boot, size_t boot_len)
+{
+    reg_node_t* np;
+
+    if ((chip->mode != CHIP_LOADING) || chip->async ||
+	((np = get_node(708)) == NULL) || (np->n.rom_type != async_boot)) {
+	errno = EINVAL;
+	return -1;
+    }
+    if (epoll_setup() < 0)
+	return -1;
+    if (fd_in < 0) {
+	if ((fd_in = open_pty(g_pty_name, sizeof(g_pty_name))) < 0)
+	    return -1;
+	// keep the slave open, the master reads EIO without one
+	(void) open(g_pty_name, O_RDWR | O_NOCTTY);
+	fd_out = fd_in;
+    }
+    memset(&r708, 0, sizeof(r708));
+    memset(&w708, 0, sizeof(w708));
+    f18_chan_init(&r708.chan);
+    f18_chan_init(&w708.chan);
+    async_reader_init(&r708);
+    r708.fd = fd_in;
+    r708.baud = baud;
+    r708.boot = boot;
+    r708.boot_len = boot_len;
+    w708.fd = fd_out;
+    w708.baud = baud;
+    async_writer_init(&w708);
+
+    np->n.read_ioreg = read_ioreg_708;  // sync buffer read
+    np->neighbour[UP] = &r708.chan;     // read async
+    r708.out = &np->chan;
+    r708.n.id = 808;
+    np->ioc = &w708.chan;               // io control channel
+    w708.n.id = 908;
+    w708.in = &np->chan;                // write from 708
+    chip->async = 1;
+    chip->epoll = 1;
+    return 0;
+}
+
+int f18_attach_serdes(f18_chip_t* chip, uint18_t id, int mode,
+		      const char* path)
+{
+    reg_node_t* np;
+
+    if ((chip->mode != CHIP_LOADING) || ((np = get_node(id)) == NULL) ||
+	(np->n.rom_type != serdes_boot) ||
+	((mode != SERDES_MODE_NONE) && (path == NULL))) {
+	errno = EINVAL;
+	return -1;
+    }
+    if ((mode != SERDES_MODE_NONE) && (epoll_setup() < 0))
+	return -1;
+    serdes_node_init((serdes_node_t*) np, mode, path ? path : "");
+    if (serdes_setup((serdes_node_t*) np) < 0)
+	return -1;
+    if (mode != SERDES_MODE_NONE)
+	chip->epoll = 1;
+    return 0;
+}
+
+int f18_attach_pins(f18_chip_t* chip, uint18_t id,
+		    f18_pin_write_t wr, void* arg)
+{
+    reg_node_t* np;
+    pin_ep_t* pp;
+
+    if ((chip->mode != CHIP_LOADING) || (wr == NULL) ||
+	((np = get_node(id)) == NULL)) {
+	errno = EINVAL;
+	return -1;
+    }
+    pp = &chip->pin[ID_TO_ROW(id)][ID_TO_COLUMN(id)];
+    if (pp->wr == NULL) {
+	pp->write_ioreg = np->n.write_ioreg;
+	np->n.write_ioreg = pin_write_ioreg;
+    }
+    pp->wr = wr;
+    pp->arg = arg;
+    return 0;
+}
+
+int f18_set_pins(f18_chip_t* chip, uint18_t id, uint18_t pins)
+{
+    reg_node_t* np;
+    uint32_t old_val, new_val;
+
+    if ((np = get_node(id)) == NULL) {
+	errno = EINVAL;
+	return -1;
+    }
+    do {
+	old_val = __atomic_load_n(&np->n.ior, __ATOMIC_SEQ_CST);
+	new_val = (old_val & ~PIN_BITS) | (pins & PIN_BITS);
+    } while (!__atomic_compare_exchange_n(&np->n.ior, &old_val, new_val,
+					  0, __ATOMIC_SEQ_CST,
+					  __ATOMIC_SEQ_CST));
+    return 0;
+}
+
+static int sched_setup(f18_chip_t* chip)
+{
+    int i, j;
+
+    chip->nsched = 0;
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    if (!chip->loaded[i][j])
+		continue;
+	    node[i][j]->flags |= FLAG_SCHED;
+	    chip->sched[chip->nsched++] = node[i][j];
+	}
+    }
+    if ((f18_chip_save() < 0) ||
+	(f18_sched_init(chip->sched, chip->nsched) < 0))
+	return -1;
+    f18_sched_restart(0);
+    chip->mode = CHIP_SCHED;
+    return 0;
+}
+
+// all loaded nodes wait: hand words between edge ports and endpoints,
+// returns the number of transfers done
+static int endpoint_step(f18_chip_t* chip)
+{
+    f18_port_t* pp;
+    int k, dir, n = 0;
+
+    for (pp = chip->streams; pp != NULL; pp = pp->next) {
+	uint32_t value;
+
+	if ((pp->mode == F18_PORT_IN) && (pp->peer->rmask & DIR_BIT(pp->dir))
+	    && (word_queue_available(&pp->q) > 0)) {
+	    word_queue_deq_bulk(&pp->q, &value, 1);
+	    f18_chan_write(pp->peer, pp->far, value & MASK18);
+	    pp->words++;
+	    n++;
+	}
+	else if ((pp->mode == F18_PORT_OUT) &&
+		 (pp->peer->wmask & DIR_BIT(pp->dir)) &&
+		 (word_queue_space(&pp->q) > 0) &&
+		 f18_chan_read(pp->peer, pp->far, &value)) {
+	    word_queue_enq_batch(&pp->q, &value, 1);
+	    pp->words++;
+	    n++;
+	}
+    }
+
+    for (k = 0; k < chip->nsched; k++) {
+	reg_node_t* np = (reg_node_t*) chip->sched[k];
+	port_ep_t* ep = chip->port[ID_TO_ROW(np->n.id)][ID_TO_COLUMN(np->n.id)];
+	uint18_t value;
+
+	for (dir = 0; dir < 4; dir++) {
+	    if ((ep[dir].wr != NULL) && (np->chan.wmask & DIR_BIT(dir)) &&
+		f18_chan_read(&np->chan, far_dir[dir], &value)) {
+		(*ep[dir].wr)(ep[dir].arg, np->n.id, dir, value);
+		n++;
+		break;
+	    }
+	    if ((ep[dir].rd != NULL) && (np->chan.rmask & DIR_BIT(dir)) &&
+		(*ep[dir].rd)(ep[dir].arg, np->n.id, dir, &value) &&
+		f18_chan_write(&np->chan, far_dir[dir], value)) {
+		n++;
+		break;
+	    }
+	}
+    }
+    return n;
+}
+
+int f18_run(f18_chip_t* chip, uint64_t max_words)
+{
+    if ((chip->mode == CHIP_THREADS) || (chip->mode == CHIP_STOPPED))
+	return -1;
+    if (chip->mode == CHIP_LOADING) {
+	f18_port_t* pp;
+	if (chip->epoll) {  // async and serdes io need threads
+	    errno = EINVAL;
+	    return -1;
+	}
+	for (pp = chip->streams; pp != NULL; pp = pp->next) {
+	    // no pump or device threads here
+	    if ((pp->fd >= 0) || (pp->mode == F18_PORT_DEVICE)) {
+		errno = EINVAL;
+		return -1;
+	    }
+	}
+	if (sched_setup(chip) < 0)
+	    return -1;
+    }
+    f18_sched_limit(max_words);
+    for (;;) {
+	int r = f18_sched_round();
+	if (r < 0)
+	    return F18_RUN_LIMIT;
+	if ((r == 0) && (endpoint_step(chip) == 0))
+	    return F18_RUN_IDLE;
+    }
+}
+
+uint64_t f18_words(f18_chip_t* chip)
+{
+    return (chip->mode == CHIP_SCHED) ? f18_sched_words() : 0;
+}
+
+void f18_reset(f18_chip_t* chip)
+{
+    f18_port_t* pp;
+
+    if (chip->mode != CHIP_SCHED)
+	return;
+    for (pp = chip->streams; pp != NULL; pp = pp->next)
+	f18_port_reset(pp);
+    f18_chip_reset();
+    f18_sched_restart(0);
+}
+
+node_t* f18_node(f18_chip_t* chip, uint18_t id)
+{
+    reg_node_t* np = get_node(id);
+    return (np != NULL) ? &np->n : NULL;
+}
+
+int f18_start(f18_chip_t* chip, size_t stack_size)
+{
+    f18_port_t* pp;
+
+    if (chip->mode != CHIP_LOADING) {
+	errno = EBUSY;
+	return -1;
+    }
+    if (stack_size == 0) {  // as bin/f18, smallest working size
+	size_t page = sysconf(_SC_PAGESIZE);
+	stack_size = ((2*page + PTHREAD_STACK_MIN + page-1)/page)*page;
+    }
+    if (chip->epoll && !epoll_running) {
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, stack_size);
+	if (pthread_create(&epoll_thread, &attr, f18_epoll_main, NULL) != 0)
+	    return -1;
+	epoll_running = 1;
+    }
+    if (chip->async) {
+	sys_add_active(2);
+	pthread_attr_init(&r708.attr);
+	pthread_attr_setstacksize(&r708.attr, stack_size);
+	pthread_attr_init(&w708.attr);
+	pthread_attr_setstacksize(&w708.attr, stack_size);
+	if ((pthread_create(&r708.thread, &r708.attr, async_reader_start,
+			    &r708) != 0) ||
+	    (pthread_create(&w708.thread, &w708.attr, async_writer_start,
+			    &w708) != 0))
+	    return -1;
+    }
+    for (pp = chip->streams; pp != NULL; pp = pp->next)
+	if (f18_port_start(pp, stack_size) < 0)
+	    return -1;
+    if (f18_chip_start(stack_size) < 0)
+	return -1;
+    chip->mode = CHIP_THREADS;
+    return 0;
+}
+
+int f18_wait(f18_chip_t* chip)
+{
+    if (chip->mode != CHIP_THREADS)
+	return 0;
+    return sys_wait_done();
+}
+
+void f18_stop(f18_chip_t* chip)
+{
+    f18_port_t* pp;
+
+    if (chip->mode != CHIP_THREADS)
+	return;
+    if (chip->async) {
+	f18_chan_terminate(&r708.chan);
+	f18_chan_terminate(&w708.chan);
+	byte_queue_terminate(&r708.bq);
+    }
+    for (pp = chip->streams; pp != NULL; pp = pp->next)
+	f18_port_stop(pp);
+    f18_chip_stop();
+    if (chip->async) {
+	pthread_join(r708.thread, NULL);
+	pthread_join(w708.thread, NULL);
+	byte_queue_destroy(&r708.bq);  // the chip can not be started again
+    }
+    chip->mode = CHIP_STOPPED;
+}
+
+void f18_destroy(f18_chip_t* chip)
+{
+    f18_stop(chip);
+    if (chip->mode == CHIP_SCHED)
+	f18_sched_free();
+    while (chip->streams != NULL) {
+	f18_port_t* pp = chip->streams;
+	chip->streams = pp->next;
+	f18_port_free(pp);
+    }
+    f18_chip_free();
+    free(chip);
+    the_chip = NULL;
+}
@@ -0,0 +1,125 @@
+#ifndef __F18_LIB_H__
+#define __F18_LIB_H__
+
+//
+// libf18, the emulator as a library
+//
+// A chip is created, loaded and then run either with a thread per node
+// (f18_start, f18_wait, f18_stop as bin/f18 does) or deterministically
+// in the calling thread (f18_run). The node table and flags are process
+// globals, there is one chip per process.
+//
+// Endpoints are attached to the edge ports of loaded nodes, ports that
+// face the chip edge or a node that is not loaded. f18_run calls them
+// when all loaded nodes are waiting. Attach endpoints before the first
+// f18_run, f18_reset returns to the chip state at that point. Streams
+// put a word ring on an edge port, with threads (f18_start) or served
+// by f18_run like the other endpoints.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include "f18.h"
+#include "f18_port.h"
+
+typedef struct _f18_chip_t f18_chip_t;
+
+#define F18_RUN_IDLE   0   // all loaded nodes blocked or done
+#define F18_RUN_LIMIT  1   // word limit reached
+
+// Node id waits to read from port dir (UP, LEFT, DOWN, RIGHT): return 1
+// and set *value to hand it a word, 0 when there is none
+typedef int  (*f18_port_read_t)(void* arg, uint18_t id, int dir,
+				uint18_t* value);
+// Node id wrote value to port dir
+typedef void (*f18_port_write_t)(void* arg, uint18_t id, int dir,
+				 uint18_t value);
+// Node id wrote value to its io register (pin outputs)
+typedef void (*f18_pin_write_t)(void* arg, uint18_t id, uint18_t value);
+
+// Allocate the chip, flags (FLAG_xxx) are set on all nodes,
+// NULL when a chip exists or allocation fails
+extern f18_chip_t* f18_create(uint18_t flags);
+
+// Load a .f18 source or .f18b image, returns -1 on error
+extern int f18_load(f18_chip_t* chip, const char* filename);
+extern int f18_load_fd(f18_chip_t* chip, int fd, const char* filename);
+
+// Words loaded into node id plus 1, 0 when not loaded
+extern int f18_loaded(f18_chip_t* chip, uint18_t id);
+
+// Attach a host endpoint to edge port dir of loaded node id, rd or wr
+// may be NULL, returns -1 if the port is not an edge port
+extern int f18_attach_port(f18_chip_t* chip, uint18_t id, int dir,
+			   f18_port_read_t rd, f18_port_write_t wr,
+			   void* arg);
+
+// Attach a word stream to edge port dir of loaded node id, mode is
+// F18_PORT_IN (the node reads) or F18_PORT_OUT (the node writes). With
+// fd >= 0 the words are moved to or from fd in bulk by a thread, 4 byte
+// words in host byte order (needs f18_start). Otherwise feed and drain
+// the ring with f18_port_put, f18_port_close and f18_port_get.
+// NULL if the port is not an edge port.
+extern f18_port_t* f18_attach_stream(f18_chip_t* chip, uint18_t id, int dir,
+				     f18_port_mode_t mode, int fd);
+
+// Attach a device to edge port dir of loaded node id, serve runs in the
+// port thread and talks to the node with f18_port_send / f18_port_recv
+// (needs f18_start). NULL if the port is not an edge port.
+extern f18_port_t* f18_attach_device(f18_chip_t* chip, uint18_t id, int dir,
+				     void (*serve)(f18_port_t* pp, void* arg),
+				     void* arg);
+
+// Attach the 708 async serial port. Node 708 samples its serial input
+// from fd_in, after the boot words (may be NULL), and writes its serial
+// output to fd_out at baud bits per second. With fd_in < 0 a pty is
+// opened for both, its name is in g_pty_name. The reader and writer
+// threads run with f18_start, f18_run refuses a chip with async io.
+// Returns -1 when node 708 has no async boot ROM or the pty fails.
+extern int f18_attach_async(f18_chip_t* chip, int fd_in, int fd_out, int baud,
+			    const uint18_t* boot, size_t boot_len);
+
+// Connect the SERDES of node id (001 or 701) to the unix socket path,
+// mode is SERDES_MODE_SERVER, SERDES_MODE_CLIENT or SERDES_MODE_NONE
+// (f18_serdes.h). The words move in the node threads (needs f18_start).
+// Returns -1 when id has no SERDES or the socket setup fails.
+extern int f18_attach_serdes(f18_chip_t* chip, uint18_t id, int mode,
+			     const char* path);
+
+// Call wr when node id writes its io register
+extern int f18_attach_pins(f18_chip_t* chip, uint18_t id,
+			   f18_pin_write_t wr, void* arg);
+
+// Set input pin levels of node id (F18_IO_PIN17/5/3/1 bits)
+extern int f18_set_pins(f18_chip_t* chip, uint18_t id, uint18_t pins);
+
+// Run loaded nodes in the calling thread for at most max_words words,
+// returns F18_RUN_IDLE, F18_RUN_LIMIT or -1 when threads are running
+extern int f18_run(f18_chip_t* chip, uint64_t max_words);
+
+// Words executed by f18_run since create or reset
+extern uint64_t f18_words(f18_chip_t* chip);
+
+// Back to the state before the first run, nodes restart from there,
+// words left in stream rings are dropped and closed rings reopened
+extern void f18_reset(f18_chip_t* chip);
+
+// Node id for inspection (ram, ds, rs, ior, iow), reg holds the
+// registers at the start of the word f18_run left the node in
+extern node_t* f18_node(f18_chip_t* chip, uint18_t id);
+
+// Start a thread per node, the stream and async io threads, stack_size
+// 0 for the default
+extern int f18_start(f18_chip_t* chip, size_t stack_size);
+
+// Wait until no node runs and no node waits on external io,
+// returns 1 when stopped by a deadlock
+extern int f18_wait(f18_chip_t* chip);
+
+// Terminate and join stream, async io and node threads
+extern void f18_stop(f18_chip_t* chip);
+
+// Stop and release the chip
+extern void f18_destroy(f18_chip_t* chip);
+
+#endif
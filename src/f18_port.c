@@ -0,0 +1,304 @@
+//
+// Host endpoint on a node edge port
+//
+// Input:  fd -> pump -> ring -> adapter -> node port
+// Output: node port -> adapter -> ring -> pump -> fd
+//
+// The ring is only touched once per batch on either side. A pump that
+// waits on the ring counts as blocked on a port, so the emulator still
+// stops when the nodes are done. The input adapter stays active until
+// the input is closed.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_chip.h"
+#include "f18_port.h"
+
+#define PORT_POLL_MS  100  // poll timeout, to notice terminate
+
+f18_port_t* f18_port_attach(uint18_t id, int dir,
+			    f18_port_mode_t mode, int fd, size_t ring)
+{
+    f18_port_t* pp;
+
+    if ((ID_TO_ROW(id) >= GRID_ROWS) || (ID_TO_COLUMN(id) >= GRID_COLS) ||
+	(dir < 0) || (dir > 3) ||
+	((mode != F18_PORT_IN) && (mode != F18_PORT_OUT) &&
+	 (mode != F18_PORT_DEVICE))) {
+	errno = EINVAL;
+	return NULL;
+    }
+    if ((pp = calloc(1, sizeof(f18_port_t))) == NULL)
+	return NULL;
+    if (word_queue_init(&pp->q, ring) < 0) {
+	free(pp);
+	return NULL;
+    }
+    f18_chan_init(&pp->chan);
+    pp->n.id = 1000 + id;
+    pp->peer = &((reg_node_t*)node[ID_TO_ROW(id)][ID_TO_COLUMN(id)])->chan;
+    pp->dir = dir;
+    pp->far = dir ^ 2;  // inverse direction
+    pp->mode = mode;
+    pp->fd = fd;
+    f18_chip_attach(id, dir, &pp->chan);
+    return pp;
+}
+
+f18_port_t* f18_port_device(uint18_t id, int dir,
+			    void (*serve)(f18_port_t* pp, void* arg),
+			    void* arg)
+{
+    f18_port_t* pp;
+
+    if ((pp = f18_port_attach(id, dir, F18_PORT_DEVICE, -1, 0)) == NULL)
+	return NULL;
+    pp->serve = serve;
+    pp->arg = arg;
+    return pp;
+}
+
+// hand a word to the node, 0 on terminate
+int f18_port_send(f18_port_t* pp, uint18_t value)
+{
+    if (f18_chan_write(pp->peer, pp->far, value))
+	return 1;
+    f18_init_transfer(&pp->chan, F18_CHAN_WRITE, 0, DIR_BIT(pp->far), value);
+    if (f18_chan_complete_write(&pp->chan, pp->peer, pp->far, value))
+	return 1;
+    f18_wait_transfer(&pp->chan, F18_CHAN_WRITE);
+    return pp->chan.completed && !pp->chan.terminate;
+}
+
+// take a word from the node, 0 on terminate
+int f18_port_recv(f18_port_t* pp, uint18_t* value)
+{
+    if (f18_chan_read(pp->peer, pp->far, value))
+	return 1;
+    f18_init_transfer(&pp->chan, F18_CHAN_READ, DIR_BIT(pp->far), 0, 0);
+    if (f18_chan_complete_read(&pp->chan, pp->peer, pp->far, value))
+	return 1;
+    *value = f18_wait_transfer(&pp->chan, F18_CHAN_READ);
+    return pp->chan.completed && !pp->chan.terminate;
+}
+
+static void port_in(f18_port_t* pp)
+{
+    uint32_t buf[F18_PORT_BULK];
+    int i, n;
+
+    while (!pp->chan.terminate &&
+	   ((n = word_queue_deq_bulk(&pp->q, buf, F18_PORT_BULK)) > 0)) {
+	for (i = 0; i < n; i++) {
+	    if (!f18_port_send(pp, buf[i] & MASK18))
+		return;
+	    pp->words++;
+	}
+    }
+}
+
+// Words the node writes back to back are collected and queued in one
+// go, the batch is flushed before the adapter waits for the node.
+static void port_out(f18_port_t* pp)
+{
+    uint32_t buf[F18_PORT_BULK];
+    int n = 0;
+
+    while (!pp->chan.terminate) {
+	uint18_t value;
+
+	if ((n > 0) && !f18_chan_read(pp->peer, pp->far, &value)) {
+	    if (word_queue_enq_batch(&pp->q, buf, n) < 0)
+		return;
+	    n = 0;
+	    continue;
+	}
+	if ((n == 0) && !f18_port_recv(pp, &value))
+	    break;
+	buf[n++] = value;
+	pp->words++;
+	if (n == F18_PORT_BULK) {
+	    if (word_queue_enq_batch(&pp->q, buf, n) < 0)
+		return;
+	    n = 0;
+	}
+    }
+    if (n > 0)
+	word_queue_enq_batch(&pp->q, buf, n);
+    word_queue_close(&pp->q);
+}
+
+// fd to ring, a trailing partial word is dropped
+static void pump_in(f18_port_t* pp)
+{
+    uint32_t buf[F18_PORT_BULK];
+    size_t len = 0;
+
+    while (!__atomic_load_n(&pp->q.terminate, __ATOMIC_ACQUIRE)) {
+	struct pollfd pfd = { .fd = pp->fd, .events = POLLIN };
+	size_t count, rest;
+	ssize_t n;
+	int r;
+
+	if (poll(&pfd, 1, PORT_POLL_MS) <= 0)
+	    continue;
+	if ((n = read(pp->fd, (uint8_t*)buf + len, sizeof(buf) - len)) < 0) {
+	    if ((errno == EINTR) || (errno == EAGAIN))
+		continue;
+	    ERRORF("port %03d: read error %d (%s)\n",
+		   pp->n.id - 1000, errno, strerror(errno));
+	    break;
+	}
+	if (n == 0)
+	    break;
+	len += n;
+	if ((count = len / sizeof(uint32_t)) == 0)
+	    continue;
+	if (word_queue_space(&pp->q) < (int) count) {
+	    sys_enter_blocked_port();
+	    r = word_queue_enq_batch(&pp->q, buf, count);
+	    sys_leave_blocked_port();
+	}
+	else
+	    r = word_queue_enq_batch(&pp->q, buf, count);
+	if (r < 0)
+	    return;
+	rest = len - count*sizeof(uint32_t);
+	memmove(buf, &buf[count], rest);
+	len = rest;
+    }
+    word_queue_close(&pp->q);
+}
+
+// ring to fd until the adapter closes the ring
+static void pump_out(f18_port_t* pp)
+{
+    uint32_t buf[F18_PORT_BULK];
+    int n;
+
+    for (;;) {
+	uint8_t* ptr = (uint8_t*) buf;
+	size_t len;
+
+	if (word_queue_available(&pp->q) == 0) {
+	    sys_enter_blocked_port();
+	    n = word_queue_deq_bulk(&pp->q, buf, F18_PORT_BULK);
+	    sys_leave_blocked_port();
+	}
+	else
+	    n = word_queue_deq_bulk(&pp->q, buf, F18_PORT_BULK);
+	if (n < 0)
+	    return;
+	len = n*sizeof(uint32_t);
+	while (len > 0) {
+	    ssize_t r;
+	    if ((r = write(pp->fd, ptr, len)) < 0) {
+		if (errno == EINTR)
+		    continue;
+		ERRORF("port %03d: write error %d (%s)\n",
+		       pp->n.id - 1000, errno, strerror(errno));
+		word_queue_terminate(&pp->q);  // release the adapter
+		return;
+	    }
+	    ptr += r;
+	    len -= r;
+	}
+    }
+}
+
+static void* port_start(void* arg)
+{
+    f18_port_t* pp = arg;
+
+    sys_thread_started();
+    if (pp->mode == F18_PORT_IN)
+	port_in(pp);
+    else if (pp->mode == F18_PORT_OUT)
+	port_out(pp);
+    else
+	(*pp->serve)(pp, pp->arg);
+    sys_thread_terminated();
+    return NULL;
+}
+
+static void* pump_start(void* arg)
+{
+    f18_port_t* pp = arg;
+
+    sys_thread_started();
+    if (pp->mode == F18_PORT_IN)
+	pump_in(pp);
+    else
+	pump_out(pp);
+    sys_thread_terminated();
+    return NULL;
+}
+
+int f18_port_start(f18_port_t* pp, size_t stack_size)
+{
+    sys_add_active((pp->fd >= 0) ? 2 : 1);
+    pthread_attr_init(&pp->attr);
+    pthread_attr_setstacksize(&pp->attr, stack_size);
+    if (pthread_create(&pp->thread, &pp->attr, port_start, pp) != 0)
+	return -1;
+    if (pp->fd >= 0) {
+	pthread_attr_init(&pp->pump_attr);
+	pthread_attr_setstacksize(&pp->pump_attr, stack_size);
+	if (pthread_create(&pp->pump, &pp->pump_attr, pump_start, pp) != 0)
+	    return -1;
+    }
+    pp->started = 1;
+    return 0;
+}
+
+int f18_port_put(f18_port_t* pp, const uint18_t* words, int count)
+{
+    return word_queue_enq_batch(&pp->q, words, count);
+}
+
+void f18_port_close(f18_port_t* pp)
+{
+    word_queue_close(&pp->q);
+}
+
+void f18_port_reset(f18_port_t* pp)
+{
+    word_queue_reset(&pp->q);
+    pp->words = 0;
+}
+
+int f18_port_get(f18_port_t* pp, uint18_t* words, int count)
+{
+    return word_queue_deq_bulk(&pp->q, words, count);
+}
+
+void f18_port_stop(f18_port_t* pp)
+{
+    if (!pp->started)
+	return;
+    f18_chan_terminate(&pp->chan);
+    if (pp->mode == F18_PORT_IN)  // words the node did not take are dropped
+	word_queue_terminate(&pp->q);
+    pthread_join(pp->thread, NULL);
+    if (pp->fd >= 0)
+	pthread_join(pp->pump, NULL);
+    pp->started = 0;
+}
+
+void f18_port_free(f18_port_t* pp)
+{
+    f18_port_stop(pp);
+    word_queue_destroy(&pp->q);
+    pthread_mutex_destroy(&pp->chan.lock);
+    pthread_cond_destroy(&pp->chan.cond);
+    free(pp);
+}
@@ -0,0 +1,92 @@
+#ifndef __F18_PORT_H__
+#define __F18_PORT_H__
+
+//
+// Host endpoint on a node edge port
+//
+// The adapter looks like a neighbour node to the node it is attached
+// to: the node's neighbour[dir] points at the adapter channel and the
+// transfers follow the rendezvous protocol. The adapter thread moves
+// words between the port and a word ring. The other side of the ring
+// is either a pump thread doing bulk read/write on a file descriptor
+// (4 byte words in host byte order, as in .f18b images) or the caller
+// through f18_port_put / f18_port_get. A device port skips the ring,
+// its thread runs a serve function that talks to the node word by word
+// with f18_port_send / f18_port_recv.
+//
+
+#include <stdint.h>
+#include <pthread.h>
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_word_queue.h"
+
+typedef enum {
+    F18_PORT_IN  = 1,   // host to node, the node reads the port
+    F18_PORT_OUT = 2,   // node to host, the node writes the port
+    F18_PORT_DEVICE = 3 // both ways, driven by serve
+} f18_port_mode_t;
+
+// Words moved per ring, fd or port batch
+#define F18_PORT_BULK  1024
+
+typedef struct _f18_port_t {
+    node_t n;                // dummy node, id is 1000 + node id
+    chan_t chan;             // channel the node sees as its neighbour
+    chan_t* peer;            // node channel
+    int dir;                 // port direction on the node
+    int far;                 // port direction seen from the adapter
+    f18_port_mode_t mode;
+    word_queue_t q;
+    int fd;                  // pumped in bulk, -1 for put/get
+    pthread_t thread;        // port side
+    pthread_attr_t attr;
+    pthread_t pump;          // fd side
+    pthread_attr_t pump_attr;
+    int started;             // threads running
+    uint64_t words;          // words transferred on the port
+    void (*serve)(struct _f18_port_t* pp, void* arg);  // device thread
+    void* arg;
+    struct _f18_port_t* next;
+} f18_port_t;
+
+// Attach to edge port dir of node id, replacing the grid neighbour,
+// ring is the ring size in words (0 for the default). NULL on error.
+extern f18_port_t* f18_port_attach(uint18_t id, int dir,
+				   f18_port_mode_t mode, int fd, size_t ring);
+
+// Make a device port, serve runs in the port thread until it returns
+// or a transfer is terminated
+extern f18_port_t* f18_port_device(uint18_t id, int dir,
+				   void (*serve)(f18_port_t* pp, void* arg),
+				   void* arg);
+
+// Device side transfers, block until the node takes or hands a word,
+// 0 when the port is stopped
+extern int f18_port_send(f18_port_t* pp, uint18_t value);
+extern int f18_port_recv(f18_port_t* pp, uint18_t* value);
+
+// Start the adapter (and pump) threads, they are counted as active
+extern int f18_port_start(f18_port_t* pp, size_t stack_size);
+
+// Queue words for an input port, blocks while the ring is full,
+// returns count or -1 when stopped
+extern int f18_port_put(f18_port_t* pp, const uint18_t* words, int count);
+
+// End of input, the adapter exits when the ring is drained
+extern void f18_port_close(f18_port_t* pp);
+
+// Take up to count words from an output port, blocks until one is
+// there, -1 when the port is stopped and drained
+extern int f18_port_get(f18_port_t* pp, uint18_t* words, int count);
+
+// Empty the ring and reopen it, the port threads must not run
+extern void f18_port_reset(f18_port_t* pp);
+
+// Terminate and join the threads, words queued for output are kept
+extern void f18_port_stop(f18_port_t* pp);
+
+// Release a stopped (or never started) port
+extern void f18_port_free(f18_port_t* pp);
+
+#endif
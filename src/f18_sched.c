@@ -0,0 +1,162 @@
+//
+// Deterministic single threaded node scheduler
+//
+// A coroutine is entered once with makecontext/setcontext, after that
+// all switching is done with _setjmp/_longjmp, which does not save the
+// signal mask (no system call per switch). A restart jumps back to the
+// top of the coroutine, dropping whatever the node was doing.
+//
+#undef _FORTIFY_SOURCE  // __longjmp_chk rejects jumps between stacks
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <ucontext.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_sched.h"
+
+typedef enum {
+    CO_START,   // enter f18_emu on the next round
+    CO_RUN,     // runnable
+    CO_WAIT,    // waiting for a port transfer
+    CO_DONE     // f18_emu returned
+} co_state_t;
+
+typedef struct {
+    node_t*    np;
+    co_state_t state;
+    jmp_buf    top;    // restart point
+    jmp_buf    ctx;    // where the node yielded
+    ucontext_t uc;     // initial context
+    void*      stack;
+} co_t;
+
+static co_t*    s_co = NULL;
+static int      s_nco = 0;
+static co_t*    s_cur = NULL;
+static jmp_buf  s_main;
+static uint64_t s_words = 0;
+static uint64_t s_limit = 0;
+static int      s_slice = 0;
+
+static void co_entry(void)
+{
+    if (_setjmp(s_cur->top) == 0)
+	_longjmp(s_main, 1);  // set up, wait for the first round
+    f18_emu(s_cur->np);
+    s_cur->state = CO_DONE;
+    _longjmp(s_main, 1);
+}
+
+static void co_resume(co_t* co)
+{
+    if (_setjmp(s_main) == 0) {
+	s_cur = co;
+	if (co->state == CO_START) {
+	    co->state = CO_RUN;
+	    _longjmp(co->top, 1);
+	}
+	co->state = CO_RUN;
+	_longjmp(co->ctx, 1);
+    }
+}
+
+int f18_sched_init(node_t** nodes, int n)
+{
+    int k;
+
+    if ((s_co = calloc(n, sizeof(co_t))) == NULL)
+	return -1;
+    for (k = 0; k < n; k++) {
+	co_t* co = &s_co[k];
+
+	co->np = nodes[k];
+	if ((co->stack = malloc(F18_SCHED_STACK)) == NULL)
+	    return -1;
+	getcontext(&co->uc);
+	co->uc.uc_stack.ss_sp = co->stack;
+	co->uc.uc_stack.ss_size = F18_SCHED_STACK;
+	co->uc.uc_link = NULL;
+	makecontext(&co->uc, co_entry, 0);
+	if (_setjmp(s_main) == 0) {
+	    s_cur = co;
+	    setcontext(&co->uc);
+	}
+	co->state = CO_START;
+    }
+    s_nco = n;
+    return 0;
+}
+
+void f18_sched_restart(uint64_t max_words)
+{
+    int k;
+
+    for (k = 0; k < s_nco; k++)
+	s_co[k].state = CO_START;
+    s_words = 0;
+    s_limit = max_words;
+}
+
+void f18_sched_limit(uint64_t max_words)
+{
+    s_limit = s_words + max_words;
+}
+
+void f18_sched_free(void)
+{
+    int k;
+
+    for (k = 0; k < s_nco; k++)
+	free(s_co[k].stack);
+    free(s_co);
+    s_co = NULL;
+    s_nco = 0;
+    s_cur = NULL;
+}
+
+int f18_sched_round(void)
+{
+    int k, nrun = 0;
+
+    for (k = 0; k < s_nco; k++) {
+	co_t* co = &s_co[k];
+
+	if (s_words >= s_limit)
+	    return -1;
+	if (co->state == CO_DONE)
+	    continue;
+	if (co->state == CO_WAIT) {
+	    chan_t* cp = &((reg_node_t*)co->np)->chan;
+	    if (!cp->completed && !cp->terminate && !cp->interrupt)
+		continue;
+	}
+	s_slice = 0;
+	co_resume(co);
+	nrun++;
+    }
+    return nrun;
+}
+
+uint64_t f18_sched_words(void)
+{
+    return s_words;
+}
+
+void f18_sched_yield(int blocked)
+{
+    co_t* co = s_cur;
+
+    co->state = blocked ? CO_WAIT : CO_RUN;
+    if (_setjmp(co->ctx) == 0)
+	_longjmp(s_main, 1);
+}
+
+void f18_sched_next(void)
+{
+    s_words++;
+    if ((++s_slice >= F18_SCHED_SLICE) || (s_words >= s_limit))
+	f18_sched_yield(0);
+}
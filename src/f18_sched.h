@@ -0,0 +1,45 @@
+#ifndef __F18_SCHED_H__
+#define __F18_SCHED_H__
+
+//
+// Deterministic single threaded node scheduler
+//
+// Each node runs f18_emu as a coroutine on its own stack. A node gives
+// up the cpu every F18_SCHED_SLICE words and when a port transfer has
+// to wait (the node has FLAG_SCHED set). Nodes are run round robin in
+// the order given to f18_sched_init, so a run is a function of the
+// node state and what the caller feeds into the ports between rounds.
+//
+
+#include <stdint.h>
+#include "f18.h"
+
+#define F18_SCHED_SLICE  64      // words per node and round
+#define F18_SCHED_STACK  (64*1024)
+
+// Setup coroutines for n nodes, returns -1 on failure
+extern int f18_sched_init(node_t** nodes, int n);
+
+// Restart all nodes at f18_emu from the node state on the next round,
+// clears the word count and sets the word limit for the run
+extern void f18_sched_restart(uint64_t max_words);
+
+// Continue the run for another max_words words
+extern void f18_sched_limit(uint64_t max_words);
+
+// Release the coroutine stacks
+extern void f18_sched_free(void);
+
+// Run each runnable node once, returns the number of nodes run
+// (0 when all are blocked or done) or -1 when the word limit is hit
+extern int f18_sched_round(void);
+
+// Words executed since the last restart
+extern uint64_t f18_sched_words(void);
+
+// Called from the emulator loop at each word and from a port wait,
+// blocked is set while the node waits for a transfer
+extern void f18_sched_next(void);
+extern void f18_sched_yield(int blocked);
+
+#endif
@@ -0,0 +1,236 @@
+//
+// External SDRAM model for the 007/008/009 memory interface
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_port.h"
+#include "f18_sdram.h"
+
+#define SDRAM_DATA  7     // node ids
+#define SDRAM_CTRL  8
+#define SDRAM_ADDR  9
+
+#define SDRAM_COLS  1024   // words per row
+
+// ~RAS ~CAS ~WE on io_pin 0, 1, 2 of 008, 1 when driven low
+#define CMD_RAS  4
+#define CMD_CAS  2
+#define CMD_WE   1
+
+#define CMD_ACTIVE  (CMD_RAS)
+#define CMD_READ    (CMD_CAS)
+#define CMD_WRITE   (CMD_CAS|CMD_WE)
+
+typedef struct {
+    uint32_t* mem;
+    size_t words;            // power of 2
+    size_t mask;
+    int mapped;              // file backed
+    // bus latches, written by the node threads
+    uint18_t addr;
+    uint18_t data;
+    uint18_t rdata;
+    uint32_t row;            // open row, 008 only
+    // chained io register handlers
+    uint18_t (*data_read_ioreg)(node_t* np, uint18_t reg);
+    void (*data_write_ioreg)(node_t* np, uint18_t reg, uint18_t val);
+    void (*ctrl_write_ioreg)(node_t* np, uint18_t reg, uint18_t val);
+    void (*addr_write_ioreg)(node_t* np, uint18_t reg, uint18_t val);
+} sdram_t;
+
+static sdram_t sdram;
+
+static inline node_t* get_node(node_t* nodes[GRID_ROWS][GRID_COLS], int id)
+{
+    return nodes[ID_TO_ROW(id)][ID_TO_COLUMN(id)];
+}
+
+int f18_sdram_open(const char* filename, size_t words)
+{
+    size_t n = 1;
+    void* mem;
+
+    if (sdram.mem != NULL) {
+	errno = EBUSY;
+	return -1;
+    }
+    if (words == 0)
+	words = F18_SDRAM_WORDS;
+    if (filename != NULL) {
+	struct stat st;
+	int fd;
+
+	if ((fd = open(filename, O_RDWR|O_CREAT, 0644)) < 0)
+	    return -1;
+	if (fstat(fd, &st) < 0)
+	    goto error;
+	if (st.st_size >= sizeof(uint32_t))
+	    words = st.st_size / sizeof(uint32_t);
+	while (2*n <= words)
+	    n <<= 1;
+	if ((st.st_size < n*sizeof(uint32_t)) &&
+	    (ftruncate(fd, n*sizeof(uint32_t)) < 0))
+	    goto error;
+	mem = mmap(NULL, n*sizeof(uint32_t), PROT_READ|PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+	    goto error;
+	close(fd);
+	sdram.mapped = 1;
+	goto done;
+    error:
+	close(fd);
+	return -1;
+    }
+    while (2*n <= words)
+	n <<= 1;
+    mem = mmap(NULL, n*sizeof(uint32_t), PROT_READ|PROT_WRITE,
+	       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+	return -1;
+    sdram.mapped = 0;
+done:
+    sdram.mem = mem;
+    sdram.words = n;
+    sdram.mask = n - 1;
+    return 0;
+}
+
+uint32_t* f18_sdram_mem(size_t* words)
+{
+    if (words != NULL)
+	*words = sdram.words;
+    return sdram.mem;
+}
+
+int f18_sdram_close(void)
+{
+    int r = 0;
+
+    if (sdram.mem == NULL)
+	return 0;
+    if (sdram.mapped)
+	r = msync(sdram.mem, sdram.words*sizeof(uint32_t), MS_SYNC);
+    munmap(sdram.mem, sdram.words*sizeof(uint32_t));
+    sdram.mem = NULL;
+    return r;
+}
+
+// 1 when the 2 bit pin field is driven low
+static inline int pin_low(uint18_t value, int shift)
+{
+    return ((value >> shift) & 3) == 2;
+}
+
+static void sdram_command(uint18_t value)
+{
+    uint18_t addr = __atomic_load_n(&sdram.addr, __ATOMIC_ACQUIRE);
+    int cmd = (pin_low(value, 16) ? CMD_RAS : 0) |
+	      (pin_low(value, 4)  ? CMD_CAS : 0) |
+	      (pin_low(value, 2)  ? CMD_WE  : 0);
+    size_t a;
+
+    switch (cmd) {
+    case CMD_ACTIVE:
+	sdram.row = addr;   // commands all come from 008
+	break;
+    case CMD_READ:
+	a = (sdram.row*SDRAM_COLS + (addr % SDRAM_COLS)) & sdram.mask;
+	__atomic_store_n(&sdram.rdata, sdram.mem[a], __ATOMIC_RELEASE);
+	break;
+    case CMD_WRITE:
+	a = (sdram.row*SDRAM_COLS + (addr % SDRAM_COLS)) & sdram.mask;
+	sdram.mem[a] = __atomic_load_n(&sdram.data, __ATOMIC_ACQUIRE);
+	break;
+    default:  // nop, precharge, refresh, mode
+	break;
+    }
+}
+
+static void ctrl_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    if (ioreg == IOREG_IO)
+	sdram_command(value);
+    (*sdram.ctrl_write_ioreg)(np, ioreg, value);
+}
+
+static void addr_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    if (ioreg == IOREG_IO)
+	__atomic_store_n(&sdram.addr, value, __ATOMIC_RELEASE);
+    (*sdram.addr_write_ioreg)(np, ioreg, value);
+}
+
+static void data_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    if (ioreg == IOREG_IO)
+	__atomic_store_n(&sdram.data, value, __ATOMIC_RELEASE);
+    (*sdram.data_write_ioreg)(np, ioreg, value);
+}
+
+static uint18_t data_read_ioreg(node_t* np, uint18_t ioreg)
+{
+    if (ioreg == IOREG_IO)
+	return __atomic_load_n(&sdram.rdata, __ATOMIC_ACQUIRE);
+    return (*sdram.data_read_ioreg)(np, ioreg);
+}
+
+int f18_sdram_attach(node_t* nodes[GRID_ROWS][GRID_COLS])
+{
+    node_t* np;
+
+    if ((sdram.mem == NULL) || (sdram.ctrl_write_ioreg != NULL)) {
+	errno = EINVAL;
+	return -1;
+    }
+    np = get_node(nodes, SDRAM_DATA);
+    sdram.data_read_ioreg = np->read_ioreg;
+    np->read_ioreg = data_read_ioreg;
+    sdram.data_write_ioreg = np->write_ioreg;
+    np->write_ioreg = data_write_ioreg;
+
+    np = get_node(nodes, SDRAM_CTRL);
+    sdram.ctrl_write_ioreg = np->write_ioreg;
+    np->write_ioreg = ctrl_write_ioreg;
+
+    np = get_node(nodes, SDRAM_ADDR);
+    sdram.addr_write_ioreg = np->write_ioreg;
+    np->write_ioreg = addr_write_ioreg;
+    return 0;
+}
+
+// Serve one transaction per request until the port is stopped
+void f18_sdram_serve(f18_port_t* pp, void* arg)
+{
+    uint18_t cmd, lo, value;
+
+    while (f18_port_recv(pp, &cmd) && f18_port_recv(pp, &lo)) {
+	size_t a = ((((size_t)cmd & 0xffff) << 18) | lo) & sdram.mask;
+
+	switch (cmd >> 16) {
+	case F18_SDRAM_READ:
+	    if (!f18_port_send(pp, sdram.mem[a] & MASK18))
+		return;
+	    pp->words++;
+	    break;
+	case F18_SDRAM_WRITE:
+	    if (!f18_port_recv(pp, &value))
+		return;
+	    sdram.mem[a] = value;
+	    pp->words++;
+	    break;
+	default:
+	    break;
+	}
+    }
+}
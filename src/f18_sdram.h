@@ -0,0 +1,59 @@
+#ifndef __F18_SDRAM_H__
+#define __F18_SDRAM_H__
+
+//
+// External SDRAM behind nodes 007 (data), 008 (control) and 009 (address)
+//
+// Pin model, driven by io register writes:
+//
+//   009  address bus, the io value is latched
+//   007  data bus, writes latch the value, reads return the read data
+//   008  control pins 33 34 35 = ~RAS ~CAS ~WE (low when driven 10),
+//        a write issues the command the pins form:
+//          ACTIVE  L H H   row = address latch
+//          READ    H L H   read data = mem[row*1024 + column]
+//          WRITE   H L L   mem[row*1024 + column] = data latch
+//        column is the low 10 bits of the address latch, other
+//        commands are ignored
+//
+// Fast path, a device on the chip edge port of 007 (down, attached with
+// f18_attach_device) that serves a transaction per request:
+//
+//   node writes  op<<16 | addr>>18,  addr & 0x3ffff   op 1 read, 2 write
+//   write:       node writes the data word
+//   read:        node reads the data word
+//
+// Memory is an array of 18 bit words (32 bit cells, host byte order),
+// addresses wrap at the size. A file backed memory is mapped shared and
+// holds the contents across runs.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+#include "f18.h"
+#include "f18_port.h"
+
+#define F18_SDRAM_WORDS  (1 << 22)   // default size
+
+#define F18_SDRAM_NODE   7           // fast path port, down
+#define F18_SDRAM_READ   1
+#define F18_SDRAM_WRITE  2
+
+// Map filename (NULL for anonymous memory), a new or empty file is
+// sized to words (0 for F18_SDRAM_WORDS), otherwise the file size sets
+// the memory size, rounded down to a power of 2
+extern int f18_sdram_open(const char* filename, size_t words);
+
+// Hook the io registers of 007, 008 and 009
+extern int f18_sdram_attach(node_t* nodes[GRID_ROWS][GRID_COLS]);
+
+// Fast path device, serve function of a device port
+extern void f18_sdram_serve(f18_port_t* pp, void* arg);
+
+// Memory and size in words, for loading and inspection
+extern uint32_t* f18_sdram_mem(size_t* words);
+
+// Sync a file backed memory and unmap
+extern int f18_sdram_close(void);
+
+#endif
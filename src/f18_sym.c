@@ -1,6 +1,7 @@
 //  symbol handling
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include "f18.h"
 #include "f18_sym.h"
@@ -10,10 +11,54 @@ const f18_symbol_table_t no_symbols = SYMTAB_INITALIZER(&no_symbol);
 
 extern uint18_t normalize_addr(uint18_t);
 
+// index is used when built for the current table size
+#define SYM_INDEX_VALID(symtab)						\
+    (((symtab)->index != NULL) && ((symtab)->index->n > 0) &&		\
+     ((symtab)->index->n == ((symtab)->next - (symtab)->symbol)))
+
+static uint32_t sym_hash(const char* name, int len)
+{
+    uint32_t h = 2166136261u;  // FNV-1a
+    while(len--) {
+	h ^= (uint8_t) *name++;
+	h *= 16777619u;
+    }
+    return h;
+}
+
+// first (latest) entry with key in a sorted key array
+static symindex_t key_lookup(const f18_symbol_key_t* keys, int n, uint32_t key)
+{
+    int lo = 0, hi = n;
+
+    while(lo < hi) {
+	int mid = (lo + hi) / 2;
+	if (keys[mid].key < key)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if ((lo < n) && (keys[lo].key == key))
+	return keys[lo].si;
+    return NOSYM;
+}
+
 // Look for symbols from that latest to the first
 symindex_t sym_find_by_namelen(const char* name, int len,
 			       const f18_symbol_table_t* symtab)
 {
+    if ((symtab != NULL) && SYM_INDEX_VALID(symtab)) {
+	const f18_symbol_index_t* ix = symtab->index;
+	uint32_t h = sym_hash(name, len) & ix->hmask;
+
+	while(ix->hash[h]) {
+	    f18_symbol_t* sp = &symtab->symbol[ix->hash[h]-1];
+	    if ((SYMLEN(sp) == len) && (memcmp(sp->name, name, len) == 0))
+		return ix->hash[h]-1;
+	    h = (h + 1) & ix->hmask;
+	}
+	return NOSYM;
+    }
     if (symtab != NULL) {
 	f18_symbol_t* sp = symtab->next - 1;
 	int n = symtab->next - symtab->symbol;
@@ -36,6 +81,8 @@ symindex_t sym_find_by_name(const char* name, const f18_symbol_table_t* symtab)
 
 symindex_t sym_find_by_value(uint18_t addr, const f18_symbol_table_t* symtab)
 {
+    if ((symtab != NULL) && SYM_INDEX_VALID(symtab))
+	return key_lookup(symtab->index->by_value, symtab->index->n, addr);
     if (symtab != NULL) {
 	f18_symbol_t* sp = symtab->next - 1;
 	int n = symtab->next - symtab->symbol;
@@ -47,11 +94,14 @@ symindex_t sym_find_by_value(uint18_t addr, const f18_symbol_table_t* symtab)
 	    n--;
 	}
     }
-    return -1;
+    return NOSYM;
 }
 
 symindex_t sym_find_by_addr(uint18_t addr, const f18_symbol_table_t* symtab)
 {
+    if ((symtab != NULL) && SYM_INDEX_VALID(symtab))
+	return key_lookup(symtab->index->by_addr, symtab->index->n,
+			  normalize_addr(addr));
     if (symtab != NULL) {
 	f18_symbol_t* sp = symtab->next - 1;
 	int n = symtab->next - symtab->symbol;
@@ -69,6 +119,60 @@ symindex_t sym_find_by_addr(uint18_t addr, const f18_symbol_table_t* symtab)
     return NOSYM;
 }
 
+// nearest symbol at or below addr in the same region (ram, rom or io),
+// latest first among equal addresses
+symindex_t sym_find_nearest(uint18_t addr, const f18_symbol_table_t* symtab)
+{
+    uint18_t a = normalize_addr(addr);
+
+    if ((symtab != NULL) && SYM_INDEX_VALID(symtab)) {
+	const f18_symbol_key_t* keys = symtab->index->by_addr;
+	int lo = 0, hi = symtab->index->n;
+
+	while(lo < hi) {  // first key above a
+	    int mid = (lo + hi) / 2;
+	    if (keys[mid].key <= a)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	while(lo > 0) {
+	    uint32_t key = keys[lo-1].key;
+	    int first = lo - 1;
+	    int i;
+
+	    if ((key ^ a) & ~MASK7)  // below the region
+		break;
+	    while((first > 0) && (keys[first-1].key == key))
+		first--;
+	    for (i = first; i < lo; i++)
+		if (symtab->symbol[keys[i].si].name != NULL)
+		    return keys[i].si;
+	    lo = first;
+	}
+	return NOSYM;
+    }
+    if (symtab != NULL) {
+	symindex_t best = NOSYM;
+	uint18_t bv = 0;
+	int i, n = symtab->next - symtab->symbol;
+
+	for (i = 0; i < n; i++) {
+	    const f18_symbol_t* sp = &symtab->symbol[i];
+	    uint18_t v = normalize_addr(sp->value);
+
+	    if ((sp->name == NULL) || (v > a) || ((v ^ a) & ~MASK7))
+		continue;
+	    if ((best == NOSYM) || (v >= bv)) {
+		best = i;
+		bv = v;
+	    }
+	}
+	return best;
+    }
+    return NOSYM;
+}
+
 symindex_t sym_insert(char* word, int len, f18_symbol_table_t* symtab)
 {
     if (symtab != NULL) {
@@ -148,8 +252,9 @@ void sym_resolve(symindex_t si, uint18_t addr, uint18_t* ram,
 	word = (word & ~mask) | (addr & mask);
 	ram[patch_addr] = word;
 
-	printf("resolve_symbol: %s -> %03x (patched %03x slot %d)\n",
-	       symtab->symbol[si].name, addr, patch_addr, patch->slot);
+	if (g_flags & FLAG_VERBOSE)
+	    fprintf(stderr, "resolve_symbol: %s -> %03x (patched %03x slot %d)\n",
+		   symtab->symbol[si].name, addr, patch_addr, patch->slot);
 
 	p = patch->next;
     }
@@ -204,14 +309,95 @@ f18_symbol_table_t* sym_copy_table(f18_symbol_table_t* src)
 	f18_symbol_t* src_sp = &src->symbol[i];
 	f18_symbol_t* dst_sp = &dst->symbol[i];
 	size_t len = SYMLEN(src_sp);
-	printf("copy symbol %s L:%d T:%c Value:%05x\n",
-	       src_sp->name, SYMLEN(src_sp), SYMTYP(src_sp), src_sp->value);
+	if (g_flags & FLAG_VERBOSE)
+	    fprintf(stderr, "copy symbol %s L:%d T:%c Value:%05x\n",
+		   src_sp->name, SYMLEN(src_sp), SYMTYP(src_sp),
+		   src_sp->value);
 	if (SYMTYP(src_sp) == 'U')
 	    fprintf(stderr, "symbol %s is unresolved\n", src_sp->name);
 	dst->dp -= (len + 3);
 	memcpy(dst->dp, src_sp->name - 2, len+3);
 	dst_sp->name = dst->dp + 2;
     }
+    dst->index = NULL;
+    sym_build_index(dst);
     return dst;
 }
 
+// key ascending, latest symbol first among equal keys
+static int key_compare(const void* a, const void* b)
+{
+    const f18_symbol_key_t* ka = a;
+    const f18_symbol_key_t* kb = b;
+
+    if (ka->key != kb->key)
+	return (ka->key < kb->key) ? -1 : 1;
+    return (ka->si > kb->si) ? -1 : (ka->si < kb->si);
+}
+
+void sym_free_table(f18_symbol_table_t* symtab)
+{
+    if (symtab == NULL)
+	return;
+    free(symtab->index);
+    free(symtab);
+}
+
+// Static tables carry their own index struct (SYMTAB_INITALIZER),
+// other tables get one allocated together with the arrays.
+int sym_build_index(const f18_symbol_table_t* symtab)
+{
+    f18_symbol_index_t* ix = symtab->index;
+    int n = symtab->next - symtab->symbol;
+    uint32_t hsize = 4;
+    size_t size;
+    uint8_t* mem;
+    int i;
+
+    if ((n == 0) || (n > 0xffff) || SYM_INDEX_VALID(symtab))
+	return 0;
+    while(hsize < 2*(uint32_t)n)
+	hsize <<= 1;
+    size = hsize*sizeof(uint16_t) + 2*n*sizeof(f18_symbol_key_t);
+    if (ix == NULL) {
+	if ((mem = malloc(sizeof(f18_symbol_index_t) + size)) == NULL)
+	    return -1;
+	ix = (f18_symbol_index_t*) mem;
+	mem += sizeof(f18_symbol_index_t);
+	((f18_symbol_table_t*)symtab)->index = ix;
+    }
+    else if ((mem = malloc(size)) == NULL)
+	return -1;
+    ix->by_value = (f18_symbol_key_t*) mem;
+    ix->by_addr  = ix->by_value + n;
+    ix->hash     = (uint16_t*) (ix->by_addr + n);
+    ix->hmask    = hsize - 1;
+    memset(ix->hash, 0, hsize*sizeof(uint16_t));
+
+    for (i = 0; i < n; i++) {
+	f18_symbol_t* sp = &symtab->symbol[i];
+	uint32_t h;
+
+	ix->by_value[i].key = sp->value;
+	ix->by_value[i].si  = i;
+	ix->by_addr[i].key  = normalize_addr(sp->value);
+	ix->by_addr[i].si   = i;
+	if (sp->name == NULL)  // rom table end marker
+	    continue;
+	// later symbols replace earlier ones with the same name
+	h = sym_hash(sp->name, SYMLEN(sp)) & ix->hmask;
+	while(ix->hash[h]) {
+	    f18_symbol_t* hp = &symtab->symbol[ix->hash[h]-1];
+	    if ((SYMLEN(hp) == SYMLEN(sp)) &&
+		(memcmp(hp->name, sp->name, SYMLEN(sp)) == 0))
+		break;
+	    h = (h + 1) & ix->hmask;
+	}
+	ix->hash[h] = i+1;
+    }
+    qsort(ix->by_value, n, sizeof(f18_symbol_key_t), key_compare);
+    qsort(ix->by_addr, n, sizeof(f18_symbol_key_t), key_compare);
+    ix->n = n;
+    return 0;
+}
+
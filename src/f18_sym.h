@@ -23,18 +23,35 @@ typedef struct {
     uint9_t next;  // next patch address 0 = end
 } f18_symbol_patch_t;
 
+// lookup index for a finalised table, sorted arrays hold the latest
+// symbol first among equal keys (same result as the linear scans)
+typedef struct {
+    uint32_t key;         // value or normalized address
+    uint32_t si;          // symbol index
+} f18_symbol_key_t;
+
+typedef struct {
+    int       n;          // number of symbols indexed, 0 = not built
+    uint32_t  hmask;      // hash size - 1
+    uint16_t* hash;       // open addressing on name, si+1 (0 = empty)
+    f18_symbol_key_t* by_value;
+    f18_symbol_key_t* by_addr;
+} f18_symbol_index_t;
+
 typedef struct {
     uint8_t* heap;        // start heap memory
     size_t   heap_size;   // total size of heap
     f18_symbol_t* symbol;
     f18_symbol_t* next;   // next slot to insert to
     char*    dp;        // name pointer from low heap to high
+    f18_symbol_index_t* index;  // optional lookup index (or NULL)
 } f18_symbol_table_t;
 
 #define RESET_SYMTAB(sp) do {						\
 	(sp)->symbol = (f18_symbol_t*) ((sp)->heap);			\
 	(sp)->next   =  (f18_symbol_t*) ((sp)->heap);			\
 	(sp)->dp     = (char*)(((sp)->heap)) + (((sp)->heap_size));	\
+	(sp)->index  = NULL;						\
     } while(0)
 
 #define INIT_SYMTAB(sp, mem, memsize) do {		\
@@ -43,11 +60,13 @@ typedef struct {
 	RESET_SYMTAB(sp);				\
     } while(0)
 
-// init of fixed (const) f18_symbols array
+// init of fixed (const) f18_symbols array, the index is static storage
+// filled in by sym_build_index at startup
 #define SYMTAB_INITALIZER(sarr) { 		\
   .heap = NULL,					\
   .heap_size = 0,				\
   .dp = NULL,				        \
+  .index = &(f18_symbol_index_t) { .n = 0 },	\
   .symbol = (f18_symbol_t*)(sarr),		\
   .next = ((f18_symbol_t*)(sarr))+(sizeof((sarr))/sizeof(f18_symbol_t)), }
 
@@ -74,6 +93,7 @@ extern symindex_t sym_find_by_namelen(const char* name, int len,
 extern symindex_t sym_find_by_name(const char* name, const f18_symbol_table_t* symtab);
 extern symindex_t sym_find_by_value(uint18_t value, const f18_symbol_table_t* symtab);
 extern symindex_t sym_find_by_addr(uint18_t addr, const f18_symbol_table_t* symtab);
+extern symindex_t sym_find_nearest(uint18_t addr, const f18_symbol_table_t* symtab);
 
 extern symindex_t sym_insert(char* word, int len, f18_symbol_table_t* symtab);
 
@@ -88,4 +108,10 @@ extern symindex_t sym_add(char* name, int len, uint18_t addr,
 
 extern f18_symbol_table_t* sym_copy_table(f18_symbol_table_t* src);
 
+// Free a table from sym_copy_table or an image load, with its index
+extern void sym_free_table(f18_symbol_table_t* symtab);
+
+// Build lookup index for a table that will not change anymore
+extern int sym_build_index(const f18_symbol_table_t* symtab);
+
 #endif
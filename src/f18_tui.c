@@ -7,6 +7,7 @@
 #include <wchar.h>
 #include <string.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include "f18_sym.h"
 #include "f18_tui.h"
@@ -36,6 +37,18 @@ extern char g_pty_name[256];  // PTY name for 708
 #define COLOR_PAUSED  4
 #define COLOR_RUNNING 5
 #define COLOR_BLOCKED 6
+#define COLOR_HEAT0   7   // 7-11: idle, then rising heat
+
+// Heatmap modes, 'm' cycles through them
+#define HEAT_OFF      0
+#define HEAT_IPS      1   // Instruction words per second
+#define HEAT_BLOCKED  2   // Share of time blocked on ports
+#define HEAT_TRAFFIC  3   // Port words per second, arrows on hot links
+#define HEAT_MODES    4
+
+#define HEAT_SAMPLE_NS 200000000   // Min time between samples
+#define HEAT_AVG(old, new) (((old) + (new)) / 2)
+#define HEAT_HOT       0.5         // Links above this share get arrows
 
 // Window positions and sizes (calculated in tui_init)
 static int term_rows, term_cols;
@@ -51,6 +64,15 @@ static int cmd_top, cmd_left, cmd_height, cmd_width;
 static char cmd_line[256] = "";
 // static int cmd_pos = 0;  // TODO: for command editing
 static int show_help = 0;
+static int heat_mode = HEAT_OFF;
+
+// Node views of the current frame and what is on screen
+static dbg_view_t views[GRID_ROWS][GRID_COLS];
+static dbg_view_t shown;                     // focus node view drawn
+static int shown_cell[GRID_ROWS][GRID_COLS]; // grid cells drawn
+static uint18_t shown_focus;
+static dbg_mode_t shown_mode;
+static int shown_valid = 0;                  // 0 forces a full redraw
 
 // Draw a Unicode horizontal line
 static void draw_hline(int y, int x, int len)
@@ -163,6 +185,11 @@ int tui_init(void)
     init_pair(COLOR_PAUSED,  COLOR_YELLOW, COLOR_BLACK);
     init_pair(COLOR_RUNNING, COLOR_GREEN, COLOR_BLACK);
     init_pair(COLOR_BLOCKED, COLOR_RED,   COLOR_BLACK);
+    init_pair(COLOR_HEAT0,   COLOR_WHITE, COLOR_BLACK);
+    init_pair(COLOR_HEAT0+1, COLOR_WHITE, COLOR_BLUE);
+    init_pair(COLOR_HEAT0+2, COLOR_BLACK, COLOR_GREEN);
+    init_pair(COLOR_HEAT0+3, COLOR_BLACK, COLOR_YELLOW);
+    init_pair(COLOR_HEAT0+4, COLOR_WHITE, COLOR_RED);
 
     tui_setup();
 
@@ -186,9 +213,28 @@ node_t* tui_get_focused_node(void)
     return NULL;
 }
 
-void tui_draw_title(void)
+// Read the views of all nodes for this frame
+static void tui_read_views(void)
+{
+    int i, j;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+        for (j = 0; j < GRID_COLS; j++) {
+            if (node[i][j] != NULL)
+                debug_read_view(node[i][j], &views[i][j]);
+        }
+    }
+}
+
+static dbg_view_t* tui_view(node_t* np)
+{
+    if (np == NULL)
+        return NULL;
+    return &views[ID_TO_ROW(np->id)][ID_TO_COLUMN(np->id)];
+}
+
+void tui_draw_title(node_t* np, const dbg_view_t* vp)
 {
-    node_t* np = tui_get_focused_node();
     const char* mode = debug_mode_name(g_debugger.mode);
     int is_running = (g_debugger.mode == DBG_MODE_RUN);
 
@@ -208,9 +254,8 @@ void tui_draw_title(void)
         mvprintw(0, 25, ">>> RUNNING <<<");
         attroff(COLOR_PAIR(COLOR_RUNNING) | A_BOLD);
         attron(COLOR_PAIR(COLOR_TITLE));
-    } else {
-        mvprintw(0, 25, "%s s%d PC:%03x", mode, g_debugger.current_slot,
-                 g_debugger.current_pc);
+    } else if (vp) {
+        mvprintw(0, 25, "%s s%d PC:%03x", mode, vp->slot, vp->pc);
     }
 
     // Show PTY name if available
@@ -222,123 +267,401 @@ void tui_draw_title(void)
     attroff(COLOR_PAIR(COLOR_TITLE));
 }
 
-void tui_draw_grid(void)
+// Boxes and labels, only drawn on a full redraw
+static void tui_draw_frames(node_t* np)
 {
+    char title[32];
     int y, i, j;
 
     attron(COLOR_PAIR(COLOR_BORDER));
     draw_box(grid_top, grid_left, grid_height, grid_width, "Node Grid");
+    snprintf(title, sizeof(title), "Registers [%03d]", np ? np->id : 0);
+    draw_box(reg_top, reg_left, reg_height, reg_width, title);
+    draw_box(stack_top, stack_left, stack_height, stack_width, "Stacks");
+    draw_box(disasm_top, disasm_left, disasm_height, disasm_width, "Disasm");
+    draw_box(ram_top, ram_left, ram_height, ram_width, "RAM");
+    draw_box(cmd_top, cmd_left, cmd_height, cmd_width, "Command");
     attroff(COLOR_PAIR(COLOR_BORDER));
 
-    // Draw column headers
+    // Grid column and row headers
     y = grid_top + 1;
     mvprintw(y, grid_left + 3, "  ");
     for (j = 0; j < grid_cols; j++) {
         mvprintw(y, grid_left + 4 + j * 4, "%02d", j);
     }
-
-    // Draw nodes
     for (i = grid_rows-1; i >= 0 && (grid_rows - 1 - i) < 8; i--) {
         y = grid_top + 2 + (grid_rows - 1 - i);
         mvprintw(y, grid_left + 1, "%d", i);
+    }
+    if (heat_mode == HEAT_OFF)
+        mvprintw(grid_top + grid_height - 2, grid_left + 2,
+                 "[>>]=focus [Op]=blocked");
+
+    if (np) {
+        mvprintw(stack_top + 1, stack_left + 2, "Data");
+        mvprintw(stack_top + 1, stack_left + stack_width / 2 + 1, "Return");
+        y = ram_top + 1;
+        for (i = 0; i < 5 && y < ram_top + ram_height - 1; i++, y++)
+            mvprintw(y, ram_left + 1, "%02x:", i*4);
+    }
+}
+
+// Grid cell look: kind in bits 8.., blocking instruction in bits 0-7
+#define CELL_NONE     0
+#define CELL_FOCUS    1
+#define CELL_BLOCKED  2
+#define CELL_PAUSED   3
+#define CELL_STEP     4
+#define CELL_IDLE     5
+
+static int grid_cell(int i, int j)
+{
+    dbg_view_t* vp = &views[i][j];
+    int id = MAKE_ID(i, j);
+
+    if (node[i][j] == NULL)
+        return CELL_NONE << 8;
+    if (id == (int)g_debugger.focus_node)
+        return CELL_FOCUS << 8;
+    if (vp->blocked_addr != 0)
+        return (CELL_BLOCKED << 8) | vp->wins;
+    if (debug_is_step_node(id))
+        return (vp->at_barrier ? CELL_PAUSED : CELL_STEP) << 8;
+    return CELL_IDLE << 8;
+}
+
+void tui_draw_grid(void)
+{
+    int y, i, j;
+
+    for (i = grid_rows-1; i >= 0 && (grid_rows - 1 - i) < 8; i--) {
+        y = grid_top + 2 + (grid_rows - 1 - i);
 
         for (j = 0; j < grid_cols; j++) {
-            reg_node_t* np = (reg_node_t*)node[i][j];
-            int id = MAKE_ID(i, j);
-            int is_focus = (id == (int)g_debugger.focus_node);
-            int is_step = debug_is_step_node(id);
-            int at_barrier = (np != NULL) ? np->debug.at_barrier : 0;
-            int is_blocked = (np != NULL) ? (np->debug.blocked_addr != 0) : 0;
-
-            if (is_focus)
+            int cell = grid_cell(i, j);
+            int x = grid_left + 3 + j * 4;
+
+            if (shown_valid && (cell == shown_cell[i][j]))
+                continue;
+            shown_cell[i][j] = cell;
+
+            switch (cell >> 8) {
+            case CELL_FOCUS:
                 attron(COLOR_PAIR(COLOR_FOCUS) | A_BOLD);
-            else if (is_blocked)
+                mvprintw(y, x, "[>>]");
+                break;
+            case CELL_BLOCKED:
                 attron(COLOR_PAIR(COLOR_BLOCKED) | A_BOLD);
-            else if (is_step && at_barrier)
+                mvprintw(y, x, "[%2s]", f18_ins[cell & MASK5].name);
+                break;
+            case CELL_PAUSED:
                 attron(COLOR_PAIR(COLOR_PAUSED));
-            else if (is_step)
+                mvprintw(y, x, "[**]");
+                break;
+            case CELL_STEP:
                 attron(COLOR_PAIR(COLOR_RUNNING));
-
-            if (np == NULL)
-                mvprintw(y, grid_left + 3 + j * 4, "----");
-            else if (is_focus)
-                mvprintw(y, grid_left + 3 + j * 4, "[>>]");
-            else if (is_blocked) {
-		const char* name = f18_ins[np->n.wins].name;
-		mvprintw(y, grid_left + 3 + j * 4, "[%2s]", name);
-	    }
-            else if (is_step)
-                mvprintw(y, grid_left + 3 + j * 4, "[**]");
-            else
-                mvprintw(y, grid_left + 3 + j * 4, "[  ]");
+                mvprintw(y, x, "[**]");
+                break;
+            case CELL_IDLE:
+                mvprintw(y, x, "[  ]");
+                break;
+            default:
+                mvprintw(y, x, "----");
+                break;
+            }
 
             attroff(COLOR_PAIR(COLOR_FOCUS) | COLOR_PAIR(COLOR_BLOCKED) |
                     COLOR_PAIR(COLOR_PAUSED) | COLOR_PAIR(COLOR_RUNNING) | A_BOLD);
         }
     }
+}
 
-    mvprintw(grid_top + grid_height - 2, grid_left + 2,
-             "[>>]=focus [Op]=blocked");
+// Heatmap: rates sampled from the node activity counters
+typedef struct {
+    dbg_activity_t last;     // Counters at the previous sample
+    double ips;              // Instruction words/s (smoothed)
+    double blocked;          // Fraction of time blocked (smoothed)
+    double rd[4];            // Port words/s read per direction
+    double wr[4];            // Port words/s written per direction
+} heat_t;
+
+typedef struct {
+    chtype ch[4];
+    int    pair;
+    int    attr;
+} heat_cell_t;
+
+static heat_t heat[GRID_ROWS][GRID_COLS];
+static heat_cell_t shown_heat[GRID_ROWS][GRID_COLS];
+static uint64_t heat_time;   // ns of last sample
+
+static uint64_t tui_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-void tui_draw_registers(node_t* np)
+static double heat_rate(uint64_t now, uint64_t last, double dt)
 {
-    reg_node_t* rp;
-    char title[32];
-    int y;
+    return (now > last) ? (now - last) / dt : 0.0;
+}
 
-    attron(COLOR_PAIR(COLOR_BORDER));
-    snprintf(title, sizeof(title), "Registers [%03d]", np ? np->id : 0);
-    draw_box(reg_top, reg_left, reg_height, reg_width, title);
-    attroff(COLOR_PAIR(COLOR_BORDER));
+// Sample counters, rates are averaged with the previous ones
+void tui_sample_activity(void)
+{
+    uint64_t t = tui_now_ns();
+    double dt;
+    int i, j, k;
+
+    if ((heat_time != 0) && (t - heat_time < HEAT_SAMPLE_NS))
+        return;
+    dt = (t - heat_time) / 1e9;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+        for (j = 0; j < GRID_COLS; j++) {
+            reg_node_t* rp = (reg_node_t*) node[i][j];
+            heat_t* hp = &heat[i][j];
+            dbg_activity_t a;
+            uint64_t start;
+
+            if (rp == NULL)
+                continue;
+            a.words = __atomic_load_n(&rp->debug.act.words, __ATOMIC_RELAXED);
+            a.blocked_ns = __atomic_load_n(&rp->debug.act.blocked_ns,
+                                           __ATOMIC_RELAXED);
+            start = __atomic_load_n(&rp->debug.act.block_start,
+                                    __ATOMIC_RELAXED);
+            if ((start != 0) && (start < t))  // still blocked
+                a.blocked_ns += t - start;
+            for (k = 0; k < 4; k++) {
+                a.rd[k] = __atomic_load_n(&rp->debug.act.rd[k], __ATOMIC_RELAXED);
+                a.wr[k] = __atomic_load_n(&rp->debug.act.wr[k], __ATOMIC_RELAXED);
+            }
+            if (heat_time != 0) {
+                double blocked = heat_rate(a.blocked_ns, hp->last.blocked_ns,
+                                           dt * 1e9);
+                if (blocked > 1.0)
+                    blocked = 1.0;
+                hp->ips = HEAT_AVG(hp->ips, heat_rate(a.words, hp->last.words, dt));
+                hp->blocked = HEAT_AVG(hp->blocked, blocked);
+                for (k = 0; k < 4; k++) {
+                    hp->rd[k] = HEAT_AVG(hp->rd[k],
+                                         heat_rate(a.rd[k], hp->last.rd[k], dt));
+                    hp->wr[k] = HEAT_AVG(hp->wr[k],
+                                         heat_rate(a.wr[k], hp->last.wr[k], dt));
+                }
+            }
+            hp->last = a;
+        }
+    }
+    heat_time = t;
+}
 
-    if (!np) return;
+// Words/s from (i,j) to its east neighbour and back
+static void link_east(int i, int j, double* fwd, double* back)
+{
+    *fwd  = heat[i][j].wr[RIGHT] + heat[i][j+1].rd[LEFT];
+    *back = heat[i][j+1].wr[LEFT] + heat[i][j].rd[RIGHT];
+}
+
+// Words/s from (i,j) to its north neighbour and back
+static void link_north(int i, int j, double* fwd, double* back)
+{
+    *fwd  = heat[i][j].wr[UP] + heat[i+1][j].rd[DOWN];
+    *back = heat[i+1][j].wr[DOWN] + heat[i][j].rd[UP];
+}
+
+// Rate as 3 digits and unit, fits a grid cell
+static void fmt_rate(char* buf, size_t len, double v)
+{
+    static const char unit[] = " kMG";
+    int u = 0;
+
+    while ((v >= 999.5) && (u < 3)) {
+        v /= 1000;
+        u++;
+    }
+    snprintf(buf, len, "%3.0f%c", v, unit[u]);
+}
+
+// 0 = idle, 1-4 = share of the maximum
+static int heat_level(double v, double max)
+{
+    if ((v <= 0.0) || (max <= 0.0))
+        return 0;
+    if (v >= max)
+        return 4;
+    return 1 + (int)(3.999 * v / max);
+}
+
+void tui_draw_heat(void)
+{
+    double traffic[GRID_ROWS][GRID_COLS];
+    double max_ips = 0.0, max_traffic = 0.0, max_link = 0.0;
+    double fwd, back;
+    char text[32];
+    char legend[64];
+    int i, j, k, y;
+
+    memset(traffic, 0, sizeof(traffic));
+    for (i = 0; i < GRID_ROWS; i++) {
+        for (j = 0; j < GRID_COLS; j++) {
+            if (heat[i][j].ips > max_ips)
+                max_ips = heat[i][j].ips;
+            if ((j+1 < GRID_COLS) && node[i][j] && node[i][j+1]) {
+                link_east(i, j, &fwd, &back);
+                traffic[i][j] += fwd + back;
+                traffic[i][j+1] += fwd + back;
+                if (fwd + back > max_link)
+                    max_link = fwd + back;
+            }
+            if ((i+1 < GRID_ROWS) && node[i][j] && node[i+1][j]) {
+                link_north(i, j, &fwd, &back);
+                traffic[i][j] += fwd + back;
+                traffic[i+1][j] += fwd + back;
+                if (fwd + back > max_link)
+                    max_link = fwd + back;
+            }
+        }
+    }
+    for (i = 0; i < GRID_ROWS; i++)
+        for (j = 0; j < GRID_COLS; j++)
+            if (traffic[i][j] > max_traffic)
+                max_traffic = traffic[i][j];
+
+    for (i = grid_rows-1; i >= 0 && (grid_rows - 1 - i) < 8; i--) {
+        y = grid_top + 2 + (grid_rows - 1 - i);
+
+        for (j = 0; j < grid_cols; j++) {
+            heat_t* hp = &heat[i][j];
+            heat_cell_t cell;
+            int level;
+
+            memset(&cell, 0, sizeof(cell));
+            if (node[i][j] == NULL) {
+                strcpy(text, "----");
+                level = 0;
+            }
+            else if (heat_mode == HEAT_IPS) {
+                fmt_rate(text, sizeof(text), hp->ips);
+                level = heat_level(hp->ips, max_ips);
+            }
+            else if (heat_mode == HEAT_BLOCKED) {
+                snprintf(text, sizeof(text), "%3d%%",
+                         (int)(hp->blocked * 100.0 + 0.5));
+                level = heat_level(hp->blocked, 1.0);
+            }
+            else {
+                // share of the busiest node, hot links get an arrow
+                int pct = (max_traffic > 0.0) ?
+                    (int)(99.0 * traffic[i][j] / max_traffic + 0.5) : 0;
+                snprintf(text, sizeof(text), " %2d ", pct);
+                level = heat_level(traffic[i][j], max_traffic);
+            }
+            for (k = 0; k < 4; k++)
+                cell.ch[k] = (unsigned char) text[k];
+
+            if ((heat_mode == HEAT_TRAFFIC) && (node[i][j] != NULL)) {
+                if ((i+1 < GRID_ROWS) && node[i+1][j]) {
+                    link_north(i, j, &fwd, &back);
+                    if ((fwd + back > 0.0) && (fwd + back >= max_link * HEAT_HOT))
+                        cell.ch[0] = (fwd >= back) ? ACS_UARROW : ACS_DARROW;
+                }
+                if ((j+1 < GRID_COLS) && node[i][j+1]) {
+                    link_east(i, j, &fwd, &back);
+                    if ((fwd + back > 0.0) && (fwd + back >= max_link * HEAT_HOT))
+                        cell.ch[3] = (fwd >= back) ? ACS_RARROW : ACS_LARROW;
+                }
+            }
+            cell.pair = COLOR_HEAT0 + level;
+            cell.attr = (MAKE_ID(i, j) == g_debugger.focus_node) ?
+                A_UNDERLINE : A_NORMAL;
+
+            if (shown_valid && !memcmp(&cell, &shown_heat[i][j], sizeof(cell)))
+                continue;
+            shown_heat[i][j] = cell;
+
+            attron(COLOR_PAIR(cell.pair) | cell.attr);
+            move(y, grid_left + 3 + j * 4);
+            for (k = 0; k < 4; k++)
+                addch(cell.ch[k]);
+            attroff(COLOR_PAIR(cell.pair) | cell.attr);
+        }
+    }
+
+    // legend with the scale of the current mode
+    switch (heat_mode) {
+    case HEAT_IPS:
+        fmt_rate(text, sizeof(text), max_ips);
+        snprintf(legend, sizeof(legend), "insn/s  max %s", text);
+        break;
+    case HEAT_BLOCKED:
+        snprintf(legend, sizeof(legend), "%% of time blocked on ports");
+        break;
+    default:
+        fmt_rate(text, sizeof(text), max_link);
+        snprintf(legend, sizeof(legend), "%% port traffic  hot link %s w/s",
+                 text);
+        break;
+    }
+    mvprintw(grid_top + grid_height - 2, grid_left + 2, "%-*s",
+             grid_width - 4, legend);
+}
+
+void tui_draw_registers(const dbg_view_t* vp)
+{
+    int y;
+
+    if (!vp) return;
+    if (shown_valid && !memcmp(&vp->reg, &shown.reg, sizeof(vp->reg)) &&
+        (vp->blocked_addr == shown.blocked_addr) &&
+        (vp->blocked_dir == shown.blocked_dir))
+        return;
 
-    rp = (reg_node_t*)np;
     y = reg_top + 1;
     mvprintw(y, reg_left + 2, "P=%03x  A=%05x  B=%03x",
-             np->reg.p, np->reg.a, np->reg.b);
+             vp->reg.p, vp->reg.a, vp->reg.b);
     y++;
     mvprintw(y, reg_left + 2, "I=%05x  C=%d  SP=%d  RP=%d",
-             np->reg.i, np->reg.c, np->reg.sp, np->reg.rp);
+             vp->reg.i, vp->reg.c, vp->reg.sp, vp->reg.rp);
     y++;
-    if (rp->debug.blocked_addr != 0) {
+    if (vp->blocked_addr != 0) {
         attron(COLOR_PAIR(COLOR_BLOCKED) | A_BOLD);
         mvprintw(y, reg_left + 2, "BLOCKED %s IO:%03x",
-                 rp->debug.blocked_dir ? "WR" : "RD",
-                 rp->debug.blocked_addr);
+                 vp->blocked_dir ? "WR" : "RD",
+                 vp->blocked_addr);
         attroff(COLOR_PAIR(COLOR_BLOCKED) | A_BOLD);
     }
+    else
+        mvprintw(y, reg_left + 2, "%18s", "");
 }
 
-void tui_draw_stacks(node_t* np)
+void tui_draw_stacks(const dbg_view_t* vp)
 {
-    attron(COLOR_PAIR(COLOR_BORDER));
-    draw_box(stack_top, stack_left, stack_height, stack_width, "Stacks");
-    attroff(COLOR_PAIR(COLOR_BORDER));
-
-    if (!np) return;
+    if (!vp) return;
+    if (shown_valid && !memcmp(&vp->reg, &shown.reg, sizeof(vp->reg)) &&
+        !memcmp(vp->ds, shown.ds, sizeof(vp->ds)) &&
+        !memcmp(vp->rs, shown.rs, sizeof(vp->rs)))
+        return;
 
     // Data stack (left half)
-    int y = stack_top + 1;
+    int y = stack_top + 2;
     int half = stack_width / 2;
-    mvprintw(y, stack_left + 2, "Data");
-    y++;
-    mvprintw(y++, stack_left + 2, "T: %05x", np->reg.t);
-    mvprintw(y++, stack_left + 2, "S: %05x", np->reg.s);
+    mvprintw(y++, stack_left + 2, "T: %05x", vp->reg.t);
+    mvprintw(y++, stack_left + 2, "S: %05x", vp->reg.s);
     for (int i = 0; i < 3 && y < stack_top + stack_height - 1; i++) {
         mvprintw(y++, stack_left + 2, "%d: %05x",
-                 i, np->ds[(np->reg.sp - 1 - i) & 7]);
+                 i, vp->ds[(vp->reg.sp - 1 - i) & 7]);
     }
 
     // Return stack (right half)
-    y = stack_top + 1;
-    mvprintw(y, stack_left + half + 1, "Return");
-    y++;
-    mvprintw(y++, stack_left + half + 1, "R: %05x", np->reg.r);
+    y = stack_top + 2;
+    mvprintw(y++, stack_left + half + 1, "R: %05x", vp->reg.r);
     for (int i = 0; i < 4 && y < stack_top + stack_height - 1; i++) {
         mvprintw(y++, stack_left + half + 1, "%d: %05x",
-                 i, np->rs[(np->reg.rp - 1 - i) & 7]);
+                 i, vp->rs[(vp->reg.rp - 1 - i) & 7]);
     }
 }
 
@@ -401,26 +724,28 @@ static int decode_instruction(node_t* np, uint18_t addr, uint18_t word,
     return num_slots;
 }
 
-void tui_draw_disasm(node_t* np)
+void tui_draw_disasm(node_t* np, const dbg_view_t* vp)
 {
-    char title[32];
     int i;
     int y;
     uint18_t pc;
     int cur_slot;
     int start;
-    
+
+    if (!np || !vp) return;
+    if (shown_valid && (vp->pc == shown.pc) && (vp->slot == shown.slot) &&
+        (vp->iword == shown.iword) &&
+        !memcmp(vp->ram, shown.ram, sizeof(vp->ram)))
+        return;
+
     attron(COLOR_PAIR(COLOR_BORDER));
-    snprintf(title, sizeof(title), "Disasm [slot %d]", g_debugger.current_slot);
-    draw_box(disasm_top, disasm_left, disasm_height, disasm_width, title);
+    mvprintw(disasm_top, disasm_left + 2, " Disasm [slot %d] ", vp->slot);
     attroff(COLOR_PAIR(COLOR_BORDER));
 
-    if (!np) return;
-
     y = disasm_top + 1;
     // Use tracked PC from debugger (correct even when P has been incremented)
-    pc = g_debugger.current_pc & MASK9;
-    cur_slot = g_debugger.current_slot;
+    pc = vp->pc & MASK9;
+    cur_slot = vp->slot;
 
     // Show 2 instructions before and 2 after current
     start = (pc > 2) ? pc - 2 : 0;
@@ -439,9 +764,9 @@ void tui_draw_disasm(node_t* np)
 	
         // For current instruction, use tracked word (guaranteed correct)
         if (addr == pc) {
-            word = g_debugger.current_iword;
+            word = vp->iword;
         } else if (addr <= RAM_END2) {
-            word = np->ram[addr & MASK6];
+            word = vp->ram[addr & MASK6];
         } else if (addr <= ROM_END2 && np->rom) {
             word = np->rom[(addr - ROM_START) & MASK6];
         } else {
@@ -491,21 +816,17 @@ void tui_draw_disasm(node_t* np)
     }
 }
 
-void tui_draw_ram(node_t* np)
+void tui_draw_ram(const dbg_view_t* vp)
 {
-    attron(COLOR_PAIR(COLOR_BORDER));
-    draw_box(ram_top, ram_left, ram_height, ram_width, "RAM");
-    attroff(COLOR_PAIR(COLOR_BORDER));
-
-    if (!np) return;
+    if (!vp) return;
 
     int y = ram_top + 1;
     int addr = 0;
 
     for (int row = 0; row < 5 && y < ram_top + ram_height - 1; row++) {
-        mvprintw(y, ram_left + 1, "%02x:", addr);
         for (int col = 0; col < 4 && addr < 64; col++) {
-            mvprintw(y, ram_left + 5 + col * 7, "%05x", np->ram[addr]);
+            if (!shown_valid || (vp->ram[addr] != shown.ram[addr]))
+                mvprintw(y, ram_left + 5 + col * 7, "%05x", vp->ram[addr]);
             addr++;
         }
         y++;
@@ -514,11 +835,12 @@ void tui_draw_ram(node_t* np)
 
 void tui_draw_command(void)
 {
-    attron(COLOR_PAIR(COLOR_BORDER));
-    draw_box(cmd_top, cmd_left, cmd_height, cmd_width, "Command");
-    attroff(COLOR_PAIR(COLOR_BORDER));
+    if (shown_valid && (g_debugger.mode == shown_mode))
+        return;
+    shown_mode = g_debugger.mode;
 
     mvprintw(cmd_top + 1, cmd_left + 1, "> %s_", cmd_line);
+    mvprintw(cmd_top + 1, cmd_left + cmd_width - 42, "%41s", "");
 
     // Show different hints based on mode
     if (g_debugger.mode == DBG_MODE_RUN) {
@@ -548,7 +870,7 @@ void tui_draw_help(void)
     if (!show_help)
 	return;
 
-    h = 16;
+    h = 17;
     w = 50;
     y = (term_rows - h) / 2;
     x = (term_cols - w) / 2;
@@ -567,27 +889,56 @@ void tui_draw_help(void)
     mvprintw(y + 9, x + 1, " %-*s", w, "r         Refresh display");
     mvprintw(y + 10, x + 1, " %-*s", w, "b         Set breakpoint");
     mvprintw(y + 11, x + 1, " %-*s", w, "q         Quit");
-    mvprintw(y + 12, x + 1, " %-*s", w, "");
-    mvprintw(y + 13, x + 1, " %-*s", w, "");
-    print_center(y + 14, x+1, "Press any key to close", w);
+    mvprintw(y + 12, x + 1, " %-*s", w, "u         Step back one slot");
+    mvprintw(y + 13, x + 1, " %-*s", w, "R         Reverse continue to breakpoint");
+    mvprintw(y + 14, x + 1, " %-*s", w, "m         Heatmap: insn/s, blocked, traffic");
+    print_center(y + 15, x+1, "Press any key to close", w);
     attroff(COLOR_PAIR(COLOR_TITLE));
 }
 
+// Nodes publish views on request, the frame is built from the views
+// and only cells that differ from the previous frame are redrawn
 void tui_refresh(void)
 {
     node_t* np = tui_get_focused_node();
-    
-    erase();
+    dbg_view_t* vp;
+    int rows, cols;
+
+    tui_read_views();
+    tui_sample_activity();
+    __atomic_add_fetch(&g_debugger.view_gen, 1, __ATOMIC_RELAXED);
+    vp = tui_view(np);
+
+    getmaxyx(stdscr, rows, cols);
+    if ((rows != term_rows) || (cols != term_cols) ||
+        (g_debugger.focus_node != shown_focus))
+        shown_valid = 0;
+    if (!shown_valid) {
+        erase();
+        tui_setup();
+        tui_draw_frames(np);
+        shown_focus = g_debugger.focus_node;
+    }
 
-    tui_setup();
-    tui_draw_title();
-    tui_draw_grid();
-    tui_draw_registers(np);
-    tui_draw_stacks(np);
-    tui_draw_disasm(np);
-    tui_draw_ram(np);
-    tui_draw_command();
-    tui_draw_help();
+    tui_draw_title(np, vp);
+    if (show_help) {
+        tui_draw_help();
+        shown_valid = 0;  // help covers the panes
+    }
+    else {
+        if (heat_mode != HEAT_OFF)
+            tui_draw_heat();
+        else
+            tui_draw_grid();
+        tui_draw_registers(vp);
+        tui_draw_stacks(vp);
+        tui_draw_disasm(np, vp);
+        tui_draw_ram(vp);
+        tui_draw_command();
+        if (vp)
+            shown = *vp;
+        shown_valid = 1;
+    }
 
     refresh();
 }
@@ -617,6 +968,14 @@ int tui_handle_input(int ch)
         debug_step_over();
         break;
 
+    case 'u':
+        debug_step_back(1);  // Rewind one slot
+        break;
+
+    case 'R':
+        debug_reverse_continue();
+        break;
+
     case 'c':
     case KEY_F(5):
         debug_continue();
@@ -629,7 +988,8 @@ int tui_handle_input(int ch)
 
     case 'r':
     case KEY_F(12):
-        // Force refresh - redraw immediately
+        // Force refresh - redraw everything immediately
+        shown_valid = 0;
         tui_refresh();
         break;
 
@@ -644,6 +1004,11 @@ int tui_handle_input(int ch)
         show_help = 1;
         break;
 
+    case 'm':
+        heat_mode = (heat_mode + 1) % HEAT_MODES;
+        shown_valid = 0;
+        break;
+
     case 'f': {
         // Cycle to next step node
         int idx = NODE_ID_TO_INDEX(g_debugger.focus_node);
@@ -703,7 +1068,7 @@ void debug_tui_main(void)
         return;
     }
 
-    // Nodes start paused at barrier (mode=PAUSE, barrier_release=0)
+    // Nodes start paused at barrier (mode=PAUSE, no steps released)
     // User must press 's' or 'c' to start execution
 
     while (!done && g_debugger.mode != DBG_MODE_QUIT) {
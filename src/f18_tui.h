@@ -16,13 +16,18 @@ void debug_tui_main(void);
 // Refresh display
 void tui_refresh(void);
 
-// Draw individual components
-void tui_draw_title(void);
+// Draw individual components from the node views, the pane functions
+// only redraw what changed since the last frame
+void tui_draw_title(node_t* np, const dbg_view_t* vp);
 void tui_draw_grid(void);
-void tui_draw_registers(node_t* np);
-void tui_draw_stacks(node_t* np);
-void tui_draw_disasm(node_t* np);
-void tui_draw_ram(node_t* np);
+void tui_draw_heat(void);          // grid as heatmap
+
+// Sample node activity counters for the heatmap
+void tui_sample_activity(void);
+void tui_draw_registers(const dbg_view_t* vp);
+void tui_draw_stacks(const dbg_view_t* vp);
+void tui_draw_disasm(node_t* np, const dbg_view_t* vp);
+void tui_draw_ram(const dbg_view_t* vp);
 void tui_draw_command(void);
 void tui_draw_help(void);
 
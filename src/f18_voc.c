@@ -1,7 +1,20 @@
 
 #include <string.h>
+#include "f18.h"
 #include "f18_voc.h"
 
+// Index the static instruction, io and rom tables (call once at startup)
+void voc_index_init(void)
+{
+    int i, j;
+
+    sym_build_index(&ins_symbols);
+    sym_build_index(&io_symbols);
+    for (i = 0; i < GRID_ROWS; i++)
+	for (j = 0; j < GRID_COLS; j++)
+	    sym_build_index(SymTabMap[i][j]);
+}
+
 void voc_setup(f18_voc_t voc,
 	       f18_symbol_table_t* ram_syms,
 	       const f18_symbol_table_t* rom_syms)
@@ -20,6 +20,7 @@
 // array of symbols tables stack to search in
 typedef f18_symbol_table_t* f18_voc_t[5];
 
+extern void voc_index_init(void);
 extern void voc_setup(f18_voc_t voc,
 		      f18_symbol_table_t* ram_syms,
 		      const f18_symbol_table_t* rom_syms);
@@ -0,0 +1,235 @@
+//
+// Port deadlock watchdog
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_sym.h"
+#include "f18_chip.h"
+#include "f18_watchdog.h"
+
+#define NUM_NODES (GRID_ROWS*GRID_COLS)
+#define EXTERNAL  (-1)   // wait index of a non grid source
+#define NONE      (-2)   // direction not waited on
+
+extern node_t* node[GRID_ROWS][GRID_COLS];
+extern uint18_t normalize_addr(uint18_t addr);
+
+// port wait of a node as seen by one sample
+typedef struct {
+    uint18_t ioreg;      // port address, 0 when running
+    int      write;      // write (1) or read (0)
+    uint18_t dirs;       // channel rmask/wmask
+    uint64_t start;      // block start, identifies the transfer
+    uint18_t pc;
+    int      wait[4];    // node index per direction, EXTERNAL or NONE
+    int      nwait;
+} wd_wait_t;
+
+static pthread_mutex_t wd_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  wd_cond = PTHREAD_COND_INITIALIZER;
+static int wd_stop = 0;
+
+static void sample(wd_wait_t* w)
+{
+    int i, j, dir;
+
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    reg_node_t* np = (reg_node_t*) node[i][j];
+	    wd_wait_t* wp = &w[i*GRID_COLS+j];
+
+	    memset(wp, 0, sizeof(*wp));
+	    for (dir = 0; dir < 4; dir++)
+		wp->wait[dir] = NONE;
+	    wp->ioreg = __atomic_load_n(&np->debug.blocked_addr,
+					__ATOMIC_RELAXED);
+	    if (wp->ioreg == 0)
+		continue;
+	    wp->write = np->debug.blocked_dir;
+	    wp->start = __atomic_load_n(&np->debug.act.block_start,
+					__ATOMIC_RELAXED);
+	    wp->pc = __atomic_load_n(&np->debug.act.pc, __ATOMIC_RELAXED);
+	    pthread_mutex_lock(&np->chan.lock);
+	    wp->dirs = wp->write ? np->chan.wmask : np->chan.rmask;
+	    pthread_mutex_unlock(&np->chan.lock);
+	    if (wp->dirs == 0) {  // transfer completed under us
+		wp->ioreg = 0;
+		continue;
+	    }
+	    for (dir = 0; dir < 4; dir++) {
+		int ni = i + f18_drow[dir];
+		int nj = j + f18_dcol[dir];
+		chan_t* cp;
+
+		if (!(wp->dirs & DIR_BIT(dir)) || !(cp = np->neighbour[dir]))
+		    continue;
+		if ((ni >= 0) && (ni < GRID_ROWS) &&
+		    (nj >= 0) && (nj < GRID_COLS) &&
+		    (cp == &((reg_node_t*)node[ni][nj])->chan))
+		    wp->wait[dir] = ni*GRID_COLS+nj;
+		else
+		    wp->wait[dir] = EXTERNAL;  // async, serdes ...
+		wp->nwait++;
+	    }
+	    if (wp->dirs & ~0xf)  // gpio pin write
+		wp->nwait++;
+	}
+    }
+}
+
+// mark live nodes, the rest of the blocked nodes are stuck
+static int find_stuck(const wd_wait_t* w, int* live)
+{
+    int k, dir, changed, nstuck;
+
+    for (k = 0; k < NUM_NODES; k++)
+	live[k] = (w[k].ioreg == 0) || (w[k].dirs & ~0xf);
+    do {
+	changed = 0;
+	for (k = 0; k < NUM_NODES; k++) {
+	    if (live[k])
+		continue;
+	    for (dir = 0; dir < 4; dir++) {
+		int n = w[k].wait[dir];
+		if ((n == EXTERNAL) || ((n >= 0) && live[n])) {
+		    live[k] = changed = 1;
+		    break;
+		}
+	    }
+	}
+    } while(changed);
+
+    nstuck = 0;
+    for (k = 0; k < NUM_NODES; k++)
+	if (!live[k])
+	    nstuck++;
+    return nstuck;
+}
+
+// name of the nearest symbol at or below addr in the same memory region
+static const f18_symbol_t* nearest(uint18_t addr,
+				   const f18_symbol_table_t* symtab)
+{
+    symindex_t si = sym_find_nearest(addr, symtab);
+
+    return (si != NOSYM) ? &symtab->symbol[si] : NULL;
+}
+
+static void format_pc(char* buf, size_t len, int i, int j, uint18_t pc)
+{
+    const f18_symbol_t* sp;
+
+    if ((sp = nearest(pc, node[i][j]->symtab)) == NULL)
+	sp = nearest(pc, SymTabMap[i][j]);
+    if (sp == NULL)
+	snprintf(buf, len, "%03x", pc);
+    else if (normalize_addr(sp->value) == normalize_addr(pc))
+	snprintf(buf, len, "%03x (%s)", pc, sp->name);
+    else
+	snprintf(buf, len, "%03x (%s+%d)", pc, sp->name,
+		 normalize_addr(pc) - normalize_addr(sp->value));
+}
+
+static void report(const wd_wait_t* w, const int* live, int nstuck)
+{
+    int k, dir;
+
+    fprintf(stderr, "deadlock: %d node%s wedged in port transfers\n",
+	    nstuck, (nstuck == 1) ? "" : "s");
+    for (k = 0; k < NUM_NODES; k++) {
+	int i = k / GRID_COLS;
+	int j = k % GRID_COLS;
+	symindex_t si;
+	char pbuf[64];
+	char sep = ' ';
+
+	if (live[k])
+	    continue;
+	format_pc(pbuf, sizeof(pbuf), i, j, w[k].pc);
+	si = sym_find_by_value(w[k].ioreg, &io_symbols);
+	fprintf(stderr, "  %03d %s %s p=%s waits on",
+		node[i][j]->id, w[k].write ? "write" : "read",
+		(si != NOSYM) ? io_symbols.symbol[si].name : "?", pbuf);
+	for (dir = 0; dir < 4; dir++) {
+	    int n = w[k].wait[dir];
+	    if (n >= 0) {
+		fprintf(stderr, "%c%03d", sep, node[n/GRID_COLS][n%GRID_COLS]->id);
+		sep = ',';
+	    }
+	}
+	if (w[k].nwait == 0)
+	    fprintf(stderr, " nothing (edge port)");
+	fprintf(stderr, "\n");
+    }
+}
+
+// sleep ms, return 1 when stopped
+static int wd_sleep(int ms)
+{
+    struct timespec ts;
+    int stop;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&wd_lock);
+    while (!wd_stop) {
+	if (pthread_cond_timedwait(&wd_cond, &wd_lock, &ts) == ETIMEDOUT)
+	    break;
+    }
+    stop = wd_stop;
+    pthread_mutex_unlock(&wd_lock);
+    return stop;
+}
+
+void* f18_watchdog_main(void* arg)
+{
+    int period = (int)(intptr_t) arg;
+    static wd_wait_t w[2][NUM_NODES];
+    static int live[NUM_NODES];
+    int cur = 0;
+    int prev_stuck = 0;
+
+    while (!wd_sleep(period)) {
+	int nstuck, k;
+
+	sample(w[cur]);
+	nstuck = find_stuck(w[cur], live);
+	// report when the same transfers were stuck in the last sample
+	if ((nstuck > 0) && (nstuck == prev_stuck)) {
+	    for (k = 0; k < NUM_NODES; k++) {
+		if (!live[k] && ((w[cur][k].start != w[!cur][k].start) ||
+				 (w[cur][k].ioreg != w[!cur][k].ioreg)))
+		    break;
+	    }
+	    if (k == NUM_NODES) {
+		report(w[cur], live, nstuck);
+		sys_deadlock();
+		break;
+	    }
+	}
+	prev_stuck = nstuck;
+	cur = !cur;
+    }
+    return NULL;
+}
+
+void f18_watchdog_stop(void)
+{
+    pthread_mutex_lock(&wd_lock);
+    wd_stop = 1;
+    pthread_cond_signal(&wd_cond);
+    pthread_mutex_unlock(&wd_lock);
+}
@@ -0,0 +1,26 @@
+#ifndef __F18_WATCHDOG_H__
+#define __F18_WATCHDOG_H__
+
+//
+// Port deadlock watchdog
+//
+// Samples the port wait of every node each period and builds the
+// wait-for graph from the channel read/write masks. A node is live
+// when it runs, or when it waits on a port that an external source
+// (async, gpio, serdes) or a live node can complete. Blocked nodes
+// that are not live, in the same transfer for two samples, are
+// deadlocked: the graph is dumped and the emulator exits with
+// F18_EXIT_DEADLOCK.
+//
+
+#include "f18.h"
+
+#define F18_EXIT_DEADLOCK  3
+
+// Watchdog thread main, arg is the sample period in ms
+extern void* f18_watchdog_main(void* arg);
+
+// Stop the watchdog thread (at exit)
+extern void f18_watchdog_stop(void);
+
+#endif
@@ -0,0 +1,596 @@
+//
+// Pin stimulus and io register capture
+//
+// The stimulus file is mapped read only, each node walks its tracks
+// with a pointer when it reads its io register, no system call per
+// event. Captured writes go to a buffer per node, a full buffer is
+// written with one pwrite at an offset reserved atomically, so nodes
+// never share a lock. The part of a buffer past the size limit is
+// dropped and recording stops.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "f18.h"
+#include "f18_node.h"
+#include "f18_wave.h"
+#include "f18_analog.h"
+
+#define WAVE_BUFFER  4096   // capture events buffered per node
+
+typedef struct {
+    // stimulus, io_pin index k
+    const f18_stim_event_t* ev[4];   // next event
+    const f18_stim_event_t* end[4];
+    uint32_t sample[4];
+    uint18_t (*read_ioreg)(node_t* np, uint18_t reg);   // chained
+    // capture
+    f18_wave_event_t* buf;
+    int nbuf;
+    void (*write_ioreg)(node_t* np, uint18_t reg, uint18_t val); // chained
+} wave_node_t;
+
+static wave_node_t wave_node[GRID_ROWS][GRID_COLS];
+
+static int   wave_fd = -1;
+static off_t wave_off;       // next free file offset
+static off_t wave_end;       // size limit, 0 for none
+static int   wave_full;      // size limit reached
+static int   wave_errno;     // first write error
+
+// ior input bit of io_pin[k]
+static const uint18_t pin_bit[4] = {
+    F18_IO_PIN17, F18_IO_PIN5, F18_IO_PIN3, F18_IO_PIN1
+};
+
+static inline uint64_t node_time(node_t* np)
+{
+    return ((reg_node_t*)np)->debug.act.words;
+}
+
+static inline wave_node_t* get_wave_node(node_t* np)
+{
+    return &wave_node[ID_TO_ROW(np->id)][ID_TO_COLUMN(np->id)];
+}
+
+// Find the node and io_pin index of chip pin, -1 if no node has it
+static int pin_lookup(int pin, int* ip, int* jp, int* kp)
+{
+    int i, j, k;
+
+    if (pin <= 0)
+	return -1;
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    switch (ConfigMap[i][j].io_type) {
+	    case gpio_x1:
+	    case gpio_x2:
+	    case gpio_x4:
+	    case analog_pin:
+		break;
+	    default:
+		continue;
+	    }
+	    for (k = 0; k < 4; k++) {
+		if (ConfigMap[i][j].io_pin[k] == pin) {
+		    *ip = i; *jp = j; *kp = k;
+		    return 0;
+		}
+	    }
+	}
+    }
+    return -1;
+}
+
+static int write_all(int fd, const void* buf, size_t len)
+{
+    const uint8_t* ptr = buf;
+
+    while (len > 0) {
+	ssize_t n = write(fd, ptr, len);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	ptr += n;
+	len -= n;
+    }
+    return 0;
+}
+
+// Apply the events due at the node's time
+static void stim_advance(node_t* np, wave_node_t* wp)
+{
+    uint64_t now = node_time(np);
+    uint18_t set = 0, clr = 0;
+    uint32_t old_val, new_val;
+    int k;
+
+    for (k = 0; k < 4; k++) {
+	const f18_stim_event_t* ep = wp->ev[k];
+
+	if ((ep == wp->end[k]) || (ep->time > now))
+	    continue;
+	while (((ep+1) < wp->end[k]) && ((ep+1)->time <= now))
+	    ep++;
+	wp->sample[k] = ep->value;
+	if (ep->value)
+	    set |= pin_bit[k];
+	else
+	    clr |= pin_bit[k];
+	wp->ev[k] = ep+1;
+    }
+    if ((set | clr) == 0)
+	return;
+    do {
+	old_val = __atomic_load_n(&np->ior, __ATOMIC_SEQ_CST);
+	new_val = (old_val & ~clr) | set;
+    } while (!__atomic_compare_exchange_n(&np->ior, &old_val, new_val,
+					  0, __ATOMIC_SEQ_CST,
+					  __ATOMIC_SEQ_CST));
+}
+
+static uint18_t stim_read_ioreg(node_t* np, uint18_t ioreg)
+{
+    wave_node_t* wp = get_wave_node(np);
+
+    if (ioreg == IOREG_IO)
+	stim_advance(np, wp);
+    return (*wp->read_ioreg)(np, ioreg);
+}
+
+uint32_t f18_stim_sample(node_t* np, int k)
+{
+    wave_node_t* wp = get_wave_node(np);
+
+    if ((k < 0) || (k > 3))
+	return 0;
+    if (wp->read_ioreg != NULL)
+	stim_advance(np, wp);
+    return wp->sample[k];
+}
+
+int f18_stim_open(const char* filename, node_t* nodes[GRID_ROWS][GRID_COLS])
+{
+    const f18_wave_header_t* hdr;
+    const f18_stim_track_t* trk;
+    struct stat st;
+    uint8_t* base;
+    uint32_t n;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return -1;
+    }
+    if (st.st_size < sizeof(f18_wave_header_t)) {
+	close(fd);
+	errno = EINVAL;
+	return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+	return -1;
+    // events are only walked forward
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    hdr = (const f18_wave_header_t*) base;
+    if ((memcmp(hdr->magic, F18_STIM_MAGIC, sizeof(hdr->magic)) != 0) ||
+	(hdr->version != F18_STIM_VERSION) ||
+	(sizeof(*hdr) + (uint64_t)hdr->ntracks*sizeof(*trk) > st.st_size))
+	goto bad;
+
+    trk = (const f18_stim_track_t*) (base + sizeof(*hdr));
+    for (n = 0; n < hdr->ntracks; n++, trk++) {
+	wave_node_t* wp;
+	int i, j, k;
+
+	if ((pin_lookup(trk->pin, &i, &j, &k) < 0) ||
+	    (trk->offset % sizeof(f18_stim_event_t)) ||
+	    (trk->offset > st.st_size) ||
+	    ((uint64_t)trk->count*sizeof(f18_stim_event_t) >
+	     st.st_size - trk->offset))
+	    goto bad;
+	wp = &wave_node[i][j];
+	if (wp->end[k] != NULL)  // one track per pin
+	    goto bad;
+	wp->ev[k]  = (const f18_stim_event_t*) (base + trk->offset);
+	wp->end[k] = wp->ev[k] + trk->count;
+	if (wp->read_ioreg == NULL) {
+	    wp->read_ioreg = nodes[i][j]->read_ioreg;
+	    nodes[i][j]->read_ioreg = stim_read_ioreg;
+	}
+	// the first analog pin feeds the ADC unless it has a source
+	if ((ConfigMap[i][j].io_type == analog_pin) && (k == 0) &&
+	    (f18_analog_source(nodes, MAKE_ID(i,j), NULL, NULL, 0) < 0) &&
+	    (errno != EBUSY))
+	    goto bad;
+    }
+    return 0;
+bad:
+    // tracks already hooked keep pointing into the mapping
+    errno = EINVAL;
+    return -1;
+}
+
+// Write the node buffer at the end of the capture
+static void wave_flush(wave_node_t* wp)
+{
+    size_t len = wp->nbuf*sizeof(f18_wave_event_t);
+    const uint8_t* ptr = (const uint8_t*) wp->buf;
+    off_t off = __atomic_fetch_add(&wave_off, len, __ATOMIC_SEQ_CST);
+
+    wp->nbuf = 0;
+    if ((wave_end != 0) && (off + len > wave_end)) {
+	// offsets are handed out in order, the file has no holes
+	len = (off < wave_end) ? wave_end - off : 0;
+	__atomic_store_n(&wave_full, 1, __ATOMIC_SEQ_CST);
+    }
+    while (len > 0) {
+	ssize_t n = pwrite(wave_fd, ptr, len, off);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    __atomic_store_n(&wave_errno, errno, __ATOMIC_SEQ_CST);
+	    return;
+	}
+	ptr += n;
+	off += n;
+	len -= n;
+    }
+}
+
+static void wave_write_ioreg(node_t* np, uint18_t ioreg, uint18_t value)
+{
+    wave_node_t* wp = get_wave_node(np);
+
+    if ((ioreg == IOREG_IO) && (wave_fd >= 0) &&
+	!__atomic_load_n(&wave_full, __ATOMIC_RELAXED)) {
+	f18_wave_event_t* ep;
+
+	if ((wp->buf == NULL) &&
+	    ((wp->buf = malloc(WAVE_BUFFER*sizeof(f18_wave_event_t))) == NULL))
+	    __atomic_store_n(&wave_errno, ENOMEM, __ATOMIC_SEQ_CST);
+	else {
+	    ep = &wp->buf[wp->nbuf++];
+	    ep->time = node_time(np);
+	    ep->id = np->id;
+	    ep->reserved = 0;
+	    ep->value = value;
+	    if (wp->nbuf == WAVE_BUFFER)
+		wave_flush(wp);
+	}
+    }
+    (*wp->write_ioreg)(np, ioreg, value);
+}
+
+int f18_wave_open(const char* filename, node_t* nodes[GRID_ROWS][GRID_COLS],
+		  uint64_t limit)
+{
+    f18_wave_header_t hdr;
+    int i, j, fd;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, F18_WAVE_MAGIC, sizeof(hdr.magic));
+    hdr.version = F18_WAVE_VERSION;
+
+    if ((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+	return -1;
+    if (write_all(fd, &hdr, sizeof(hdr)) < 0) {
+	close(fd);
+	return -1;
+    }
+    wave_fd = fd;
+    wave_off = sizeof(hdr);
+    // whole events only
+    limit -= limit % sizeof(f18_wave_event_t);
+    wave_end = (limit != 0) ? wave_off + limit : 0;
+    wave_full = 0;
+    wave_errno = 0;
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    wave_node_t* wp = &wave_node[i][j];
+	    if (wp->write_ioreg == NULL) {
+		wp->write_ioreg = nodes[i][j]->write_ioreg;
+		nodes[i][j]->write_ioreg = wave_write_ioreg;
+	    }
+	}
+    }
+    return 0;
+}
+
+int f18_wave_close(void)
+{
+    int i, j;
+
+    if (wave_fd < 0)
+	return 0;
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    wave_node_t* wp = &wave_node[i][j];
+	    if (wp->nbuf > 0)
+		wave_flush(wp);
+	    free(wp->buf);
+	    wp->buf = NULL;
+	}
+    }
+    if (wave_full) {
+	f18_wave_header_t hdr;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, F18_WAVE_MAGIC, sizeof(hdr.magic));
+	hdr.version = F18_WAVE_VERSION;
+	hdr.flags = F18_WAVE_TRUNCATED;
+	if ((pwrite(wave_fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) &&
+	    (wave_errno == 0))
+	    wave_errno = errno;
+    }
+    if ((close(wave_fd) < 0) && (wave_errno == 0))
+	wave_errno = errno;
+    wave_fd = -1;
+    if (wave_errno) {
+	errno = wave_errno;
+	return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    f18_stim_event_t e;
+    uint16_t pin;
+    uint32_t line;
+} stim_line_t;
+
+static int cmp_stim_line(const void* a, const void* b)
+{
+    const stim_line_t* x = a;
+    const stim_line_t* y = b;
+
+    if (x->pin != y->pin)
+	return (x->pin < y->pin) ? -1 : 1;
+    if (x->e.time != y->e.time)
+	return (x->e.time < y->e.time) ? -1 : 1;
+    return (x->line < y->line) ? -1 : (x->line > y->line);
+}
+
+int f18_stim_compile(FILE* f, const char* filename)
+{
+    f18_wave_header_t hdr;
+    f18_stim_track_t* trk = NULL;
+    stim_line_t* ev = NULL;
+    size_t nev = 0, size = 0;
+    char line[256];
+    uint32_t lineno = 0;
+    uint64_t offset;
+    int ntracks = 0;
+    int fd = -1;
+    size_t n, k;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+	unsigned long long t;
+	long v;
+	int pin, i, j, p;
+	char c;
+
+	lineno++;
+	if ((sscanf(line, " %c", &c) != 1) || (c == '#'))
+	    continue;
+	if ((sscanf(line, "%llu %d %li", &t, &pin, &v) != 3) ||
+	    (pin_lookup(pin, &i, &j, &p) < 0)) {
+	    fprintf(stderr, "line %u: bad stimulus or unknown pin\n", lineno);
+	    goto bad;
+	}
+	if (nev == size) {
+	    stim_line_t* nv;
+	    size = (size == 0) ? 1024 : 2*size;
+	    if ((nv = realloc(ev, size*sizeof(stim_line_t))) == NULL)
+		goto error;
+	    ev = nv;
+	}
+	memset(&ev[nev], 0, sizeof(stim_line_t));
+	ev[nev].e.time = t;
+	ev[nev].e.value = v;
+	ev[nev].pin = pin;
+	ev[nev].line = lineno;
+	nev++;
+    }
+    qsort(ev, nev, sizeof(stim_line_t), cmp_stim_line);
+    for (n = 0; n < nev; n++)
+	if ((n == 0) || (ev[n].pin != ev[n-1].pin))
+	    ntracks++;
+    if ((trk = calloc(ntracks+1, sizeof(f18_stim_track_t))) == NULL)
+	goto error;
+
+    // tracks in pin order, events follow the track table
+    ntracks = 0;
+    offset = sizeof(hdr);
+    for (n = 0; n < nev; n++) {
+	if ((n == 0) || (ev[n].pin != ev[n-1].pin)) {
+	    trk[ntracks].pin = ev[n].pin;
+	    ntracks++;
+	}
+	trk[ntracks-1].count++;
+    }
+    offset += ntracks*sizeof(f18_stim_track_t);
+    for (k = 0; k < ntracks; k++) {
+	trk[k].offset = offset;
+	offset += trk[k].count*sizeof(f18_stim_event_t);
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, F18_STIM_MAGIC, sizeof(hdr.magic));
+    hdr.version = F18_STIM_VERSION;
+    hdr.ntracks = ntracks;
+    if ((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, 0644)) < 0)
+	goto error;
+    if ((write_all(fd, &hdr, sizeof(hdr)) < 0) ||
+	(write_all(fd, trk, ntracks*sizeof(f18_stim_track_t)) < 0))
+	goto error;
+    for (n = 0; n < nev; n++) {
+	if (write_all(fd, &ev[n].e, sizeof(f18_stim_event_t)) < 0)
+	    goto error;
+    }
+    free(ev);
+    free(trk);
+    return close(fd);
+bad:
+    errno = EINVAL;
+error:
+    free(ev);
+    free(trk);
+    if (fd >= 0)
+	close(fd);
+    return -1;
+}
+
+static int cmp_wave_event(const void* a, const void* b)
+{
+    const f18_wave_event_t* x = *(const f18_wave_event_t**) a;
+    const f18_wave_event_t* y = *(const f18_wave_event_t**) b;
+
+    if (x->time != y->time)
+	return (x->time < y->time) ? -1 : 1;
+    return (x < y) ? -1 : (x > y);   // file order
+}
+
+// VCD identifier of signal s
+static char* vcd_code(int s, char* buf)
+{
+    char* ptr = buf;
+
+    do {
+	*ptr++ = '!' + (s % 94);
+	s /= 94;
+    } while (s > 0);
+    *ptr = '\0';
+    return buf;
+}
+
+static void vcd_bits(FILE* f, uint32_t value, int width, int s)
+{
+    char code[8];
+    int b;
+
+    fputc('b', f);
+    for (b = width-1; b >= 0; b--)
+	fputc((value & (1 << b)) ? '1' : '0', f);
+    fprintf(f, " %s\n", vcd_code(s, code));
+}
+
+// One 18 bit signal for the io register of each node and a 2 bit signal
+// for each io_pin, pin 17, 5, 3 and 1 control bits in io_pin order.
+// VCD time is the node's instruction word count.
+int f18_wave_vcd(const char* filename, FILE* f)
+{
+    static const int pin_shift[4] = { 16, 4, 2, 0 };
+    const f18_wave_header_t* hdr;
+    const f18_wave_event_t** ev;
+    int used[GRID_ROWS][GRID_COLS];
+    struct stat st;
+    uint8_t* base;
+    size_t nev, n;
+    uint64_t t;
+    char code[8];
+    int i, j, k, fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0)
+	return -1;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return -1;
+    }
+    if ((st.st_size < sizeof(f18_wave_header_t)) ||
+	((st.st_size - sizeof(f18_wave_header_t)) % sizeof(f18_wave_event_t))) {
+	close(fd);
+	errno = EINVAL;
+	return -1;
+    }
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+	return -1;
+    hdr = (const f18_wave_header_t*) base;
+    if ((memcmp(hdr->magic, F18_WAVE_MAGIC, sizeof(hdr->magic)) != 0) ||
+	(hdr->version != F18_WAVE_VERSION)) {
+	munmap(base, st.st_size);
+	errno = EINVAL;
+	return -1;
+    }
+    nev = (st.st_size - sizeof(*hdr)) / sizeof(f18_wave_event_t);
+    if ((ev = malloc((nev+1)*sizeof(f18_wave_event_t*))) == NULL) {
+	munmap(base, st.st_size);
+	return -1;
+    }
+    memset(used, 0, sizeof(used));
+    for (n = 0; n < nev; n++) {
+	ev[n] = (const f18_wave_event_t*) (base + sizeof(*hdr)) + n;
+	i = ID_TO_ROW(ev[n]->id);
+	j = ID_TO_COLUMN(ev[n]->id);
+	if ((i >= GRID_ROWS) || (j >= GRID_COLS)) {
+	    free(ev);
+	    munmap(base, st.st_size);
+	    errno = EINVAL;
+	    return -1;
+	}
+	used[i][j] = 1;
+    }
+    qsort(ev, nev, sizeof(f18_wave_event_t*), cmp_wave_event);
+
+    fprintf(f, "$comment f18 io register writes,"
+	    " time unit is one instruction word $end\n");
+    if (hdr->flags & F18_WAVE_TRUNCATED)
+	fprintf(f, "$comment capture truncated at its size limit $end\n");
+    fprintf(f, "$timescale 1ns $end\n");
+    fprintf(f, "$scope module f18 $end\n");
+    for (i = 0; i < GRID_ROWS; i++) {
+	for (j = 0; j < GRID_COLS; j++) {
+	    int s = (i*GRID_COLS + j)*5;
+	    if (!used[i][j])
+		continue;
+	    fprintf(f, "$var wire 18 %s n%03d_io $end\n",
+		    vcd_code(s, code), MAKE_ID(i,j));
+	    for (k = 0; k < 4; k++) {
+		if (ConfigMap[i][j].io_pin[k] == 0)
+		    continue;
+		fprintf(f, "$var wire 2 %s n%03d_pin%d $end\n",
+			vcd_code(s+1+k, code), MAKE_ID(i,j),
+			ConfigMap[i][j].io_pin[k]);
+	    }
+	}
+    }
+    fprintf(f, "$upscope $end\n");
+    fprintf(f, "$enddefinitions $end\n");
+
+    t = UINT64_MAX;
+    for (n = 0; n < nev; n++) {
+	const f18_wave_event_t* ep = ev[n];
+	int s;
+
+	i = ID_TO_ROW(ep->id);
+	j = ID_TO_COLUMN(ep->id);
+	s = (i*GRID_COLS + j)*5;
+	if (ep->time != t) {
+	    t = ep->time;
+	    fprintf(f, "#%llu\n", (unsigned long long) t);
+	}
+	vcd_bits(f, ep->value, 18, s);
+	for (k = 0; k < 4; k++) {
+	    if (ConfigMap[i][j].io_pin[k] != 0)
+		vcd_bits(f, (ep->value >> pin_shift[k]) & 3, 2, s+1+k);
+	}
+    }
+    free(ev);
+    munmap(base, st.st_size);
+    return ferror(f) ? -1 : 0;
+}
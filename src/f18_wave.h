@@ -0,0 +1,92 @@
+#ifndef __F18_WAVE_H__
+#define __F18_WAVE_H__
+
+//
+// Pin stimulus (.f18s) and io register capture (.f18w)
+//
+// Host byte order:
+//
+//   .f18s  header:  "F18S" version ntracks 0               (32 bit)
+//          track:   pin(16) 0(16) count(32) offset(64)     (ntracks times)
+//          events:  time(64) value(32) 0(32)    (count per track, by time)
+//
+//   .f18w  header:  "F18W" version 0 flags                 (32 bit)
+//          events:  time(64) id(16) 0(16) value(32)
+//
+// Time is the number of instruction words executed by the node, so a
+// program and a stimulus give the same waveform however the node
+// threads are scheduled. A track drives one chip pin from ConfigMap
+// io_pin, the pin reads high while the value is non zero and the track
+// of the first pin of an analog node drives its ADC (f18_analog.h)
+// unless the ADC has another source. Capture events are written in
+// blocks per node, not sorted by time. A capture stops at its size
+// limit and sets F18_WAVE_TRUNCATED in the header flags.
+//
+// Events are applied only when the node reads its io register. A node
+// blocked in a pin wakeup executes no words, so its time stops and it
+// never sees the edge: nothing drives f18_chan_wakeup from the
+// stimulus. Programs under stimulus must poll io for pin changes.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include "f18.h"
+
+#define F18_STIM_MAGIC    "F18S"
+#define F18_STIM_VERSION  1
+#define F18_WAVE_MAGIC    "F18W"
+#define F18_WAVE_VERSION  1
+
+#define F18_WAVE_TRUNCATED 0x0001   // .f18w flags, size limit reached
+
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t ntracks;   // 0 for .f18w
+    uint32_t flags;     // 0 for .f18s
+} f18_wave_header_t;
+
+typedef struct {
+    uint16_t pin;
+    uint16_t reserved;
+    uint32_t count;     // number of events
+    uint64_t offset;    // file offset of the first event
+} f18_stim_track_t;
+
+typedef struct {
+    uint64_t time;
+    uint32_t value;
+    uint32_t reserved;
+} f18_stim_event_t;
+
+typedef struct {
+    uint64_t time;
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t value;     // value written to IOREG_IO
+} f18_wave_event_t;
+
+// Map a stimulus file and drive the pins it lists, the events are
+// applied when the owning node reads its io register (no wakeup)
+extern int f18_stim_open(const char* filename,
+			 node_t* nodes[GRID_ROWS][GRID_COLS]);
+
+// Last stimulus value of io_pin[k] on node np at the node's time
+extern uint32_t f18_stim_sample(node_t* np, int k);
+
+// Record all IOREG_IO writes to filename, at most limit bytes of
+// events (0 for no limit)
+extern int f18_wave_open(const char* filename,
+			 node_t* nodes[GRID_ROWS][GRID_COLS],
+			 uint64_t limit);
+
+// Flush the node buffers and close the capture, nodes must be stopped
+extern int f18_wave_close(void);
+
+// Build a stimulus file from "time pin value" lines read from f
+extern int f18_stim_compile(FILE* f, const char* filename);
+
+// Export a capture as VCD to f
+extern int f18_wave_vcd(const char* filename, FILE* f);
+
+#endif
@@ -0,0 +1,85 @@
+//
+// f18-wave, build pin stimulus files and export io captures
+//
+//   f18-wave stim [text-file] stim-file    "time pin value" lines to .f18s
+//   f18-wave vcd capture-file [vcd-file]   .f18w to VCD
+//
+// text-file and vcd-file default to stdin and stdout.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <stdarg.h>
+
+#include "f18.h"
+#include "f18_wave.h"
+
+void usage(char* prog, char* fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "usage: %s stim [text-file] stim-file\n", prog);
+    fprintf(stderr, "       %s vcd capture-file [vcd-file]\n", prog);
+    fprintf(stderr,
+	    "  text-file lines are \"time pin value\", # starts a comment,\n"
+	    "  time is counted in instruction words of the pin's node\n"
+	);
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    char* prog = basename(argv[0]);
+
+    logout = stderr;
+    if (argc < 2)
+	usage(prog, "");
+
+    if (strcmp(argv[1], "stim") == 0) {
+	FILE* f = stdin;
+	char* out;
+
+	if (argc == 3)
+	    out = argv[2];
+	else if (argc == 4) {
+	    if ((f = fopen(argv[2], "r")) == NULL) {
+		fprintf(stderr, "unabled to open file %s, error=%s\n",
+			argv[2], strerror(errno));
+		exit(1);
+	    }
+	    out = argv[3];
+	}
+	else
+	    usage(prog, "");
+	if (f18_stim_compile(f, out) < 0) {
+	    fprintf(stderr, "unable to write stimulus %s, error=%s\n",
+		    out, strerror(errno));
+	    exit(1);
+	}
+    }
+    else if (strcmp(argv[1], "vcd") == 0) {
+	FILE* f = stdout;
+
+	if ((argc < 3) || (argc > 4))
+	    usage(prog, "");
+	if ((argc == 4) && ((f = fopen(argv[3], "w")) == NULL)) {
+	    fprintf(stderr, "unabled to open file %s, error=%s\n",
+		    argv[3], strerror(errno));
+	    exit(1);
+	}
+	if ((f18_wave_vcd(argv[2], f) < 0) || (fclose(f) != 0)) {
+	    fprintf(stderr, "unable to export capture %s, error=%s\n",
+		    argv[2], strerror(errno));
+	    exit(1);
+	}
+    }
+    else
+	usage(prog, "unknown command %s\n", argv[1]);
+    exit(0);
+}
@@ -0,0 +1,197 @@
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "f18_word_queue.h"
+#include "f18_futex.h"
+
+// size is rounded up to a power of 2, 0 selects WORD_QUEUE_SIZE
+int word_queue_init(word_queue_t* qp, size_t size)
+{
+    uint32_t n = 1;
+
+    if (size == 0)
+	size = WORD_QUEUE_SIZE;
+    while (n < size)
+	n <<= 1;
+    memset(qp, 0, sizeof(*qp));
+    if ((qp->words = malloc(n*sizeof(uint32_t))) == NULL)
+	return -1;
+    qp->size = n;
+    qp->mask = n - 1;
+    return 0;
+}
+
+void word_queue_destroy(word_queue_t* qp)
+{
+    free(qp->words);
+    qp->words = NULL;
+}
+
+// Drop queued words and reopen, neither side may be using the ring
+void word_queue_reset(word_queue_t* qp)
+{
+    qp->tail = 0;
+    qp->head_cache = 0;
+    qp->head = 0;
+    qp->tail_cache = 0;
+    qp->terminate = 0;
+    qp->closed = 0;
+}
+
+// Wake up both sides, blocked calls return without transfer
+void word_queue_terminate(word_queue_t* qp)
+{
+    __atomic_store_n(&qp->terminate, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&qp->prod_seq, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&qp->cons_seq, 1, __ATOMIC_SEQ_CST);
+    f18_futex_wake_all(&qp->prod_seq);
+    f18_futex_wake_all(&qp->cons_seq);
+}
+
+// Producer: end of stream, called after the last enq
+void word_queue_close(word_queue_t* qp)
+{
+    __atomic_store_n(&qp->closed, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&qp->prod_seq, 1, __ATOMIC_SEQ_CST);
+    f18_futex_wake_all(&qp->prod_seq);
+}
+
+// Consumer: wait until head moves past tail, return the new head
+// (head == tail on return means terminate or closed and drained)
+static uint32_t wait_data(word_queue_t* qp, uint32_t tail)
+{
+    uint32_t head;
+
+    while ((head = __atomic_load_n(&qp->head, __ATOMIC_ACQUIRE)) == tail) {
+	uint32_t seq = __atomic_load_n(&qp->prod_seq, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    return tail;
+	// head is published before closed is set
+	if (__atomic_load_n(&qp->closed, __ATOMIC_SEQ_CST))
+	    return __atomic_load_n(&qp->head, __ATOMIC_ACQUIRE);
+	__atomic_store_n(&qp->cons_wait, 1, __ATOMIC_SEQ_CST);
+	if ((__atomic_load_n(&qp->head, __ATOMIC_SEQ_CST) == tail) &&
+	    !__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST) &&
+	    !__atomic_load_n(&qp->closed, __ATOMIC_SEQ_CST))
+	    f18_futex_wait(&qp->prod_seq, seq);
+	__atomic_store_n(&qp->cons_wait, 0, __ATOMIC_RELAXED);
+    }
+    return head;
+}
+
+// Producer: wait until there is room for need words, return the new tail
+static uint32_t wait_space(word_queue_t* qp, uint32_t head, uint32_t need)
+{
+    uint32_t tail;
+
+    while ((head - (tail = __atomic_load_n(&qp->tail, __ATOMIC_ACQUIRE))) >
+	   (qp->size - need)) {
+	uint32_t seq = __atomic_load_n(&qp->cons_seq, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    return tail;
+	__atomic_store_n(&qp->prod_wait, 1, __ATOMIC_SEQ_CST);
+	if (((head - __atomic_load_n(&qp->tail, __ATOMIC_SEQ_CST)) >
+	     (qp->size - need)) &&
+	    !__atomic_load_n(&qp->terminate, __ATOMIC_SEQ_CST))
+	    f18_futex_wait(&qp->cons_seq, seq);
+	__atomic_store_n(&qp->prod_wait, 0, __ATOMIC_RELAXED);
+    }
+    return tail;
+}
+
+static inline void publish_head(word_queue_t* qp, uint32_t head)
+{
+    __atomic_store_n(&qp->head, head, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&qp->cons_wait, __ATOMIC_SEQ_CST)) {
+	__atomic_fetch_add(&qp->prod_seq, 1, __ATOMIC_SEQ_CST);
+	f18_futex_wake(&qp->prod_seq);
+    }
+}
+
+static inline void publish_tail(word_queue_t* qp, uint32_t tail)
+{
+    __atomic_store_n(&qp->tail, tail, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&qp->prod_wait, __ATOMIC_SEQ_CST)) {
+	__atomic_fetch_add(&qp->cons_seq, 1, __ATOMIC_SEQ_CST);
+	f18_futex_wake(&qp->cons_seq);
+    }
+}
+
+// Add count words, blocks while the ring is full. A batch that fits
+// in the ring is published in one go.
+// Returns count or -1 on terminate
+int word_queue_enq_batch(word_queue_t* qp, const uint32_t* values, int count)
+{
+    uint32_t head = qp->head;
+    int total = count;
+
+    while (count > 0) {
+	uint32_t need = ((uint32_t)count < qp->size) ? count : qp->size;
+	uint32_t n, i, k;
+
+	if ((head - qp->tail_cache) > (qp->size - need)) {
+	    qp->tail_cache = wait_space(qp, head, need);
+	    if (__atomic_load_n(&qp->terminate, __ATOMIC_ACQUIRE))
+		return -1;
+	}
+	n = qp->size - (head - qp->tail_cache);
+	if (n > (uint32_t)count)
+	    n = count;
+	i = head & qp->mask;
+	k = qp->size - i;        // words until wrap
+	if (k >= n)
+	    memcpy(&qp->words[i], values, n*sizeof(uint32_t));
+	else {
+	    memcpy(&qp->words[i], values, k*sizeof(uint32_t));
+	    memcpy(&qp->words[0], values+k, (n-k)*sizeof(uint32_t));
+	}
+	head += n;
+	publish_head(qp, head);
+	values += n;
+	count -= n;
+    }
+    return total;
+}
+
+// Get up to count words, block until at least one is available
+// Returns number of words read or -1 on terminate or end of stream
+int word_queue_deq_bulk(word_queue_t* qp, uint32_t* values, int count)
+{
+    uint32_t tail = qp->tail;
+    uint32_t n, i, k;
+
+    if (count <= 0)
+	return 0;
+    if (tail == qp->head_cache) {
+	if ((qp->head_cache = wait_data(qp, tail)) == tail)
+	    return -1;
+    }
+    n = qp->head_cache - tail;
+    if (n > (uint32_t)count)
+	n = count;
+    i = tail & qp->mask;
+    k = qp->size - i;
+    if (k >= n)
+	memcpy(values, &qp->words[i], n*sizeof(uint32_t));
+    else {
+	memcpy(values, &qp->words[i], k*sizeof(uint32_t));
+	memcpy(values+k, &qp->words[0], (n-k)*sizeof(uint32_t));
+    }
+    publish_tail(qp, tail + n);
+    return n;
+}
+
+// Words ready without blocking (consumer side)
+int word_queue_available(word_queue_t* qp)
+{
+    qp->head_cache = __atomic_load_n(&qp->head, __ATOMIC_ACQUIRE);
+    return qp->head_cache - qp->tail;
+}
+
+// Free slots without blocking (producer side)
+int word_queue_space(word_queue_t* qp)
+{
+    qp->tail_cache = __atomic_load_n(&qp->tail, __ATOMIC_ACQUIRE);
+    return qp->size - (qp->head - qp->tail_cache);
+}
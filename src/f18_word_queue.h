@@ -0,0 +1,55 @@
+#ifndef __WORD_QUEUE_H__
+#define __WORD_QUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Single producer / single consumer word ring, the byte_queue layout
+// with 32 bit entries (an 18 bit word each).
+//
+// Besides terminate, which drops everything, the producer may close
+// the ring: the consumer drains what is queued and then gets -1.
+//
+
+// Default ring size in words (must be power of 2)
+#define WORD_QUEUE_SIZE 4096
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+typedef struct _word_queue_t
+{
+    // consumer side
+    uint32_t tail __attribute__((aligned(CACHE_LINE_SIZE))); // reads here
+    uint32_t head_cache;      // last head seen by consumer
+    uint32_t cons_seq;        // futex word, bumped when space is freed
+    int      cons_wait;       // 1 when consumer sleeps on prod_seq
+
+    // producer side
+    uint32_t head __attribute__((aligned(CACHE_LINE_SIZE))); // writes here
+    uint32_t tail_cache;      // last tail seen by producer
+    uint32_t prod_seq;        // futex word, bumped when data is published
+    int      prod_wait;       // 1 when producer sleeps on cons_seq
+
+    // constant after init
+    uint32_t* words __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t size;            // capacity (power of 2)
+    uint32_t mask;            // size - 1
+    int      terminate;
+    int      closed;          // no more words after head
+} word_queue_t;
+
+extern int  word_queue_init(word_queue_t* qp, size_t size);
+extern void word_queue_destroy(word_queue_t* qp);
+extern void word_queue_reset(word_queue_t* qp);
+extern void word_queue_terminate(word_queue_t* qp);
+extern void word_queue_close(word_queue_t* qp);
+extern int  word_queue_enq_batch(word_queue_t* qp, const uint32_t* values,
+				 int count);
+extern int  word_queue_deq_bulk(word_queue_t* qp, uint32_t* values,
+				int count);
+extern int  word_queue_available(word_queue_t* qp);
+extern int  word_queue_space(word_queue_t* qp);
+
+#endif
@@ -0,0 +1,98 @@
+//
+// f18_reset reproducibility
+//
+// Node 000 reads words from a stream on its left port and writes them
+// plus one to its down port (chip direction UP for node 000). A run, a partial run with words left in
+// the ring and a run after each reset must give the same output and
+// word count.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "f18.h"
+#include "f18_lib.h"
+
+#define NWORDS 100
+
+static uint18_t out[2*NWORDS];
+static int nout;
+
+static void out_write(void* arg, uint18_t id, int dir, uint18_t value)
+{
+    if (nout < 2*NWORDS)
+	out[nout++] = value;
+}
+
+// feed count words and run until idle
+static uint64_t run(f18_chip_t* chip, f18_port_t* pp, int count)
+{
+    uint18_t in[NWORDS];
+    int i;
+
+    for (i = 0; i < count; i++)
+	in[i] = i;
+    nout = 0;
+    f18_port_put(pp, in, count);
+    f18_port_close(pp);
+    while (f18_run(chip, 10000) == F18_RUN_LIMIT)
+	;
+    return f18_words(chip);
+}
+
+int main(int argc, char** argv)
+{
+    const char* filename = (argc > 1) ? argv[1] : "inc.f18";
+    uint18_t first[2*NWORDS];
+    uint18_t in[NWORDS];
+    f18_chip_t* chip;
+    f18_port_t* pp;
+    uint64_t words;
+    int i, n, fail = 0;
+
+    if (((chip = f18_create(FLAG_SILENT)) == NULL) ||
+	(f18_load(chip, filename) < 0) ||
+	((pp = f18_attach_stream(chip, 0, LEFT, F18_PORT_IN, -1)) == NULL) ||
+	(f18_attach_port(chip, 0, UP, NULL, out_write, NULL) < 0)) {
+	fprintf(stderr, "reset: unable to set up %s\n", filename);
+	exit(1);
+    }
+    words = run(chip, pp, NWORDS);
+    n = nout;
+    memcpy(first, out, sizeof(first));
+    for (i = 0; i < n; i++) {
+	if (first[i] != i+1) {
+	    fprintf(stderr, "reset: word %d is %d\n", i, first[i]);
+	    fail = 1;
+	}
+    }
+    if (n != NWORDS) {
+	fprintf(stderr, "reset: %d words out of %d\n", n, NWORDS);
+	fail = 1;
+    }
+
+    for (i = 0; i < 3; i++) {
+	f18_reset(chip);
+	if (i == 1) {
+	    // leave words in the ring, the reset must drop them
+	    memset(in, 0x55, sizeof(in));
+	    f18_port_put(pp, in, NWORDS/2);
+	    f18_run(chip, 50);
+	    f18_reset(chip);
+	}
+	if (f18_words(chip) != 0) {
+	    fprintf(stderr, "reset: %llu words after reset\n",
+		    (unsigned long long) f18_words(chip));
+	    fail = 1;
+	}
+	if ((run(chip, pp, NWORDS) != words) || (nout != n) ||
+	    (memcmp(out, first, n*sizeof(uint18_t)) != 0)) {
+	    fprintf(stderr, "reset: run %d differs\n", i+1);
+	    fail = 1;
+	}
+    }
+    f18_destroy(chip);
+    printf("reset: %s\n", fail ? "FAIL" : "ok");
+    return fail;
+}
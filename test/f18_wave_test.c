@@ -0,0 +1,93 @@
+//
+// Stimulus to capture round trip
+//
+// Node 117 copies its ADC count to its io register 1000 times, with
+// pin 48 stepping from 100 to 3000 at word 1000. The capture of a
+// deterministic run is exported as VCD, the Makefile compares it with
+// adc.vcd. A second run with a small size limit must stop at the limit
+// and be flagged.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "f18.h"
+#include "f18_lib.h"
+#include "f18_chip.h"
+#include "f18_wave.h"
+
+#define LIMIT (10*sizeof(f18_wave_event_t))
+
+static void run(f18_chip_t* chip)
+{
+    while (f18_run(chip, 10000) == F18_RUN_LIMIT)
+	;
+}
+
+int main(int argc, char** argv)
+{
+    char* dir = (argc > 1) ? argv[1] : "out";
+    char stim[256], wave[256], vcd[256];
+    f18_wave_header_t hdr;
+    f18_chip_t* chip;
+    struct stat st;
+    FILE* f;
+
+    snprintf(stim, sizeof(stim), "%s/adc.f18s", dir);
+    snprintf(wave, sizeof(wave), "%s/adc.f18w", dir);
+    snprintf(vcd, sizeof(vcd), "%s/adc.vcd", dir);
+
+    if (((f = fopen("adc.txt", "r")) == NULL) ||
+	(f18_stim_compile(f, stim) < 0)) {
+	fprintf(stderr, "wave: unable to build %s, error=%s\n",
+		stim, strerror(errno));
+	exit(1);
+    }
+    fclose(f);
+    if (((chip = f18_create(FLAG_SILENT)) == NULL) ||
+	(f18_load(chip, "adc.f18") < 0) ||
+	(f18_stim_open(stim, node) < 0) ||
+	(f18_wave_open(wave, node, 0) < 0)) {
+	fprintf(stderr, "wave: unable to set up, error=%s\n",
+		strerror(errno));
+	exit(1);
+    }
+    run(chip);
+    if ((f18_wave_close() < 0) ||
+	((f = fopen(vcd, "w")) == NULL) ||
+	(f18_wave_vcd(wave, f) < 0) ||
+	(fclose(f) != 0)) {
+	fprintf(stderr, "wave: unable to export %s, error=%s\n",
+		vcd, strerror(errno));
+	exit(1);
+    }
+
+    f18_reset(chip);
+    if (f18_wave_open(wave, node, LIMIT) < 0) {
+	fprintf(stderr, "wave: unable to open %s, error=%s\n",
+		wave, strerror(errno));
+	exit(1);
+    }
+    run(chip);
+    if ((f18_wave_close() < 0) || (stat(wave, &st) < 0) ||
+	((f = fopen(wave, "r")) == NULL) ||
+	(fread(&hdr, sizeof(hdr), 1, f) != 1)) {
+	fprintf(stderr, "wave: unable to read %s, error=%s\n",
+		wave, strerror(errno));
+	exit(1);
+    }
+    fclose(f);
+    f18_destroy(chip);
+    if ((st.st_size != sizeof(hdr) + LIMIT) ||
+	!(hdr.flags & F18_WAVE_TRUNCATED)) {
+	fprintf(stderr, "wave: limited capture of %ld bytes, flags %x\n",
+		(long) st.st_size, hdr.flags);
+	printf("wave: FAIL\n");
+	return 1;
+    }
+    printf("wave: ok\n");
+    return 0;
+}